@@ -94,44 +94,259 @@
 
 #include "storage/keti/ha_keti.h"
 
+#include <algorithm>
+
+#include "my_byteorder.h"
 #include "my_dbug.h"
 #include "mysql/plugin.h"
+#include "mysqld_error.h"
+#include "sql/auth/auth_acls.h"
+#include "sql/auth/auth_common.h"
+#include "sql/mysqld.h"
 #include "sql/sql_class.h"
 #include "sql/sql_plugin.h"
+#include "sql/sql_lex.h"
+#include "sql/sql_optimizer.h"
+#include "sql/sql_update.h"
+#include "sql/table.h"
+#include "storage/keti/keti_clone.h"
+#include "storage/keti/keti_cost.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_delta.h"
+#include "storage/keti/keti_encode.h"
+#include "storage/keti/keti_export.h"
+#include "storage/keti/keti_filter.h"
+#include "storage/keti/keti_ibuf.h"
+#include "storage/keti/keti_import.h"
+#include "storage/keti/keti_lock.h"
+#include "storage/keti/keti_merge.h"
+#include "storage/keti/keti_mvcc.h"
+#include "storage/keti/keti_pushdown.h"
+#include "storage/keti/keti_trx.h"
+#include "storage/keti/keti_write.h"
 #include "typelib.h"
 
-#include <iostream>
-#include <cpprest/http_client.h>
-#include <cpprest/filestream.h>
-#include <cpprest/http_headers.h>
-
-using namespace std;
-using namespace utility; // Common utilities like string conversions
-using namespace web; // Common features like URIs.
-using namespace web::http; // Common HTTP functionality
-using namespace web::http::client; // HTTP client features
-using namespace concurrency::streams; // Asynchronous streams
-
 static handler *keti_create_handler(handlerton *hton, TABLE_SHARE *table,
                                        bool partitioned, MEM_ROOT *mem_root);
 
 handlerton *keti_hton;
 
+/**
+  Files are read and written with the rights of the server or the node, so
+  naming one takes the FILE privilege, and secure_file_priv must admit it,
+  as for SELECT ... INTO OUTFILE and LOAD DATA.
+
+  @return true, with the error reported, if thd may not name path
+*/
+static bool file_access_denied(THD *thd, const char *path) {
+  if (check_global_access(thd, FILE_ACL)) return true;
+  if (!is_secure_file_path(path)) {
+    my_error(ER_OPTION_PREVENTS_STATEMENT, MYF(0), "--secure-file-priv");
+    return true;
+  }
+  return false;
+}
+
+/* Ahead of the other variables, as flush_batch() reads it */
+static int segment_dir_check(THD *thd, SYS_VAR *, void *save,
+                             struct st_mysql_value *value) {
+  char buffer[FN_REFLEN];
+  int length = sizeof(buffer);
+  const char *dir = value->val_str(value, buffer, &length);
+  if (dir != NULL && *dir != '\0') {
+    if (file_access_denied(thd, dir)) return 1;
+    dir = thd->strmake(dir, length);
+  }
+  *static_cast<const char **>(save) = dir;
+  return 0;
+}
+
+static MYSQL_THDVAR_STR(segment_dir, PLUGIN_VAR_MEMALLOC,
+                        "Directory the inserts of the session write segment "
+                        "files to instead of the storage node, and ALTER "
+                        "TABLE ... IMPORT TABLESPACE attaches them from. "
+                        "Setting it requires the FILE privilege",
+                        segment_dir_check, NULL, NULL);
+
+/** Exports are written with the rights of the node, see file_access_denied */
+static int export_file_check(THD *thd, SYS_VAR *, void *save,
+                             struct st_mysql_value *value) {
+  char buffer[FN_REFLEN];
+  int length = sizeof(buffer);
+  const char *file = value->val_str(value, buffer, &length);
+  if (file != NULL && *file != '\0') {
+    Keti_external_source target;
+    if (!keti_parse_source(std::string(file, length), &target)) return 1;
+    if (file_access_denied(thd, target.location.c_str())) return 1;
+    file = thd->strmake(file, length);
+  }
+  *static_cast<const char **>(save) = file;
+  return 0;
+}
+
+static MYSQL_THDVAR_STR(export_file, PLUGIN_VAR_MEMALLOC,
+                        "File, as csv:path or parquet:path, the storage node "
+                        "writes the rows of the scans of the session to "
+                        "instead of returning them. Setting it requires the "
+                        "FILE privilege",
+                        export_file_check, NULL, NULL);
+
+static MYSQL_THDVAR_BOOL(clone_rows, PLUGIN_VAR_OPCMDARG,
+                         "Have CREATE TABLE ... LIKE of a KETI table share "
+                         "the rows of its source on the storage node",
+                         NULL, NULL, false);
+
 /* Interface to mysqld, to check system tables supported by SE */
 static bool keti_is_supported_system_table(const char *db,
                                               const char *table_name,
                                               bool is_sql_layer_system_table);
 
-Example_share::Example_share() { thr_lock_init(&lock); }
+Example_share::Example_share() : lock_id(0) { thr_lock_init(&lock); }
+
+/** @brief
+  What the engine keeps of a connection.
+*/
+struct Keti_session {
+  Keti_session() : changes(&trx) {}
+
+  Keti_trx trx;
+  Keti_trx_changes changes;
+  /** Handlers locked for writing, which may hold rows not handed over */
+  std::vector<ha_keti *> writers;
+};
+
+/** The state of the connection of thd, created on first use. */
+static Keti_session *keti_session(THD *thd) {
+  Keti_session *session =
+      static_cast<Keti_session *>(thd_get_ha_data(thd, keti_hton));
+  if (session == NULL) {
+    session = new Keti_session;
+    thd_set_ha_data(thd, keti_hton, session);
+  }
+  return session;
+}
+
+/** The lock state of the transaction thd runs. */
+static Keti_trx *keti_trx(THD *thd) { return &keti_session(thd)->trx; }
+
+/** Release what the transaction of session holds and renew its id. */
+static void keti_end_trx(Keti_session *session) {
+  keti_lock_manager->release_all(&session->trx);
+  keti_close_read_view(&session->trx);
+  session->trx.id = keti_new_trx_id();
+}
+
+/**
+  Hand the changes of the statement to its transaction and, at the end of
+  the transaction, commit them and release its row locks and read view.
+
+  @details
+  The server unlocks the tables of a statement only after it committed, so
+  the handlers still batching rows are flushed here.
+*/
+static int keti_commit(handlerton *, THD *thd, bool all) {
+  Keti_session *session =
+      static_cast<Keti_session *>(thd_get_ha_data(thd, keti_hton));
+  if (session == NULL) return 0;
+
+  int rc = 0;
+  for (ha_keti *writer : session->writers) {
+    int write_rc = writer->sync_writes();
+    if (rc == 0) rc = write_rc;
+  }
+  if (!all && thd_test_options(thd, OPTION_NOT_AUTOCOMMIT | OPTION_BEGIN)) {
+    /* The server rolls the statement back if its rows did not make it */
+    if (rc == 0) session->changes.statement_done();
+    return rc;
+  }
+
+  if (rc == 0)
+    rc = session->changes.commit();
+  else
+    session->changes.rollback(false);
+  keti_end_trx(session);
+  return rc;
+}
+
+/**
+  Take back the changes of the statement or, at the end of the
+  transaction, all of its changes, and release its row locks and read view.
+*/
+static int keti_rollback(handlerton *, THD *thd, bool all) {
+  Keti_session *session =
+      static_cast<Keti_session *>(thd_get_ha_data(thd, keti_hton));
+  if (session == NULL) return 0;
+
+  for (ha_keti *writer : session->writers) writer->discard_writes();
+  const bool statement =
+      !all && thd_test_options(thd, OPTION_NOT_AUTOCOMMIT | OPTION_BEGIN);
+  session->changes.rollback(statement);
+  if (!statement) keti_end_trx(session);
+  return 0;
+}
+
+static int keti_close_connection(handlerton *, THD *thd) {
+  Keti_session *session =
+      static_cast<Keti_session *>(thd_get_ha_data(thd, keti_hton));
+  if (session != NULL) {
+    /* The server rolled back what was open; this is what it left */
+    session->changes.rollback(false);
+    keti_end_trx(session);
+    delete session;
+    thd_set_ha_data(thd, keti_hton, NULL);
+  }
+  return 0;
+}
 
 static int keti_init_func(void *p) {
   DBUG_TRACE;
+  if (keti_log_init()) return 1;
 
   keti_hton = (handlerton *)p;
   keti_hton->state = SHOW_OPTION_YES;
   keti_hton->create = keti_create_handler;
   keti_hton->flags = HTON_CAN_RECREATE;
   keti_hton->is_supported_system_table = keti_is_supported_system_table;
+  keti_hton->get_cost_constants = keti_get_cost_constants;
+  keti_hton->commit = keti_commit;
+  keti_hton->rollback = keti_rollback;
+  keti_hton->close_connection = keti_close_connection;
+
+  keti_calibrate_costs();
+  keti_buf_init();
+  keti_ibuf_init();
+  keti_write_init();
+  keti_lock_init();
+  keti_purge_init();
+  keti_merge_init();
+  keti_vector_init();
+
+  return 0;
+}
+
+/**
+  @brief
+  Called on UNINSTALL PLUGIN and at shutdown, after all tables are closed.
+  Outstanding segment writes are drained and the index changes they
+  buffered are merged before the node is checkpointed, and the pooled
+  connections go last since all of these still use them.
+*/
+static int keti_deinit_func(void *) {
+  DBUG_TRACE;
+
+  keti_vector_deinit();
+  keti_merge_deinit();
+  keti_purge_deinit();
+  keti_write_deinit();
+  keti_ibuf_deinit();
+  if (csd_checkpoint())
+    keti_log(WARNING_LEVEL,
+             "checkpoint at shutdown failed; the storage node will replay its "
+             "log when it is next opened");
+  keti_lock_deinit();
+  keti_buf_deinit();
+  csd_close_sessions();
+  keti_log_deinit();
 
   return 0;
 }
@@ -153,6 +368,27 @@ Example_share *ha_keti::get_share() {
   if (!(tmp_share = static_cast<Example_share *>(get_ha_share_ptr()))) {
     tmp_share = new Example_share;
     if (!tmp_share) goto err;
+    tmp_share->csd_name = csd_table_name(table_share->normalized_path.str);
+    tmp_share->lock_id = std::hash<std::string>()(tmp_share->csd_name);
+    keti_indexed_fields(table_share, &tmp_share->indexed_fields);
+    keti_bitmap_fields(table_share, &tmp_share->bitmap_fields);
+    keti_tag_fields(table_share, &tmp_share->tag_fields);
+    keti_fulltext_keys(table_share, &tmp_share->fulltext_keys);
+    keti_vector_fields(table_share, &tmp_share->vector_fields);
+    keti_packed_columns(table_share, &tmp_share->packed_columns);
+    keti_external_source(table_share, &tmp_share->external);
+    tmp_share->versions.init(tmp_share->csd_name, &tmp_share->deltas,
+                             &tmp_share->table_stats);
+    /* External tables have no segments, deltas or tombstones */
+    if (tmp_share->external.format == KETI_EXTERNAL_NONE &&
+        (tmp_share->deltas.load(tmp_share->csd_name) ||
+         tmp_share->versions.load() ||
+         tmp_share->table_stats.load(tmp_share->csd_name,
+                                     tmp_share->versions.lag()))) {
+      delete tmp_share;
+      tmp_share = NULL;
+      goto err;
+    }
 
     set_ha_share_ptr(static_cast<Handler_share *>(tmp_share));
   }
@@ -167,7 +403,18 @@ static handler *keti_create_handler(handlerton *hton, TABLE_SHARE *table,
 }
 
 ha_keti::ha_keti(handlerton *hton, TABLE_SHARE *table_arg)
-    : handler(hton, table_arg) {}
+    : handler(hton, table_arg),
+      m_row_lock(TL_UNLOCK),
+      m_trx(NULL),
+      m_changes(NULL),
+      m_delta_update(-1),
+      m_scan_segment(0),
+      m_scan_row(0),
+      m_block_rows_left(0),
+      m_bulk_load(false),
+      m_exported(false) {
+  ref_length = KETI_REF_LENGTH;
+}
 
 /*
   List of all system tables specific to the SE.
@@ -233,6 +480,7 @@ int ha_keti::open(const char *, int, uint, const dd::Table *) {
 
   if (!(share = get_share())) return 1;
   thr_lock_data_init(&share->lock, &lock, NULL);
+  m_batch.set_packed_columns(share->packed_columns);
 
   return 0;
 }
@@ -254,7 +502,7 @@ int ha_keti::open(const char *, int, uint, const dd::Table *) {
 
 int ha_keti::close(void) {
   DBUG_TRACE;
-  return 0;
+  return sync_writes();
 }
 
 /**
@@ -286,70 +534,174 @@ int ha_keti::close(void) {
   item_sum.cc, item_sum.cc, sql_acl.cc, sql_insert.cc,
   sql_insert.cc, sql_select.cc, sql_table.cc, sql_udf.cc and sql_update.cc
 */
-void GetHttp()
-{
-  http_client client(U("http://10.0.5.101:8181"));
-  auto resp = client.request(U("GET")).get();
-  
-  
-  cout << U("STATUS : ") << resp.status_code() << endl;
-  cout << "content-type : " << resp.headers().content_type() << endl;
-  cout << resp.extract_string(true).get() << endl;
-}
-void GetHttpAsync()
-{
-  http_client client(U("http://en.cppreference.com/w/"));
-  
-  client.request(U("GET")).then([](http_response resp){
-  cout << U("STATUS : ") << resp.status_code() << endl;
-  cout << "content-type : " << resp.headers().content_type() << endl;
-  
-  resp.extract_string(true).then([](string_t sBoby){
-  cout << sBoby << endl;
-  }).wait();
-  
-  }).wait();
- 
-}
-void GetJson()
-{
-  http_client client(U("http://date.jsontest.com/"));
-  
-  http_request req(methods::GET);
-  
-  client.request(req).then([=](http_response r){
-  cout << U("STATUS : ") << r.status_code() << endl;
-  cout << "content-type : " << r.headers().content_type() << endl;
-  
-  //{
-  // "time": "11:25:23 AM",
-  // "milliseconds_since_epoch" : 1423999523092,
-  // "date" : "02-15-2015"
-  //}
-  
-  r.extract_json(true).then([](json::value v) {
-  cout << v.at(U("date")).as_string() << endl;
-  cout << v.at(U("time")).as_string() << endl;
-  }).wait();
-  
-  }).wait();
- 
-}
-int ha_keti::write_row(uchar *) {
+int ha_keti::write_row(uchar *buf) {
   DBUG_TRACE;
-  /*
-    Example of a successful write_row. We don't store the data
-    anywhere; they are thrown away. A real implementation will
-    probably need to do something with 'buf'. We report a success
-    here, to pretend that the insert was successful.
-  */
-  
-  GetHttp();
-  //GetHttpAsync();
-  //GetJson();
+  if (share->external.format != KETI_EXTERNAL_NONE)
+    return HA_ERR_TABLE_READONLY;
+
+  const Keti_row_pos pos = m_batch.add_row(table, buf);
+  m_batch_stats.add_row(table);
+
+  const ptrdiff_t offset = buf - table->record[0];
+  for (uint16 index : share->indexed_fields) {
+    Field *field = table->field[index];
+    if (field->is_null(offset)) continue;
+    Keti_ibuf_entry entry;
+    entry.field = index;
+    entry.op = KETI_IBUF_INSERT;
+    entry.pos = pos;
+    keti_index_key(field, buf, &entry.key);
+    m_batch_index.push_back(std::move(entry));
+  }
+
+  std::string key;
+  for (uint16 index : share->bitmap_fields)
+    if (keti_bitmap_key(table->field[index], buf, &key))
+      m_batch_bitmaps.add(index, key, pos.block, m_batch.last_row_index());
+
+  std::vector<std::string> tags;
+  for (uint16 index : share->tag_fields) {
+    keti_tags(table->field[index], buf, &tags);
+    m_batch_postings.add(index, tags, pos.block, m_batch.last_row_index());
+  }
+
+  std::vector<std::string> words;
+  for (uint16 key : share->fulltext_keys) {
+    keti_ft_words(table, key, buf, &words);
+    m_batch_fulltext.add(key, words, pos.block, m_batch.last_row_index());
+  }
+
+  std::vector<float> vector;
+  for (uint16 index : share->vector_fields)
+    if (keti_vector(table->field[index], buf, &vector))
+      m_batch_vectors.add(index, vector, pos.block, m_batch.last_row_index());
+    else
+      m_batch_vectors.add_unindexed(index, pos.block,
+                                    m_batch.last_row_index());
+
+  if (m_batch.size() >= srv_write_batch_size) return flush_batch();
   return 0;
 }
 
+/**
+  @brief
+  Send the rows batched so far to the storage node, without
+  waiting for the writes to complete.
+
+  @details
+  Each handler fills its own batch, so concurrent inserters into one table
+  share no latch per row; they meet only here, once per batch, to publish
+  the statistics of their rows and queue the segment.
+*/
+int ha_keti::flush_batch() {
+  if (m_batch.empty()) return 0;
+
+  const ha_rows rows = m_batch.rows();
+  std::vector<uchar> blocks;
+  m_batch.take(&blocks);
+  Keti_segment_indexes indexes;
+  m_batch_bitmaps.take(&indexes.bitmaps);
+  m_batch_postings.take(&indexes.postings);
+  m_batch_fulltext.take(&indexes.fulltext);
+  m_batch_vectors.take(&indexes.vectors);
+
+  /* A session building segment files leaves the table as it is */
+  const char *segment_dir = THDVAR(ha_thd(), segment_dir);
+  if (segment_dir != NULL && *segment_dir != '\0') {
+    if (m_bulk_load) keti_encode_segment(share->packed_columns, &blocks);
+    int rc = keti_write_segment_file(segment_dir, table, &blocks, rows,
+                                     &m_batch_index, &indexes,
+                                     m_batch_stats);
+    m_batch_stats.clear();
+    return rc;
+  }
+
+  /* Kept with the segment, so a restart does not lose them */
+  m_batch_stats.pack(&indexes.stats);
+  m_changes->add_stats(share->csd_name, m_batch_stats);
+  m_batch_stats.clear();
+
+  /* The segment joins the table when the transaction commits */
+  Keti_table_versions *versions = &share->versions;
+  Keti_trx_changes *changes = m_changes;
+  const ulonglong trx = m_trx->id;
+  const std::string name = share->csd_name;
+
+  auto staged = [versions, changes, trx, name](const Keti_segment &segment) {
+    /* Searches of its indexes find rows others may not see yet */
+    versions->add_segment(segment.id, KETI_UNCOMMITTED, trx);
+    changes->add_segment(name, segment);
+  };
+  std::future<int> done;
+  int rc = m_bulk_load
+               ? keti_load_segment(share->csd_name, share->packed_columns,
+                                   &blocks, rows, &m_batch_index, &indexes,
+                                   staged, m_last_load, &done)
+               : keti_write_segment(share->csd_name, &blocks, rows,
+                                    &m_batch_index, &indexes, staged, &done);
+  m_batch_index.clear();
+  if (rc) return rc;
+  m_pending.push_back(done.share());
+  if (m_bulk_load) m_last_load = m_pending.back();
+  return 0;
+}
+
+/**
+  @brief
+  LOAD DATA and multi-row INSERT have the blocks of their segments encoded
+  by the load threads, see keti_write.h.
+*/
+void ha_keti::start_bulk_insert(ha_rows) {
+  m_bulk_load = true;
+  m_batch.set_defer_encoding(true);
+}
+
+int ha_keti::end_bulk_insert() {
+  /* The segment left is built plain too */
+  int rc = flush_batch();
+  m_bulk_load = false;
+  m_last_load = std::shared_future<int>();
+  m_batch.set_defer_encoding(false);
+  return rc;
+}
+
+/**
+  @brief
+  Flush the batch and wait for all segments this handler sent, handing
+  them to the changes of its transaction.
+
+  @return the first error any of the writes failed with
+*/
+int ha_keti::sync_writes() {
+  int rc = flush_batch();
+  for (const std::shared_future<int> &done : m_pending) {
+    int write_rc = done.get();
+    if (rc == 0) rc = write_rc;
+  }
+  m_pending.clear();
+  return rc;
+}
+
+/**
+  @brief
+  Drop the batch and wait for the segments this handler sent, so that the
+  transaction can take them back.
+*/
+void ha_keti::discard_writes() {
+  std::vector<uchar> blocks;
+  m_batch.take(&blocks);
+  Keti_segment_indexes indexes;
+  m_batch_bitmaps.take(&indexes.bitmaps);
+  m_batch_postings.take(&indexes.postings);
+  m_batch_fulltext.take(&indexes.fulltext);
+  m_batch_vectors.take(&indexes.vectors);
+  m_batch_stats.clear();
+  m_batch_index.clear();
+
+  for (const std::shared_future<int> &done : m_pending) done.wait();
+  m_pending.clear();
+}
+
 /**
   @brief
   Yes, update_row() does what you expect, it updates a row. old_data will have
@@ -373,9 +725,84 @@ int ha_keti::write_row(uchar *) {
   @see
   sql_select.cc, sql_acl.cc, sql_update.cc and sql_insert.cc
 */
-int ha_keti::update_row(const uchar *, uchar *) {
+int ha_keti::update_row(const uchar *old_data, uchar *new_data) {
   DBUG_TRACE;
-  return HA_ERR_WRONG_COMMAND;
+  if (share->external.format != KETI_EXTERNAL_NONE)
+    return HA_ERR_TABLE_READONLY;
+
+  /*
+    Statements delta_update() lets through change rows by deltas, which
+    other transactions see once this one commits. Anything else makes a
+    new version of the row.
+  */
+  const bool delta = m_delta_update == 1 &&
+                     keti_delta_update(table, old_data, new_data, &m_deltas);
+  if (!delta) {
+    /* lock_row() took a delta lock only */
+    if (m_delta_update == 1) {
+      m_delta_update = 0;
+      int rc = lock_row(m_current);
+      if (rc) return rc;
+    }
+    int rc = delete_row(old_data);
+    if (rc) return rc;
+    return write_row(new_data);
+  }
+
+  m_changes->add_deltas(share->csd_name, m_current, m_deltas);
+  return 0;
+}
+
+/**
+  @brief
+  True if the statement is an UPDATE whose rows can change by deltas, which
+  commute with those of others: every column it writes is a NOT NULL
+  integer without an index that it sets to itself plus or minus a constant,
+  and its condition does not test those columns, which concurrent deltas
+  change under it.
+*/
+bool ha_keti::delta_update() const {
+  THD *thd = ha_thd();
+  if (thd_sql_command(thd) != SQLCOM_UPDATE ||
+      table->pos_in_table_list == NULL)
+    return false;
+  const SELECT_LEX *select = table->pos_in_table_list->select_lex;
+  const Sql_cmd_update *update =
+      static_cast<const Sql_cmd_update *>(thd->lex->m_sql_cmd);
+  if (select == NULL || update == NULL || update->update_value_list == NULL)
+    return false;
+
+  std::vector<uint16> columns;
+  List_iterator_fast<Item> fields(
+      const_cast<List<Item> &>(select->fields_list));
+  List_iterator_fast<Item> values(*update->update_value_list);
+  Item *item;
+  Item *value;
+  while ((item = fields++) && (value = values++)) {
+    const Item *real = item->real_item();
+    if (real->type() != Item::FIELD_ITEM) return false;
+    const Field *field = static_cast<const Item_field *>(real)->field;
+    const uint16 index = static_cast<uint16>(field->field_index);
+    if (field->table != table || !keti_delta_field(field) ||
+        field->is_nullable() || !keti_delta_increment(field, value) ||
+        std::find(share->indexed_fields.begin(), share->indexed_fields.end(),
+                  index) != share->indexed_fields.end() ||
+        std::find(share->bitmap_fields.begin(), share->bitmap_fields.end(),
+                  index) != share->bitmap_fields.end())
+      return false;
+    columns.push_back(index);
+  }
+
+  /* Nor may the server write other columns, such as ON UPDATE ones */
+  for (Field **field = table->field; *field; field++)
+    if (bitmap_is_set(table->write_set, (*field)->field_index) &&
+        std::find(columns.begin(), columns.end(), (*field)->field_index) ==
+            columns.end())
+      return false;
+
+  return !columns.empty() &&
+         (select->where_cond() == NULL ||
+          !keti_delta_reads(select->where_cond(), table, columns));
 }
 
 /**
@@ -398,9 +825,29 @@ int ha_keti::update_row(const uchar *, uchar *) {
   sql_acl.cc, sql_udf.cc, sql_delete.cc, sql_insert.cc and sql_select.cc
 */
 
-int ha_keti::delete_row(const uchar *) {
+int ha_keti::delete_row(const uchar *buf) {
   DBUG_TRACE;
-  return HA_ERR_WRONG_COMMAND;
+  if (share->external.format != KETI_EXTERNAL_NONE)
+    return HA_ERR_TABLE_READONLY;
+
+  /* Hidden from the transaction alone until it commits */
+  if (!share->versions.add_tombstone(m_current, KETI_UNCOMMITTED, m_trx->id))
+    return HA_ERR_RECORD_CHANGED;
+
+  std::vector<Keti_ibuf_entry> entries;
+  const ptrdiff_t offset = buf - table->record[0];
+  for (uint16 index : share->indexed_fields) {
+    Field *field = table->field[index];
+    if (field->is_null(offset)) continue;
+    Keti_ibuf_entry entry;
+    entry.field = index;
+    entry.op = KETI_IBUF_DELETE;
+    entry.pos = m_current;
+    keti_index_key(field, buf, &entry.key);
+    entries.push_back(std::move(entry));
+  }
+  m_changes->add_tombstone(share->csd_name, m_current, &entries);
+  return 0;
 }
 
 /**
@@ -490,16 +937,231 @@ int ha_keti::index_last(uchar *) {
   filesort.cc, records.cc, sql_handler.cc, sql_select.cc, sql_table.cc and
   sql_update.cc
 */
-int ha_keti::rnd_init(bool) {
+int ha_keti::rnd_init(bool scan) {
   DBUG_TRACE;
+
+  m_scan_segment = 0;
+  m_scan_pos.block = 0;
+  m_block_rows_left = 0;
+  m_page.reset();
+  m_scan_rows.clear();
+  m_projection.clear();
+  /* The node reads the files of an external table itself */
+  if (share->external.format != KETI_EXTERNAL_NONE)
+    return m_external.init(share->external, table, pushed_cond, scan);
+  if (!scan) return 0;
+
+  /* A condition the node evaluates may use its indexes; complete them */
+  int rc;
+  if (pushed_cond != NULL && !share->indexed_fields.empty() &&
+      (rc = keti_ibuf_merge(share->csd_name)))
+    return rc;
+
+  /* Segments are immutable; new rows show up as new segments. */
+  rc = csd_read_manifest(share->csd_name, &m_segments);
+  if (rc == HA_ERR_NO_SUCH_TABLE) {
+    m_segments.clear();
+    rc = 0;
+  }
+  if (rc) return rc;
+  /* The transaction reads the segments it staged too */
+  m_changes->staged_segments(share->csd_name, &m_segments);
+
+  /* The compiled condition is checked on the rows as stored */
+  m_filter.bind();
+
+  /* A session exporting has the node write the rows of SELECTs instead */
+  const char *export_file = THDVAR(ha_thd(), export_file);
+  if (export_file != NULL && *export_file != '\0' &&
+      m_row_lock < TL_WRITE_ALLOW_WRITE &&
+      thd_sql_command(ha_thd()) == SQLCOM_SELECT)
+    return export_scan(export_file);
+
+  /* Statements that only read have the node send the columns they read */
+  if (m_row_lock < TL_WRITE_ALLOW_WRITE) m_projection.build(table);
+
+  /* Equality and IN predicates narrow the scan to the rows they admit */
+  Keti_bitmap_filter filter;
+  if (filter.build(pushed_cond, table, share->bitmap_fields) &&
+      (rc = filter.lookup(share->csd_name, m_segments, &m_scan_rows)))
+    return rc;
+
+  /* and so do tag containments, searched by the node */
+  Keti_tag_search search;
+  std::vector<std::unique_ptr<Keti_bitmap>> found;
+  if (search.build(pushed_cond, table, share->tag_fields)) {
+    if ((rc = search.search(share->csd_name, m_segments, &found))) return rc;
+    narrow_scan(&found);
+  }
+
+  /* An ORDER BY distance ... LIMIT reads the nearest rows only */
+  Keti_vector_search nearest;
+  if (nearest.build(table, share->vector_fields)) {
+    if ((rc = nearest.search(share->csd_name, m_segments, share->versions,
+                             m_trx, &found)))
+      return rc;
+    narrow_scan(&found);
+  }
   return 0;
 }
 
+/**
+  @brief
+  Have the node write the rows the scan would return to file, once per
+  statement, and return none of them; see keti_export.h.
+*/
+int ha_keti::export_scan(const char *file) {
+  std::vector<Keti_segment> segments;
+  segments.swap(m_segments);
+  if (m_exported) return 0;
+  m_exported = true;
+
+  /* The server would join, group, sort or limit rows the file has not */
+  std::vector<uint16> columns;
+  if (!keti_exportable_query(table, pushed_cond, &columns)) {
+    keti_log(WARNING_LEVEL,
+             "cannot export %s: the statement does more than scan it",
+             share->csd_name.c_str());
+    return HA_ERR_UNSUPPORTED;
+  }
+
+  Keti_external_source target;
+  if (!keti_parse_source(file, &target)) {
+    keti_log(WARNING_LEVEL, "cannot export %s to %s: not csv:path or "
+             "parquet:path", share->csd_name.c_str(), file);
+    return HA_ERR_WRONG_COMMAND;
+  }
+  /* The server will not see the rows to filter them */
+  if (!m_filter.exact()) {
+    keti_log(WARNING_LEVEL,
+             "cannot export %s: the node cannot evaluate its condition",
+             share->csd_name.c_str());
+    return HA_ERR_UNSUPPORTED;
+  }
+
+  std::vector<uchar> deltas;
+  share->deltas.visible(m_trx, &deltas);
+  m_changes->table_deltas(share->csd_name, &deltas);
+  ulonglong rows;
+  return keti_export(ha_thd(), share->csd_name, table, target, segments,
+                     share->versions, m_trx, deltas, m_filter, columns,
+                     &rows);
+}
+
+/**
+  @brief
+  Evaluate the pushed condition on the rows of m_page the scan may return,
+  all at once, and remember which ones it rejects.
+*/
+void ha_keti::filter_block(const Keti_bitmap *rows) {
+  const uint32 count = keti_block_rows(*m_page);
+  std::vector<const uchar *> records;
+  std::vector<uint32> indexes;
+  size_t offset = KETI_BLOCK_HEADER_SIZE;
+  for (uint32 row = 0; row < count; row++) {
+    /* A damaged row is left for the unpacking to report */
+    if (offset + KETI_ROW_HEADER_SIZE > m_page->size()) break;
+    const uint32 length = uint4korr(m_page->data() + offset);
+    if (length >= table->s->reclength &&
+        m_page->size() - offset - KETI_ROW_HEADER_SIZE >= length &&
+        (rows == NULL || rows->contains(m_scan_pos.block << 16 | row))) {
+      records.push_back(m_page->data() + offset + KETI_ROW_HEADER_SIZE);
+      indexes.push_back(row);
+    }
+    offset += KETI_ROW_HEADER_SIZE + length;
+  }
+
+  std::vector<bool> match(records.size(), true);
+  m_filter.evaluate(records, &match);
+  m_block_match.assign(count, true);
+  for (size_t i = 0; i < indexes.size(); i++)
+    if (!match[i]) m_block_match[indexes[i]] = false;
+}
+
+/**
+  @brief
+  Restrict the scan to the rows of each segment in found as well.
+*/
+void ha_keti::narrow_scan(std::vector<std::unique_ptr<Keti_bitmap>> *found) {
+  m_scan_rows.resize(m_segments.size());
+  for (size_t i = 0; i < m_segments.size(); i++) {
+    if ((*found)[i] == NULL) continue;
+    if (m_scan_rows[i] == NULL)
+      m_scan_rows[i] = std::move((*found)[i]);
+    else
+      m_scan_rows[i]->intersect(*(*found)[i]);
+  }
+}
+
 int ha_keti::rnd_end() {
   DBUG_TRACE;
+  m_page.reset();
+  m_external.close();
+  return 0;
+}
+
+/**
+  @brief
+  Unpack the row at pos, which lives in page, into buf.
+
+  @details
+  A scan that listed the manifest before a compaction goes on reading the
+  segments it replaced; locks, deltas and later changes of the row use the
+  position the row was moved to.
+*/
+int ha_keti::read_row(uchar *buf, const Keti_row_pos &pos,
+                      const Keti_page &page) {
+  if (pos.offset >= page->size()) return HA_ERR_CRASHED;
+
+  const Keti_row_pos current = share->versions.forward(pos);
+  int rc = lock_row(current);
+  if (rc) return rc;
+
+  rc = keti_unpack_row(table, page->data() + pos.offset,
+                       page->data() + page->size(), buf, &m_blob_buffer);
+  if (rc) return rc;
+  if (!share->deltas.empty())
+    share->deltas.apply(table, current, m_trx, buf);
+  m_changes->apply_deltas(share->csd_name, table, current, buf);
+
+  m_current = current;
   return 0;
 }
 
+/**
+  @brief
+  Take the row lock the statement asked for in store_lock() on the row at
+  pos: none for plain reads, shared for LOCK IN SHARE MODE and exclusive for
+  statements that go on to change the rows they read, unless they change
+  them by deltas alone, which take delta locks.
+
+  @details
+  The row was read in the view of the transaction, so another transaction
+  may have deleted or replaced it since, or while this one waited for the
+  lock. Changing it would bring a deleted row back, so that is an error.
+*/
+int ha_keti::lock_row(const Keti_row_pos &pos) {
+  Keti_lock_mode mode;
+  if (m_row_lock >= TL_WRITE_ALLOW_WRITE) {
+    /* Deltas commute, so hot counters need not change one at a time */
+    if (m_delta_update < 0) m_delta_update = delta_update() ? 1 : 0;
+    mode = m_delta_update == 1 ? KETI_LOCK_D : KETI_LOCK_X;
+  } else if (m_row_lock == TL_READ_WITH_SHARED_LOCKS) {
+    mode = KETI_LOCK_S;
+  } else {
+    return 0;
+  }
+
+  THD *thd = ha_thd();
+  int rc = keti_lock_manager->lock(keti_trx(thd),
+                                   keti_row_lock_key(share->lock_id, pos),
+                                   mode, srv_lock_wait_timeout);
+  if (rc == HA_ERR_LOCK_DEADLOCK) thd_mark_transaction_to_rollback(thd, 1);
+  if (rc == 0 && share->versions.row_deleted(pos, m_trx))
+    rc = HA_ERR_RECORD_CHANGED;
+  return rc;
+}
+
 /**
   @brief
   This is called for each row of the table scan. When you run out of records
@@ -515,11 +1177,70 @@ int ha_keti::rnd_end() {
   filesort.cc, records.cc, sql_handler.cc, sql_select.cc, sql_table.cc and
   sql_update.cc
 */
-int ha_keti::rnd_next(uchar *) {
+int ha_keti::rnd_next(uchar *buf) {
   int rc;
   DBUG_TRACE;
-  rc = HA_ERR_END_OF_FILE;
-  return rc;
+  if (share->external.format != KETI_EXTERNAL_NONE)
+    return m_external.next(buf);
+
+  for (;;) {
+    while (m_block_rows_left == 0) {
+      m_page.reset();
+      if (m_scan_segment >= m_segments.size()) return HA_ERR_END_OF_FILE;
+
+      const Keti_segment &segment = m_segments[m_scan_segment];
+      const Keti_bitmap *rows = m_scan_segment < m_scan_rows.size()
+                                    ? m_scan_rows[m_scan_segment].get()
+                                    : NULL;
+      if (m_scan_pos.block >= segment.blocks ||
+          (rows != NULL && rows->empty()) ||
+          !share->versions.segment_visible(segment.id, m_trx)) {
+        m_scan_segment++;
+        m_scan_pos.block = 0;
+        continue;
+      }
+      /* Blocks without a row the bitmaps admit are not read at all */
+      if (rows != NULL && !rows->contains_high(m_scan_pos.block)) {
+        m_scan_pos.block++;
+        continue;
+      }
+
+      const Keti_page_id id = {share->csd_name, segment.id,
+                               m_scan_pos.block};
+      if ((rc = m_projection.empty() ? keti_buffer_pool->read(id, &m_page)
+                                     : m_projection.read(id, &m_page)))
+        return rc;
+      m_scan_pos.segment = segment.id;
+      m_scan_pos.offset = KETI_BLOCK_HEADER_SIZE;
+      m_scan_row = 0;
+      m_block_rows_left = keti_block_rows(*m_page);
+      /* Deltas change integer columns after the fact */
+      m_block_match.clear();
+      if (!m_filter.empty() && share->deltas.empty() &&
+          !m_changes->has_deltas())
+        filter_block(rows);
+      if (m_block_rows_left == 0) m_scan_pos.block++;
+    }
+
+    const Keti_row_pos pos = m_scan_pos;
+    const uint32 row = m_scan_row++;
+    if (pos.offset + KETI_ROW_HEADER_SIZE > m_page->size())
+      return HA_ERR_CRASHED;
+    m_scan_pos.offset +=
+        KETI_ROW_HEADER_SIZE + uint4korr(m_page->data() + pos.offset);
+    if (--m_block_rows_left == 0) m_scan_pos.block++;
+
+    const Keti_bitmap *rows = m_scan_segment < m_scan_rows.size()
+                                  ? m_scan_rows[m_scan_segment].get()
+                                  : NULL;
+    if (rows != NULL && !rows->contains(pos.block << 16 | row)) continue;
+
+    if (!m_block_match.empty() && !m_block_match[row]) continue;
+
+    /* Rows deleted before the view was opened, and purged rows */
+    if (share->versions.row_visible(pos, m_trx))
+      return read_row(buf, pos, m_page);
+  }
 }
 
 /**
@@ -543,7 +1264,15 @@ int ha_keti::rnd_next(uchar *) {
   @see
   filesort.cc, sql_select.cc, sql_delete.cc and sql_update.cc
 */
-void ha_keti::position(const uchar *) { DBUG_TRACE; }
+void ha_keti::position(const uchar *) {
+  DBUG_TRACE;
+  if (share->external.format != KETI_EXTERNAL_NONE) {
+    memset(ref, 0, ref_length);
+    int8store(ref, m_external.row_id());
+    return;
+  }
+  keti_store_pos(ref, m_current);
+}
 
 /**
   @brief
@@ -559,10 +1288,74 @@ void ha_keti::position(const uchar *) { DBUG_TRACE; }
   @see
   filesort.cc, records.cc, sql_insert.cc, sql_select.cc and sql_update.cc
 */
-int ha_keti::rnd_pos(uchar *, uchar *) {
+int ha_keti::rnd_pos(uchar *buf, uchar *pos) {
   int rc;
   DBUG_TRACE;
-  rc = HA_ERR_WRONG_COMMAND;
+  if (share->external.format != KETI_EXTERNAL_NONE)
+    return m_external.fetch(uint8korr(pos), buf);
+
+  const Keti_row_pos row_pos = share->versions.forward(keti_read_pos(pos));
+  const Keti_page_id id = {share->csd_name, row_pos.segment, row_pos.block};
+  Keti_page page;
+  if ((rc = keti_buffer_pool->read(id, &page))) return rc;
+  return read_row(buf, row_pos, page);
+}
+
+/**
+  @brief
+  Start a MATCH ... AGAINST on FULLTEXT key inx. The server owns the search
+  it gets back and closes it through its FT_INFO.
+
+  @details
+  hints carry the LIMIT of an ORDER BY MATCH ... DESC LIMIT, so the storage
+  node sends the best rows of each segment only.
+*/
+FT_INFO *ha_keti::ft_init_ext_with_hints(uint inx, String *key,
+                                         Ft_hints *hints) {
+  DBUG_TRACE;
+  if (inx >= table->s->keys || !(table->key_info[inx].flags & HA_FULLTEXT))
+    return NULL;
+
+  Keti_ft_search *search = new Keti_ft_search(
+      table, inx, share->csd_name, &share->versions, &m_current);
+  search->parse(*key, hints->get_flags(), hints->get_limit());
+  return search;
+}
+
+/**
+  @brief
+  Fetch the matching rows for ft_read(); called when the FULLTEXT key is
+  the access method.
+*/
+int ha_keti::ft_init() {
+  DBUG_TRACE;
+  if (ft_handler == NULL) return HA_ERR_WRONG_COMMAND;
+  return static_cast<Keti_ft_search *>(ft_handler)->execute();
+}
+
+/**
+  @brief
+  Return the matching rows by descending score, skipping those the
+  transaction cannot see.
+*/
+int ha_keti::ft_read(uchar *buf) {
+  DBUG_TRACE;
+  Keti_ft_search *search = static_cast<Keti_ft_search *>(ft_handler);
+  Keti_row_pos pos;
+  int rc;
+  while ((rc = search->next(&pos)) == 0) {
+    if (!share->versions.segment_visible(pos.segment, m_trx) ||
+        !share->versions.row_visible(pos, m_trx)) {
+      search->skipped();
+      continue;
+    }
+
+    const Keti_row_pos row_pos = share->versions.forward(pos);
+    const Keti_page_id id = {share->csd_name, row_pos.segment, row_pos.block};
+    Keti_page page;
+    if ((rc = keti_buffer_pool->read(id, &page))) return rc;
+    return read_row(buf, row_pos, page);
+  }
   return rc;
 }
 
@@ -604,11 +1397,78 @@ int ha_keti::rnd_pos(uchar *, uchar *) {
   sql_select.cc, sql_select.cc, sql_show.cc, sql_show.cc, sql_show.cc,
   sql_show.cc, sql_table.cc, sql_union.cc and sql_update.cc
 */
-int ha_keti::info(uint) {
+int ha_keti::info(uint flag) {
   DBUG_TRACE;
+
+  if (flag & HA_STATUS_VARIABLE) {
+    stats.records = share->table_stats.records();
+    stats.mean_rec_length = table_share->reclength;
+    stats.data_file_length = stats.records * table_share->reclength;
+    stats.block_size = KETI_BLOCK_SIZE;
+    if (stats.records < 2) stats.records = 2;
+  }
   return 0;
 }
 
+/**
+  @brief
+  Number of CSD blocks read by a full table scan.
+*/
+double ha_keti::scan_time() {
+  return (double)stats.data_file_length / KETI_BLOCK_SIZE + 1;
+}
+
+/**
+  @brief
+  Estimated fraction of rows the storage node returns.
+
+  @details
+  cond_push() is only called once the plan has been chosen, so while costing
+  we look at the WHERE clause of the query block the table belongs to and
+  count the part of it that cond_push() would accept.
+*/
+double ha_keti::pushed_cond_selectivity() {
+  const Item *cond = pushed_cond;
+  TABLE_LIST *table_list = table->pos_in_table_list;
+  if (cond == NULL && table_list != NULL && table_list->select_lex != NULL &&
+      table_list->select_lex->join != NULL)
+    cond = table_list->select_lex->join->where_cond;
+
+  return keti_cond_selectivity(cond, table, share->table_stats);
+}
+
+/**
+  @brief
+  Cost of a full scan with the pushed condition evaluated on the CSD.
+
+  @details
+  Every rejected row saves pushdown_filter_saving of its share of the block
+  transfer; the calibrated value comes from keti_calibrate_costs(), unless
+  mysql.engine_cost overrides it.
+*/
+Cost_estimate ha_keti::table_scan_cost() {
+  const double filtered = 1.0 - pushed_cond_selectivity();
+  Cost_estimate cost;
+  cost.add_io(table->cost_model()->page_read_cost(scan_time()) *
+              (1.0 - keti_pushdown_filter_saving(table) * filtered));
+  return cost;
+}
+
+/**
+  @brief
+  Cost of reading rows found through an index or by position, with the
+  pushed condition evaluated on the CSD.
+*/
+Cost_estimate ha_keti::read_cost(uint index, double ranges, double rows) {
+  const double filtered = 1.0 - pushed_cond_selectivity();
+  const Cost_estimate full = handler::read_cost(index, ranges, rows);
+  Cost_estimate cost;
+  cost.add_io(full.get_io_cost() *
+              (1.0 - keti_pushdown_filter_saving(table) * filtered));
+  cost.add_cpu(full.get_cpu_cost());
+  return cost;
+}
+
 /**
   @brief
   extra() is called whenever the server wishes to send a hint to
@@ -648,6 +1508,26 @@ int ha_keti::delete_all_rows() {
   return HA_ERR_WRONG_COMMAND;
 }
 
+/**
+  @brief
+  ALTER TABLE ... IMPORT TABLESPACE attaches the segment files in the
+  directory keti_segment_dir of the session names, see keti_import.h.
+  DISCARD TABLESPACE is not supported.
+*/
+int ha_keti::discard_or_import_tablespace(bool discard, dd::Table *) {
+  DBUG_TRACE;
+  const char *segment_dir = THDVAR(ha_thd(), segment_dir);
+  if (discard || segment_dir == NULL || *segment_dir == '\0')
+    return HA_ERR_WRONG_COMMAND;
+  if (share->external.format != KETI_EXTERNAL_NONE)
+    return HA_ERR_TABLE_READONLY;
+
+  int rc = sync_writes();
+  if (rc) return rc;
+  return keti_import_segments(segment_dir, table, share->csd_name,
+                              &share->versions, &share->table_stats);
+}
+
 /**
   @brief
   This create a lock on the table. If you are implementing a storage engine
@@ -665,8 +1545,32 @@ int ha_keti::delete_all_rows() {
   the section "locking functions for mysql" in lock.cc;
   copy_data_between_tables() in sql_table.cc.
 */
-int ha_keti::external_lock(THD *, int) {
+int ha_keti::external_lock(THD *thd, int lock_type) {
   DBUG_TRACE;
+  Keti_session *session = keti_session(thd);
+  if (lock_type == F_UNLCK) {
+    /* keti_commit() flushed the handler unless a transaction is open */
+    int rc = sync_writes();
+    session->writers.erase(
+        std::remove(session->writers.begin(), session->writers.end(), this),
+        session->writers.end());
+    m_trx = NULL;
+    m_changes = NULL;
+    return rc;
+  }
+
+  /* Row locks and the read view live until keti_commit() or keti_rollback() */
+  m_trx = &session->trx;
+  m_changes = &session->changes;
+  m_delta_update = -1;
+  keti_open_read_view(m_trx);
+  if (lock_type == F_WRLCK &&
+      std::find(session->writers.begin(), session->writers.end(), this) ==
+          session->writers.end())
+    session->writers.push_back(this);
+  trans_register_ha(thd, false, keti_hton, NULL);
+  if (thd_test_options(thd, OPTION_NOT_AUTOCOMMIT | OPTION_BEGIN))
+    trans_register_ha(thd, true, keti_hton, NULL);
   return 0;
 }
 
@@ -707,8 +1611,22 @@ int ha_keti::external_lock(THD *, int) {
   @see
   get_lock_data() in lock.cc
 */
-THR_LOCK_DATA **ha_keti::store_lock(THD *, THR_LOCK_DATA **to,
+THR_LOCK_DATA **ha_keti::store_lock(THD *thd, THR_LOCK_DATA **to,
                                        enum thr_lock_type lock_type) {
+  if (lock_type != TL_IGNORE) m_row_lock = lock_type;
+
+  /*
+    Rows are locked by the KETI lock manager, so like Berkeley DB we let
+    writers share the table, except under LOCK TABLES and for statements
+    that rebuild or drop it.
+  */
+  if (lock_type >= TL_WRITE_CONCURRENT_INSERT && lock_type <= TL_WRITE &&
+      !thd_in_lock_tables(thd) && !thd_tablespace_op(thd) &&
+      thd_sql_command(thd) != SQLCOM_TRUNCATE &&
+      thd_sql_command(thd) != SQLCOM_ALTER_TABLE &&
+      thd_sql_command(thd) != SQLCOM_DROP_TABLE)
+    lock_type = TL_WRITE_ALLOW_WRITE;
+
   if (lock_type != TL_IGNORE && lock.type == TL_UNLOCK) lock.type = lock_type;
   *to++ = &lock;
   return to;
@@ -733,10 +1651,14 @@ THR_LOCK_DATA **ha_keti::store_lock(THD *, THR_LOCK_DATA **to,
   @see
   delete_table and ha_create_table() in handler.cc
 */
-int ha_keti::delete_table(const char *, const dd::Table *) {
+int ha_keti::delete_table(const char *name, const dd::Table *) {
   DBUG_TRACE;
-  /* This is not implemented but we want someone to be able that it works. */
-  return 0;
+  const std::string csd_name = csd_table_name(name);
+  /* The share, with its deltas and versions, went with the last handler */
+  keti_buffer_pool->evict_table(csd_name);
+  keti_ibuf_drop(csd_name);
+  int rc = csd_drop_table(csd_name);
+  return rc == HA_ERR_NO_SUCH_TABLE ? 0 : rc;
 }
 
 /**
@@ -802,18 +1724,53 @@ static MYSQL_THDVAR_UINT(create_count_thdvar, 0, NULL, NULL, NULL, 0, 0, 1000,
   ha_create_table() in handle.cc
 */
 
-int ha_keti::create(const char *name, TABLE *, HA_CREATE_INFO *,
-                       dd::Table *) {
+int ha_keti::create(const char *name, TABLE *form,
+                       HA_CREATE_INFO *create_info, dd::Table *) {
   DBUG_TRACE;
-  /*
-    This is not implemented but we want someone to be able to see that it
-    works.
-  */
+
+  /* Rows are found by scans, bitmaps and the storage node's indexes */
+  for (uint i = 0; i < form->s->keys; i++)
+    if (!(form->key_info[i].flags & HA_FULLTEXT)) return HA_ERR_UNSUPPORTED;
+
+  /* External files are only scanned, and read with the rights of the node */
+  THD *thd = ha_thd();
+  Keti_external_source source;
+  if (keti_external_comment(form->s)) {
+    if (!keti_external_source(form->s, &source)) return HA_WRONG_CREATE_OPTION;
+    if (form->s->keys > 0) return HA_ERR_UNSUPPORTED;
+    if (file_access_denied(thd, source.location.c_str()))
+      return HA_ERR_GENERIC;
+  }
+
+  /* A clone shares the segments of the source of LIKE, see keti_clone.h */
+  if (THDVAR(thd, clone_rows) &&
+      (create_info->options & HA_LEX_CREATE_TABLE_LIKE) &&
+      source.format == KETI_EXTERNAL_NONE) {
+    const TABLE_LIST *like = thd->lex->query_tables != NULL
+                                 ? thd->lex->query_tables->next_global
+                                 : NULL;
+    if (like == NULL || like->table == NULL ||
+        like->table->s->db_type() != keti_hton)
+      return HA_ERR_UNSUPPORTED;
+
+    const Example_share *like_share =
+        static_cast<const ha_keti *>(like->table->file)->share;
+    /* The view closes with the statement, as those of external_lock() */
+    Keti_trx *trx = keti_trx(thd);
+    keti_open_read_view(trx);
+    trans_register_ha(thd, false, keti_hton, NULL);
+    int rc = keti_clone_table(like_share->csd_name, csd_table_name(name),
+                              like_share->versions, trx);
+    /* The node may have made the clone before the reply was lost */
+    if (rc) {
+      csd_drop_table(csd_table_name(name));
+      return rc;
+    }
+  }
 
   /*
     It's just an keti of THDVAR_SET() usage below.
   */
-  THD *thd = ha_thd();
   char *buf = (char *)my_malloc(PSI_NOT_INSTRUMENTED, SHOW_VAR_FUNC_BUFF_SIZE,
                                 MYF(MY_FAE));
   snprintf(buf, SHOW_VAR_FUNC_BUFF_SIZE, "Last creation '%s'", name);
@@ -826,6 +1783,45 @@ int ha_keti::create(const char *name, TABLE *, HA_CREATE_INFO *,
   return 0;
 }
 
+/**
+  @brief
+  Accept the pushable part of a condition for evaluation on the storage
+  node.
+
+  @details
+  The server still evaluates the whole condition on every row returned, so
+  the complete condition is handed back as the remainder.
+
+  @see
+  keti_cond_pushable() in keti_pushdown.cc
+*/
+const Item *ha_keti::cond_push(const Item *cond) {
+  DBUG_TRACE;
+  if (keti_cond_pushable(cond, table)) {
+    pushed_cond = cond;
+    m_filter.compile(cond, table);
+  }
+  return cond;
+}
+
+void ha_keti::cond_pop() {
+  DBUG_TRACE;
+  pushed_cond = NULL;
+  m_filter.clear();
+}
+
+/**
+  @brief
+  Called at the end of each statement; forget what was pushed.
+*/
+int ha_keti::reset() {
+  DBUG_TRACE;
+  pushed_cond = NULL;
+  m_filter.clear();
+  m_exported = false;
+  return 0;
+}
+
 struct st_mysql_storage_engine keti_storage_engine = {
     MYSQL_HANDLERTON_INTERFACE_VERSION};
 
@@ -882,10 +1878,194 @@ static MYSQL_SYSVAR_LONGLONG(signed_longlong_var, srv_signed_longlong_var,
                              PLUGIN_VAR_RQCMDARG, "LLONG_MIN..LLONG_MAX", NULL,
                              NULL, -10, LLONG_MIN, LLONG_MAX, 0);
 
+static MYSQL_SYSVAR_STR(csd_url, srv_csd_url,
+                        PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY |
+                            PLUGIN_VAR_MEMALLOC,
+                        "Base URL of the KETI storage node.", NULL, NULL,
+                        "http://10.0.5.101:8181");
+
+static MYSQL_SYSVAR_ULONG(csd_timeout, srv_csd_timeout, PLUGIN_VAR_RQCMDARG,
+                          "Timeout in seconds for requests to the storage "
+                          "node.",
+                          NULL, NULL, 5, 1, 3600, 0);
+
+static MYSQL_SYSVAR_ULONG(io_threads, srv_io_threads,
+                          PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                          "Number of threads writing segments to the CSD",
+                          NULL, NULL, 4, 1, 64, 0);
+
+static MYSQL_SYSVAR_ULONG(load_threads, srv_load_threads,
+                          PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                          "Number of threads encoding the segments of bulk "
+                          "loads; 0 for one per core",
+                          NULL, NULL, 0, 0, 256, 0);
+
+static MYSQL_SYSVAR_ULONGLONG(write_batch_size, srv_write_batch_size,
+                              PLUGIN_VAR_RQCMDARG,
+                              "Bytes of inserted rows a table collects before "
+                              "writing them to the CSD as a segment",
+                              NULL, NULL, 1024 * 1024, KETI_BLOCK_SIZE,
+                              1024 * 1024 * 1024, 0);
+
+static MYSQL_SYSVAR_ULONG(shutdown_timeout, srv_shutdown_timeout,
+                          PLUGIN_VAR_RQCMDARG,
+                          "Seconds shutdown waits for outstanding segment "
+                          "writes before giving up on them",
+                          NULL, NULL, 60, 0, 3600, 0);
+
+static MYSQL_SYSVAR_ULONG(lock_shards, srv_lock_shards,
+                          PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                          "Number of independently latched partitions of the "
+                          "row lock table",
+                          NULL, NULL, 256, 1, 65536, 0);
+
+static MYSQL_SYSVAR_ULONG(lock_wait_timeout, srv_lock_wait_timeout,
+                          PLUGIN_VAR_RQCMDARG,
+                          "Seconds a row lock request waits before giving up",
+                          NULL, NULL, 50, 1, 1024 * 1024 * 1024, 0);
+
+static MYSQL_SYSVAR_ULONG(deadlock_detect_interval,
+                          srv_deadlock_detect_interval, PLUGIN_VAR_RQCMDARG,
+                          "Milliseconds between deadlock searches while row "
+                          "lock requests wait",
+                          NULL, NULL, 100, 1, 60 * 1000, 0);
+
+static MYSQL_SYSVAR_ULONGLONG(change_buffer_max_size,
+                              srv_change_buffer_max_size, PLUGIN_VAR_RQCMDARG,
+                              "Bytes of buffered index changes that trigger a "
+                              "merge into the CSD",
+                              NULL, NULL, 64 * 1024 * 1024, 0,
+                              ULLONG_MAX, 0);
+
+static MYSQL_SYSVAR_ULONG(change_buffer_merge_interval,
+                          srv_change_buffer_merge_interval,
+                          PLUGIN_VAR_RQCMDARG,
+                          "Seconds between background merges of buffered "
+                          "index changes",
+                          NULL, NULL, 5, 1, 3600, 0);
+
+static MYSQL_SYSVAR_ULONG(purge_batch_size, srv_purge_batch_size,
+                          PLUGIN_VAR_RQCMDARG,
+                          "Deleted rows of a table purged per round",
+                          NULL, NULL, 300, 1, 5000, 0);
+
+static MYSQL_SYSVAR_ULONG(purge_interval, srv_purge_interval,
+                          PLUGIN_VAR_RQCMDARG,
+                          "Milliseconds between purge rounds",
+                          NULL, NULL, 1000, 1, 60 * 1000, 0);
+
+static MYSQL_SYSVAR_ULONG(merge_interval, srv_merge_interval,
+                          PLUGIN_VAR_RQCMDARG,
+                          "Seconds between searches for segments to merge; "
+                          "0 pauses merging",
+                          NULL, NULL, 60, 0, 24 * 3600, 0);
+
+static MYSQL_SYSVAR_ULONGLONG(merge_min_segment_size,
+                              srv_merge_min_segment_size, PLUGIN_VAR_RQCMDARG,
+                              "Segments smaller than this many bytes are "
+                              "merged with others",
+                              NULL, NULL, 4 * 1024 * 1024, 0,
+                              1024 * 1024 * 1024, 0);
+
+static MYSQL_SYSVAR_ULONGLONG(merge_max_segment_size,
+                              srv_merge_max_segment_size, PLUGIN_VAR_RQCMDARG,
+                              "Bytes of segments merged into one",
+                              NULL, NULL, 64 * 1024 * 1024, KETI_BLOCK_SIZE,
+                              ULLONG_MAX, 0);
+
+static MYSQL_SYSVAR_ULONG(merge_sparse_pct, srv_merge_sparse_pct,
+                          PLUGIN_VAR_RQCMDARG,
+                          "Percentage of purged rows that makes a segment "
+                          "worth rewriting",
+                          NULL, NULL, 30, 1, 100, 0);
+
+static MYSQL_SYSVAR_ULONG(ft_min_token_size, srv_ft_min_token_size,
+                          PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                          "Shortest word in characters a FULLTEXT key holds",
+                          NULL, NULL, 3, 1, 16, 0);
+
+static MYSQL_SYSVAR_ULONG(ft_max_token_size, srv_ft_max_token_size,
+                          PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                          "Longest word in characters a FULLTEXT key holds",
+                          NULL, NULL, 84, 10, 84, 0);
+
+static MYSQL_SYSVAR_ULONG(vector_nprobe, srv_vector_nprobe,
+                          PLUGIN_VAR_RQCMDARG,
+                          "Lists of a segment's vector index searched for "
+                          "the nearest rows",
+                          NULL, NULL, 8, 1, 65536, 0);
+
+static MYSQL_SYSVAR_BOOL(block_encoding, srv_block_encoding,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Encode the numeric and temporal columns of new "
+                         "blocks",
+                         NULL, NULL, true);
+
+static MYSQL_SYSVAR_BOOL(projection_pushdown, srv_projection_pushdown,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Have scans fetch only the columns statements read "
+                         "from the storage node",
+                         NULL, NULL, true);
+
+static MYSQL_SYSVAR_BOOL(calibrate_costs, srv_calibrate_costs,
+                         PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                         "Probe the storage node at startup to calibrate the "
+                         "optimizer cost constants of KETI tables.",
+                         NULL, NULL, true);
+
 static MYSQL_THDVAR_LONGLONG(signed_longlong_thdvar, PLUGIN_VAR_RQCMDARG,
                              "LLONG_MIN..LLONG_MAX", NULL, NULL, -10, LLONG_MIN,
                              LLONG_MAX, 0);
 
+static void buffer_pool_dump_interval_update(THD *, SYS_VAR *, void *var_ptr,
+                                             const void *save) {
+  *static_cast<ulong *>(var_ptr) = *static_cast<const ulong *>(save);
+  keti_buf_dump_interval_changed();
+}
+
+static MYSQL_SYSVAR_ULONGLONG(buffer_pool_size, srv_buffer_pool_size,
+                              PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                              "Bytes of CSD blocks cached by the server.",
+                              NULL, NULL, 128 * 1024 * 1024, KETI_BLOCK_SIZE,
+                              ULLONG_MAX, KETI_BLOCK_SIZE);
+
+static MYSQL_SYSVAR_BOOL(buffer_pool_dump_at_shutdown,
+                         srv_buffer_pool_dump_at_shutdown, PLUGIN_VAR_RQCMDARG,
+                         "Record the hottest buffer pool pages at shutdown.",
+                         NULL, NULL, true);
+
+static MYSQL_SYSVAR_BOOL(buffer_pool_load_at_startup,
+                         srv_buffer_pool_load_at_startup,
+                         PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                         "Read the recorded pages back in the background at "
+                         "startup.",
+                         NULL, NULL, true);
+
+static MYSQL_SYSVAR_ULONG(buffer_pool_dump_pct, srv_buffer_pool_dump_pct,
+                          PLUGIN_VAR_RQCMDARG,
+                          "Percentage of the most recently used buffer pool "
+                          "pages to record.",
+                          NULL, NULL, 25, 1, 100, 0);
+
+static MYSQL_SYSVAR_ULONG(buffer_pool_dump_interval,
+                          srv_buffer_pool_dump_interval, PLUGIN_VAR_RQCMDARG,
+                          "Seconds between periodic buffer pool dumps; 0 "
+                          "dumps at shutdown only.",
+                          NULL, buffer_pool_dump_interval_update, 0, 0,
+                          7 * 24 * 3600, 0);
+
+static MYSQL_SYSVAR_ULONG(buffer_pool_load_threads,
+                          srv_buffer_pool_load_threads,
+                          PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                          "Parallel reads issued by the startup load.", NULL,
+                          NULL, 4, 1, 64, 0);
+
+static MYSQL_SYSVAR_ULONG(buffer_pool_load_rate, srv_buffer_pool_load_rate,
+                          PLUGIN_VAR_RQCMDARG,
+                          "Maximum pages per second read by the startup "
+                          "load; 0 means unthrottled.",
+                          NULL, NULL, 1000, 0, ULONG_MAX, 0);
+
 static SYS_VAR *keti_system_variables[] = {
     MYSQL_SYSVAR(enum_var),
     MYSQL_SYSVAR(ulong_var),
@@ -899,6 +2079,39 @@ static SYS_VAR *keti_system_variables[] = {
     MYSQL_SYSVAR(signed_long_thdvar),
     MYSQL_SYSVAR(signed_longlong_var),
     MYSQL_SYSVAR(signed_longlong_thdvar),
+    MYSQL_SYSVAR(csd_url),
+    MYSQL_SYSVAR(csd_timeout),
+    MYSQL_SYSVAR(calibrate_costs),
+    MYSQL_SYSVAR(buffer_pool_size),
+    MYSQL_SYSVAR(buffer_pool_dump_at_shutdown),
+    MYSQL_SYSVAR(buffer_pool_load_at_startup),
+    MYSQL_SYSVAR(buffer_pool_dump_pct),
+    MYSQL_SYSVAR(buffer_pool_dump_interval),
+    MYSQL_SYSVAR(buffer_pool_load_threads),
+    MYSQL_SYSVAR(buffer_pool_load_rate),
+    MYSQL_SYSVAR(io_threads),
+    MYSQL_SYSVAR(load_threads),
+    MYSQL_SYSVAR(write_batch_size),
+    MYSQL_SYSVAR(shutdown_timeout),
+    MYSQL_SYSVAR(lock_shards),
+    MYSQL_SYSVAR(lock_wait_timeout),
+    MYSQL_SYSVAR(deadlock_detect_interval),
+    MYSQL_SYSVAR(change_buffer_max_size),
+    MYSQL_SYSVAR(change_buffer_merge_interval),
+    MYSQL_SYSVAR(purge_batch_size),
+    MYSQL_SYSVAR(purge_interval),
+    MYSQL_SYSVAR(merge_interval),
+    MYSQL_SYSVAR(merge_min_segment_size),
+    MYSQL_SYSVAR(merge_max_segment_size),
+    MYSQL_SYSVAR(merge_sparse_pct),
+    MYSQL_SYSVAR(ft_min_token_size),
+    MYSQL_SYSVAR(ft_max_token_size),
+    MYSQL_SYSVAR(vector_nprobe),
+    MYSQL_SYSVAR(block_encoding),
+    MYSQL_SYSVAR(projection_pushdown),
+    MYSQL_SYSVAR(segment_dir),
+    MYSQL_SYSVAR(export_file),
+    MYSQL_SYSVAR(clone_rows),
     NULL};
 
 // this is an keti of SHOW_FUNC
@@ -946,6 +2159,87 @@ static SHOW_VAR func_status[] = {
      SHOW_SCOPE_GLOBAL},
     {"keti_status", (char *)show_array_keti, SHOW_ARRAY,
      SHOW_SCOPE_GLOBAL},
+    {"keti_memory_block_read_cost",
+     (char *)&keti_costs.memory_block_read_cost, SHOW_DOUBLE,
+     SHOW_SCOPE_GLOBAL},
+    {"keti_io_block_read_cost", (char *)&keti_costs.io_block_read_cost,
+     SHOW_DOUBLE, SHOW_SCOPE_GLOBAL},
+    {"keti_pushdown_filter_saving",
+     (char *)&keti_costs.pushdown_filter_saving, SHOW_DOUBLE,
+     SHOW_SCOPE_GLOBAL},
+    {"keti_buffer_pool_pages_data", (char *)&keti_buf_stats.pages_data,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_buffer_pool_read_requests", (char *)&keti_buf_stats.read_requests,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_buffer_pool_reads", (char *)&keti_buf_stats.reads, SHOW_LONGLONG,
+     SHOW_SCOPE_GLOBAL},
+    {"keti_buffer_pool_pages_loaded", (char *)&keti_buf_stats.pages_loaded,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_segments_written", (char *)&keti_write_stats.segments_written,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_rows_written", (char *)&keti_write_stats.rows_written,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_deltas_written", (char *)&keti_trx_stats.deltas_written,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_segment_writes_pending", (char *)&keti_write_stats.pending,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_change_buffer_entries", (char *)&keti_ibuf_stats.entries,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_change_buffer_merges", (char *)&keti_ibuf_stats.merges,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_purge_lag", (char *)&keti_purge_stats.lag, SHOW_LONGLONG,
+     SHOW_SCOPE_GLOBAL},
+    {"keti_purged_rows", (char *)&keti_purge_stats.rows_purged,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_segments_merged", (char *)&keti_merge_stats.segments_merged,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_merge_rows_moved", (char *)&keti_merge_stats.rows_moved,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_fulltext_searches", (char *)&keti_fulltext_stats.searches,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_fulltext_rows_host_scored",
+     (char *)&keti_fulltext_stats.rows_host_scored, SHOW_LONGLONG,
+     SHOW_SCOPE_GLOBAL},
+    {"keti_vector_searches", (char *)&keti_vector_stats.searches,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_blocks_encoded", (char *)&keti_encode_stats.blocks_encoded,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_encoding_bytes_saved", (char *)&keti_encode_stats.bytes_saved,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_filter_rows_rejected", (char *)&keti_filter_stats.rows_rejected,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_filter_reorders", (char *)&keti_filter_stats.reorders,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_projected_blocks", (char *)&keti_project_stats.blocks,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_projection_bytes_saved", (char *)&keti_project_stats.bytes_saved,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_external_scans", (char *)&keti_external_stats.scans,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_external_rows_read", (char *)&keti_external_stats.rows_read,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_segment_files_written", (char *)&keti_import_stats.files_written,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_segments_imported", (char *)&keti_import_stats.segments_imported,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_rows_imported", (char *)&keti_import_stats.rows_imported,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_exports", (char *)&keti_export_stats.exports, SHOW_LONGLONG,
+     SHOW_SCOPE_GLOBAL},
+    {"keti_export_rows", (char *)&keti_export_stats.rows, SHOW_LONGLONG,
+     SHOW_SCOPE_GLOBAL},
+    {"keti_export_bytes", (char *)&keti_export_stats.bytes, SHOW_LONGLONG,
+     SHOW_SCOPE_GLOBAL},
+    {"keti_clones", (char *)&keti_clone_stats.clones, SHOW_LONGLONG,
+     SHOW_SCOPE_GLOBAL},
+    {"keti_segments_shared", (char *)&keti_clone_stats.segments_shared,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_row_lock_waits", (char *)&keti_lock_stats.waits, SHOW_LONGLONG,
+     SHOW_SCOPE_GLOBAL},
+    {"keti_row_lock_timeouts", (char *)&keti_lock_stats.timeouts,
+     SHOW_LONGLONG, SHOW_SCOPE_GLOBAL},
+    {"keti_deadlocks", (char *)&keti_lock_stats.deadlocks, SHOW_LONGLONG,
+     SHOW_SCOPE_GLOBAL},
     {0, 0, SHOW_UNDEF, SHOW_SCOPE_UNDEF}};
 
 mysql_declare_plugin(keti){
@@ -955,9 +2249,9 @@ mysql_declare_plugin(keti){
     "Brian Aker, MySQL AB",
     "Example storage engine",
     PLUGIN_LICENSE_GPL,
-    keti_init_func, /* Plugin Init */
-    NULL,              /* Plugin check uninstall */
-    NULL,              /* Plugin Deinit */
+    keti_init_func,   /* Plugin Init */
+    NULL,             /* Plugin check uninstall */
+    keti_deinit_func, /* Plugin Deinit */
     0x0001 /* 0.1 */,
     func_status,              /* status variables */
     keti_system_variables, /* system variables */
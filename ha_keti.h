@@ -40,11 +40,35 @@
 
 #include <sys/types.h>
 
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "my_base.h" /* ha_rows */
 #include "my_compiler.h"
 #include "my_inttypes.h"
 #include "sql/handler.h" /* handler */
-#include "thr_lock.h"    /* THR_LOCK, THR_LOCK_DATA */
+#include "storage/keti/keti_bitmap.h"
+#include "storage/keti/keti_buf.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_delta.h"
+#include "storage/keti/keti_encode.h"
+#include "storage/keti/keti_external.h"
+#include "storage/keti/keti_filter.h"
+#include "storage/keti/keti_fulltext.h"
+#include "storage/keti/keti_ibuf.h"
+#include "storage/keti/keti_inverted.h"
+#include "storage/keti/keti_lock.h"
+#include "storage/keti/keti_mvcc.h"
+#include "storage/keti/keti_project.h"
+#include "storage/keti/keti_pushdown.h"
+#include "storage/keti/keti_row.h"
+#include "storage/keti/keti_stats.h"
+#include "storage/keti/keti_trx.h"
+#include "storage/keti/keti_vector.h"
+#include "storage/keti/keti_write.h"
+#include "thr_lock.h" /* THR_LOCK, THR_LOCK_DATA */
 
 /** @brief
   Example_share is a class that will be shared among all open handlers.
@@ -53,6 +77,18 @@
 class Example_share : public Handler_share {
  public:
   THR_LOCK lock;
+  std::string csd_name;          ///< Name of the table on the CSD
+  ulonglong lock_id;             ///< Table part of its row lock keys
+  Keti_delta_store deltas;       ///< Integer updates not yet compacted
+  std::vector<uint16> indexed_fields;  ///< Columns with a KETI index
+  std::vector<uint16> bitmap_fields;   ///< Columns with a bitmap index
+  std::vector<uint16> tag_fields;      ///< Columns with an inverted index
+  std::vector<uint16> fulltext_keys;   ///< FULLTEXT keys
+  std::vector<uint16> vector_fields;   ///< Columns of embeddings
+  std::vector<Keti_packed_column> packed_columns;  ///< Encoded in blocks
+  Keti_table_versions versions;  ///< Visibility of segments and rows
+  Keti_table_stats table_stats;  ///< Row count and zone maps
+  Keti_external_source external;  ///< Files read in place, if external
   Example_share();
   ~Example_share() { thr_lock_delete(&lock); }
 };
@@ -65,10 +101,59 @@ class ha_keti : public handler {
   Example_share *share;        ///< Shared lock info
   Example_share *get_share();  ///< Get the share
 
+  double pushed_cond_selectivity();  ///< Share of rows the CSD returns
+
+  enum thr_lock_type m_row_lock;  ///< Lock type the statement asked for
+  Keti_trx *m_trx;                ///< Transaction of the statement
+  Keti_trx_changes *m_changes;    ///< What m_trx did not commit yet
+  /** 1 if the statement updates by deltas alone, -1 until known */
+  int m_delta_update;
+
+  std::vector<Keti_segment> m_segments;  ///< Segments seen by this scan
+  size_t m_scan_segment;                 ///< Index into m_segments
+  /** Rows of each segment the pushed condition may match; NULL for all. */
+  std::vector<std::unique_ptr<Keti_bitmap>> m_scan_rows;
+  Keti_filter m_filter;                  ///< pushed_cond, compiled
+  Keti_projection m_projection;          ///< What the scan reads of rows
+  Keti_external_scan m_external;         ///< Scan of an external table
+  Keti_row_pos m_scan_pos;               ///< Next row of the scan
+  uint32 m_scan_row;                     ///< Index of m_scan_pos in its block
+  uint32 m_block_rows_left;              ///< Rows after m_scan_pos in m_page
+  Keti_page m_page;                      ///< Block m_scan_pos is in
+  /** Rows of m_page m_filter does not reject; empty for all. */
+  std::vector<bool> m_block_match;
+  Keti_row_pos m_current;                ///< Row last returned
+  std::vector<uchar> m_blob_buffer;      ///< BLOB data of the current row
+
+  Keti_segment_builder m_batch;            ///< Rows not yet sent
+  Keti_row_stats m_batch_stats;            ///< Statistics of m_batch
+  std::vector<Keti_ibuf_entry> m_batch_index;  ///< Index changes of m_batch
+  Keti_bitmap_index m_batch_bitmaps;       ///< Bitmap indexes of m_batch
+  Keti_posting_index m_batch_postings;     ///< Inverted indexes of m_batch
+  Keti_fulltext_index m_batch_fulltext;    ///< FULLTEXT indexes of m_batch
+  Keti_vector_index m_batch_vectors;       ///< Embeddings of m_batch
+  std::vector<Keti_delta> m_deltas;        ///< Deltas of the last update
+  /** Segments and logs being written */
+  std::vector<std::shared_future<int>> m_pending;
+  bool m_bulk_load;                  ///< Between start and end_bulk_insert()
+  std::shared_future<int> m_last_load;  ///< Last segment of the bulk load
+  bool m_exported;  ///< The statement had the node export the table
+
+  int read_row(uchar *buf, const Keti_row_pos &pos, const Keti_page &page);
+  int lock_row(const Keti_row_pos &pos);
+  int flush_batch();
+  bool delta_update() const;
+  void narrow_scan(std::vector<std::unique_ptr<Keti_bitmap>> *found);
+  void filter_block(const Keti_bitmap *rows);
+  int export_scan(const char *file);
+
  public:
   ha_keti(handlerton *hton, TABLE_SHARE *table_arg);
   ~ha_keti() {}
 
+  int sync_writes();
+  void discard_writes();
+
   /** @brief
     The name that will be used for display purposes.
    */
@@ -95,9 +180,9 @@ class ha_keti : public handler {
     /*
       We are saying that this engine is just statement capable to have
       an engine that can only handle statement-based logging. This is
-      used in testing.
+      used in testing. FULLTEXT keys are the only keys, see create().
     */
-    return HA_BINLOG_STMT_CAPABLE;
+    return HA_BINLOG_STMT_CAPABLE | HA_CAN_FULLTEXT | HA_CAN_FULLTEXT_HINTS;
   }
 
   /** @brief
@@ -131,39 +216,30 @@ class ha_keti : public handler {
     here; MySQL will do min(your_limits, MySQL_limits) automatically.
 
       @details
-    There is no need to implement ..._key_... methods if your engine doesn't
-    support indexes.
+    Only FULLTEXT keys are supported; create() refuses any other, so the
+    limits on keys below are those of the server.
    */
-  uint max_supported_keys() const { return 0; }
+  uint max_supported_keys() const { return MAX_KEY; }
 
   /** @brief
     unireg.cc will call this to make sure that the storage engine can handle
     the data it is about to send. Return *real* limits of your storage engine
     here; MySQL will do min(your_limits, MySQL_limits) automatically.
-
-      @details
-    There is no need to implement ..._key_... methods if your engine doesn't
-    support indexes.
    */
-  uint max_supported_key_parts() const { return 0; }
+  uint max_supported_key_parts() const { return MAX_REF_PARTS; }
 
   /** @brief
     unireg.cc will call this to make sure that the storage engine can handle
     the data it is about to send. Return *real* limits of your storage engine
     here; MySQL will do min(your_limits, MySQL_limits) automatically.
-
-      @details
-    There is no need to implement ..._key_... methods if your engine doesn't
-    support indexes.
    */
-  uint max_supported_key_length() const { return 0; }
+  uint max_supported_key_length() const { return MAX_KEY_LENGTH; }
 
   /** @brief
     Called in test_quick_select to determine if indexes should be used.
+    Returns the number of CSD blocks a full scan reads.
   */
-  virtual double scan_time() {
-    return (double)(stats.records + stats.deleted) / 20.0 + 10;
-  }
+  virtual double scan_time();
 
   /** @brief
     This method will never be called if you do not implement indexes.
@@ -172,6 +248,13 @@ class ha_keti : public handler {
     return (double)rows / 20.0 + 1;
   }
 
+  /** @brief
+    Scan and read costs only charge for the blocks the storage node still
+    has to send once the pushed condition has filtered them.
+  */
+  virtual Cost_estimate table_scan_cost();
+  virtual Cost_estimate read_cost(uint index, double ranges, double rows);
+
   /*
     Everything below are methods that we implement in ha_keti.cc.
 
@@ -250,11 +333,23 @@ class ha_keti : public handler {
   int rnd_end();
   int rnd_next(uchar *buf);             ///< required
   int rnd_pos(uchar *buf, uchar *pos);  ///< required
+
+  /** @brief
+    MATCH ... AGAINST on a FULLTEXT key, scored by the storage node; see
+    keti_fulltext.h.
+  */
+  FT_INFO *ft_init_ext_with_hints(uint inx, String *key, Ft_hints *hints);
+  int ft_init();
+  int ft_read(uchar *buf);
+
   void position(const uchar *record);   ///< required
   int info(uint);                       ///< required
   int extra(enum ha_extra_function operation);
   int external_lock(THD *thd, int lock_type);  ///< required
   int delete_all_rows(void);
+  int discard_or_import_tablespace(bool discard, dd::Table *table_def);
+  void start_bulk_insert(ha_rows rows);
+  int end_bulk_insert();
   ha_rows records_in_range(uint inx, key_range *min_key, key_range *max_key);
   int delete_table(const char *from, const dd::Table *table_def);
   int rename_table(const char *from, const char *to,
@@ -264,5 +359,9 @@ class ha_keti : public handler {
 
   THR_LOCK_DATA **store_lock(THD *thd, THR_LOCK_DATA **to,
                              enum thr_lock_type lock_type);  ///< required
+
+  const Item *cond_push(const Item *cond);
+  void cond_pop();
+  int reset();
 };
 
@@ -0,0 +1,533 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_bitmap.cc
+
+    @brief
+  Roaring bitmaps, their construction per segment and their use as a scan
+  filter.
+*/
+
+#include "storage/keti/keti_bitmap.h"
+
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "sql/field.h"
+#include "sql/item.h"
+#include "sql/item_cmpfunc.h"
+#include "sql/table.h"
+#include "sql_string.h"
+#include "storage/keti/keti_key.h"
+#include "storage/keti/keti_pushdown.h"
+#include "template_utils.h"
+
+static const char *BITMAP_COMMENT = "keti_bitmap";
+
+/** Beyond this many values a container is a bitset. */
+static const uint32 ARRAY_MAX = 4096;
+static const size_t BITSET_WORDS = 65536 / 64;
+static const size_t CONTAINER_HEADER_SIZE = 2 + 4;
+/** Length the node replies with for a segment without the index. */
+static const uint32 NO_INDEX = 0xFFFFFFFF;
+
+static uint32 popcount(const std::vector<uint64> &bits) {
+  uint32 count = 0;
+  for (uint64 word : bits) count += __builtin_popcountll(word);
+  return count;
+}
+
+static bool test_bit(const std::vector<uint64> &bits, uint16 low) {
+  return (bits[low >> 6] >> (low & 63)) & 1;
+}
+
+void Keti_bitmap::to_bitset(Container *container) {
+  container->bits.assign(BITSET_WORDS, 0);
+  for (uint16 low : container->array)
+    container->bits[low >> 6] |= (uint64)1 << (low & 63);
+  std::vector<uint16>().swap(container->array);
+}
+
+void Keti_bitmap::to_array(Container *container) {
+  container->array.clear();
+  container->array.reserve(container->cardinality);
+  for (size_t i = 0; i < BITSET_WORDS; i++)
+    for (uint64 word = container->bits[i]; word != 0; word &= word - 1)
+      container->array.push_back(
+          static_cast<uint16>(i * 64 + __builtin_ctzll(word)));
+  std::vector<uint64>().swap(container->bits);
+}
+
+void Keti_bitmap::add(uint32 value) {
+  const uint16 high = value >> 16;
+  const uint16 low = value & 0xFFFF;
+
+  auto it = m_containers.end();
+  if (m_containers.empty() || m_containers.back().high < high) {
+    m_containers.push_back(Container());
+    m_containers.back().high = high;
+    m_containers.back().cardinality = 0;
+    it = std::prev(m_containers.end());
+  } else {
+    it = std::lower_bound(
+        m_containers.begin(), m_containers.end(), high,
+        [](const Container &c, uint16 key) { return c.high < key; });
+    if (it->high != high) {
+      it = m_containers.insert(it, Container());
+      it->high = high;
+      it->cardinality = 0;
+    }
+  }
+
+  if (!it->bits.empty()) {
+    if (test_bit(it->bits, low)) return;
+    it->bits[low >> 6] |= (uint64)1 << (low & 63);
+    it->cardinality++;
+    return;
+  }
+  if (it->array.empty() || it->array.back() < low) {
+    it->array.push_back(low);
+  } else {
+    auto pos = std::lower_bound(it->array.begin(), it->array.end(), low);
+    if (*pos == low) return;
+    it->array.insert(pos, low);
+  }
+  if (++it->cardinality > ARRAY_MAX) to_bitset(&*it);
+}
+
+const Keti_bitmap::Container *Keti_bitmap::find(uint16 high) const {
+  auto it = std::lower_bound(
+      m_containers.begin(), m_containers.end(), high,
+      [](const Container &c, uint16 key) { return c.high < key; });
+  return it != m_containers.end() && it->high == high ? &*it : NULL;
+}
+
+bool Keti_bitmap::contains(uint32 value) const {
+  const Container *container = find(value >> 16);
+  if (container == NULL) return false;
+  const uint16 low = value & 0xFFFF;
+  if (!container->bits.empty()) return test_bit(container->bits, low);
+  return std::binary_search(container->array.begin(), container->array.end(),
+                            low);
+}
+
+bool Keti_bitmap::contains_high(uint16 high) const {
+  return find(high) != NULL;
+}
+
+size_t Keti_bitmap::cardinality() const {
+  size_t count = 0;
+  for (const Container &container : m_containers)
+    count += container.cardinality;
+  return count;
+}
+
+void Keti_bitmap::intersect(Container *a, const Container &b) {
+  if (!a->bits.empty() && !b.bits.empty()) {
+    uint64 *x = a->bits.data();
+    const uint64 *y = b.bits.data();
+#if defined(__SSE2__)
+    for (size_t i = 0; i < BITSET_WORDS; i += 2) {
+      const __m128i v =
+          _mm_and_si128(_mm_loadu_si128(reinterpret_cast<__m128i *>(x + i)),
+                        _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                            y + i)));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(x + i), v);
+    }
+#else
+    for (size_t i = 0; i < BITSET_WORDS; i++) x[i] &= y[i];
+#endif
+    a->cardinality = popcount(a->bits);
+    if (a->cardinality <= ARRAY_MAX) to_array(a);
+    return;
+  }
+
+  std::vector<uint16> result;
+  if (a->bits.empty() && b.bits.empty()) {
+    std::set_intersection(a->array.begin(), a->array.end(), b.array.begin(),
+                          b.array.end(), std::back_inserter(result));
+  } else {
+    /* One array, one bitset: probe the bitset with the array */
+    const std::vector<uint16> &array = a->bits.empty() ? a->array : b.array;
+    const std::vector<uint64> &bits = a->bits.empty() ? b.bits : a->bits;
+    for (uint16 low : array)
+      if (test_bit(bits, low)) result.push_back(low);
+    std::vector<uint64>().swap(a->bits);
+  }
+  a->array.swap(result);
+  a->cardinality = static_cast<uint32>(a->array.size());
+}
+
+void Keti_bitmap::unite(Container *a, const Container &b) {
+  if (a->bits.empty() && b.bits.empty()) {
+    std::vector<uint16> result;
+    result.reserve(a->array.size() + b.array.size());
+    std::set_union(a->array.begin(), a->array.end(), b.array.begin(),
+                   b.array.end(), std::back_inserter(result));
+    a->array.swap(result);
+    a->cardinality = static_cast<uint32>(a->array.size());
+    if (a->cardinality > ARRAY_MAX) to_bitset(a);
+    return;
+  }
+
+  if (a->bits.empty()) to_bitset(a);
+  if (b.bits.empty()) {
+    for (uint16 low : b.array) a->bits[low >> 6] |= (uint64)1 << (low & 63);
+  } else {
+    uint64 *x = a->bits.data();
+    const uint64 *y = b.bits.data();
+#if defined(__SSE2__)
+    for (size_t i = 0; i < BITSET_WORDS; i += 2) {
+      const __m128i v =
+          _mm_or_si128(_mm_loadu_si128(reinterpret_cast<__m128i *>(x + i)),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                           y + i)));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(x + i), v);
+    }
+#else
+    for (size_t i = 0; i < BITSET_WORDS; i++) x[i] |= y[i];
+#endif
+  }
+  a->cardinality = popcount(a->bits);
+}
+
+void Keti_bitmap::intersect(const Keti_bitmap &other) {
+  std::vector<Container> result;
+  auto b = other.m_containers.begin();
+  for (Container &a : m_containers) {
+    while (b != other.m_containers.end() && b->high < a.high) ++b;
+    if (b == other.m_containers.end()) break;
+    if (b->high != a.high) continue;
+    intersect(&a, *b);
+    if (a.cardinality > 0) result.push_back(std::move(a));
+  }
+  m_containers.swap(result);
+}
+
+void Keti_bitmap::unite(const Keti_bitmap &other) {
+  std::vector<Container> result;
+  result.reserve(m_containers.size() + other.m_containers.size());
+  auto a = m_containers.begin();
+  auto b = other.m_containers.begin();
+  while (a != m_containers.end() || b != other.m_containers.end()) {
+    if (b == other.m_containers.end() ||
+        (a != m_containers.end() && a->high < b->high)) {
+      result.push_back(std::move(*a++));
+    } else if (a == m_containers.end() || b->high < a->high) {
+      result.push_back(*b++);
+    } else {
+      unite(&*a, *b++);
+      result.push_back(std::move(*a++));
+    }
+  }
+  m_containers.swap(result);
+}
+
+void Keti_bitmap::pack(std::vector<uchar> *out) const {
+  size_t offset = out->size();
+  out->resize(offset + 4);
+  int4store(&(*out)[offset], static_cast<uint32>(m_containers.size()));
+
+  for (const Container &container : m_containers) {
+    offset = out->size();
+    if (container.bits.empty()) {
+      out->resize(offset + CONTAINER_HEADER_SIZE + 2 * container.array.size());
+      uchar *ptr = &(*out)[offset + CONTAINER_HEADER_SIZE];
+      for (uint16 low : container.array) {
+        int2store(ptr, low);
+        ptr += 2;
+      }
+    } else {
+      out->resize(offset + CONTAINER_HEADER_SIZE + 8 * BITSET_WORDS);
+      uchar *ptr = &(*out)[offset + CONTAINER_HEADER_SIZE];
+      for (uint64 word : container.bits) {
+        int8store(ptr, word);
+        ptr += 8;
+      }
+    }
+    int2store(&(*out)[offset], container.high);
+    int4store(&(*out)[offset + 2], container.cardinality);
+  }
+}
+
+bool Keti_bitmap::unpack(const uchar *data, size_t length) {
+  m_containers.clear();
+  if (length < 4) return false;
+  const uchar *end = data + length;
+  uint32 count = uint4korr(data);
+  data += 4;
+
+  for (; count > 0; count--) {
+    if (end - data < static_cast<ptrdiff_t>(CONTAINER_HEADER_SIZE))
+      return false;
+    Container container;
+    container.high = uint2korr(data);
+    container.cardinality = uint4korr(data + 2);
+    data += CONTAINER_HEADER_SIZE;
+    if ((!m_containers.empty() && m_containers.back().high >= container.high)
+        || container.cardinality == 0 || container.cardinality > 65536)
+      return false;
+
+    if (container.cardinality <= ARRAY_MAX) {
+      if (end - data < static_cast<ptrdiff_t>(2 * container.cardinality))
+        return false;
+      container.array.resize(container.cardinality);
+      for (uint16 &low : container.array) {
+        low = uint2korr(data);
+        data += 2;
+      }
+    } else {
+      if (end - data < static_cast<ptrdiff_t>(8 * BITSET_WORDS)) return false;
+      container.bits.resize(BITSET_WORDS);
+      for (uint64 &word : container.bits) {
+        word = uint8korr(data);
+        data += 8;
+      }
+    }
+    m_containers.push_back(std::move(container));
+  }
+  return data == end;
+}
+
+void Keti_bitmap_index::add(uint16 field, const std::string &key,
+                            uint32 block, uint32 index) {
+  if (block > KETI_BITMAP_MAX_BLOCK) {
+    m_overflow = true;
+    return;
+  }
+  m_bitmaps[std::make_pair(field, key)].add(block << 16 | index);
+}
+
+void Keti_bitmap_index::take(std::vector<uchar> *out) {
+  out->clear();
+  if (!m_overflow) {
+    for (const auto &bitmap : m_bitmaps) {
+      const std::string &key = bitmap.first.second;
+      size_t offset = out->size();
+      out->resize(offset + 2 + 4);
+      int2store(&(*out)[offset], bitmap.first.first);
+      int4store(&(*out)[offset + 2], static_cast<uint32>(key.size()));
+      out->insert(out->end(), key.begin(), key.end());
+      bitmap.second.pack(out);
+    }
+  }
+  m_bitmaps.clear();
+  m_overflow = false;
+}
+
+void keti_bitmap_fields(const TABLE_SHARE *share,
+                        std::vector<uint16> *fields) {
+  fields->clear();
+  for (uint i = 0; i < share->fields; i++) {
+    const Field *field = share->field[i];
+    const LEX_CSTRING &comment = field->comment;
+    if (comment.length == 0 ||
+        std::search(comment.str, comment.str + comment.length, BITMAP_COMMENT,
+                    BITMAP_COMMENT + strlen(BITMAP_COMMENT)) ==
+            comment.str + comment.length)
+      continue;
+    if (field->result_type() == INT_RESULT ||
+        (field->result_type() == STRING_RESULT && keti_field_pushable(field)))
+      fields->push_back(static_cast<uint16>(i));
+  }
+}
+
+/** Key of an integer, the same for every integer type. */
+static void int_key(longlong value, std::string *key) {
+  uchar buf[8];
+  int8store(buf, value);
+  key->assign(pointer_cast<const char *>(buf), sizeof(buf));
+}
+
+bool keti_bitmap_key(Field *field, const uchar *record, std::string *key) {
+  const ptrdiff_t offset = record - field->table->record[0];
+  if (field->is_null(offset)) return false;
+
+  field->move_field_offset(offset);
+  if (field->result_type() == INT_RESULT) {
+    int_key(field->val_int(), key);
+  } else {
+    String value;
+    field->val_str(&value);
+    *key = keti_weight_string(field->charset(), value.ptr(), value.length());
+  }
+  field->move_field_offset(-offset);
+  return true;
+}
+
+/**
+  Key of a constant compared with field.
+
+  @return false if the constant is NULL, or of a type whose key would not
+          match the keys of equal values of field
+*/
+static bool const_key(const Field *field, Item *item, std::string *key) {
+  if (field->result_type() == INT_RESULT) {
+    if (item->result_type() != INT_RESULT) return false;
+    const longlong value = item->val_int();
+    if (item->null_value) return false;
+    int_key(value, key);
+    return true;
+  }
+
+  if (!keti_string_constant(field, item)) return false;
+  String buffer;
+  const String *value = item->val_str(&buffer);
+  if (value == NULL) return false;
+  *key = keti_weight_string(field->charset(), value->ptr(), value->length());
+  return true;
+}
+
+int Keti_bitmap_filter::add_node(const Item *cond, TABLE *table,
+                                 const std::vector<uint16> &fields) {
+  Node node;
+  if (cond->type() == Item::COND_ITEM) {
+    const Item_cond *item_cond = static_cast<const Item_cond *>(cond);
+    const bool is_and = item_cond->functype() == Item_func::COND_AND_FUNC;
+    if (!is_and && item_cond->functype() != Item_func::COND_OR_FUNC)
+      return -1;
+
+    node.type = is_and ? NODE_AND : NODE_OR;
+    List_iterator<Item> li(*const_cast<Item_cond *>(item_cond)->argument_list());
+    Item *item;
+    while ((item = li++)) {
+      const int child = add_node(item, table, fields);
+      /* An AND can do without a conjunct; an OR needs every disjunct */
+      if (child < 0 && !is_and) return -1;
+      if (child >= 0) node.children.push_back(child);
+    }
+    if (node.children.empty()) return -1;
+  } else {
+    const Field *field;
+    std::vector<Item *> values;
+    if (!keti_equality_predicate(cond, table, &field, &values) ||
+        std::find(fields.begin(), fields.end(), field->field_index) ==
+            fields.end())
+      return -1;
+
+    /* An IN is the OR of its values; NULL values match nothing */
+    node.type = NODE_OR;
+    for (Item *value : values) {
+      Term term;
+      term.field = static_cast<uint16>(field->field_index);
+      if (!const_key(field, value, &term.key)) {
+        if (value->null_value) continue;
+        return -1;
+      }
+      Node leaf;
+      leaf.type = NODE_TERM;
+      leaf.children.push_back(static_cast<int>(m_terms.size()));
+      m_terms.push_back(std::move(term));
+      node.children.push_back(static_cast<int>(m_nodes.size()));
+      m_nodes.push_back(std::move(leaf));
+    }
+  }
+  m_nodes.push_back(std::move(node));
+  return static_cast<int>(m_nodes.size()) - 1;
+}
+
+bool Keti_bitmap_filter::build(const Item *cond, TABLE *table,
+                               const std::vector<uint16> &fields) {
+  m_nodes.clear();
+  m_terms.clear();
+  m_root = cond != NULL && !fields.empty() ? add_node(cond, table, fields)
+                                           : -1;
+  if (m_terms.empty()) m_root = -1;
+  return m_root >= 0;
+}
+
+std::unique_ptr<Keti_bitmap> Keti_bitmap_filter::evaluate(
+    int index, const std::vector<std::unique_ptr<Keti_bitmap>> &bitmaps) const {
+  const Node &node = m_nodes[index];
+  if (node.type == NODE_TERM) {
+    const Keti_bitmap *bitmap = bitmaps[node.children[0]].get();
+    return std::unique_ptr<Keti_bitmap>(
+        bitmap != NULL ? new Keti_bitmap(*bitmap) : NULL);
+  }
+
+  /* A child without an index admits every row */
+  std::unique_ptr<Keti_bitmap> result(node.type == NODE_OR ? new Keti_bitmap
+                                                           : NULL);
+  for (int child : node.children) {
+    std::unique_ptr<Keti_bitmap> rows = evaluate(child, bitmaps);
+    if (node.type == NODE_OR) {
+      if (rows == NULL) return rows;
+      result->unite(*rows);
+    } else if (rows != NULL) {
+      if (result == NULL)
+        result = std::move(rows);
+      else
+        result->intersect(*rows);
+    }
+  }
+  return result;
+}
+
+static int bad_reply(const std::string &table,
+                     std::vector<std::unique_ptr<Keti_bitmap>> *rows) {
+  keti_log(ERROR_LEVEL, "bad reply to bitmap lookup for %s", table.c_str());
+  for (std::unique_ptr<Keti_bitmap> &segment_rows : *rows) segment_rows.reset();
+  return HA_ERR_INTERNAL_ERROR;
+}
+
+int Keti_bitmap_filter::lookup(
+    const std::string &table, const std::vector<Keti_segment> &segments,
+    std::vector<std::unique_ptr<Keti_bitmap>> *rows) const {
+  rows->clear();
+  rows->resize(segments.size());
+  if (m_root < 0 || segments.empty()) return 0;
+
+  std::vector<uint32> ids;
+  for (const Keti_segment &segment : segments) ids.push_back(segment.id);
+  std::vector<uchar> terms;
+  for (const Term &term : m_terms) {
+    const size_t offset = terms.size();
+    terms.resize(offset + 2 + 4);
+    int2store(&terms[offset], term.field);
+    int4store(&terms[offset + 2], static_cast<uint32>(term.key.size()));
+    terms.insert(terms.end(), term.key.begin(), term.key.end());
+  }
+
+  std::vector<uchar> reply;
+  int rc = csd_read_bitmaps(table, ids, &terms, &reply);
+  if (rc) return rc;
+
+  const uchar *ptr = reply.data();
+  const uchar *end = ptr + reply.size();
+  std::vector<std::unique_ptr<Keti_bitmap>> bitmaps(m_terms.size());
+  for (size_t i = 0; i < segments.size(); i++) {
+    for (std::unique_ptr<Keti_bitmap> &bitmap : bitmaps) {
+      bitmap.reset();
+      if (end - ptr < 4) return bad_reply(table, rows);
+      const uint32 length = uint4korr(ptr);
+      ptr += 4;
+      if (length == NO_INDEX) continue;
+      bitmap.reset(new Keti_bitmap);
+      if (end - ptr < static_cast<ptrdiff_t>(length) ||
+          !bitmap->unpack(ptr, length))
+        return bad_reply(table, rows);
+      ptr += length;
+    }
+    (*rows)[i] = evaluate(m_root, bitmaps);
+  }
+  return 0;
+}
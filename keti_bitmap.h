@@ -0,0 +1,204 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_bitmap.h
+
+    @brief
+  Per segment bitmap indexes of low cardinality columns.
+
+    @details
+  A column whose COMMENT contains "keti_bitmap" gets, in every segment, one
+  bitmap per distinct value telling which rows of the segment hold it. The
+  bitmaps are built on the host while the segment is filled and stored on
+  the node next to it. Integer columns and strings other than BLOB and TEXT
+  qualify. A string's key is its weight string in the column's collation,
+  so values the collation finds equal, as 'a' and 'A' under a case
+  insensitive one, share a bitmap.
+
+  A row is numbered block << 16 | index of the row in its block, so the
+  bitmaps are roaring bitmaps with one container per block: a container is
+  a sorted array of row indexes while it has at most 4096 of them, and a
+  bitset of 65536 bits beyond. A scan whose pushed condition has equality
+  and IN predicates on such columns combines their bitmaps with AND and OR,
+  and then reads only the blocks that have a container and returns only
+  the rows set in it. Bitsets are combined with SSE2 where available.
+*/
+
+#ifndef KETI_BITMAP_H
+#define KETI_BITMAP_H
+
+#include <stddef.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "my_inttypes.h"
+#include "storage/keti/keti_csd.h"
+
+class Field;
+class Item;
+struct TABLE;
+struct TABLE_SHARE;
+
+/** Highest block number a bitmap can address. */
+static const uint32 KETI_BITMAP_MAX_BLOCK = 0xFFFF;
+
+/** @brief
+  Roaring bitmap of 32 bit row numbers.
+*/
+class Keti_bitmap {
+ public:
+  /** Set value; cheapest in increasing order. */
+  void add(uint32 value);
+
+  bool contains(uint32 value) const;
+
+  /** True if some value with these high 16 bits is set. */
+  bool contains_high(uint16 high) const;
+
+  bool empty() const { return m_containers.empty(); }
+  size_t cardinality() const;
+
+  /** Keep only the values also set in other. */
+  void intersect(const Keti_bitmap &other);
+
+  /** Set the values set in other. */
+  void unite(const Keti_bitmap &other);
+
+  /**
+    Append the bitmap to out: the number of containers in 4 bytes, then for
+    each its high bits in 2 and its cardinality in 4 bytes followed by its
+    values, 2 bytes each, or by 8192 bytes of bits if it has more than 4096.
+  */
+  void pack(std::vector<uchar> *out) const;
+
+  /** Read what pack() wrote. @return false if data is malformed */
+  bool unpack(const uchar *data, size_t length);
+
+ private:
+  struct Container {
+    uint16 high;
+    uint32 cardinality;
+    std::vector<uint16> array;  ///< Values, if cardinality <= 4096
+    std::vector<uint64> bits;   ///< 1024 words, otherwise
+  };
+
+  static void to_bitset(Container *container);
+  static void to_array(Container *container);
+  static void intersect(Container *a, const Container &b);
+  static void unite(Container *a, const Container &b);
+
+  /** Container for high, or NULL. */
+  const Container *find(uint16 high) const;
+
+  std::vector<Container> m_containers;  ///< Sorted by high
+};
+
+/** @brief
+  The bitmaps of one segment under construction, per column and value.
+*/
+class Keti_bitmap_index {
+ public:
+  Keti_bitmap_index() : m_overflow(false) {}
+
+  /** Record that the row at block and index holds key in field. */
+  void add(uint16 field, const std::string &key, uint32 block, uint32 index);
+
+  bool empty() const { return m_bitmaps.empty() || m_overflow; }
+
+  /**
+    Hand over the index in the format csd_write_bitmaps() takes: for each
+    bitmap the column in 2 bytes, the key preceded by its length in 4 bytes
+    and the bitmap as packed by Keti_bitmap::pack(). The builder is empty
+    afterwards. A segment too large to be addressed gets no index.
+  */
+  void take(std::vector<uchar> *out);
+
+ private:
+  std::map<std::pair<uint16, std::string>, Keti_bitmap> m_bitmaps;
+  bool m_overflow;
+};
+
+/** @brief
+  AND/OR tree of equality and IN predicates answered by bitmap indexes.
+*/
+class Keti_bitmap_filter {
+ public:
+  /** One value of one column to look up. */
+  struct Term {
+    uint16 field;
+    std::string key;
+  };
+
+  Keti_bitmap_filter() : m_root(-1) {}
+
+  /**
+    Build the filter for the part of cond the bitmap indexes of fields can
+    answer. Rows it rejects fail cond; rows it accepts may fail it too.
+
+    @return false if no part of cond can use an index
+  */
+  bool build(const Item *cond, TABLE *table,
+             const std::vector<uint16> &fields);
+
+  /**
+    Find the rows of each segment that may match.
+
+    @param rows  receives, per segment, the rows that may match, or NULL if
+                 all of them may
+  */
+  int lookup(const std::string &table,
+             const std::vector<Keti_segment> &segments,
+             std::vector<std::unique_ptr<Keti_bitmap>> *rows) const;
+
+ private:
+  enum Node_type { NODE_AND, NODE_OR, NODE_TERM };
+  struct Node {
+    Node_type type;
+    std::vector<int> children;  ///< Nodes, or the term for NODE_TERM
+  };
+
+  /** Add the node for cond; @return its index, or -1 if unusable */
+  int add_node(const Item *cond, TABLE *table,
+               const std::vector<uint16> &fields);
+
+  /**
+    Rows of a segment that may match node, given the bitmap of each term in
+    that segment, NULL where the segment has no index.
+
+    @return NULL if every row may match
+  */
+  std::unique_ptr<Keti_bitmap> evaluate(
+      int node, const std::vector<std::unique_ptr<Keti_bitmap>> &bitmaps)
+      const;
+
+  std::vector<Node> m_nodes;
+  std::vector<Term> m_terms;
+  int m_root;
+};
+
+/** Columns of a table with a bitmap index. */
+void keti_bitmap_fields(const TABLE_SHARE *share, std::vector<uint16> *fields);
+
+/**
+  Key of the value of field in record.
+
+  @return false if the value is NULL
+*/
+bool keti_bitmap_key(Field *field, const uchar *record, std::string *key);
+
+#endif /* KETI_BITMAP_H */
@@ -0,0 +1,299 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_buf.cc
+
+    @brief
+  KETI buffer pool, its dump file and its warm-up at startup.
+
+    @details
+  The dump file holds one line per block, hottest first:
+
+  @verbatim
+    <segment> <block> <table>
+  @endverbatim
+
+  It is written to a temporary file and renamed, so a crash while dumping
+  leaves the previous dump intact.
+*/
+
+#include "storage/keti/keti_buf.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+
+#include "my_io.h"
+#include "my_sys.h"
+#include "sql/mysqld.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_encode.h"
+
+Keti_buffer_pool *keti_buffer_pool = NULL;
+keti_buf_stats_t keti_buf_stats = {0, 0, 0, 0};
+
+ulonglong srv_buffer_pool_size = 128 * 1024 * 1024;
+bool srv_buffer_pool_dump_at_shutdown = true;
+bool srv_buffer_pool_load_at_startup = true;
+ulong srv_buffer_pool_dump_pct = 25;
+ulong srv_buffer_pool_dump_interval = 0;
+ulong srv_buffer_pool_load_threads = 4;
+ulong srv_buffer_pool_load_rate = 1000;
+
+static const char *DUMP_FILE_NAME = "keti_buffer_pool";
+
+bool Keti_page_id::operator<(const Keti_page_id &other) const {
+  if (table != other.table) return table < other.table;
+  if (segment != other.segment) return segment < other.segment;
+  return block < other.block;
+}
+
+Keti_page Keti_buffer_pool::insert(const Keti_page_id &id,
+                                   const Keti_page &page, bool hot) {
+  auto it = m_pages.find(id);
+  if (it != m_pages.end()) return it->second->second;
+
+  m_lru.emplace(hot ? m_lru.begin() : m_lru.end(), id, page);
+  m_pages[id] = hot ? m_lru.begin() : std::prev(m_lru.end());
+
+  while (m_lru.size() > m_capacity) {
+    m_pages.erase(m_lru.back().first);
+    m_lru.pop_back();
+  }
+  keti_buf_stats.pages_data = m_lru.size();
+  return page;
+}
+
+int Keti_buffer_pool::read(const Keti_page_id &id, Keti_page *page) {
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    keti_buf_stats.read_requests++;
+    auto it = m_pages.find(id);
+    if (it != m_pages.end()) {
+      m_lru.splice(m_lru.begin(), m_lru, it->second);
+      *page = it->second->second;
+      return 0;
+    }
+    keti_buf_stats.reads++;
+  }
+
+  /* Read outside the latch; a concurrent reader of the same block wins. */
+  std::shared_ptr<std::vector<uchar>> data =
+      std::make_shared<std::vector<uchar>>();
+  int rc = csd_read_block(id.table, id.segment, id.block, data.get());
+  if (rc == 0) rc = keti_decode_block(data.get(), NULL);
+  if (rc) return rc;
+
+  std::lock_guard<std::mutex> guard(m_mutex);
+  *page = insert(id, data, true);
+  return 0;
+}
+
+bool Keti_buffer_pool::cached(const Keti_page_id &id, Keti_page *page) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto it = m_pages.find(id);
+  if (it == m_pages.end()) return false;
+  keti_buf_stats.read_requests++;
+  m_lru.splice(m_lru.begin(), m_lru, it->second);
+  *page = it->second->second;
+  return true;
+}
+
+int Keti_buffer_pool::prefetch(const Keti_page_id &id) {
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_pages.count(id) || m_lru.size() >= m_capacity) return 0;
+  }
+
+  std::shared_ptr<std::vector<uchar>> data =
+      std::make_shared<std::vector<uchar>>();
+  int rc = csd_read_block(id.table, id.segment, id.block, data.get());
+  if (rc == 0) rc = keti_decode_block(data.get(), NULL);
+  if (rc) return rc;
+
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_lru.size() < m_capacity && !m_pages.count(id)) {
+    insert(id, data, false);
+    keti_buf_stats.pages_loaded++;
+  }
+  return 0;
+}
+
+void Keti_buffer_pool::hot_pages(size_t count,
+                                 std::vector<Keti_page_id> *ids) const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  ids->clear();
+  for (auto it = m_lru.begin(); it != m_lru.end() && ids->size() < count; ++it)
+    ids->push_back(it->first);
+}
+
+void Keti_buffer_pool::evict_table(const std::string &table) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  const Keti_page_id first = {table, 0, 0};
+  auto it = m_pages.lower_bound(first);
+  while (it != m_pages.end() && it->first.table == table) {
+    m_lru.erase(it->second);
+    it = m_pages.erase(it);
+  }
+  keti_buf_stats.pages_data = m_lru.size();
+}
+
+size_t Keti_buffer_pool::size() const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_lru.size();
+}
+
+static void dump_file_path(char *path) {
+  fn_format(path, DUMP_FILE_NAME, mysql_real_data_home, "",
+            MY_UNPACK_FILENAME | MY_SAFE_PATH);
+}
+
+/** Write the ids of the hottest keti_buffer_pool_dump_pct percent of blocks. */
+static void buffer_pool_dump() {
+  std::vector<Keti_page_id> ids;
+  keti_buffer_pool->hot_pages(
+      keti_buffer_pool->size() * srv_buffer_pool_dump_pct / 100, &ids);
+
+  char path[FN_REFLEN];
+  dump_file_path(path);
+  const std::string tmp_path = std::string(path) + ".incomplete";
+
+  FILE *file = fopen(tmp_path.c_str(), "w");
+  if (file == NULL) {
+    keti_log(WARNING_LEVEL, "cannot open %s for writing", tmp_path.c_str());
+    return;
+  }
+  for (const Keti_page_id &id : ids)
+    fprintf(file, "%u %u %s\n", id.segment, id.block, id.table.c_str());
+
+  if (fclose(file) != 0 || rename(tmp_path.c_str(), path) != 0) {
+    keti_log(WARNING_LEVEL, "cannot write buffer pool dump %s", path);
+    remove(tmp_path.c_str());
+    return;
+  }
+  keti_log(INFORMATION_LEVEL, "dumped %zu buffer pool pages to %s", ids.size(),
+           path);
+}
+
+static std::thread dump_thread;
+static std::mutex dump_mutex;
+static std::condition_variable dump_cond;
+static bool dump_thread_stop = false;
+
+static void buffer_pool_dump_thread() {
+  std::unique_lock<std::mutex> lock(dump_mutex);
+  while (!dump_thread_stop) {
+    if (srv_buffer_pool_dump_interval == 0) {
+      dump_cond.wait(lock);
+      continue;
+    }
+    if (dump_cond.wait_for(lock, std::chrono::seconds(
+                                     srv_buffer_pool_dump_interval)) ==
+            std::cv_status::timeout &&
+        !dump_thread_stop) {
+      lock.unlock();
+      buffer_pool_dump();
+      lock.lock();
+    }
+  }
+}
+
+void keti_buf_dump_interval_changed() {
+  std::lock_guard<std::mutex> guard(dump_mutex);
+  dump_cond.notify_all();
+}
+
+static std::thread load_thread;
+static std::atomic<bool> load_abort(false);
+
+/** Read the dump file and prefetch its blocks, hottest first. */
+static void buffer_pool_load() {
+  char path[FN_REFLEN];
+  dump_file_path(path);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) return;
+
+  std::vector<Keti_page_id> ids;
+  char table[FN_REFLEN];
+  for (;;) {
+    Keti_page_id id;
+    if (fscanf(file, "%u %u %511s", &id.segment, &id.block, table) != 3)
+      break;
+    id.table = table;
+    ids.push_back(id);
+    if (ids.size() >= keti_buffer_pool->capacity()) break;
+  }
+  fclose(file);
+
+  const auto start = std::chrono::steady_clock::now();
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+
+  /*
+    Read i is not issued before start + i / keti_buffer_pool_load_rate, so
+    the warm-up never takes more than its share of the storage node.
+  */
+  auto worker = [&]() {
+    for (size_t i = next++; i < ids.size() && !load_abort; i = next++) {
+      if (srv_buffer_pool_load_rate > 0)
+        std::this_thread::sleep_until(
+            start + std::chrono::microseconds(i * 1000000 /
+                                              srv_buffer_pool_load_rate));
+      if (!load_abort) keti_buffer_pool->prefetch(ids[i]);
+    }
+  };
+  for (ulong i = 0; i < srv_buffer_pool_load_threads; i++)
+    workers.emplace_back(worker);
+  for (std::thread &thread : workers) thread.join();
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  keti_log(INFORMATION_LEVEL,
+           "buffer pool load %s: %llu of %zu pages in %.1f seconds",
+           load_abort ? "aborted" : "completed", keti_buf_stats.pages_loaded,
+           ids.size(), elapsed.count());
+}
+
+void keti_buf_init() {
+  keti_buffer_pool = new Keti_buffer_pool(
+      std::max<size_t>(srv_buffer_pool_size / KETI_BLOCK_SIZE, 1));
+
+  dump_thread_stop = false;
+  dump_thread = std::thread(buffer_pool_dump_thread);
+
+  load_abort = false;
+  if (srv_buffer_pool_load_at_startup)
+    load_thread = std::thread(buffer_pool_load);
+}
+
+void keti_buf_deinit() {
+  load_abort = true;
+  if (load_thread.joinable()) load_thread.join();
+
+  {
+    std::lock_guard<std::mutex> guard(dump_mutex);
+    dump_thread_stop = true;
+    dump_cond.notify_all();
+  }
+  if (dump_thread.joinable()) dump_thread.join();
+
+  if (srv_buffer_pool_dump_at_shutdown) buffer_pool_dump();
+
+  delete keti_buffer_pool;
+  keti_buffer_pool = NULL;
+}
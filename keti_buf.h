@@ -0,0 +1,129 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_buf.h
+
+    @brief
+  Host side cache of CSD blocks, and its dump and warm-up across restarts.
+
+    @details
+  Blocks are immutable once written to a segment, so cached copies never go
+  stale; they are only dropped when the pool is full or the table is
+  dropped. The ids of the hottest blocks are written to keti_buffer_pool in
+  the data directory at shutdown, and optionally every
+  keti_buffer_pool_dump_interval seconds. At startup they are read back from
+  the storage node in the background, hottest first, by
+  keti_buffer_pool_load_threads threads issuing at most
+  keti_buffer_pool_load_rate reads per second.
+*/
+
+#ifndef KETI_BUF_H
+#define KETI_BUF_H
+
+#include <stddef.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "my_inttypes.h"
+
+/** A cached block. Holders keep it alive after it has been evicted. */
+typedef std::shared_ptr<const std::vector<uchar>> Keti_page;
+
+/** @brief
+  Identity of a block on the storage node.
+*/
+struct Keti_page_id {
+  std::string table;
+  uint32 segment;
+  uint32 block;
+
+  bool operator<(const Keti_page_id &other) const;
+};
+
+/** @brief
+  LRU cache of CSD blocks shared by all KETI tables.
+*/
+class Keti_buffer_pool {
+ public:
+  explicit Keti_buffer_pool(size_t capacity) : m_capacity(capacity) {}
+
+  /** Return a block, reading it from the storage node on a miss. */
+  int read(const Keti_page_id &id, Keti_page *page);
+
+  /** Return a block if it is cached. @return false on a miss */
+  bool cached(const Keti_page_id &id, Keti_page *page);
+
+  /**
+    Read a block into the pool without making it the most recently used
+    one. Does nothing if the block is cached or the pool is full.
+  */
+  int prefetch(const Keti_page_id &id);
+
+  /** Ids of up to count blocks, most recently used first. */
+  void hot_pages(size_t count, std::vector<Keti_page_id> *ids) const;
+
+  /** Forget all blocks of a table. */
+  void evict_table(const std::string &table);
+
+  size_t size() const;
+  size_t capacity() const { return m_capacity; }
+
+ private:
+  typedef std::list<std::pair<Keti_page_id, Keti_page>> lru_t;
+
+  /** Add a block unless present; caller holds m_mutex. */
+  Keti_page insert(const Keti_page_id &id, const Keti_page &page, bool hot);
+
+  mutable std::mutex m_mutex;
+  const size_t m_capacity;
+  /** Most recently used first. */
+  lru_t m_lru;
+  std::map<Keti_page_id, lru_t::iterator> m_pages;
+};
+
+struct keti_buf_stats_t {
+  ulonglong pages_data;
+  ulonglong read_requests;
+  ulonglong reads;
+  /** Blocks read back from the dump file since startup. */
+  ulonglong pages_loaded;
+};
+
+extern Keti_buffer_pool *keti_buffer_pool;
+extern keti_buf_stats_t keti_buf_stats;
+
+extern ulonglong srv_buffer_pool_size;
+extern bool srv_buffer_pool_dump_at_shutdown;
+extern bool srv_buffer_pool_load_at_startup;
+extern ulong srv_buffer_pool_dump_pct;
+extern ulong srv_buffer_pool_dump_interval;
+extern ulong srv_buffer_pool_load_threads;
+extern ulong srv_buffer_pool_load_rate;
+
+/** Create the pool, start the dump thread and the background load. */
+void keti_buf_init();
+
+/** Stop loading, write the final dump if enabled and free the pool. */
+void keti_buf_deinit();
+
+/** Wake the dump thread after keti_buffer_pool_dump_interval changed. */
+void keti_buf_dump_interval_changed();
+
+#endif /* KETI_BUF_H */
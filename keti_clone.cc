@@ -0,0 +1,80 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_clone.cc
+
+    @brief
+  Tables cloned by sharing segments, see keti_clone.h.
+*/
+
+#include "storage/keti/keti_clone.h"
+
+#include <string.h>
+#include <mutex>
+#include <vector>
+
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_ibuf.h"
+#include "storage/keti/keti_mvcc.h"
+#include "storage/keti/keti_row.h"
+
+keti_clone_stats_t keti_clone_stats = {0, 0};
+
+static std::mutex stats_mutex;
+
+int keti_clone_table(const std::string &source, const std::string &clone,
+                     const Keti_table_versions &versions,
+                     const Keti_trx *trx) {
+  /* The node copies the index entries of the rows it shares */
+  int rc = keti_ibuf_merge(source);
+  if (rc) return rc;
+
+  std::vector<Keti_segment> segments;
+  rc = csd_read_manifest(source, &segments);
+  if (rc == HA_ERR_NO_SUCH_TABLE) return 0;
+  if (rc) return rc;
+
+  std::vector<uchar> request(2 + source.size() + 4);
+  int2store(request.data(), static_cast<uint16>(source.size()));
+  memcpy(request.data() + 2, source.data(), source.size());
+
+  uint32 shared = 0;
+  std::vector<Keti_row_pos> hidden;
+  for (const Keti_segment &segment : segments) {
+    if (!versions.segment_visible(segment.id, trx)) continue;
+    versions.hidden_rows(segment.id, trx, &hidden);
+
+    size_t pos = request.size();
+    request.resize(pos + 8 + KETI_REF_LENGTH * hidden.size());
+    int4store(&request[pos], segment.id);
+    int4store(&request[pos + 4], static_cast<uint32>(hidden.size()));
+    pos += 8;
+    for (const Keti_row_pos &row : hidden) {
+      keti_store_pos(&request[pos], row);
+      pos += KETI_REF_LENGTH;
+    }
+    shared++;
+  }
+  int4store(&request[2 + source.size()], shared);
+
+  if ((rc = csd_clone_table(clone, &request))) return rc;
+
+  std::lock_guard<std::mutex> guard(stats_mutex);
+  keti_clone_stats.clones++;
+  keti_clone_stats.segments_shared += shared;
+  return 0;
+}
@@ -0,0 +1,82 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_clone.h
+
+    @brief
+  Clones: a new table that starts out with the rows of another, sharing
+  its segments on the storage node instead of copying them.
+
+    @details
+  A session with keti_clone_rows on makes
+
+  @verbatim
+    CREATE TABLE orders_sandbox LIKE orders
+  @endverbatim
+
+  a clone of orders: the new table has the rows of orders its read view
+  sees, at once and whatever their size. Segments are immutable, so the
+  two tables can share them. The node counts the tables whose manifest
+  references a segment, and only deletes it once the last of them retired
+  it. The segments a clone shares keep their ids and their bitmap,
+  inverted, FULLTEXT and vector indexes. Writes of either table go to new
+  segments of its own and deletes to tombstones of its own; a merge
+  copies the live rows of the segments it compacts into a new segment of
+  the table merging and retires the old ones there alone. So the tables
+  copy only what they write, and never see each other's changes.
+
+  A clone gets the deltas of the rows it shares, which are read whatever
+  the view, and the rows its view may not see as tombstones of its own: the
+  rows purged from the source and the ones deleted in that view. Changes
+  to KETI indexes still in the change buffer are merged into the source
+  first, and the node copies the index entries of the shared rows. The
+  request is
+
+  @verbatim
+    clone    := source_length(2) source segment_count(4) segment*
+    segment  := id(4) hidden_count(4) row(12)*
+  @endverbatim
+
+  source being the name of the source on the node and each row a hidden
+  row as keti_store_pos() writes it. Segments the view does not see are
+  not shared.
+*/
+
+#ifndef KETI_CLONE_H
+#define KETI_CLONE_H
+
+#include <string>
+
+#include "my_inttypes.h"
+
+class Keti_table_versions;
+class Keti_trx;
+
+struct keti_clone_stats_t {
+  ulonglong clones;           ///< Tables cloned
+  ulonglong segments_shared;  ///< Segments they share with their sources
+};
+
+extern keti_clone_stats_t keti_clone_stats;
+
+/**
+  Make clone, a new table, share the rows of source that trx sees.
+
+  @param versions  of source
+*/
+int keti_clone_table(const std::string &source, const std::string &clone,
+                     const Keti_table_versions &versions, const Keti_trx *trx);
+
+#endif /* KETI_CLONE_H */
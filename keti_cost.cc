@@ -0,0 +1,188 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_cost.cc
+
+    @brief
+  Calibration of the KETI cost constants.
+
+    @details
+  Three quantities are measured:
+    - copying one KETI_BLOCK_SIZE block in host memory,
+    - fetching one block from the CSD (GET /probe?bytes=N),
+    - having the CSD read one block but return nothing
+      (GET /probe?bytes=N&selectivity=0), i.e. the cost left when a pushed
+      condition rejects every row.
+  The memory block read cost keeps the server default and anchors the scale;
+  the CSD read is priced relative to it, and the pushdown saving is the part
+  of a CSD read that disappears when the node filters everything out.
+*/
+
+#include "storage/keti/keti_cost.h"
+
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "m_string.h"
+#include "sql/opt_costconstantcache.h"
+#include "storage/keti/keti_csd.h"
+#include "template_utils.h"
+
+keti_costs_t keti_costs = {KETI_MEMORY_BLOCK_READ_COST,
+                           KETI_IO_BLOCK_READ_COST, KETI_PUSHDOWN_FILTER_SAVING,
+                           false};
+
+bool srv_calibrate_costs = true;
+
+/** Number of timed requests per probe, after one warm-up request. */
+static const uint PROBE_SAMPLES = 8;
+
+/** Bounds on the calibrated io_block_read_cost / memory_block_read_cost. */
+static const double MIN_IO_TO_MEMORY_RATIO = 1.0;
+static const double MAX_IO_TO_MEMORY_RATIO = 100.0;
+
+static const double MAX_PUSHDOWN_FILTER_SAVING = 0.95;
+
+static const LEX_CSTRING PUSHDOWN_FILTER_SAVING_NAME = {
+    STRING_WITH_LEN("pushdown_filter_saving")};
+
+Keti_cost_constants::Keti_cost_constants()
+    : m_pushdown_filter_saving(keti_costs.pushdown_filter_saving),
+      m_pushdown_filter_saving_default(!keti_costs.calibrated) {
+  if (!keti_costs.calibrated) return;
+
+  /*
+    Calibrated values are engine specific: rows for engine_name='default' in
+    mysql.engine_cost must not replace them, rows for 'KETI' still do.
+  */
+  static const LEX_CSTRING memory_name = {
+      STRING_WITH_LEN("memory_block_read_cost")};
+  static const LEX_CSTRING io_name = {STRING_WITH_LEN("io_block_read_cost")};
+  SE_cost_constants::set(memory_name, keti_costs.memory_block_read_cost,
+                         false);
+  SE_cost_constants::set(io_name, keti_costs.io_block_read_cost, false);
+}
+
+cost_constant_error Keti_cost_constants::set(const LEX_CSTRING &name,
+                                             const double value,
+                                             bool default_value) {
+  if (name.length != PUSHDOWN_FILTER_SAVING_NAME.length ||
+      strncasecmp(name.str, PUSHDOWN_FILTER_SAVING_NAME.str, name.length) != 0)
+    return SE_cost_constants::set(name, value, default_value);
+
+  if (value < 0.0 || value >= 1.0) return INVALID_COST_VALUE;
+
+  if (default_value && !m_pushdown_filter_saving_default)
+    return COST_CONSTANT_OK;
+
+  m_pushdown_filter_saving = value;
+  m_pushdown_filter_saving_default = default_value;
+  return COST_CONSTANT_OK;
+}
+
+double keti_pushdown_filter_saving(const TABLE *table) {
+  const Cost_model_constants *constants =
+      cost_constant_cache->get_cost_constants();
+  const double saving = down_cast<const Keti_cost_constants *>(
+                            constants->get_se_cost_constants(table))
+                            ->pushdown_filter_saving();
+  cost_constant_cache->release_cost_constants(constants);
+  return saving;
+}
+
+static double median(std::vector<double> *samples) {
+  std::sort(samples->begin(), samples->end());
+  return (*samples)[samples->size() / 2];
+}
+
+/** Median time in microseconds of copying one block in memory. */
+static double time_memory_block_read() {
+  std::vector<unsigned char> src(KETI_BLOCK_SIZE, 0x5a);
+  std::vector<unsigned char> dst(KETI_BLOCK_SIZE);
+  std::vector<double> samples;
+  volatile unsigned char sink = 0;
+
+  for (uint i = 0; i < PROBE_SAMPLES; i++) {
+    static const uint copies = 256;
+    auto start = std::chrono::steady_clock::now();
+    for (uint j = 0; j < copies; j++) {
+      src[j] = static_cast<unsigned char>(j);
+      memcpy(dst.data(), src.data(), KETI_BLOCK_SIZE);
+      sink = sink + dst[j];
+    }
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+    samples.push_back(elapsed.count() / copies);
+  }
+  return median(&samples);
+}
+
+/** Median time in microseconds of a probe request, or < 0 on failure. */
+static double time_csd_request(const std::string &path) {
+  std::vector<double> samples;
+  std::vector<unsigned char> body;
+
+  if (csd_get(path, &body)) return -1.0;
+
+  for (uint i = 0; i < PROBE_SAMPLES; i++) {
+    auto start = std::chrono::steady_clock::now();
+    if (csd_get(path, &body)) return -1.0;
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+    samples.push_back(elapsed.count());
+  }
+  return median(&samples);
+}
+
+void keti_calibrate_costs() {
+  if (!srv_calibrate_costs) return;
+
+  const std::string block_path =
+      "/probe?bytes=" + std::to_string(KETI_BLOCK_SIZE);
+  const double memory_usec = time_memory_block_read();
+  const double io_usec = time_csd_request(block_path);
+  const double filtered_usec = time_csd_request(block_path + "&selectivity=0");
+
+  if (io_usec <= 0.0 || filtered_usec < 0.0) {
+    keti_log(WARNING_LEVEL,
+             "cost probe of %s failed; using default cost constants",
+             srv_csd_url);
+    return;
+  }
+
+  const double ratio =
+      std::min(std::max(io_usec / std::max(memory_usec, 0.001),
+                        MIN_IO_TO_MEMORY_RATIO),
+               MAX_IO_TO_MEMORY_RATIO);
+  keti_costs.memory_block_read_cost = KETI_MEMORY_BLOCK_READ_COST;
+  keti_costs.io_block_read_cost = KETI_MEMORY_BLOCK_READ_COST * ratio;
+  keti_costs.pushdown_filter_saving = std::min(
+      std::max(1.0 - filtered_usec / io_usec, 0.0), MAX_PUSHDOWN_FILTER_SAVING);
+  keti_costs.calibrated = true;
+
+  keti_log(INFORMATION_LEVEL,
+           "calibrated cost constants: memory_block_read_cost %.3f, "
+           "io_block_read_cost %.3f, pushdown_filter_saving %.3f",
+           keti_costs.memory_block_read_cost, keti_costs.io_block_read_cost,
+           keti_costs.pushdown_filter_saving);
+}
+
+SE_cost_constants *keti_get_cost_constants(uint) {
+  return new Keti_cost_constants();
+}
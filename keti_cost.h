@@ -0,0 +1,98 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_cost.h
+
+    @brief
+  Optimizer cost constants for KETI tables.
+
+    @details
+  The server asks each engine for its SE cost constants through
+  handlerton::get_cost_constants. KETI answers with values measured by a
+  short probe of the storage node at plugin startup, so that a CSD block read
+  is priced as what it is rather than as an InnoDB page read. Rows in
+  mysql.engine_cost with engine_name='KETI' still take precedence, and
+  additionally accept the engine specific constant pushdown_filter_saving.
+*/
+
+#ifndef KETI_COST_H
+#define KETI_COST_H
+
+#include "my_inttypes.h"
+#include "sql/opt_costconstants.h"
+
+struct TABLE;
+
+/** Constants used when calibration is disabled or the probe fails. */
+static const double KETI_MEMORY_BLOCK_READ_COST = 0.25;
+static const double KETI_IO_BLOCK_READ_COST = 1.0;
+static const double KETI_PUSHDOWN_FILTER_SAVING = 0.5;
+
+/**
+  Calibrated KETI cost constants, filled by keti_calibrate_costs(). They seed
+  every Keti_cost_constants; overrides from mysql.engine_cost only change
+  those.
+*/
+struct keti_costs_t {
+  double memory_block_read_cost;
+  double io_block_read_cost;
+  /**
+    Fraction of the transfer cost of a block that is saved for every row the
+    CSD rejects while evaluating a pushed condition, in [0, 1).
+  */
+  double pushdown_filter_saving;
+  bool calibrated;
+};
+
+extern keti_costs_t keti_costs;
+extern bool srv_calibrate_costs;
+
+/** @brief
+  SE cost constants for KETI tables.
+*/
+class Keti_cost_constants : public SE_cost_constants {
+ public:
+  Keti_cost_constants();
+
+  double pushdown_filter_saving() const { return m_pushdown_filter_saving; }
+
+ protected:
+  cost_constant_error set(const LEX_CSTRING &name, const double value,
+                          bool default_value);
+
+ private:
+  SE_cost_constants *clone() const { return new Keti_cost_constants(*this); }
+
+  double m_pushdown_filter_saving;
+  bool m_pushdown_filter_saving_default;
+};
+
+/**
+  Measure memory and CSD block read times and derive keti_costs from them.
+  Leaves the defaults in place if keti_calibrate_costs is OFF or the storage
+  node does not answer within keti_csd_timeout.
+*/
+void keti_calibrate_costs();
+
+/**
+  pushdown_filter_saving of the cost constants in effect for table, with the
+  overrides of mysql.engine_cost as last read by FLUSH OPTIMIZER_COSTS.
+*/
+double keti_pushdown_filter_saving(const TABLE *table);
+
+/** handlerton::get_cost_constants. The server owns the returned object. */
+SE_cost_constants *keti_get_cost_constants(uint storage_category);
+
+#endif /* KETI_COST_H */
@@ -0,0 +1,447 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_csd.cc
+
+    @brief
+  HTTP transport to the KETI storage node.
+*/
+
+#include "storage/keti/keti_csd.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <mutex>
+
+#include <cpprest/http_client.h>
+
+#include "my_base.h"
+#include "my_byteorder.h"
+#define LOG_COMPONENT_TAG "keti"
+
+#include "mysql/components/services/log_builtins.h"
+#include "mysqld_error.h"
+
+using namespace web;
+using namespace web::http;
+using namespace web::http::client;
+
+char *srv_csd_url = NULL;
+ulong srv_csd_timeout = 5;
+
+std::string csd_table_name(const char *path) {
+  if (strncmp(path, "./", 2) == 0) path += 2;
+  return path;
+}
+
+/** Request path of a table resource, with the table name escaped. */
+static std::string table_path(const std::string &table) {
+  return "/tables/" + utility::conversions::to_utf8string(uri::encode_data_string(
+                          utility::conversions::to_string_t(table)));
+}
+
+/*
+  Idle connections to the storage node. cpprest keeps the underlying
+  connection of an http_client alive, so reusing clients saves a TCP
+  handshake per request.
+*/
+static std::mutex session_mutex;
+static std::vector<std::unique_ptr<http_client>> idle_sessions;
+
+/** @brief
+  A pooled connection, returned to the pool when the guard goes away.
+*/
+class Csd_session {
+ public:
+  Csd_session() {
+    std::lock_guard<std::mutex> guard(session_mutex);
+    if (!idle_sessions.empty()) {
+      m_client = std::move(idle_sessions.back());
+      idle_sessions.pop_back();
+    }
+  }
+
+  ~Csd_session() {
+    if (!m_client) return;
+    std::lock_guard<std::mutex> guard(session_mutex);
+    idle_sessions.push_back(std::move(m_client));
+  }
+
+  http_client &client() {
+    if (!m_client) {
+      http_client_config config;
+      config.set_timeout(std::chrono::seconds(srv_csd_timeout));
+      m_client.reset(new http_client(
+          utility::conversions::to_string_t(srv_csd_url), config));
+    }
+    return *m_client;
+  }
+
+  /** Do not return a connection in an unknown state to the pool. */
+  void discard() { m_client.reset(); }
+
+ private:
+  std::unique_ptr<http_client> m_client;
+};
+
+/**
+  Send a request on a pooled connection.
+
+  @param body      request payload, consumed; NULL for none
+  @param response  if not NULL, receives the response payload
+*/
+static int csd_request(const method &mtd, const std::string &path,
+                       std::vector<unsigned char> *body,
+                       std::vector<unsigned char> *response) {
+  Csd_session session;
+  try {
+    http_request request(mtd);
+    request.set_request_uri(utility::conversions::to_string_t(path));
+    if (body != NULL) request.set_body(std::move(*body));
+
+    http_response resp = session.client().request(request).get();
+    if (resp.status_code() == status_codes::NotFound)
+      return HA_ERR_NO_SUCH_TABLE;
+    if (resp.status_code() != status_codes::OK &&
+        resp.status_code() != status_codes::Created)
+      return HA_ERR_INTERNAL_ERROR;
+    if (response != NULL) *response = resp.extract_vector().get();
+  } catch (const std::exception &e) {
+    session.discard();
+    keti_log(WARNING_LEVEL, "%s %s failed: %s",
+             utility::conversions::to_utf8string(mtd).c_str(), path.c_str(),
+             e.what());
+    return HA_ERR_NO_CONNECTION;
+  }
+  return 0;
+}
+
+int csd_get(const std::string &path, std::vector<unsigned char> *body) {
+  return csd_request(methods::GET, path, NULL, body);
+}
+
+int csd_post(const std::string &path, std::vector<unsigned char> *body,
+             std::vector<unsigned char> *response) {
+  return csd_request(methods::POST, path, body, response);
+}
+
+void csd_close_sessions() {
+  std::lock_guard<std::mutex> guard(session_mutex);
+  idle_sessions.clear();
+}
+
+int csd_read_manifest(const std::string &table,
+                      std::vector<Keti_segment> *segments) {
+  std::vector<unsigned char> body;
+  int rc = csd_get(table_path(table) + "/manifest", &body);
+  if (rc) return rc;
+
+  /* {"segments": [{"id": 1, "blocks": 12, "rows": 4711}, ...]} */
+  try {
+    const json::value manifest = json::value::parse(
+        utility::conversions::to_string_t(std::string(body.begin(), body.end())));
+    segments->clear();
+    for (const json::value &entry :
+         manifest.at(U("segments")).as_array()) {
+      Keti_segment segment;
+      segment.id = static_cast<uint32>(entry.at(U("id")).as_number().to_uint64());
+      segment.blocks =
+          static_cast<uint32>(entry.at(U("blocks")).as_number().to_uint64());
+      segment.rows = entry.at(U("rows")).as_number().to_uint64();
+      segments->push_back(segment);
+    }
+  } catch (const std::exception &e) {
+    keti_log(ERROR_LEVEL, "bad manifest for %s: %s", table.c_str(), e.what());
+    return HA_ERR_CRASHED;
+  }
+  return 0;
+}
+
+int csd_read_block(const std::string &table, uint32 segment, uint32 block,
+                   std::vector<unsigned char> *data) {
+  return csd_get(table_path(table) + "/segments/" + std::to_string(segment) +
+                     "/blocks/" + std::to_string(block),
+                 data);
+}
+
+int csd_read_projected(const std::string &table, uint32 segment, uint32 block,
+                       std::vector<unsigned char> *projection,
+                       std::vector<unsigned char> *reply) {
+  return csd_post(table_path(table) + "/segments/" + std::to_string(segment) +
+                      "/blocks/" + std::to_string(block) + "/project",
+                  projection, reply);
+}
+
+/** Read the id out of a reply of the form {"id": 42}. */
+static int parse_segment_id(const std::string &table,
+                            const std::vector<unsigned char> &response,
+                            uint32 *segment) {
+  try {
+    const json::value reply =
+        json::value::parse(utility::conversions::to_string_t(
+            std::string(response.begin(), response.end())));
+    *segment = static_cast<uint32>(reply.at(U("id")).as_number().to_uint64());
+  } catch (const std::exception &e) {
+    keti_log(ERROR_LEVEL, "bad reply to segment write for %s: %s",
+             table.c_str(), e.what());
+    return HA_ERR_INTERNAL_ERROR;
+  }
+  return 0;
+}
+
+/** Append a list of segment ids, preceded by their count, to body. */
+static void pack_segment_ids(const std::vector<uint32> &segments,
+                             std::vector<unsigned char> *body) {
+  size_t offset = body->size();
+  body->resize(offset + 4 * (segments.size() + 1));
+  int4store(&(*body)[offset], static_cast<uint32>(segments.size()));
+  for (uint32 segment : segments) int4store(&(*body)[offset += 4], segment);
+}
+
+int csd_stage_segment(const std::string &table,
+                      std::vector<unsigned char> *blocks, uint32 *segment) {
+  std::vector<unsigned char> response;
+  int rc =
+      csd_post(table_path(table) + "/segments/stage", blocks, &response);
+  if (rc) return rc;
+  return parse_segment_id(table, response, segment);
+}
+
+int csd_attach_segments(const std::string &table,
+                        const std::vector<uint32> &segments) {
+  std::vector<unsigned char> body;
+  pack_segment_ids(segments, &body);
+  return csd_post(table_path(table) + "/segments/attach", &body, NULL);
+}
+
+int csd_discard_segments(const std::string &table,
+                         const std::vector<uint32> &segments) {
+  std::vector<unsigned char> body;
+  pack_segment_ids(segments, &body);
+  return csd_post(table_path(table) + "/segments/discard", &body, NULL);
+}
+
+int csd_commit(std::vector<unsigned char> *request) {
+  return csd_post("/commit", request, NULL);
+}
+
+int csd_write_bitmaps(const std::string &table, uint32 segment,
+                      std::vector<unsigned char> *bitmaps) {
+  return csd_post(
+      table_path(table) + "/segments/" + std::to_string(segment) + "/bitmaps",
+      bitmaps, NULL);
+}
+
+int csd_read_bitmaps(const std::string &table,
+                     const std::vector<uint32> &segments,
+                     std::vector<unsigned char> *terms,
+                     std::vector<unsigned char> *reply) {
+  std::vector<unsigned char> body;
+  pack_segment_ids(segments, &body);
+  body.insert(body.end(), terms->begin(), terms->end());
+  terms->clear();
+  return csd_post(table_path(table) + "/bitmaps/lookup", &body, reply);
+}
+
+int csd_write_postings(const std::string &table, uint32 segment,
+                       std::vector<unsigned char> *postings) {
+  return csd_post(table_path(table) + "/segments/" +
+                      std::to_string(segment) + "/postings",
+                  postings, NULL);
+}
+
+int csd_search_postings(const std::string &table,
+                        const std::vector<uint32> &segments,
+                        std::vector<unsigned char> *search,
+                        std::vector<unsigned char> *reply) {
+  std::vector<unsigned char> body;
+  pack_segment_ids(segments, &body);
+  body.insert(body.end(), search->begin(), search->end());
+  search->clear();
+  return csd_post(table_path(table) + "/postings/search", &body, reply);
+}
+
+int csd_write_fulltext(const std::string &table, uint32 segment,
+                       std::vector<unsigned char> *index) {
+  return csd_post(table_path(table) + "/segments/" +
+                      std::to_string(segment) + "/fulltext",
+                  index, NULL);
+}
+
+int csd_fulltext_stats(const std::string &table,
+                       const std::vector<uint32> &segments,
+                       std::vector<unsigned char> *terms,
+                       std::vector<unsigned char> *reply) {
+  std::vector<unsigned char> body;
+  pack_segment_ids(segments, &body);
+  body.insert(body.end(), terms->begin(), terms->end());
+  terms->clear();
+  return csd_post(table_path(table) + "/fulltext/stats", &body, reply);
+}
+
+int csd_fulltext_search(const std::string &table,
+                        const std::vector<uint32> &segments,
+                        std::vector<unsigned char> *search,
+                        std::vector<unsigned char> *reply) {
+  std::vector<unsigned char> body;
+  pack_segment_ids(segments, &body);
+  body.insert(body.end(), search->begin(), search->end());
+  search->clear();
+  return csd_post(table_path(table) + "/fulltext/search", &body, reply);
+}
+
+int csd_write_vectors(const std::string &table, uint32 segment,
+                      std::vector<unsigned char> *vectors) {
+  return csd_post(
+      table_path(table) + "/segments/" + std::to_string(segment) + "/vectors",
+      vectors, NULL);
+}
+
+int csd_search_vectors(const std::string &table,
+                       const std::vector<uint32> &segments,
+                       std::vector<unsigned char> *search,
+                       std::vector<unsigned char> *reply) {
+  std::vector<unsigned char> body;
+  pack_segment_ids(segments, &body);
+  body.insert(body.end(), search->begin(), search->end());
+  search->clear();
+  return csd_post(table_path(table) + "/vectors/search", &body, reply);
+}
+
+int csd_write_stats(const std::string &table, uint32 segment,
+                    std::vector<unsigned char> *stats) {
+  return csd_post(
+      table_path(table) + "/segments/" + std::to_string(segment) + "/stats",
+      stats, NULL);
+}
+
+int csd_read_stats(const std::string &table,
+                   std::vector<unsigned char> *reply) {
+  return csd_get(table_path(table) + "/stats", reply);
+}
+
+int csd_replace_segments(const std::string &table,
+                         const std::vector<uint32> &sources,
+                         std::vector<unsigned char> *moves,
+                         std::vector<unsigned char> *blocks, uint32 *segment) {
+  /* sources, moves and blocks, each but the last preceded by its length */
+  std::vector<unsigned char> body;
+  pack_segment_ids(sources, &body);
+  const size_t offset = body.size();
+  body.resize(offset + 4);
+  int4store(&body[offset], static_cast<uint32>(moves->size()));
+  body.insert(body.end(), moves->begin(), moves->end());
+  body.insert(body.end(), blocks->begin(), blocks->end());
+  moves->clear();
+  blocks->clear();
+
+  std::vector<unsigned char> response;
+  int rc =
+      csd_post(table_path(table) + "/segments/replace", &body, &response);
+  if (rc) return rc;
+  return parse_segment_id(table, response, segment);
+}
+
+int csd_retire_segments(const std::string &table,
+                        const std::vector<uint32> &segments) {
+  std::vector<unsigned char> body;
+  pack_segment_ids(segments, &body);
+  return csd_post(table_path(table) + "/segments/retire", &body, NULL);
+}
+
+int csd_clone_table(const std::string &table,
+                    std::vector<unsigned char> *request) {
+  return csd_post(table_path(table) + "/clone", request, NULL);
+}
+
+int csd_drop_table(const std::string &table) {
+  return csd_post(table_path(table) + "/drop", NULL, NULL);
+}
+
+int csd_external_scan(std::vector<unsigned char> *request,
+                      std::vector<unsigned char> *reply) {
+  return csd_post("/external/scan", request, reply);
+}
+
+int csd_external_rows(std::vector<unsigned char> *request,
+                      std::vector<unsigned char> *reply) {
+  return csd_post("/external/rows", request, reply);
+}
+
+int csd_start_export(const std::string &table,
+                     std::vector<unsigned char> *request, uint32 *id) {
+  std::vector<unsigned char> response;
+  int rc = csd_post(table_path(table) + "/export", request, &response);
+  if (rc) return rc;
+  return parse_segment_id(table, response, id);
+}
+
+int csd_export_progress(uint32 id, std::vector<unsigned char> *progress) {
+  std::vector<unsigned char> body;
+  return csd_post("/exports/" + std::to_string(id), &body, progress);
+}
+
+int csd_cancel_export(uint32 id) {
+  std::vector<unsigned char> body;
+  return csd_post("/exports/" + std::to_string(id) + "/cancel", &body, NULL);
+}
+
+int csd_read_deltas(const std::string &table,
+                    std::vector<unsigned char> *deltas) {
+  return csd_get(table_path(table) + "/deltas", deltas);
+}
+
+int csd_read_tombstones(const std::string &table,
+                        std::vector<unsigned char> *rows) {
+  return csd_get(table_path(table) + "/tombstones", rows);
+}
+
+int csd_purge(const std::string &table, std::vector<unsigned char> *rows) {
+  return csd_post(table_path(table) + "/purge", rows, NULL);
+}
+
+int csd_write_index_changes(const std::string &table, uint field,
+                            std::vector<unsigned char> *changes) {
+  return csd_post(table_path(table) + "/indexes/" + std::to_string(field) +
+                      "/changes",
+                  changes, NULL);
+}
+
+int csd_checkpoint() { return csd_post("/checkpoint", NULL, NULL); }
+
+/* The error log, as a plugin reaches it */
+static SERVICE_TYPE(registry) *reg_srv = nullptr;
+static SERVICE_TYPE(log_builtins) *log_bi = nullptr;
+static SERVICE_TYPE(log_builtins_string) *log_bs = nullptr;
+
+bool keti_log_init() {
+  return init_logging_service_for_plugin(&reg_srv, &log_bi, &log_bs);
+}
+
+void keti_log_deinit() {
+  deinit_logging_service_for_plugin(&reg_srv, &log_bi, &log_bs);
+}
+
+void keti_log(enum loglevel level, const char *format, ...) {
+  if (log_bi == nullptr) return;
+  char msg[512];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(msg, sizeof(msg), format, args);
+  va_end(args);
+  LogPluginErr(level, ER_LOG_PRINTF_MSG, msg);
+}
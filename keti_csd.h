@@ -0,0 +1,424 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_csd.h
+
+    @brief
+  Client side of the protocol spoken by the KETI computational storage
+  device (CSD).
+
+    @details
+  The storage node is reached over HTTP at keti_csd_url, on connections
+  kept in a pool between requests. All helpers here are synchronous, bounded
+  by keti_csd_timeout, and return 0 or a HA_ERR_* code; cpprest exceptions
+  never escape into the handler.
+*/
+
+#ifndef KETI_CSD_H
+#define KETI_CSD_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "my_base.h" /* ha_rows */
+#include "my_compiler.h"
+#include "my_inttypes.h"
+#include "my_loglevel.h"
+
+/** Unit of I/O between the host and the CSD, and of the optimizer's costs. */
+static const size_t KETI_BLOCK_SIZE = 16 * 1024;
+
+extern char *srv_csd_url;
+extern ulong srv_csd_timeout;
+
+/** @brief
+  One immutable segment of a table, as listed in its manifest.
+*/
+struct Keti_segment {
+  uint32 id;
+  uint32 blocks;
+  ha_rows rows;
+};
+
+/** Name of a table on the storage node, from its path in the server. */
+std::string csd_table_name(const char *path);
+
+/**
+  Issue a GET against the storage node.
+
+  @param path  request path and query, relative to keti_csd_url
+  @param body  if not NULL, receives the response payload
+
+  @return 0, HA_ERR_NO_CONNECTION if the node could not be reached,
+          HA_ERR_NO_SUCH_TABLE if the resource does not exist or
+          HA_ERR_INTERNAL_ERROR if it answered with another error status
+*/
+int csd_get(const std::string &path, std::vector<unsigned char> *body);
+
+/**
+  Issue a POST against the storage node.
+
+  @param body      request payload, consumed; NULL for none
+  @param response  if not NULL, receives the response payload
+
+  @return as csd_get()
+*/
+int csd_post(const std::string &path, std::vector<unsigned char> *body,
+             std::vector<unsigned char> *response);
+
+/** Drop the idle pooled connections to the storage node. */
+void csd_close_sessions();
+
+/**
+  Read the list of segments of a table (GET /tables/{table}/manifest).
+
+  @return 0, HA_ERR_NO_SUCH_TABLE if the node does not know the table, or
+          an error of csd_get()
+*/
+int csd_read_manifest(const std::string &table,
+                      std::vector<Keti_segment> *segments);
+
+/** Read one block of a segment (GET /tables/{table}/segments/{id}/blocks/{n}). */
+int csd_read_block(const std::string &table, uint32 segment, uint32 block,
+                   std::vector<unsigned char> *data);
+
+/**
+  Read the parts of the rows of a block a scan needs
+  (POST /tables/{table}/segments/{id}/blocks/{n}/project), see
+  keti_project.h.
+
+  @param projection  the ranges of the record to send, as their count in 2
+                     bytes and each as offset and length in 2 bytes, then
+                     the number of BLOB columns in 2 bytes and how many
+                     bytes of each to send in 4; consumed
+  @param reply       receives the rows
+*/
+int csd_read_projected(const std::string &table, uint32 segment, uint32 block,
+                       std::vector<unsigned char> *projection,
+                       std::vector<unsigned char> *reply);
+
+/**
+  Send a segment of a table that is not to be part of it yet
+  (POST /tables/{table}/segments/stage). The node creates the table on its
+  first segment. A staged segment takes indexes and is read by id like any
+  other, but is not in the manifest before it is attached; the node drops
+  staged segments that are neither attached nor discarded when it restarts.
+
+  @param blocks   the blocks of the segment, each preceded by its length in
+                  4 bytes; consumed
+  @param segment  receives the id the node assigned to the segment
+*/
+int csd_stage_segment(const std::string &table,
+                      std::vector<unsigned char> *blocks, uint32 *segment);
+
+/**
+  Add staged segments to the manifest of a table, in one manifest update
+  (POST /tables/{table}/segments/attach).
+*/
+int csd_attach_segments(const std::string &table,
+                        const std::vector<uint32> &segments);
+
+/**
+  Drop staged segments that are not to be attached
+  (POST /tables/{table}/segments/discard). Index changes of their rows the
+  node is sent later are ignored.
+*/
+int csd_discard_segments(const std::string &table,
+                         const std::vector<uint32> &segments);
+
+/**
+  Commit the changes of a transaction to all the tables it changed, all or
+  none of them (POST /commit).
+
+  @param request  in the format of keti_trx.h; consumed
+*/
+int csd_commit(std::vector<unsigned char> *request);
+
+/**
+  Store the bitmap indexes of a segment
+  (POST /tables/{table}/segments/{id}/bitmaps).
+
+  @param bitmaps  as built by Keti_bitmap_index::take(); consumed
+*/
+int csd_write_bitmaps(const std::string &table, uint32 segment,
+                      std::vector<unsigned char> *bitmaps);
+
+/**
+  Look up values in the bitmap indexes of segments
+  (POST /tables/{table}/bitmaps/lookup).
+
+  @param terms  for each value, its column in 2 bytes and its key preceded
+                by its length in 4 bytes; consumed
+  @param reply  receives, for each segment and then each value, the bitmap
+                as packed by Keti_bitmap::pack() preceded by its length in 4
+                bytes, or a length of 0xFFFFFFFF if the segment has no index
+                on the column
+*/
+int csd_read_bitmaps(const std::string &table,
+                     const std::vector<uint32> &segments,
+                     std::vector<unsigned char> *terms,
+                     std::vector<unsigned char> *reply);
+
+/**
+  Store the inverted indexes of a segment
+  (POST /tables/{table}/segments/{id}/postings).
+
+  @param postings  as built by Keti_posting_index::take(); consumed
+*/
+int csd_write_postings(const std::string &table, uint32 segment,
+                       std::vector<unsigned char> *postings);
+
+/**
+  Find the rows of segments that carry tags
+  (POST /tables/{table}/postings/search).
+
+  @param search  the search as built by Keti_tag_search; consumed
+  @param reply   receives, for each segment, the row numbers of its matching
+                 rows as packed by keti_pack_postings(), or a row count of
+                 0xFFFFFFFF if the segment has no index on a searched column
+*/
+int csd_search_postings(const std::string &table,
+                        const std::vector<uint32> &segments,
+                        std::vector<unsigned char> *search,
+                        std::vector<unsigned char> *reply);
+
+/**
+  Store the FULLTEXT indexes of a segment
+  (POST /tables/{table}/segments/{id}/fulltext).
+
+  @param index  as built by Keti_fulltext_index::take(); consumed
+*/
+int csd_write_fulltext(const std::string &table, uint32 segment,
+                       std::vector<unsigned char> *index);
+
+/**
+  Count rows, words and rows holding each of some words in the FULLTEXT
+  indexes of segments (POST /tables/{table}/fulltext/stats).
+
+  @param terms  the key number in 2 bytes, then the number of words in 4
+                bytes and each word preceded by its length in 4; consumed
+  @param reply  receives, for each segment, its row count in 4 bytes, or
+                0xFFFFFFFF if it has no index on the key, then its word
+                count in 8 bytes and per word the rows holding it in 4
+*/
+int csd_fulltext_stats(const std::string &table,
+                       const std::vector<uint32> &segments,
+                       std::vector<unsigned char> *terms,
+                       std::vector<unsigned char> *reply);
+
+/**
+  Score the rows of segments with BM25
+  (POST /tables/{table}/fulltext/search), see keti_fulltext.h.
+
+  @param search  the search as built by Keti_ft_search; consumed
+  @param reply   receives, for each segment, the number of its matching rows
+                 in 4 bytes, at most the limit of the search, then per row
+                 by descending score and then position its block and offset
+                 in 4 bytes each and its score as a double
+*/
+int csd_fulltext_search(const std::string &table,
+                        const std::vector<uint32> &segments,
+                        std::vector<unsigned char> *search,
+                        std::vector<unsigned char> *reply);
+
+/**
+  Hand the vectors of a segment to the node to index
+  (POST /tables/{table}/segments/{id}/vectors).
+
+  @param vectors  as built by Keti_vector_index::take(); consumed
+*/
+int csd_write_vectors(const std::string &table, uint32 segment,
+                      std::vector<unsigned char> *vectors);
+
+/**
+  Find the rows of segments nearest to a vector
+  (POST /tables/{table}/vectors/search), see keti_vector.h.
+
+  @param search  the search as built by Keti_vector_search; consumed
+  @param reply   receives, for each segment, the number of rows found in 4
+                 bytes, or 0xFFFFFFFF if it has no index on the column of
+                 the dimension of the search, then per row its number in 4
+                 bytes and its distance as a double, then the number of
+                 its unindexed rows in 4 bytes and their numbers in 4 bytes
+                 each
+*/
+int csd_search_vectors(const std::string &table,
+                       const std::vector<uint32> &segments,
+                       std::vector<unsigned char> *search,
+                       std::vector<unsigned char> *reply);
+
+/**
+  Store the statistics of a segment
+  (POST /tables/{table}/segments/{id}/stats).
+
+  @param stats  as built by Keti_row_stats::pack(); consumed
+*/
+int csd_write_stats(const std::string &table, uint32 segment,
+                    std::vector<unsigned char> *stats);
+
+/**
+  Read the statistics of the segments of a table (GET /tables/{table}/stats).
+  The node lowers the row count of a segment for every row purged from it,
+  and gives a segment replaced by compaction the statistics of its sources.
+
+  @param reply  receives the number of segments in 4 bytes, then per segment
+                its id and the length of its statistics in 4 bytes each and
+                the statistics as csd_write_stats() stored them
+
+  @retval HA_ERR_NO_SUCH_TABLE  the table has no segments
+*/
+int csd_read_stats(const std::string &table,
+                   std::vector<unsigned char> *reply);
+
+/**
+  Replace segments of a table by one new segment, in one manifest update
+  (POST /tables/{table}/segments/replace). Readers that listed the manifest
+  before may keep reading the replaced segments until csd_retire_segments().
+
+  @param sources  segments the new one replaces
+  @param moves    for every row kept, its old position followed by its
+                  position in blocks with a segment id of 0, KETI_REF_LENGTH
+                  bytes each; the node rewrites its indexes and the bitmap,
+                  inverted, FULLTEXT and vector indexes of the segments
+                  accordingly; consumed
+  @param blocks   as for csd_stage_segment(); consumed
+  @param segment  receives the id of the new segment
+*/
+int csd_replace_segments(const std::string &table,
+                         const std::vector<uint32> &sources,
+                         std::vector<unsigned char> *moves,
+                         std::vector<unsigned char> *blocks, uint32 *segment);
+
+/**
+  Let the node delete segments replaced by csd_replace_segments()
+  (POST /tables/{table}/segments/retire), once no clone shares them.
+*/
+int csd_retire_segments(const std::string &table,
+                        const std::vector<uint32> &segments);
+
+/**
+  Make table a clone sharing segments of another table
+  (POST /tables/{table}/clone), see keti_clone.h.
+
+  @param request  consumed
+*/
+int csd_clone_table(const std::string &table,
+                    std::vector<unsigned char> *request);
+
+/**
+  Drop a table on the node (POST /tables/{table}/drop): its manifest, delta
+  log, tombstone log, statistics and indexes. Segments a clone still shares
+  are deleted with the last table using them.
+
+  @retval HA_ERR_NO_SUCH_TABLE  the node never stored anything of the table
+*/
+int csd_drop_table(const std::string &table);
+
+/**
+  Read a batch of rows of external files (POST /external/scan), see
+  keti_external.h.
+
+  @param request  consumed
+*/
+int csd_external_scan(std::vector<unsigned char> *request,
+                      std::vector<unsigned char> *reply);
+
+/**
+  Read rows of external files by their ids (POST /external/rows), see
+  keti_external.h.
+
+  @param request  consumed
+*/
+int csd_external_rows(std::vector<unsigned char> *request,
+                      std::vector<unsigned char> *reply);
+
+/**
+  Have the node export rows of table to a file of its own
+  (POST /tables/{table}/export), see keti_export.h.
+
+  @param request  consumed
+  @param id       receives the id of the export
+*/
+int csd_start_export(const std::string &table,
+                     std::vector<unsigned char> *request, uint32 *id);
+
+/** Read how far an export got (POST /exports/{id}). */
+int csd_export_progress(uint32 id, std::vector<unsigned char> *progress);
+
+/** Stop an export and remove its file (POST /exports/{id}/cancel). */
+int csd_cancel_export(uint32 id);
+
+/**
+  Read the delta log of a table (GET /tables/{table}/deltas).
+
+  @retval HA_ERR_NO_SUCH_TABLE  the table has no delta log
+*/
+int csd_read_deltas(const std::string &table,
+                    std::vector<unsigned char> *deltas);
+
+/**
+  Read the tombstones of a table the node has not reclaimed yet
+  (GET /tables/{table}/tombstones).
+
+  @retval HA_ERR_NO_SUCH_TABLE  the table has no tombstones
+*/
+int csd_read_tombstones(const std::string &table,
+                        std::vector<unsigned char> *rows);
+
+/**
+  Tell the node no reader can see deleted rows any more
+  (POST /tables/{table}/purge). It drops their index entries and reclaims
+  them when it next compacts their segments.
+
+  @param rows  positions, KETI_REF_LENGTH bytes each; consumed
+*/
+int csd_purge(const std::string &table, std::vector<unsigned char> *rows);
+
+/**
+  Merge changes into a secondary index of a table
+  (POST /tables/{table}/indexes/{field}/changes).
+
+  The node ignores the changes of rows of segments it discarded and the
+  deletions of entries of rows it has no tombstone for, which a replay of
+  the change buffer log may send, see keti_ibuf.h.
+
+  @param changes  changes in the format of keti_ibuf.cc, sorted by key with
+                  memcmp(); consumed
+*/
+int csd_write_index_changes(const std::string &table, uint field,
+                            std::vector<unsigned char> *changes);
+
+/**
+  Ask the node to make everything it acknowledged durable, so that it has
+  nothing to replay when it is next opened (POST /checkpoint).
+*/
+int csd_checkpoint();
+
+/**
+  Acquire the logging service; the plugin logs nothing before.
+
+  @return true on failure
+*/
+bool keti_log_init();
+
+/** Release the logging service. */
+void keti_log_deinit();
+
+/** Write a message of the keti component to the server error log. */
+void keti_log(enum loglevel level, const char *format, ...)
+    MY_ATTRIBUTE((format(printf, 2, 3)));
+
+#endif /* KETI_CSD_H */
@@ -0,0 +1,393 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_delta.cc
+
+    @brief
+  Detection, logging and merging of integer column deltas.
+*/
+
+#include "storage/keti/keti_delta.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "sql/field.h"
+#include "sql/item.h"
+#include "sql/item_cmpfunc.h"
+#include "sql/item_func.h"
+#include "sql/table.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_mvcc.h"
+#include "template_utils.h"
+
+static const size_t DELTA_STRIPES = 64;
+
+bool keti_delta_field(const Field *field) {
+  switch (field->real_type()) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool keti_delta_increment(const Field *field, const Item *value) {
+  if (value->type() != Item::FUNC_ITEM) return false;
+  const Item_func *func = static_cast<const Item_func *>(value);
+  if (func->arg_count != 2) return false;
+  const bool plus = strcmp(func->func_name(), "+") == 0;
+  if (!plus && strcmp(func->func_name(), "-") != 0) return false;
+
+  /* A constant of another type rounds differently from row to row */
+  Item **args = func->arguments();
+  for (uint i = 0; i < (plus ? 2U : 1U); i++) {
+    const Item *column = args[i]->real_item();
+    const Item *constant = args[1 - i];
+    if (column->type() != Item::FIELD_ITEM) continue;
+    const Field *read = static_cast<const Item_field *>(column)->field;
+    if (read->table == field->table &&
+        read->field_index == field->field_index && constant->const_item() &&
+        constant->result_type() == INT_RESULT)
+      return true;
+  }
+  return false;
+}
+
+bool keti_delta_reads(const Item *item, const TABLE *table,
+                      const std::vector<uint16> &columns) {
+  const Item *real = item->real_item();
+  if (real->const_item()) return false;
+
+  switch (real->type()) {
+    case Item::FIELD_ITEM: {
+      const Field *field = static_cast<const Item_field *>(real)->field;
+      return field->table == table &&
+             std::find(columns.begin(), columns.end(), field->field_index) !=
+                 columns.end();
+    }
+    case Item::COND_ITEM: {
+      const Item_cond *cond = static_cast<const Item_cond *>(real);
+      List_iterator<Item> li(*const_cast<Item_cond *>(cond)->argument_list());
+      Item *arg;
+      while ((arg = li++))
+        if (keti_delta_reads(arg, table, columns)) return true;
+      return false;
+    }
+    case Item::FUNC_ITEM: {
+      const Item_func *func = static_cast<const Item_func *>(real);
+      for (uint i = 0; i < func->arg_count; i++)
+        if (keti_delta_reads(func->arguments()[i], table, columns))
+          return true;
+      return false;
+    }
+    default:
+      /* Subqueries and the like are not looked into */
+      return true;
+  }
+}
+
+static ulonglong load_int(const uchar *ptr, size_t length) {
+  ulonglong value = 0;
+  for (size_t i = length; i > 0; i--) value = (value << 8) | ptr[i - 1];
+  return value;
+}
+
+static void store_int(uchar *ptr, size_t length, ulonglong value) {
+  for (size_t i = 0; i < length; i++, value >>= 8)
+    ptr[i] = static_cast<uchar>(value);
+}
+
+bool keti_delta_update(TABLE *table, const uchar *old_data,
+                       const uchar *new_data, std::vector<Keti_delta> *deltas) {
+  deltas->clear();
+
+  /* NULL flags, and BIT columns that keep bits there, must not change */
+  if (memcmp(old_data, new_data, table->s->null_bytes) != 0) return false;
+
+  const ptrdiff_t old_offset = old_data - table->record[0];
+  const ptrdiff_t new_offset = new_data - table->record[0];
+  for (Field **field = table->field; *field; field++) {
+    if ((*field)->is_null(old_offset)) continue;
+
+    if ((*field)->flags & BLOB_FLAG) {
+      const Field_blob *blob = down_cast<Field_blob *>(*field);
+      const uint32 length = blob->get_length(old_offset);
+      if (length != blob->get_length(new_offset) ||
+          (length > 0 && memcmp(blob->get_blob_data(old_offset),
+                                blob->get_blob_data(new_offset), length) != 0))
+        return false;
+      continue;
+    }
+
+    const uchar *old_ptr = (*field)->ptr + old_offset;
+    const uchar *new_ptr = (*field)->ptr + new_offset;
+    const size_t length = (*field)->pack_length();
+    if (memcmp(old_ptr, new_ptr, length) == 0) continue;
+    if (!keti_delta_field(*field)) return false;
+
+    Keti_delta delta;
+    delta.field = static_cast<uint16>((*field)->field_index);
+    delta.value = load_int(new_ptr, length) - load_int(old_ptr, length);
+    deltas->push_back(delta);
+  }
+  return !deltas->empty();
+}
+
+void keti_delta_pack(const Keti_row_pos &pos, const Keti_delta &delta,
+                     std::vector<uchar> *out) {
+  const size_t start = out->size();
+  out->resize(start + KETI_DELTA_SIZE);
+  uchar *ptr = out->data() + start;
+  keti_store_pos(ptr, pos);
+  int2store(ptr + KETI_REF_LENGTH, delta.field);
+  int8store(ptr + KETI_REF_LENGTH + 2, delta.value);
+}
+
+void keti_delta_unpack(const uchar *ptr, Keti_row_pos *pos,
+                       Keti_delta *delta) {
+  *pos = keti_read_pos(ptr);
+  delta->field = uint2korr(ptr + KETI_REF_LENGTH);
+  delta->value = uint8korr(ptr + KETI_REF_LENGTH + 2);
+}
+
+size_t Keti_delta_store::Pos_hash::operator()(const Keti_row_pos &pos) const {
+  return (static_cast<size_t>(pos.segment) * 0x9E3779B97F4A7C15ULL) ^
+         (static_cast<size_t>(pos.block) << 20) ^ pos.offset;
+}
+
+bool Keti_delta_store::Pos_equal::operator()(const Keti_row_pos &a,
+                                             const Keti_row_pos &b) const {
+  return a.segment == b.segment && a.block == b.block && a.offset == b.offset;
+}
+
+Keti_delta_store::Keti_delta_store() : m_rows(0) {
+  for (size_t i = 0; i < DELTA_STRIPES; i++) m_stripes.emplace_back(new Stripe);
+}
+
+Keti_delta_store::Stripe &Keti_delta_store::stripe_of(
+    const Keti_row_pos &pos) const {
+  return *m_stripes[Pos_hash()(pos) % m_stripes.size()];
+}
+
+void Keti_delta_store::put(Stripe *stripe, std::vector<Entry> *row,
+                           const Entry &entry) {
+  if (row->empty()) m_rows++;
+  for (Entry &known : *row) {
+    if (known.delta.field != entry.delta.field ||
+        known.version != entry.version || known.trx != entry.trx)
+      continue;
+    known.delta.value += entry.delta.value;
+    return;
+  }
+  row->push_back(entry);
+  if (entry.version != 0) stripe->stamped++;
+}
+
+void Keti_delta_store::fold_row(Stripe *stripe, std::vector<Entry> *row,
+                                ulonglong low_watermark) {
+  for (size_t i = 0; i < row->size();) {
+    Entry &entry = (*row)[i];
+    if (entry.version == 0 || entry.version >= low_watermark) {
+      i++;
+      continue;
+    }
+    const Keti_delta delta = entry.delta;
+    row->erase(row->begin() + i);
+    stripe->stamped--;
+
+    bool summed = false;
+    for (Entry &known : *row) {
+      if (known.version != 0 || known.delta.field != delta.field) continue;
+      known.delta.value += delta.value;
+      summed = true;
+      break;
+    }
+    if (summed) continue;
+    /* Keep the summed up entries ahead of those still stamped */
+    const Entry folded = {delta, 0, 0};
+    row->insert(row->begin(), folded);
+    i++;
+  }
+}
+
+void Keti_delta_store::add(const Keti_row_pos &pos, const Keti_delta &delta) {
+  Stripe &stripe = stripe_of(pos);
+  std::lock_guard<std::mutex> guard(stripe.mutex);
+  const Entry entry = {delta, 0, 0};
+  put(&stripe, &stripe.rows[pos], entry);
+}
+
+void Keti_delta_store::add(const Keti_row_pos &pos, const Keti_delta &delta,
+                           ulonglong trx) {
+  Stripe &stripe = stripe_of(pos);
+  std::lock_guard<std::mutex> guard(stripe.mutex);
+  const Entry entry = {delta, KETI_UNCOMMITTED, trx};
+  put(&stripe, &stripe.rows[pos], entry);
+}
+
+void Keti_delta_store::stamp(const Keti_row_pos &pos, ulonglong trx,
+                             ulonglong version, ulonglong low_watermark) {
+  Stripe &stripe = stripe_of(pos);
+  std::lock_guard<std::mutex> guard(stripe.mutex);
+  auto row = stripe.rows.find(pos);
+  if (row == stripe.rows.end()) return;
+
+  for (Entry &entry : row->second)
+    if (entry.trx == trx && entry.version == KETI_UNCOMMITTED)
+      entry.version = version;
+  fold_row(&stripe, &row->second, low_watermark);
+}
+
+void Keti_delta_store::remove(const Keti_row_pos &pos, ulonglong trx) {
+  Stripe &stripe = stripe_of(pos);
+  std::lock_guard<std::mutex> guard(stripe.mutex);
+  auto row = stripe.rows.find(pos);
+  if (row == stripe.rows.end()) return;
+
+  std::vector<Entry> &entries = row->second;
+  for (size_t i = 0; i < entries.size();) {
+    if (entries[i].trx == trx && entries[i].version == KETI_UNCOMMITTED) {
+      entries.erase(entries.begin() + i);
+      stripe.stamped--;
+    } else {
+      i++;
+    }
+  }
+  if (!entries.empty()) return;
+  stripe.rows.erase(row);
+  m_rows--;
+}
+
+void Keti_delta_store::apply(TABLE *table, const Keti_row_pos &pos,
+                             const Keti_trx *trx, uchar *record) const {
+  const Stripe &stripe = stripe_of(pos);
+  std::lock_guard<std::mutex> guard(stripe.mutex);
+
+  auto row = stripe.rows.find(pos);
+  if (row == stripe.rows.end()) return;
+
+  const ptrdiff_t offset = record - table->record[0];
+  for (const Entry &entry : row->second) {
+    const Keti_delta &delta = entry.delta;
+    if (entry.version != 0 && !keti_sees(entry.version, entry.trx, trx))
+      continue;
+    if (delta.field >= table->s->fields) continue;
+    Field *field = table->field[delta.field];
+    if (!keti_delta_field(field) || field->is_null(offset)) continue;
+
+    uchar *ptr = field->ptr + offset;
+    const size_t length = field->pack_length();
+    store_int(ptr, length, load_int(ptr, length) + delta.value);
+  }
+}
+
+void Keti_delta_store::visible(const Keti_trx *trx,
+                               std::vector<uchar> *out) const {
+  std::vector<Keti_delta> sums;
+  for (const std::unique_ptr<Stripe> &stripe : m_stripes) {
+    std::lock_guard<std::mutex> guard(stripe->mutex);
+    for (const auto &row : stripe->rows) {
+      sums.clear();
+      for (const Entry &entry : row.second) {
+        if (entry.version != 0 && !keti_sees(entry.version, entry.trx, trx))
+          continue;
+        auto sum = std::find_if(sums.begin(), sums.end(),
+                                [&](const Keti_delta &delta) {
+                                  return delta.field == entry.delta.field;
+                                });
+        if (sum == sums.end())
+          sums.push_back(entry.delta);
+        else
+          sum->value += entry.delta.value;
+      }
+      for (const Keti_delta &sum : sums)
+        if (sum.value != 0) keti_delta_pack(row.first, sum, out);
+    }
+  }
+}
+
+void Keti_delta_store::fold(ulonglong low_watermark) {
+  for (std::unique_ptr<Stripe> &stripe : m_stripes) {
+    std::lock_guard<std::mutex> guard(stripe->mutex);
+    if (stripe->stamped == 0) continue;
+    for (auto &row : stripe->rows)
+      fold_row(stripe.get(), &row.second, low_watermark);
+  }
+}
+
+int Keti_delta_store::load(const std::string &table) {
+  std::vector<uchar> log;
+  int rc = csd_read_deltas(table, &log);
+  if (rc == HA_ERR_NO_SUCH_TABLE) return 0;
+  if (rc) return rc;
+
+  if (log.size() % KETI_DELTA_SIZE != 0) {
+    keti_log(ERROR_LEVEL, "delta log of %s is truncated", table.c_str());
+    return HA_ERR_CRASHED;
+  }
+  for (size_t i = 0; i < log.size(); i += KETI_DELTA_SIZE) {
+    Keti_row_pos pos;
+    Keti_delta delta;
+    keti_delta_unpack(log.data() + i, &pos, &delta);
+    add(pos, delta);
+  }
+  return 0;
+}
+
+void Keti_delta_store::move(const Keti_row_pos &from, const Keti_row_pos &to) {
+  std::vector<Entry> entries;
+  {
+    Stripe &stripe = stripe_of(from);
+    std::lock_guard<std::mutex> guard(stripe.mutex);
+    auto row = stripe.rows.find(from);
+    if (row == stripe.rows.end()) return;
+    entries.swap(row->second);
+    stripe.rows.erase(row);
+    m_rows--;
+    for (const Entry &entry : entries)
+      if (entry.version != 0) stripe.stamped--;
+  }
+  Stripe &stripe = stripe_of(to);
+  std::lock_guard<std::mutex> guard(stripe.mutex);
+  std::vector<Entry> &row = stripe.rows[to];
+  for (const Entry &entry : entries) put(&stripe, &row, entry);
+}
+
+void Keti_delta_store::erase(const Keti_row_pos &pos) {
+  Stripe &stripe = stripe_of(pos);
+  std::lock_guard<std::mutex> guard(stripe.mutex);
+  auto row = stripe.rows.find(pos);
+  if (row == stripe.rows.end()) return;
+  for (const Entry &entry : row->second)
+    if (entry.version != 0) stripe.stamped--;
+  stripe.rows.erase(row);
+  m_rows--;
+}
+
+void Keti_delta_store::clear() {
+  for (std::unique_ptr<Stripe> &stripe : m_stripes) {
+    std::lock_guard<std::mutex> guard(stripe->mutex);
+    m_rows -= stripe->rows.size();
+    stripe->rows.clear();
+    stripe->stamped = 0;
+  }
+}
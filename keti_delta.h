@@ -0,0 +1,197 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_delta.h
+
+    @brief
+  Commutative delta records for updates that only change integer columns.
+
+    @details
+  An UPDATE that leaves every column but some integer ones alone, such as
+  UPDATE t SET hits = hits + 1, is not written as a new version of the row.
+  The difference of each changed column is logged instead, modulo the width
+  of the column, and added to the row whenever it is read. Additions
+  commute, so the deltas of concurrent statements can be logged and merged
+  in any order, and the node can fold them into the segment on compaction.
+
+  A delta is seen by the read views that see the commit of its transaction,
+  see keti_mvcc.h: it joins the deltas of the table stamped
+  KETI_UNCOMMITTED before the commit is sent to the node, and is stamped
+  with the commit version afterwards. Deltas stamped below the low
+  watermark are seen by everybody and are summed up per column.
+
+  On the storage node the deltas of a table form one log, appended to by
+  the commits of the transactions that made them, see keti_trx.h, and read
+  back when the table is first opened. Each delta takes KETI_DELTA_SIZE
+  bytes:
+
+  @verbatim
+    segment(4) block(4) offset(4) field(2) delta(8)
+  @endverbatim
+*/
+
+#ifndef KETI_DELTA_H
+#define KETI_DELTA_H
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "my_inttypes.h"
+#include "storage/keti/keti_row.h"
+
+class Field;
+class Item;
+class Keti_trx;
+struct TABLE;
+
+static const size_t KETI_DELTA_SIZE = 22;
+
+/** @brief
+  Change of one integer column of one row.
+*/
+struct Keti_delta {
+  uint16 field;     ///< Field index
+  ulonglong value;  ///< Added to the column modulo its width
+};
+
+/**
+  Express an update as deltas.
+
+  @return false if the update changes anything but integer columns, in which
+          case deltas is left in an unspecified state
+*/
+bool keti_delta_update(TABLE *table, const uchar *old_data,
+                       const uchar *new_data, std::vector<Keti_delta> *deltas);
+
+/** True for the columns deltas are kept for: little endian integers. */
+bool keti_delta_field(const Field *field);
+
+/**
+  True if value, the new value of field in an UPDATE, adds an integer
+  constant to it or subtracts one from it, as SET hits = hits + 1 does.
+  Only such updates commute with each other.
+*/
+bool keti_delta_increment(const Field *field, const Item *value);
+
+/** True if item may read one of the columns of table. */
+bool keti_delta_reads(const Item *item, const TABLE *table,
+                      const std::vector<uint16> &columns);
+
+/** Append a delta of the row at pos to out in the log format. */
+void keti_delta_pack(const Keti_row_pos &pos, const Keti_delta &delta,
+                     std::vector<uchar> *out);
+
+/** Read a delta in the log format at ptr. */
+void keti_delta_unpack(const uchar *ptr, Keti_row_pos *pos,
+                       Keti_delta *delta);
+
+/** @brief
+  Deltas of one table not yet folded into its segments.
+
+    @details
+  Rows are spread over striped maps, so that updates of different hot rows
+  do not take turns on one mutex.
+*/
+class Keti_delta_store {
+ public:
+  Keti_delta_store();
+
+  /** Record a delta of the row at pos that every reader sees. */
+  void add(const Keti_row_pos &pos, const Keti_delta &delta);
+
+  /** Record a delta of the row at pos that trx commits; see stamp(). */
+  void add(const Keti_row_pos &pos, const Keti_delta &delta, ulonglong trx);
+
+  /**
+    trx committed its deltas of the row at pos at version. The deltas of the
+    row stamped below low_watermark are summed up.
+  */
+  void stamp(const Keti_row_pos &pos, ulonglong trx, ulonglong version,
+             ulonglong low_watermark);
+
+  /** Take out the deltas of the row at pos that trx did not commit. */
+  void remove(const Keti_row_pos &pos, ulonglong trx);
+
+  /** Add the deltas of the row at pos trx may see to record. */
+  void apply(TABLE *table, const Keti_row_pos &pos, const Keti_trx *trx,
+             uchar *record) const;
+
+  /** Append the deltas trx may see, one per row and column, to out. */
+  void visible(const Keti_trx *trx, std::vector<uchar> *out) const;
+
+  /** Sum up the deltas stamped below low_watermark. */
+  void fold(ulonglong low_watermark);
+
+  /** Read the delta log of table from the storage node. */
+  int load(const std::string &table);
+
+  /** The row at from moved to to. */
+  void move(const Keti_row_pos &from, const Keti_row_pos &to);
+
+  /** Forget the deltas of a row that is gone. */
+  void erase(const Keti_row_pos &pos);
+
+  /** Forget all deltas, e.g. when the rows they apply to are gone. */
+  void clear();
+
+  bool empty() const { return m_rows.load() == 0; }
+
+ private:
+  struct Pos_hash {
+    size_t operator()(const Keti_row_pos &pos) const;
+  };
+  struct Pos_equal {
+    bool operator()(const Keti_row_pos &a, const Keti_row_pos &b) const;
+  };
+
+  /** Deltas of one column and one transaction, or summed up. */
+  struct Entry {
+    Keti_delta delta;
+    ulonglong version;  ///< 0 once summed up
+    ulonglong trx;
+  };
+
+  typedef std::unordered_map<Keti_row_pos, std::vector<Entry>, Pos_hash,
+                             Pos_equal>
+      row_map_t;
+
+  struct Stripe {
+    Stripe() : stamped(0) {}
+
+    mutable std::mutex mutex;
+    row_map_t rows;
+    size_t stamped;  ///< Entries of rows not summed up yet
+  };
+
+  Stripe &stripe_of(const Keti_row_pos &pos) const;
+
+  /** Add entry to row, of stripe; caller holds its mutex. */
+  void put(Stripe *stripe, std::vector<Entry> *row, const Entry &entry);
+
+  /** Sum up the entries of row stamped below low_watermark. */
+  static void fold_row(Stripe *stripe, std::vector<Entry> *row,
+                       ulonglong low_watermark);
+
+  std::vector<std::unique_ptr<Stripe>> m_stripes;
+  /** Rows with deltas, so that reads of unchanged tables skip the lookup */
+  std::atomic<size_t> m_rows;
+};
+
+#endif /* KETI_DELTA_H */
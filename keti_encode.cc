@@ -0,0 +1,628 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_encode.cc
+
+    @brief
+  Encoding and decoding of the columns of blocks.
+*/
+
+#include "storage/keti/keti_encode.h"
+
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <utility>
+
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "sql/field.h"
+#include "sql/table.h"
+#include "storage/keti/keti_row.h"
+
+keti_encode_stats_t keti_encode_stats = {0, 0};
+
+bool srv_block_encoding = true;
+
+static std::mutex stats_mutex;
+
+enum Codec { CODEC_FOR = 1, CODEC_DELTA = 2, CODEC_DOD = 3, CODEC_XOR = 4 };
+
+/** Bytes of a column header: offset, length, kind, codec, base, step, bits. */
+static const size_t COLUMN_HEADER_SIZE = 2 + 1 + 1 + 1 + 8 + 8 + 1;
+static const size_t GROUP = 64;
+
+bool keti_packed_column(const Field *field, const uchar *record,
+                        Keti_packed_column *column) {
+  switch (field->real_type()) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+      column->kind =
+          (field->flags & UNSIGNED_FLAG) ? KETI_KIND_UINT : KETI_KIND_INT;
+      break;
+    case MYSQL_TYPE_YEAR:
+    case MYSQL_TYPE_NEWDATE:
+      column->kind = KETI_KIND_CODE;
+      break;
+    case MYSQL_TYPE_TIMESTAMP2:
+    case MYSQL_TYPE_DATETIME2:
+    case MYSQL_TYPE_TIME2:
+      column->kind = KETI_KIND_BIG_ENDIAN;
+      break;
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+      column->kind = KETI_KIND_FLOAT;
+      break;
+    default:
+      return false;
+  }
+  column->offset = static_cast<uint16>(field->ptr - record);
+  column->length = static_cast<uint8>(field->pack_length());
+  return column->length > 0 && column->length <= 8;
+}
+
+void keti_packed_columns(const TABLE_SHARE *share,
+                         std::vector<Keti_packed_column> *columns) {
+  columns->clear();
+  Keti_packed_column column;
+  for (uint i = 0; i < share->fields; i++)
+    if (keti_packed_column(share->field[i], share->default_values, &column))
+      columns->push_back(column);
+  /* Fields are in record order already, but nothing says so */
+  std::sort(columns->begin(), columns->end(),
+            [](const Keti_packed_column &a, const Keti_packed_column &b) {
+              return a.offset < b.offset;
+            });
+}
+
+ulonglong keti_column_value(const Keti_packed_column &column,
+                            const uchar *record) {
+  const uchar *ptr = record + column.offset;
+  uint64 value = 0;
+  if (column.kind == KETI_KIND_BIG_ENDIAN) {
+    for (uint i = 0; i < column.length; i++) value = value << 8 | ptr[i];
+    return value;
+  }
+  for (uint i = column.length; i > 0; i--) value = value << 8 | ptr[i - 1];
+  if (column.kind == KETI_KIND_INT && column.length < 8) {
+    const uint64 sign = 1ULL << (8 * column.length - 1);
+    value = (value ^ sign) - sign;
+  }
+  return value;
+}
+
+static void store_value(const Keti_packed_column &column, uint64 value,
+                        uchar *ptr) {
+  if (column.kind == KETI_KIND_BIG_ENDIAN) {
+    for (uint i = column.length; i > 0; i--, value >>= 8)
+      ptr[i - 1] = static_cast<uchar>(value);
+    return;
+  }
+  for (uint i = 0; i < column.length; i++, value >>= 8)
+    ptr[i] = static_cast<uchar>(value);
+}
+
+/** True if a is below b in the order of the column's kind. */
+static bool value_less(const Keti_packed_column &column, uint64 a, uint64 b) {
+  if (column.kind != KETI_KIND_INT) return a < b;
+  return static_cast<longlong>(a) < static_cast<longlong>(b);
+}
+
+static uint bit_width(uint64 value) {
+  uint bits = 0;
+  for (; value != 0; value >>= 1) bits++;
+  return bits;
+}
+
+static uint trailing_zeros(uint64 value) {
+  uint bits = 0;
+  for (; value != 0 && !(value & 1); value >>= 1) bits++;
+  return bits;
+}
+
+/** Small magnitudes of either sign to small numbers. */
+static uint64 zigzag(uint64 value) {
+  return value << 1 ^ static_cast<uint64>(static_cast<longlong>(value) >> 63);
+}
+
+static uint64 unzigzag(uint64 number) {
+  return number >> 1 ^ (0 - (number & 1));
+}
+
+/** @brief
+  Appends bits to a byte stream, most significant first.
+*/
+class Bit_writer {
+ public:
+  explicit Bit_writer(std::vector<uchar> *out)
+      : m_out(out), m_byte(0), m_count(0) {}
+
+  /** Append the count low bits of value, count at most 64. */
+  void write(uint64 value, uint count) {
+    while (count > 0) {
+      const uint take = std::min(count, 8 - m_count);
+      const uint bits = static_cast<uint>(value >> (count - take));
+      m_byte = m_byte << take | (bits & ((1U << take) - 1));
+      m_count += take;
+      count -= take;
+      if (m_count == 8) {
+        m_out->push_back(static_cast<uchar>(m_byte));
+        m_byte = 0;
+        m_count = 0;
+      }
+    }
+  }
+
+  /** Pad the last byte with zeros. */
+  void flush() {
+    if (m_count > 0) write(0, 8 - m_count);
+  }
+
+ private:
+  std::vector<uchar> *m_out;
+  uint m_byte;
+  uint m_count;  ///< Bits in m_byte
+};
+
+/** @brief
+  Reads what Bit_writer wrote.
+*/
+class Bit_reader {
+ public:
+  Bit_reader(const uchar *ptr, const uchar *end)
+      : m_ptr(ptr), m_end(end), m_byte(0), m_left(0) {}
+
+  /** @return false past the end of the stream */
+  bool read(uint count, uint64 *value) {
+    uint64 result = 0;
+    while (count > 0) {
+      if (m_left == 0) {
+        if (m_ptr == m_end) return false;
+        m_byte = *m_ptr++;
+        m_left = 8;
+      }
+      const uint take = std::min(count, m_left);
+      const uint mask = (1U << take) - 1;
+      result = result << take | ((m_byte >> (m_left - take)) & mask);
+      m_left -= take;
+      count -= take;
+    }
+    *value = result;
+    return true;
+  }
+
+ private:
+  const uchar *m_ptr;
+  const uchar *m_end;
+  uint m_byte;
+  uint m_left;  ///< Bits of m_byte not read yet
+};
+
+static size_t packed_size(uint32 rows, uint bits) {
+  return (rows + GROUP - 1) / GROUP * bits * 8;
+}
+
+/** Append the numbers, bits wide each, in groups of 64. */
+static void pack(const std::vector<uint64> &numbers, uint bits,
+                 std::vector<uchar> *out) {
+  if (bits == 0) return;
+  for (size_t start = 0; start < numbers.size(); start += GROUP) {
+    uint64 words[GROUP] = {0};
+    const size_t count = std::min(GROUP, numbers.size() - start);
+    for (size_t j = 0; j < count; j++) {
+      const uint64 number = numbers[start + j];
+      const size_t bit = j * bits;
+      const size_t word = bit / 64;
+      const uint shift = bit % 64;
+      words[word] |= number << shift;
+      if (shift + bits > 64) words[word + 1] |= number >> (64 - shift);
+    }
+    const size_t offset = out->size();
+    out->resize(offset + bits * 8);
+    for (uint w = 0; w < bits; w++)
+      int8store(&(*out)[offset + 8 * w], words[w]);
+  }
+}
+
+/** Unpack a group of 64 numbers BITS wide. */
+template <uint BITS>
+static void unpack_group(const uchar *in, uint64 *out) {
+  if (BITS == 0) {
+    memset(out, 0, GROUP * sizeof(uint64));
+    return;
+  }
+  const uint64 mask = BITS == 64 ? ~0ULL : (1ULL << (BITS % 64)) - 1;
+  for (uint j = 0; j < GROUP; j++) {
+    const uint bit = j * BITS;
+    const uint word = bit / 64;
+    const uint shift = bit % 64;
+    uint64 value = uint8korr(in + 8 * word) >> shift;
+    if (shift + BITS > 64)
+      value |= uint8korr(in + 8 * (word + 1)) << ((64 - shift) % 64);
+    out[j] = value & mask;
+  }
+}
+
+typedef void (*unpack_fn)(const uchar *, uint64 *);
+
+template <size_t... BITS>
+static std::array<unpack_fn, sizeof...(BITS)> make_unpackers(
+    std::index_sequence<BITS...>) {
+  return {{&unpack_group<BITS>...}};
+}
+
+/** One unpacker per width, 0 to 64 bits. */
+static const std::array<unpack_fn, 65> unpackers =
+    make_unpackers(std::make_index_sequence<65>());
+
+/** An encoded column: its header, then its packed numbers. */
+struct Encoded_column {
+  Keti_packed_column column;
+  Codec codec;
+  uint64 base;
+  uint64 step;
+  uint bits;
+  std::vector<uint64> numbers;
+  std::vector<uchar> stream;  ///< For CODEC_XOR
+};
+
+/**
+  XOR each value with the one before, as Gorilla does: a 0 bit if they are
+  equal, else 10 and the meaningful bits if they lie within those of the
+  previous XOR, else 11, the number of leading zeros in 6 bits, the number
+  of meaningful bits less one in 6 bits and those bits.
+*/
+static void xor_encode(const Keti_packed_column &column,
+                       const std::vector<uint64> &values,
+                       Encoded_column *encoded) {
+  const uint width = 8 * column.length;
+  Bit_writer writer(&encoded->stream);
+  uint window_lead = 0;
+  uint window_length = 0;
+  for (size_t i = 1; i < values.size(); i++) {
+    const uint64 x = values[i] ^ values[i - 1];
+    if (x == 0) {
+      writer.write(0, 1);
+      continue;
+    }
+    const uint lead = width - bit_width(x);
+    const uint trail = trailing_zeros(x);
+    if (window_length > 0 && lead >= window_lead &&
+        trail >= width - window_lead - window_length) {
+      writer.write(2, 2);
+      writer.write(x >> (width - window_lead - window_length), window_length);
+      continue;
+    }
+    window_lead = lead;
+    window_length = width - lead - trail;
+    writer.write(3, 2);
+    writer.write(lead, 6);
+    writer.write(window_length - 1, 6);
+    writer.write(x >> trail, window_length);
+  }
+  writer.flush();
+
+  encoded->codec = CODEC_XOR;
+  encoded->base = values[0];
+  encoded->step = 0;
+  encoded->bits = 0;
+}
+
+static bool xor_decode(const Keti_packed_column &column, uint64 base,
+                       const uchar *stream, const uchar *end,
+                       uint32 row_count, std::vector<uint64> *values) {
+  const uint width = 8 * column.length;
+  Bit_reader reader(stream, end);
+  uint64 value = base;
+  uint64 lead = 0;
+  uint64 length = 0;
+  values->resize(row_count);
+  if (row_count > 0) (*values)[0] = value;
+  for (uint32 i = 1; i < row_count; i++) {
+    uint64 flag, bits;
+    if (!reader.read(1, &flag)) return false;
+    if (flag) {
+      if (!reader.read(1, &flag)) return false;
+      if (flag) {
+        if (!reader.read(6, &lead) || !reader.read(6, &length)) return false;
+        length++;
+        if (lead + length > width) return false;
+      } else if (length == 0) {
+        return false;
+      }
+      if (!reader.read(static_cast<uint>(length), &bits)) return false;
+      value ^= bits << (width - lead - length);
+    }
+    (*values)[i] = value;
+  }
+  return true;
+}
+
+/** Bytes of an encoded column, header included. */
+static size_t encoded_size(const Encoded_column &column, uint32 row_count) {
+  if (column.codec == CODEC_XOR)
+    return COLUMN_HEADER_SIZE + 4 + column.stream.size();
+  return COLUMN_HEADER_SIZE + packed_size(row_count, column.bits);
+}
+
+/**
+  Pick the codec for the values of a column: XOR for floating point ones,
+  else whichever of FOR, DELTA and DOD packs into the fewest bits.
+
+  @return false if it saves no space over the plain values
+*/
+static bool encode_column(const Keti_packed_column &column,
+                          const std::vector<uint64> &values,
+                          Encoded_column *encoded) {
+  const uint32 row_count = static_cast<uint32>(values.size());
+  encoded->column = column;
+  if (column.kind == KETI_KIND_FLOAT) {
+    xor_encode(column, values, encoded);
+    return encoded_size(*encoded, row_count) <
+           static_cast<size_t>(row_count) * column.length;
+  }
+
+  uint64 min = values[0];
+  uint64 max = values[0];
+  uint64 step = 0;
+  for (size_t i = 1; i < values.size(); i++) {
+    if (value_less(column, values[i], min)) min = values[i];
+    if (value_less(column, max, values[i])) max = values[i];
+    const uint64 delta = values[i] - values[i - 1];
+    if (i == 1 || static_cast<longlong>(delta) < static_cast<longlong>(step))
+      step = delta;
+  }
+  uint64 max_delta = 0;
+  uint64 max_dod = 0;
+  for (size_t i = 1; i < values.size(); i++) {
+    max_delta = std::max(max_delta, values[i] - values[i - 1] - step);
+    if (i >= 2)
+      max_dod = std::max(max_dod, zigzag(values[i] - 2 * values[i - 1] +
+                                         values[i - 2]));
+  }
+
+  const uint for_bits = bit_width(max - min);
+  const uint delta_bits = bit_width(max_delta);
+  const uint dod_bits = bit_width(max_dod);
+  encoded->numbers.assign(values.size(), 0);
+  if (for_bits <= delta_bits && for_bits <= dod_bits) {
+    encoded->codec = CODEC_FOR;
+    encoded->base = min;
+    encoded->step = 0;
+    encoded->bits = for_bits;
+    for (size_t i = 0; i < values.size(); i++)
+      encoded->numbers[i] = values[i] - min;
+  } else if (delta_bits <= dod_bits) {
+    encoded->codec = CODEC_DELTA;
+    encoded->base = values[0];
+    encoded->step = step;
+    encoded->bits = delta_bits;
+    for (size_t i = 1; i < values.size(); i++)
+      encoded->numbers[i] = values[i] - values[i - 1] - step;
+  } else {
+    /* The first delta, then the changes of the deltas */
+    encoded->codec = CODEC_DOD;
+    encoded->base = values[0];
+    encoded->step = values[1] - values[0];
+    encoded->bits = dod_bits;
+    for (size_t i = 2; i < values.size(); i++)
+      encoded->numbers[i] =
+          zigzag(values[i] - 2 * values[i - 1] + values[i - 2]);
+  }
+  return encoded_size(*encoded, row_count) <
+         static_cast<size_t>(row_count) * column.length;
+}
+
+bool keti_encode_block(const std::vector<Keti_packed_column> &columns,
+                       uint32 row_count, const std::vector<uchar> &rows,
+                       std::vector<uchar> *out) {
+  if (columns.empty() || row_count == 0) return false;
+
+  /* Where each row starts; every record must hold all the columns */
+  const Keti_packed_column &last = columns.back();
+  const size_t record_end = last.offset + last.length;
+  std::vector<size_t> starts(row_count);
+  size_t offset = 0;
+  for (uint32 i = 0; i < row_count; i++) {
+    if (offset + KETI_ROW_HEADER_SIZE > rows.size()) return false;
+    const size_t length = uint4korr(&rows[offset]);
+    if (length < record_end ||
+        offset + KETI_ROW_HEADER_SIZE + length > rows.size())
+      return false;
+    starts[i] = offset;
+    offset += KETI_ROW_HEADER_SIZE + length;
+  }
+
+  std::vector<Encoded_column> encoded;
+  std::vector<uint64> values(row_count);
+  for (const Keti_packed_column &column : columns) {
+    for (uint32 i = 0; i < row_count; i++)
+      values[i] = keti_column_value(
+          column, &rows[starts[i] + KETI_ROW_HEADER_SIZE]);
+    encoded.emplace_back();
+    if (!encode_column(column, values, &encoded.back())) encoded.pop_back();
+  }
+  if (encoded.empty()) return false;
+
+  out->clear();
+  out->resize(KETI_BLOCK_HEADER_SIZE + 1);
+  int4store(&(*out)[0], KETI_BLOCK_ENCODED | row_count);
+  (*out)[KETI_BLOCK_HEADER_SIZE] = static_cast<uchar>(encoded.size());
+  for (const Encoded_column &column : encoded) {
+    const size_t start = out->size();
+    out->resize(start + COLUMN_HEADER_SIZE);
+    uchar *ptr = &(*out)[start];
+    int2store(ptr, column.column.offset);
+    ptr[2] = column.column.length;
+    ptr[3] = column.column.kind;
+    ptr[4] = static_cast<uchar>(column.codec);
+    int8store(ptr + 5, column.base);
+    int8store(ptr + 13, column.step);
+    ptr[21] = static_cast<uchar>(column.bits);
+    if (column.codec == CODEC_XOR) {
+      const size_t length = out->size();
+      out->resize(length + 4);
+      int4store(&(*out)[length], static_cast<uint32>(column.stream.size()));
+      out->insert(out->end(), column.stream.begin(), column.stream.end());
+    } else {
+      pack(column.numbers, column.bits, out);
+    }
+  }
+
+  /* The rows without the encoded columns */
+  for (uint32 i = 0; i < row_count; i++) {
+    const uchar *row = &rows[starts[i]];
+    const uchar *end = row + KETI_ROW_HEADER_SIZE + uint4korr(row);
+    const uchar *from = row + KETI_ROW_HEADER_SIZE;
+    out->insert(out->end(), row, from);
+    for (const Encoded_column &column : encoded) {
+      const uchar *field = row + KETI_ROW_HEADER_SIZE + column.column.offset;
+      out->insert(out->end(), from, field);
+      from = field + column.column.length;
+    }
+    out->insert(out->end(), from, end);
+  }
+
+  const size_t plain = KETI_BLOCK_HEADER_SIZE + rows.size();
+  if (out->size() >= plain) return false;
+
+  std::lock_guard<std::mutex> guard(stats_mutex);
+  keti_encode_stats.blocks_encoded++;
+  keti_encode_stats.bytes_saved += plain - out->size();
+  return true;
+}
+
+/** Unpack the values of a column, row_count of them, from in. */
+static void decode_column(Codec codec, uint64 base, uint64 step, uint bits,
+                          const uchar *in, uint32 row_count,
+                          std::vector<uint64> *values) {
+  values->resize((row_count + GROUP - 1) / GROUP * GROUP);
+  const unpack_fn unpack = unpackers[bits];
+  for (size_t start = 0; start < row_count; start += GROUP, in += bits * 8)
+    unpack(in, &(*values)[start]);
+  values->resize(row_count);
+
+  uint64 previous = base - step;
+  uint64 delta = step;
+  switch (codec) {
+    case CODEC_FOR:
+      for (uint64 &value : *values) value += base;
+      break;
+    case CODEC_DELTA:
+      for (uint64 &value : *values) value = previous += step + value;
+      break;
+    default: /* CODEC_DOD; the first two numbers are 0 */
+      for (uint64 &value : *values) {
+        delta += unzigzag(value);
+        value = previous += delta;
+      }
+      break;
+  }
+}
+
+int keti_decode_block(std::vector<uchar> *block,
+                      std::vector<Keti_packed_column> *columns) {
+  if (columns != NULL) columns->clear();
+  if (block->size() < KETI_BLOCK_HEADER_SIZE) return 0;
+  const uint32 header = uint4korr(block->data());
+  if (!(header & KETI_BLOCK_ENCODED)) return 0;
+  const uint32 row_count = header & ~KETI_BLOCK_ENCODED;
+
+  const uchar *ptr = block->data() + KETI_BLOCK_HEADER_SIZE;
+  const uchar *end = block->data() + block->size();
+  if (ptr >= end) return HA_ERR_CRASHED;
+  const uint column_count = *ptr++;
+
+  std::vector<Keti_packed_column> encoded(column_count);
+  std::vector<std::vector<uint64>> values(column_count);
+  size_t removed = 0;
+  for (uint c = 0; c < column_count; c++) {
+    if (static_cast<size_t>(end - ptr) < COLUMN_HEADER_SIZE)
+      return HA_ERR_CRASHED;
+    Keti_packed_column &column = encoded[c];
+    column.offset = uint2korr(ptr);
+    column.length = ptr[2];
+    column.kind = ptr[3];
+    const Codec codec = static_cast<Codec>(ptr[4]);
+    const uint64 base = uint8korr(ptr + 5);
+    const uint64 step = uint8korr(ptr + 13);
+    const uint bits = ptr[21];
+    ptr += COLUMN_HEADER_SIZE;
+
+    if (codec < CODEC_FOR || codec > CODEC_XOR || bits > 64 ||
+        column.length == 0 || column.length > 8 ||
+        (c > 0 && column.offset < encoded[c - 1].offset +
+                                      encoded[c - 1].length))
+      return HA_ERR_CRASHED;
+    if (codec == CODEC_XOR) {
+      if (end - ptr < 4) return HA_ERR_CRASHED;
+      const size_t length = uint4korr(ptr);
+      ptr += 4;
+      if (static_cast<size_t>(end - ptr) < length ||
+          !xor_decode(column, base, ptr, ptr + length, row_count, &values[c]))
+        return HA_ERR_CRASHED;
+      ptr += length;
+    } else {
+      if (static_cast<size_t>(end - ptr) < packed_size(row_count, bits))
+        return HA_ERR_CRASHED;
+      decode_column(codec, base, step, bits, ptr, row_count, &values[c]);
+      ptr += packed_size(row_count, bits);
+    }
+    removed += column.length;
+  }
+  const size_t record_end =
+      column_count > 0 ? encoded.back().offset + encoded.back().length : 0;
+
+  /* Put the values back into the records */
+  std::vector<uchar> plain;
+  plain.reserve(KETI_BLOCK_HEADER_SIZE + (end - ptr) + row_count * removed);
+  plain.resize(KETI_BLOCK_HEADER_SIZE);
+  int4store(&plain[0], row_count);
+  for (uint32 i = 0; i < row_count; i++) {
+    if (static_cast<size_t>(end - ptr) < KETI_ROW_HEADER_SIZE)
+      return HA_ERR_CRASHED;
+    const size_t length = uint4korr(ptr);
+    if (length < record_end ||
+        static_cast<size_t>(end - ptr) <
+            KETI_ROW_HEADER_SIZE + length - removed)
+      return HA_ERR_CRASHED;
+
+    const size_t row = plain.size();
+    plain.resize(row + KETI_ROW_HEADER_SIZE + length);
+    uchar *out = &plain[row];
+    memcpy(out, ptr, KETI_ROW_HEADER_SIZE);
+    out += KETI_ROW_HEADER_SIZE;
+    ptr += KETI_ROW_HEADER_SIZE;
+    size_t at = 0;
+    for (uint c = 0; c < column_count; c++) {
+      const Keti_packed_column &column = encoded[c];
+      memcpy(out + at, ptr, column.offset - at);
+      ptr += column.offset - at;
+      store_value(column, values[c][i], out + column.offset);
+      at = column.offset + column.length;
+    }
+    memcpy(out + at, ptr, length - at);
+    ptr += length - at;
+  }
+  if (ptr != end) return HA_ERR_CRASHED;
+
+  block->swap(plain);
+  if (columns != NULL) columns->swap(encoded);
+  return 0;
+}
@@ -0,0 +1,143 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_encode.h
+
+    @brief
+  Column encodings of blocks: integer and temporal columns frame of
+  reference, delta or delta of delta coded and bit-packed, floating point
+  columns XOR coded.
+
+    @details
+  When a block is closed, the numeric and temporal columns of its rows are
+  taken out of the records and stored in front of the rows, one column
+  after the other:
+
+  @verbatim
+    block   := (KETI_BLOCK_ENCODED | row_count)(4) column_count(1) column*
+               row*
+    column  := offset(2) length(1) kind(1) codec(1) base(8) step(8) bits(1)
+               (word* | stream_length(4) stream)
+    row     := length(4) record-without-columns blob*
+  @endverbatim
+
+  offset and length locate the column in the record, and length of a row is
+  that of the plain row. Values are taken as unsigned integers of length
+  bytes, in the byte order of the column, sign extended for signed integer
+  columns; FLOAT and DOUBLE as their bits.
+
+  With the FOR codec a value is base plus its packed number. With DELTA it
+  is the previous value plus step plus its packed number; with DOD the
+  difference to the previous value is that of the two values before plus
+  its packed number, zigzag coded, the first difference being step. The
+  first value is base for both. These come as words. XOR, for floating
+  point columns, is the stream of bits of Gorilla: each value XORed with the
+  one before, leading and trailing zeros left out.
+
+  Integer and temporal columns pick the codec that needs the fewest bits in
+  every block, so regular timestamps take none at all. A column is left in
+  the records if its codec saves no space, and a block none of whose
+  columns is worth it stays plain.
+
+  Packed numbers come in groups of 64, a group taking bits 64 bit words,
+  so that the unpacking of a group is a loop of constant shifts and masks
+  specialized for every width, which compilers unroll and vectorize.
+
+  Blocks are decoded back into the plain layout of keti_row.h as they are
+  read from the node, so rows keep their offsets and the rest of the engine
+  never sees the encoding.
+*/
+
+#ifndef KETI_ENCODE_H
+#define KETI_ENCODE_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "my_inttypes.h"
+
+class Field;
+struct TABLE_SHARE;
+
+/** Flag in the row count of a block whose columns are encoded. */
+static const uint32 KETI_BLOCK_ENCODED = 0x80000000;
+
+/** How the bytes of an encoded column are interpreted. */
+enum Keti_column_kind {
+  KETI_KIND_INT = 0,         ///< Signed integer, little endian
+  KETI_KIND_UINT = 1,        ///< Unsigned integer, little endian
+  KETI_KIND_CODE = 2,        ///< YEAR or DATE, little endian
+  KETI_KIND_BIG_ENDIAN = 3,  ///< TIMESTAMP, DATETIME or TIME
+  KETI_KIND_FLOAT = 4        ///< FLOAT or DOUBLE
+};
+
+/** @brief
+  A column blocks may take out of their records and encode.
+*/
+struct Keti_packed_column {
+  uint16 offset;  ///< In the record
+  uint8 length;   ///< Bytes, little endian
+  uint8 kind;     ///< Keti_column_kind
+};
+
+struct keti_encode_stats_t {
+  ulonglong blocks_encoded;  ///< Blocks written with encoded columns
+  ulonglong bytes_saved;     ///< Bytes the encodings saved on those
+};
+
+extern keti_encode_stats_t keti_encode_stats;
+
+extern bool srv_block_encoding;
+
+/**
+  Describe field, whose record is record, as a column blocks may encode.
+
+  @return false if it is of a type blocks do not encode
+*/
+bool keti_packed_column(const Field *field, const uchar *record,
+                        Keti_packed_column *column);
+
+/** The value of column in record, as the encodings take it. */
+ulonglong keti_column_value(const Keti_packed_column &column,
+                            const uchar *record);
+
+/** Columns of a table that blocks encode, by offset. */
+void keti_packed_columns(const TABLE_SHARE *share,
+                         std::vector<Keti_packed_column> *columns);
+
+/**
+  Encode the block of rows row_count rows long.
+
+  @param rows  the rows of the block, without the block header
+  @param out   receives the encoded block, header included
+
+  @return false if encoding would not make the block smaller
+*/
+bool keti_encode_block(const std::vector<Keti_packed_column> &columns,
+                       uint32 row_count, const std::vector<uchar> &rows,
+                       std::vector<uchar> *out);
+
+/**
+  Turn a block as stored on the node into the plain layout, in place.
+  Plain blocks are left as they are.
+
+  @param columns  if not NULL, receives the columns the block encoded
+
+  @return 0 or HA_ERR_CRASHED
+*/
+int keti_decode_block(std::vector<uchar> *block,
+                      std::vector<Keti_packed_column> *columns);
+
+#endif /* KETI_ENCODE_H */
@@ -0,0 +1,265 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_export.cc
+
+    @brief
+  Exports written by the storage node, see keti_export.h.
+*/
+
+#include "storage/keti/keti_export.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "m_ctype.h"
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "mysql/plugin.h"
+#include "sql/field.h"
+#include "sql/handler.h"
+#include "sql/item.h"
+#include "sql/sql_lex.h"
+#include "sql/table.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_delta.h"
+#include "storage/keti/keti_filter.h"
+#include "storage/keti/keti_mvcc.h"
+#include "template_utils.h"
+
+keti_export_stats_t keti_export_stats = {0, 0, 0};
+
+static std::mutex stats_mutex;
+
+/* States of an export */
+static const uchar EXPORT_RUNNING = 0;
+static const uchar EXPORT_DONE = 1;
+
+static const uchar EXPORT_UNSIGNED = 1;
+static const uint16 NO_BLOB = 0xFFFF;
+
+/** Progress: state(1) rows(8) bytes(8) message_length(2) */
+static const size_t PROGRESS_SIZE = 19;
+
+/** Pauses between questions on the progress grow up to this */
+static const std::chrono::milliseconds MAX_POLL_INTERVAL(1000);
+
+/** True if the node knows how to write values of field. */
+static bool exportable(const Field *field) {
+  switch (field->real_type()) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+    case MYSQL_TYPE_NEWDECIMAL:
+    case MYSQL_TYPE_YEAR:
+    case MYSQL_TYPE_NEWDATE:
+    case MYSQL_TYPE_TIME2:
+    case MYSQL_TYPE_DATETIME2:
+    case MYSQL_TYPE_TIMESTAMP2:
+    case MYSQL_TYPE_STRING:
+    case MYSQL_TYPE_VARCHAR:
+    case MYSQL_TYPE_BLOB:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+  Append columns of table to request.
+
+  @return false if the node cannot write one of them
+*/
+static bool pack_columns(const TABLE *table,
+                         const std::vector<uint16> &columns,
+                         std::vector<uchar> *request) {
+  /* The row holds the BLOBs after its record, in the order of the table */
+  std::vector<uint16> blobs(table->s->fields, NO_BLOB);
+  uint16 blob_count = 0;
+  for (uint i = 0; i < table->s->fields; i++)
+    if (table->field[i]->flags & BLOB_FLAG) blobs[i] = blob_count++;
+
+  const size_t count_pos = request->size();
+  request->resize(count_pos + 2);
+  uint16 count = 0;
+  for (uint16 index : columns) {
+    const Field *field = table->field[index];
+    const uint16 blob = blobs[index];
+    if (!exportable(field)) {
+      keti_log(WARNING_LEVEL, "cannot export column %s of type %d",
+               field->field_name, static_cast<int>(field->real_type()));
+      return false;
+    }
+
+    const size_t name_length = strlen(field->field_name);
+    const size_t pos = request->size();
+    request->resize(pos + 2 + name_length + 17);
+    uchar *ptr = &(*request)[pos];
+    int2store(ptr, static_cast<uint16>(name_length));
+    memcpy(ptr + 2, field->field_name, name_length);
+    ptr += 2 + name_length;
+
+    const uchar null_bit = field->is_nullable() ? field->null_bit : 0;
+    const size_t null_offset =
+        null_bit ? field->null_offset(table->record[0]) : 0;
+    const uint precision =
+        field->real_type() == MYSQL_TYPE_NEWDECIMAL
+            ? down_cast<const Field_new_decimal *>(field)->precision
+            : 0;
+    ptr[0] = static_cast<uchar>(field->real_type());
+    ptr[1] = (field->flags & UNSIGNED_FLAG) ? EXPORT_UNSIGNED : 0;
+    int2store(ptr + 2, static_cast<uint16>(field->offset(table->record[0])));
+    int4store(ptr + 4, field->pack_length());
+    int2store(ptr + 8, static_cast<uint16>(null_offset));
+    ptr[10] = null_bit;
+    ptr[11] = static_cast<uchar>(field->decimals());
+    ptr[12] = static_cast<uchar>(precision);
+    int2store(ptr + 13, static_cast<uint16>(field->charset()->number));
+    int2store(ptr + 15, blob);
+    count++;
+  }
+  int2store(&(*request)[count_pos], count);
+  return true;
+}
+
+bool keti_exportable_query(const TABLE *table, const Item *pushed_cond,
+                           std::vector<uint16> *columns) {
+  columns->clear();
+  if (thd_sql_command(table->in_use) != SQLCOM_SELECT ||
+      table->pos_in_table_list == NULL)
+    return false;
+  const SELECT_LEX *select = table->pos_in_table_list->select_lex;
+  if (select == NULL || select->outer_select() != NULL ||
+      select->leaf_table_count != 1 || select->having_cond() != NULL ||
+      select->is_grouped() || select->is_distinct() ||
+      select->select_limit != NULL || select->order_list.elements != 0)
+    return false;
+
+  /* The node filters the rows by the condition pushed, so it is all of it */
+  if (select->where_cond() != NULL && select->where_cond() != pushed_cond)
+    return false;
+
+  /* and writes columns as stored, not expressions of them */
+  List_iterator_fast<Item> li(const_cast<List<Item> &>(select->fields_list));
+  Item *item;
+  while ((item = li++)) {
+    const Item *real = item->real_item();
+    if (real->type() != Item::FIELD_ITEM) return false;
+    const Field *field = static_cast<const Item_field *>(real)->field;
+    if (field->table != table) return false;
+    columns->push_back(static_cast<uint16>(field->field_index));
+  }
+  return !columns->empty();
+}
+
+int keti_export(THD *thd, const std::string &csd_name, const TABLE *table,
+                const Keti_external_source &file,
+                const std::vector<Keti_segment> &segments,
+                const Keti_table_versions &versions, const Keti_trx *trx,
+                const std::vector<uchar> &deltas, const Keti_filter &filter,
+                const std::vector<uint16> &columns, ulonglong *rows) {
+  *rows = 0;
+  std::vector<uchar> request;
+  request.resize(1 + 2 + file.location.size() + 4);
+  uchar *ptr = request.data();
+  ptr[0] = file.format;
+  int2store(ptr + 1, static_cast<uint16>(file.location.size()));
+  memcpy(ptr + 3, file.location.data(), file.location.size());
+  const size_t count_pos = 3 + file.location.size();
+
+  /* Deleted rows of the segments are only hidden from the view */
+  uint32 count = 0;
+  std::vector<Keti_row_pos> hidden;
+  for (const Keti_segment &segment : segments) {
+    if (!versions.segment_visible(segment.id, trx)) continue;
+    versions.hidden_rows(segment.id, trx, &hidden);
+
+    size_t pos = request.size();
+    request.resize(pos + 8 + KETI_REF_LENGTH * hidden.size());
+    int4store(&request[pos], segment.id);
+    int4store(&request[pos + 4], static_cast<uint32>(hidden.size()));
+    pos += 8;
+    for (const Keti_row_pos &row : hidden) {
+      keti_store_pos(&request[pos], row);
+      pos += KETI_REF_LENGTH;
+    }
+    count++;
+  }
+  int4store(&request[count_pos], count);
+
+  /* The node applies these, not its delta log, for the view to hold */
+  const size_t delta_pos = request.size();
+  request.resize(delta_pos + 4);
+  int4store(&request[delta_pos],
+            static_cast<uint32>(deltas.size() / KETI_DELTA_SIZE));
+  request.insert(request.end(), deltas.begin(), deltas.end());
+
+  if (!pack_columns(table, columns, &request)) return HA_ERR_UNSUPPORTED;
+  filter.pack(&request);
+
+  uint32 id;
+  int rc = csd_start_export(csd_name, &request, &id);
+  if (rc) return rc;
+
+  /* Follow the export, counting what it wrote since the last look */
+  ulonglong bytes = 0;
+  std::chrono::milliseconds interval(10);
+  for (;;) {
+    std::this_thread::sleep_for(interval);
+    interval = std::min(interval * 2, MAX_POLL_INTERVAL);
+    if (thd_killed(thd)) {
+      csd_cancel_export(id);
+      return HA_ERR_QUERY_INTERRUPTED;
+    }
+
+    std::vector<uchar> progress;
+    if ((rc = csd_export_progress(id, &progress))) return rc;
+    if (progress.size() < PROGRESS_SIZE ||
+        progress.size() < PROGRESS_SIZE + uint2korr(&progress[17])) {
+      keti_log(ERROR_LEVEL, "bad progress of export %u of %s", id,
+               csd_name.c_str());
+      return HA_ERR_INTERNAL_ERROR;
+    }
+    const uchar state = progress[0];
+    const ulonglong now_rows = uint8korr(&progress[1]);
+    const ulonglong now_bytes = uint8korr(&progress[9]);
+    {
+      std::lock_guard<std::mutex> guard(stats_mutex);
+      keti_export_stats.rows += std::max(now_rows, *rows) - *rows;
+      keti_export_stats.bytes += std::max(now_bytes, bytes) - bytes;
+      if (state == EXPORT_DONE) keti_export_stats.exports++;
+    }
+    *rows = std::max(now_rows, *rows);
+    bytes = std::max(now_bytes, bytes);
+
+    if (state == EXPORT_RUNNING) continue;
+    if (state == EXPORT_DONE) break;
+    keti_log(ERROR_LEVEL, "export of %s to %s failed: %.*s", csd_name.c_str(),
+             file.location.c_str(), static_cast<int>(uint2korr(&progress[17])),
+             pointer_cast<const char *>(&progress[PROGRESS_SIZE]));
+    return HA_ERR_GENERIC;
+  }
+
+  keti_log(INFORMATION_LEVEL, "exported %llu rows of %s to %s (%llu bytes)",
+           *rows, csd_name.c_str(), file.location.c_str(), bytes);
+  return 0;
+}
@@ -0,0 +1,150 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_export.h
+
+    @brief
+  Exports: the storage node writes the rows of a scan to a file of its own,
+  and the server only follows how far it got.
+
+    @details
+  A session whose keti_export_file is set, to
+
+  @verbatim
+    csv:/exports/orders-2026.csv
+    parquet:/exports/orders-2026.parquet
+  @endverbatim
+
+  has its SELECT scans of KETI tables done by the node. Setting it takes the
+  FILE privilege, and secure_file_priv must admit the path, as for SELECT
+  ... INTO OUTFILE, since the node writes the file with its own rights.
+  Instead of returning rows, a scan, such as the one of
+
+  @verbatim
+    SELECT id, amount, placed FROM orders WHERE placed >= 20260101
+  @endverbatim
+
+  has the node write the rows it would return to that file on the node, in
+  that format, and then returns none. The query block must read that one
+  table and nothing the server would do after the scan, no join, grouping,
+  aggregate, DISTINCT, HAVING, ORDER BY or LIMIT, nor be nested in another
+  query block, as the file would miss it; otherwise the scan fails with
+  HA_ERR_UNSUPPORTED. Other statements scan as usual. The select list must
+  name columns of the table only, no expressions of them, and the file
+  holds those columns in the order it names them. A statement that scans
+  the table more than once exports once.
+
+  The node decides which rows to write by itself, so the WHERE clause, if
+  any, must be the condition pushed, whole, and compile to an exact
+  program of the filter, see keti_filter.h; and the node must know how to
+  write every column selected: integers, FLOAT, DOUBLE, DECIMAL, the
+  temporal types, TIMESTAMP in UTC, and CHAR, VARCHAR, TEXT and BLOB,
+  converted to UTF-8. Otherwise the scan fails with HA_ERR_UNSUPPORTED; so
+  does one with a WHERE clause while engine_condition_pushdown is off.
+
+  The node writes the rows of the segments in the read view of the
+  statement, less the rows it may not see, and with the deltas the view
+  sees, those of the transaction included, applied; these come with the
+  request, in place of the delta log of the node. The request is
+
+  @verbatim
+    export   := format(1) path_length(2) path segment_count(4) segment*
+                delta_count(4) delta(22)* column_count(2) column* program
+    segment  := segment_id(4) hidden_count(4) row(12)*
+    column   := name_length(2) name type(1) flags(1) offset(2) length(4)
+                null_offset(2) null_bit(1) decimals(1) precision(1)
+                charset(2) blob(2)
+  @endverbatim
+
+  hidden rows being those Keti_table_versions::hidden_rows() lists, as for
+  a clone, see keti_clone.h, each as keti_store_pos() writes it, and the
+  deltas in the format of keti_delta.h.
+
+  format being a Keti_external_format, type the real type of the column,
+  flags 1 for an UNSIGNED one, length its pack length, and blob the place
+  of a BLOB or TEXT column among those of the table, which the row holds
+  after its record, and 0xFFFF for other columns. program is the filter
+  as Keti_filter::pack() writes it, and a row is written when every one of
+  its conjuncts is TRUE.
+
+  The node answers with an id and runs the export in the background. The
+  scan asks how it goes with growing pauses, up to a second, and keeps the
+  status variables keti_export_rows and keti_export_bytes up to date on
+  the way. The progress is
+
+  @verbatim
+    progress := state(1) rows(8) bytes(8) message_length(2) message
+  @endverbatim
+
+  state being 0 while the export runs, 1 once the file is complete and 2
+  if it failed, for the reason message gives. A killed statement cancels
+  its export, and the node removes the file.
+*/
+
+#ifndef KETI_EXPORT_H
+#define KETI_EXPORT_H
+
+#include <string>
+#include <vector>
+
+#include "my_inttypes.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_external.h"
+
+class Item;
+class Keti_filter;
+class Keti_table_versions;
+class Keti_trx;
+class THD;
+struct TABLE;
+
+struct keti_export_stats_t {
+  ulonglong exports;  ///< Exports the node completed
+  ulonglong rows;     ///< Rows exports wrote, as they write them
+  ulonglong bytes;    ///< Bytes of the files they wrote
+};
+
+extern keti_export_stats_t keti_export_stats;
+
+/**
+  True if the query block table is scanned for may be exported.
+
+  @param pushed_cond  condition pushed to the scan, or NULL
+  @param columns      receives the columns it selects, in its order
+*/
+bool keti_exportable_query(const TABLE *table, const Item *pushed_cond,
+                           std::vector<uint16> *columns);
+
+/**
+  Have the node write columns of the rows of table in segments that trx
+  sees and filter accepts to file, and wait until it did.
+
+  @param deltas   deltas of table trx sees, in the log format
+  @param filter   bound, and exact
+  @param columns  as keti_exportable_query() returns them
+  @param rows     receives the rows written
+
+  @return 0, HA_ERR_UNSUPPORTED if the node cannot write some column,
+          HA_ERR_QUERY_INTERRUPTED if thd was killed, or an error of the
+          node
+*/
+int keti_export(THD *thd, const std::string &csd_name, const TABLE *table,
+                const Keti_external_source &file,
+                const std::vector<Keti_segment> &segments,
+                const Keti_table_versions &versions, const Keti_trx *trx,
+                const std::vector<uchar> &deltas, const Keti_filter &filter,
+                const std::vector<uint16> &columns, ulonglong *rows);
+
+#endif /* KETI_EXPORT_H */
@@ -0,0 +1,368 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_external.cc
+
+    @brief
+  Scans of Parquet and CSV files on the storage node.
+*/
+
+#include "storage/keti/keti_external.h"
+
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+
+#include "m_ctype.h"
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "sql/field.h"
+#include "sql/item.h"
+#include "sql/item_cmpfunc.h"
+#include "sql/table.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_pushdown.h"
+#include "template_utils.h"
+
+keti_external_stats_t keti_external_stats = {0, 0};
+
+static std::mutex stats_mutex;
+
+static const char EXTERNAL_COMMENT[] = "keti_external=";
+static const uint32 NULL_LENGTH = 0xFFFFFFFF;
+
+bool keti_external_comment(const TABLE_SHARE *share) {
+  const LEX_CSTRING &comment = share->comment;
+  const char *end = comment.str + comment.length;
+  return comment.length > 0 &&
+         std::search(comment.str, end, EXTERNAL_COMMENT,
+                     EXTERNAL_COMMENT + sizeof(EXTERNAL_COMMENT) - 1) != end;
+}
+
+bool keti_parse_source(const std::string &spec,
+                       Keti_external_source *source) {
+  source->format = KETI_EXTERNAL_NONE;
+  source->location.clear();
+  const size_t colon = spec.find(':');
+  if (colon == std::string::npos) return false;
+  const std::string format = spec.substr(0, colon);
+  const std::string location = spec.substr(colon + 1);
+  if (location.empty() || location.size() > 0xFFFF) return false;
+
+  if (format == "csv")
+    source->format = KETI_EXTERNAL_CSV;
+  else if (format == "parquet")
+    source->format = KETI_EXTERNAL_PARQUET;
+  else
+    return false;
+  source->location = location;
+  return true;
+}
+
+bool keti_external_source(const TABLE_SHARE *share,
+                          Keti_external_source *source) {
+  source->format = KETI_EXTERNAL_NONE;
+  source->location.clear();
+  if (!keti_external_comment(share)) return false;
+
+  /* keti_external=format:location, up to the next blank */
+  const std::string comment(share->comment.str, share->comment.length);
+  const size_t start =
+      comment.find(EXTERNAL_COMMENT) + sizeof(EXTERNAL_COMMENT) - 1;
+  const size_t end = comment.find_first_of(" \t\n", start);
+  return keti_parse_source(
+      comment.substr(start, end == std::string::npos ? end : end - start),
+      source);
+}
+
+static void append_uint2(uint16 value, std::vector<uchar> *out) {
+  const size_t pos = out->size();
+  out->resize(pos + 2);
+  int2store(out->data() + pos, value);
+}
+
+static void append_uint4(uint32 value, std::vector<uchar> *out) {
+  const size_t pos = out->size();
+  out->resize(pos + 4);
+  int4store(out->data() + pos, value);
+}
+
+int Keti_external_scan::init(const Keti_external_source &source,
+                             TABLE *table, const Item *cond, bool scan) {
+  m_table = table;
+  m_fields.clear();
+  m_header.clear();
+  m_header.push_back(source.format);
+  append_uint2(static_cast<uint16>(source.location.size()), &m_header);
+  m_header.insert(m_header.end(), source.location.begin(),
+                  source.location.end());
+
+  /* Only the columns the statement reads cross the wire */
+  for (uint i = 0; i < table->s->fields; i++)
+    if (bitmap_is_set(table->read_set, i)) m_fields.push_back(i);
+  append_uint2(static_cast<uint16>(m_fields.size()), &m_header);
+  for (uint i : m_fields) {
+    const char *name = table->field[i]->field_name;
+    const size_t length = strlen(name);
+    append_uint2(static_cast<uint16>(length), &m_header);
+    m_header.insert(m_header.end(), name, name + length);
+  }
+
+  m_ranges.assign(2, 0);
+  m_range_count = 0;
+  if (cond != NULL) add_ranges(cond);
+  int2store(m_ranges.data(), m_range_count);
+
+  close();
+  if (!scan) return 0;
+  {
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_external_stats.scans++;
+  }
+  m_last_batch = false;
+  return request_batch();
+}
+
+/** Append one range, bounds of the column at index in the request. */
+static void append_range(uint16 index, uint8 kind, uint8 flags, uchar *low,
+                         uchar *high, std::vector<uchar> *out) {
+  append_uint2(index, out);
+  out->push_back(kind);
+  out->push_back(flags);
+  out->insert(out->end(), low, low + 8);
+  out->insert(out->end(), high, high + 8);
+}
+
+void Keti_external_scan::add_ranges(const Item *cond) {
+  if (cond->type() == Item::COND_ITEM) {
+    const Item_cond *item_cond = static_cast<const Item_cond *>(cond);
+    if (item_cond->functype() != Item_func::COND_AND_FUNC) return;
+    List_iterator<Item> li(
+        *const_cast<Item_cond *>(item_cond)->argument_list());
+    Item *item;
+    while ((item = li++)) add_ranges(item);
+    return;
+  }
+
+  Keti_predicate pred;
+  if (cond->type() != Item::FUNC_ITEM ||
+      !keti_normalize_predicate(static_cast<const Item_func *>(cond),
+                                m_table, &pred) ||
+      pred.negated || pred.arg_count < 2)
+    return;
+
+  const Field *field = pred.field->field;
+  const auto column =
+      std::find(m_fields.begin(), m_fields.end(), field->field_index);
+  if (column == m_fields.end()) return;
+
+  /* Integer columns compare with integer constants, FLOAT and DOUBLE with
+     any number; the constants are those of this execution */
+  uint8 kind;
+  if (field->result_type() == INT_RESULT && !field->is_unsigned())
+    kind = KETI_RANGE_INT;
+  else if (field->result_type() == REAL_RESULT)
+    kind = KETI_RANGE_REAL;
+  else
+    return;
+
+  std::vector<longlong> ints;
+  std::vector<double> reals;
+  for (uint i = 1; i < pred.arg_count; i++) {
+    Item *value = pred.args[i];
+    if (kind == KETI_RANGE_INT) {
+      if (value->result_type() != INT_RESULT) return;
+      const longlong number = value->val_int();
+      if (value->null_value || (value->unsigned_flag && number < 0)) return;
+      ints.push_back(number);
+    } else {
+      if (value->result_type() != INT_RESULT &&
+          value->result_type() != REAL_RESULT &&
+          value->result_type() != DECIMAL_RESULT)
+        return;
+      const double number = value->val_real();
+      if (value->null_value) return;
+      reals.push_back(number);
+    }
+  }
+
+  uchar low[8];
+  uchar high[8];
+  auto bound = [&](size_t i, uchar *to) {
+    if (kind == KETI_RANGE_INT)
+      int8store(to, static_cast<ulonglong>(ints[i]));
+    else
+      float8store(to, reals[i]);
+  };
+  auto less = [&](size_t a, size_t b) {
+    return kind == KETI_RANGE_INT ? ints[a] < ints[b] : reals[a] < reals[b];
+  };
+
+  uint8 flags;
+  switch (pred.op) {
+    case Item_func::EQ_FUNC:
+      flags = KETI_RANGE_LOW | KETI_RANGE_HIGH;
+      bound(0, low);
+      bound(0, high);
+      break;
+    case Item_func::LT_FUNC:
+    case Item_func::LE_FUNC:
+      flags = KETI_RANGE_HIGH;
+      if (pred.op == Item_func::LT_FUNC) flags |= KETI_RANGE_HIGH_STRICT;
+      memset(low, 0, sizeof(low));
+      bound(0, high);
+      break;
+    case Item_func::GT_FUNC:
+    case Item_func::GE_FUNC:
+      flags = KETI_RANGE_LOW;
+      if (pred.op == Item_func::GT_FUNC) flags |= KETI_RANGE_LOW_STRICT;
+      bound(0, low);
+      memset(high, 0, sizeof(high));
+      break;
+    case Item_func::BETWEEN:
+      flags = KETI_RANGE_LOW | KETI_RANGE_HIGH;
+      bound(0, low);
+      bound(1, high);
+      break;
+    case Item_func::IN_FUNC: {
+      size_t least = 0, greatest = 0;
+      for (size_t i = 1; i < pred.arg_count - 1; i++) {
+        if (less(i, least)) least = i;
+        if (less(greatest, i)) greatest = i;
+      }
+      flags = KETI_RANGE_LOW | KETI_RANGE_HIGH;
+      bound(least, low);
+      bound(greatest, high);
+      break;
+    }
+    default:
+      return;
+  }
+
+  append_range(static_cast<uint16>(column - m_fields.begin()), kind, flags,
+               low, high, &m_ranges);
+  m_range_count++;
+}
+
+int Keti_external_scan::request_batch() {
+  std::vector<uchar> body(m_header);
+  body.insert(body.end(), m_ranges.begin(), m_ranges.end());
+  append_uint4(static_cast<uint32>(m_cursor.size()), &body);
+  body.insert(body.end(), m_cursor.begin(), m_cursor.end());
+
+  int rc = csd_external_scan(&body, &m_reply);
+  if (rc) return rc;
+
+  const uchar *ptr = m_reply.data();
+  const uchar *end = ptr + m_reply.size();
+  if (end - ptr < 4 || static_cast<size_t>(end - ptr - 4) < uint4korr(ptr) + 4)
+    return HA_ERR_CRASHED;
+  const uint32 cursor_length = uint4korr(ptr);
+  m_cursor.assign(pointer_cast<const char *>(ptr + 4), cursor_length);
+  m_last_batch = m_cursor.empty();
+  ptr += 4 + cursor_length;
+  m_rows_left = uint4korr(ptr);
+  m_pos = ptr + 4;
+  return 0;
+}
+
+int Keti_external_scan::next(uchar *buf) {
+  while (m_rows_left == 0) {
+    if (m_last_batch) return HA_ERR_END_OF_FILE;
+    int rc = request_batch();
+    if (rc) return rc;
+  }
+  m_rows_left--;
+  int rc = store_row(buf);
+  if (rc == 0) {
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_external_stats.rows_read++;
+  }
+  return rc;
+}
+
+int Keti_external_scan::fetch(ulonglong id, uchar *buf) {
+  std::vector<uchar> body(m_header);
+  append_uint2(0, &body);
+  append_uint4(0, &body);
+  append_uint4(1, &body);
+  const size_t pos = body.size();
+  body.resize(pos + 8);
+  int8store(body.data() + pos, id);
+
+  std::vector<uchar> reply;
+  int rc = csd_external_rows(&body, &reply);
+  if (rc) return rc;
+  /* No cursor and the one row */
+  if (reply.size() < 8 || uint4korr(reply.data()) != 0 ||
+      uint4korr(reply.data() + 4) != 1)
+    return HA_ERR_KEY_NOT_FOUND;
+
+  m_reply.swap(reply);
+  m_pos = m_reply.data() + 8;
+  m_rows_left = 0;
+  return store_row(buf);
+}
+
+void Keti_external_scan::close() {
+  m_reply.clear();
+  m_cursor.clear();
+  m_rows_left = 0;
+  m_pos = NULL;
+  m_last_batch = true;
+}
+
+/**
+  Store the row at m_pos into buf. Columns not requested keep their
+  defaults; values that do not fit are converted as LOAD DATA IGNORE
+  would.
+*/
+int Keti_external_scan::store_row(uchar *buf) {
+  const uchar *end = m_reply.data() + m_reply.size();
+  if (end - m_pos < 8) return HA_ERR_CRASHED;
+  m_row_id = uint8korr(m_pos);
+  m_pos += 8;
+
+  memcpy(buf, m_table->s->default_values, m_table->s->reclength);
+  const ptrdiff_t offset = buf - m_table->record[0];
+  my_bitmap_map *old_map =
+      dbug_tmp_use_all_columns(m_table, m_table->write_set);
+  int rc = 0;
+  for (uint i : m_fields) {
+    if (end - m_pos < 4) {
+      rc = HA_ERR_CRASHED;
+      break;
+    }
+    const uint32 length = uint4korr(m_pos);
+    m_pos += 4;
+    Field *field = m_table->field[i];
+    if (length == NULL_LENGTH) {
+      if (field->is_nullable()) field->set_null(offset);
+      continue;
+    }
+    if (static_cast<size_t>(end - m_pos) < length) {
+      rc = HA_ERR_CRASHED;
+      break;
+    }
+    field->set_notnull(offset);
+    field->move_field_offset(offset);
+    field->store(pointer_cast<const char *>(m_pos), length,
+                 &my_charset_utf8mb4_bin);
+    field->move_field_offset(-offset);
+    m_pos += length;
+  }
+  dbug_tmp_restore_column_map(m_table->write_set, old_map);
+  return rc;
+}
@@ -0,0 +1,184 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_external.h
+
+    @brief
+  External tables: Parquet and CSV files on the storage node, read in place
+  as read-only KETI tables.
+
+    @details
+  A table whose COMMENT holds
+
+  @verbatim
+    keti_external=parquet:/lake/orders/2026-*.parquet
+    keti_external=csv:/lake/clicks/
+  @endverbatim
+
+  has no segments. Its rows are the rows of the files the location names,
+  a file, a directory or a glob on the node, and its columns are matched
+  with the columns of the files by name, the header line of a CSV file
+  naming those. Such tables take no inserts, updates or deletes. The node
+  reads the files with its own rights, so creating one takes the FILE
+  privilege, and secure_file_priv must admit the location, as for LOAD
+  DATA.
+
+  A scan asks the node for the columns in the read set only, and hands it
+  ranges of the numeric columns the pushed condition bounds: a
+  comparison with a constant, BETWEEN, and IN as the range from its least
+  to its greatest value, for every conjunct of the condition that is one
+  of these. The node skips the row groups and pages whose statistics lie
+  outside a range, and may drop rows outside of one; the server evaluates
+  the whole condition on the rest.
+
+  The request is
+
+  @verbatim
+    scan      := format(1) location_length(2) location column_count(2)
+                 column* range_count(2) range* cursor_length(4) cursor
+    column    := name_length(2) name
+    range     := column(2) kind(1) flags(1) low(8) high(8)
+  @endverbatim
+
+  column of a range being the index of its column in the request, kind
+  KETI_RANGE_INT for signed integers or KETI_RANGE_REAL for doubles and
+  flags the Keti_range_flags that say which bounds hold. The node answers
+  with a batch of rows and the cursor to send for the next one, none at the
+  end:
+
+  @verbatim
+    reply     := cursor_length(4) cursor row_count(4) row*
+    row       := row_id(8) value*
+    value     := length(4) bytes
+  @endverbatim
+
+  one value per column, as text in UTF-8, of length 0xFFFFFFFF for NULL.
+  The row id lets rnd_pos() read the row again: the node answers a request
+  of the same form with no ranges, the ids after the cursor as count(4)
+  and id(8) each, with a reply of those rows.
+*/
+
+#ifndef KETI_EXTERNAL_H
+#define KETI_EXTERNAL_H
+
+#include <string>
+#include <vector>
+
+#include "my_inttypes.h"
+
+class Item;
+struct TABLE;
+struct TABLE_SHARE;
+
+enum Keti_external_format {
+  KETI_EXTERNAL_NONE = 0,  ///< Not an external table
+  KETI_EXTERNAL_CSV = 1,
+  KETI_EXTERNAL_PARQUET = 2
+};
+
+enum Keti_range_kind { KETI_RANGE_INT = 0, KETI_RANGE_REAL = 1 };
+
+enum Keti_range_flags {
+  KETI_RANGE_LOW = 1,          ///< low holds
+  KETI_RANGE_HIGH = 2,         ///< high holds
+  KETI_RANGE_LOW_STRICT = 4,   ///< Values must be greater than low
+  KETI_RANGE_HIGH_STRICT = 8   ///< Values must be less than high
+};
+
+/** Where the rows of an external table are. */
+struct Keti_external_source {
+  uint8 format;  ///< Keti_external_format
+  std::string location;
+};
+
+struct keti_external_stats_t {
+  ulonglong scans;      ///< Scans of external tables
+  ulonglong rows_read;  ///< Rows they returned
+};
+
+extern keti_external_stats_t keti_external_stats;
+
+/**
+  Read the source of an external table from its COMMENT.
+
+  @return false if the COMMENT names none, or names it wrongly; format is
+          then KETI_EXTERNAL_NONE
+*/
+bool keti_external_source(const TABLE_SHARE *share,
+                          Keti_external_source *source);
+
+/**
+  Parse a source written format:location, format being csv or parquet.
+
+  @return false if spec is not one; format is then KETI_EXTERNAL_NONE
+*/
+bool keti_parse_source(const std::string &spec,
+                       Keti_external_source *source);
+
+/** True if the COMMENT of the table means to name an external source. */
+bool keti_external_comment(const TABLE_SHARE *share);
+
+/** @brief
+  A scan of an external table.
+*/
+class Keti_external_scan {
+ public:
+  Keti_external_scan()
+      : m_table(NULL),
+        m_range_count(0),
+        m_last_batch(true),
+        m_rows_left(0),
+        m_pos(NULL),
+        m_row_id(0) {}
+
+  /**
+    Prepare to read the columns in the read set of table.
+
+    @param cond  pushed condition whose ranges the node may apply, or NULL
+    @param scan  also request the first rows
+  */
+  int init(const Keti_external_source &source, TABLE *table,
+           const Item *cond, bool scan);
+
+  /** @return 0, HA_ERR_END_OF_FILE or an error */
+  int next(uchar *buf);
+
+  /** Id of the row next() or fetch() returned last. */
+  ulonglong row_id() const { return m_row_id; }
+
+  /** Read the row of the id into buf. */
+  int fetch(ulonglong id, uchar *buf);
+
+  void close();
+
+ private:
+  int request_batch();
+  int store_row(uchar *buf);
+  void add_ranges(const Item *cond);
+
+  TABLE *m_table;
+  std::vector<uint> m_fields;      ///< Columns requested, by index
+  std::vector<uchar> m_header;     ///< Start of every request
+  std::vector<uchar> m_ranges;     ///< range_count and ranges
+  uint16 m_range_count;
+  std::string m_cursor;            ///< Of the next batch
+  bool m_last_batch;
+  std::vector<uchar> m_reply;      ///< The batch being returned
+  uint32 m_rows_left;              ///< In m_reply
+  const uchar *m_pos;              ///< Next row in m_reply
+  ulonglong m_row_id;
+};
+
+#endif /* KETI_EXTERNAL_H */
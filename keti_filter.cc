@@ -0,0 +1,544 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_filter.cc
+
+    @brief
+  Compilation and evaluation of pushed conditions on stored rows.
+*/
+
+#include "storage/keti/keti_filter.h"
+
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+#include <utility>
+
+#include "m_ctype.h"
+#include "my_byteorder.h"
+#include "sql/field.h"
+#include "sql/item.h"
+#include "sql/item_cmpfunc.h"
+#include "sql/item_func.h"
+#include "sql/table.h"
+#include "sql_string.h"
+#include "storage/keti/keti_key.h"
+#include "storage/keti/keti_pushdown.h"
+
+keti_filter_stats_t keti_filter_stats = {0, 0};
+
+static std::mutex stats_mutex;
+
+/** Values of registers. */
+static const uint8 IS_FALSE = 0;
+static const uint8 IS_TRUE = 1;
+static const uint8 IS_UNKNOWN = 2;
+
+static const uint8 NOT_TABLE[3] = {IS_TRUE, IS_FALSE, IS_UNKNOWN};
+static const uint8 AND_TABLE[3][3] = {{IS_FALSE, IS_FALSE, IS_FALSE},
+                                      {IS_FALSE, IS_TRUE, IS_UNKNOWN},
+                                      {IS_FALSE, IS_UNKNOWN, IS_UNKNOWN}};
+static const uint8 OR_TABLE[3][3] = {{IS_FALSE, IS_TRUE, IS_UNKNOWN},
+                                     {IS_TRUE, IS_TRUE, IS_TRUE},
+                                     {IS_UNKNOWN, IS_TRUE, IS_UNKNOWN}};
+
+/** Registers a conjunct may use; deeper conditions are UNKNOWN there. */
+static const uint MAX_REGISTERS = 64;
+
+/** Batches between reorderings of the conjuncts. */
+static const ulonglong REORDER_INTERVAL = 16;
+
+/* Estimated work per row of the instructions, in integer comparisons */
+static const double INT_CMP_COST = 1.0;
+static const double KEY_CMP_COST = 12.0;
+static const double IS_NULL_COST = 0.5;
+static const double LOGIC_COST = 0.25;
+
+/** Compare two integers, each signed or not. @return -1, 0 or 1 */
+static int compare_int(longlong a, bool a_unsigned, longlong b,
+                       bool b_unsigned) {
+  const bool a_negative = !a_unsigned && a < 0;
+  const bool b_negative = !b_unsigned && b < 0;
+  if (a_negative != b_negative) return a_negative ? -1 : 1;
+  if (a_negative) return a < b ? -1 : (a > b ? 1 : 0);
+  const ulonglong ua = static_cast<ulonglong>(a);
+  const ulonglong ub = static_cast<ulonglong>(b);
+  return ua < ub ? -1 : (ua > ub ? 1 : 0);
+}
+
+void Keti_filter::clear() {
+  m_operands.clear();
+  m_conjuncts.clear();
+  m_registers = 0;
+  m_batches = 0;
+  m_exact = true;
+}
+
+void Keti_filter::compile(const Item *cond, const TABLE *table) {
+  clear();
+  if (cond == NULL) return;
+
+  std::vector<const Item *> conjuncts;
+  if (cond->type() == Item::COND_ITEM &&
+      static_cast<const Item_cond *>(cond)->functype() ==
+          Item_func::COND_AND_FUNC) {
+    const Item_cond *item_cond = static_cast<const Item_cond *>(cond);
+    List_iterator<Item> li(
+        *const_cast<Item_cond *>(item_cond)->argument_list());
+    Item *item;
+    while ((item = li++)) conjuncts.push_back(item);
+  } else {
+    conjuncts.push_back(cond);
+  }
+
+  for (const Item *item : conjuncts) {
+    Conjunct conjunct;
+    conjunct.cost = 0.0;
+    conjunct.rows_in = 0;
+    conjunct.rows_out = 0;
+    bool may_false, may_true;
+    compile_node(item, table, 0, &conjunct, &may_false, &may_true);
+    /* A conjunct that never rejects a row is not worth running */
+    if (may_false)
+      m_conjuncts.push_back(std::move(conjunct));
+    else
+      m_exact = false;
+  }
+}
+
+void Keti_filter::emit(Conjunct *conjunct, Keti_opcode op, uint reg, uint a,
+                       uint b, uint32 operand) {
+  Keti_instruction instruction;
+  instruction.op = static_cast<uint8>(op);
+  instruction.dst = static_cast<uint8>(reg);
+  instruction.a = static_cast<uint8>(a);
+  instruction.b = static_cast<uint8>(b);
+  instruction.operand = operand;
+  conjunct->code.push_back(instruction);
+  m_registers = std::max(m_registers, std::max(reg, std::max(a, b)) + 1);
+
+  switch (op) {
+    case KETI_OP_UNKNOWN:
+      break;
+    case KETI_OP_IS_NULL:
+      conjunct->cost += IS_NULL_COST;
+      break;
+    case KETI_OP_INT_CMP:
+    case KETI_OP_KEY_CMP:
+      conjunct->cost +=
+          (op == KETI_OP_INT_CMP ? INT_CMP_COST : KEY_CMP_COST) *
+          std::max<size_t>(m_operands[operand].items.size(), 1);
+      break;
+    default:
+      conjunct->cost += LOGIC_COST;
+      break;
+  }
+}
+
+/**
+  Compile cond into instructions leaving its value in register reg.
+
+  @param may_false  receives whether the value can be FALSE
+  @param may_true   receives whether the value can be TRUE
+*/
+void Keti_filter::compile_node(const Item *cond, const TABLE *table, uint reg,
+                               Conjunct *conjunct, bool *may_false,
+                               bool *may_true) {
+  const size_t start = conjunct->code.size();
+  *may_false = *may_true = false;
+
+  if (reg + 2 > MAX_REGISTERS) {
+    /* Too deep */
+  } else if (cond->type() == Item::COND_ITEM) {
+    const Item_cond *item_cond = static_cast<const Item_cond *>(cond);
+    const bool is_and = item_cond->functype() == Item_func::COND_AND_FUNC;
+    if (is_and || item_cond->functype() == Item_func::COND_OR_FUNC) {
+      /* AND is FALSE if any argument can be, TRUE if all can; OR the reverse */
+      *may_false = !is_and;
+      *may_true = is_and;
+      bool first = true;
+      List_iterator<Item> li(
+          *const_cast<Item_cond *>(item_cond)->argument_list());
+      Item *item;
+      while ((item = li++)) {
+        bool arg_false, arg_true;
+        compile_node(item, table, first ? reg : reg + 1, conjunct, &arg_false,
+                     &arg_true);
+        if (is_and) {
+          *may_false |= arg_false;
+          *may_true &= arg_true;
+        } else {
+          *may_false &= arg_false;
+          *may_true |= arg_true;
+        }
+        if (!first)
+          emit(conjunct, is_and ? KETI_OP_AND : KETI_OP_OR, reg, reg, reg + 1,
+               0);
+        first = false;
+      }
+    }
+  } else if (cond->type() == Item::FUNC_ITEM &&
+             static_cast<const Item_func *>(cond)->functype() ==
+                 Item_func::NOT_FUNC) {
+    compile_node(static_cast<const Item_func *>(cond)->arguments()[0], table,
+                 reg, conjunct, may_true, may_false);
+    emit(conjunct, KETI_OP_NOT, reg, reg, 0, 0);
+  } else if (compile_leaf(cond, table, reg, conjunct)) {
+    *may_false = *may_true = true;
+  }
+
+  if (!*may_false && !*may_true) {
+    conjunct->code.resize(start);
+    emit(conjunct, KETI_OP_UNKNOWN, reg, 0, 0, 0);
+  }
+}
+
+/**
+  Compile a comparison into instructions leaving its value in register reg.
+
+  @return false if the machine cannot evaluate it
+*/
+bool Keti_filter::compile_leaf(const Item *cond, const TABLE *table, uint reg,
+                               Conjunct *conjunct) {
+  Keti_predicate pred;
+  if (cond->type() != Item::FUNC_ITEM ||
+      !keti_normalize_predicate(static_cast<const Item_func *>(cond), table,
+                                &pred))
+    return false;
+
+  Operand operand;
+  Field *field = pred.field->field;
+  operand.field = NULL;
+  operand.null_bit = field->is_nullable() ? field->null_bit : 0;
+  operand.null_offset =
+      operand.null_bit ? field->null_offset(table->record[0]) : 0;
+  operand.column = Keti_packed_column();
+  operand.lowest = operand.highest = 0;
+  operand.null_item = false;
+
+  if (pred.op == Item_func::ISNULL_FUNC ||
+      pred.op == Item_func::ISNOTNULL_FUNC) {
+    if (!operand.null_bit) return false;
+    m_operands.push_back(operand);
+    emit(conjunct, KETI_OP_IS_NULL, reg, 0, 0,
+         static_cast<uint32>(m_operands.size() - 1));
+    if (pred.op == Item_func::ISNOTNULL_FUNC)
+      emit(conjunct, KETI_OP_NOT, reg, reg, 0, 0);
+    return true;
+  }
+
+  Keti_opcode op;
+  if (keti_string_field(field)) {
+    op = KETI_OP_KEY_CMP;
+    operand.field = field;
+    for (uint i = 1; i < pred.arg_count; i++)
+      if (!keti_string_constant(field, pred.args[i])) return false;
+    /* Under PAD SPACE, 'a' sorts after 'a\t' but its weights before */
+    if (field->charset()->pad_attribute != NO_PAD &&
+        pred.op != Item_func::EQ_FUNC && pred.op != Item_func::NE_FUNC &&
+        pred.op != Item_func::IN_FUNC)
+      return false;
+  } else {
+    op = KETI_OP_INT_CMP;
+    if (!keti_packed_column(field, table->record[0], &operand.column) ||
+        (operand.column.kind != KETI_KIND_INT &&
+         operand.column.kind != KETI_KIND_UINT))
+      return false;
+    for (uint i = 1; i < pred.arg_count; i++)
+      if (pred.args[i]->result_type() != INT_RESULT) return false;
+  }
+
+  /* column OP constants as the outcomes of comparing column to them */
+  auto leaf = [&](Item **items, uint count, int lowest, int highest,
+                  uint dst) {
+    operand.items.assign(items, items + count);
+    operand.lowest = lowest;
+    operand.highest = highest;
+    m_operands.push_back(operand);
+    emit(conjunct, op, dst, 0, 0, static_cast<uint32>(m_operands.size() - 1));
+  };
+
+  switch (pred.op) {
+    case Item_func::EQ_FUNC:
+    case Item_func::NE_FUNC:
+      leaf(pred.args + 1, 1, 0, 0, reg);
+      break;
+    case Item_func::LT_FUNC:
+      leaf(pred.args + 1, 1, -1, -1, reg);
+      break;
+    case Item_func::LE_FUNC:
+      leaf(pred.args + 1, 1, -1, 0, reg);
+      break;
+    case Item_func::GT_FUNC:
+      leaf(pred.args + 1, 1, 1, 1, reg);
+      break;
+    case Item_func::GE_FUNC:
+      leaf(pred.args + 1, 1, 0, 1, reg);
+      break;
+    case Item_func::IN_FUNC:
+      leaf(pred.args + 1, pred.arg_count - 1, 0, 0, reg);
+      break;
+    case Item_func::BETWEEN:
+      leaf(pred.args + 1, 1, 0, 1, reg);
+      leaf(pred.args + 2, 1, -1, 0, reg + 1);
+      emit(conjunct, KETI_OP_AND, reg, reg, reg + 1, 0);
+      break;
+    default:
+      return false;
+  }
+  if (pred.op == Item_func::NE_FUNC || pred.negated)
+    emit(conjunct, KETI_OP_NOT, reg, reg, 0, 0);
+  return true;
+}
+
+void Keti_filter::bind() {
+  for (Operand &operand : m_operands) {
+    operand.values.clear();
+    operand.unsigned_values.clear();
+    operand.keys.clear();
+    operand.null_item = false;
+    for (Item *item : operand.items) {
+      if (operand.field != NULL) {
+        String buffer;
+        const String *value = item->val_str(&buffer);
+        if (value == NULL) {
+          operand.null_item = true;
+          continue;
+        }
+        operand.keys.push_back(keti_weight_string(
+            operand.field->charset(), value->ptr(), value->length()));
+      } else {
+        const longlong value = item->val_int();
+        if (item->null_value) {
+          operand.null_item = true;
+          continue;
+        }
+        operand.values.push_back(value);
+        operand.unsigned_values.push_back(item->unsigned_flag);
+      }
+    }
+  }
+}
+
+/** Compare the column of operand in record with its constants. */
+void Keti_filter::compare(const Operand &operand, const uchar *record,
+                          uint8 *out) {
+  if (operand.null_bit && (record[operand.null_offset] & operand.null_bit)) {
+    *out = IS_UNKNOWN;
+    return;
+  }
+
+  /* Not equal to any value, but maybe to the NULL among them */
+  *out = operand.null_item ? IS_UNKNOWN : IS_FALSE;
+  if (operand.field != NULL) {
+    keti_normalized_key(operand.field, record, &m_key);
+    for (const std::string &key : operand.keys) {
+      const int result = m_key.compare(key);
+      const int cmp = result < 0 ? -1 : (result > 0 ? 1 : 0);
+      if (cmp >= operand.lowest && cmp <= operand.highest) {
+        *out = IS_TRUE;
+        return;
+      }
+    }
+  } else {
+    const longlong value =
+        static_cast<longlong>(keti_column_value(operand.column, record));
+    const bool is_unsigned = operand.column.kind == KETI_KIND_UINT;
+    for (size_t i = 0; i < operand.values.size(); i++) {
+      const int cmp = compare_int(value, is_unsigned, operand.values[i],
+                                  operand.unsigned_values[i]);
+      if (cmp >= operand.lowest && cmp <= operand.highest) {
+        *out = IS_TRUE;
+        return;
+      }
+    }
+  }
+}
+
+/** Run the instructions of conjunct on the selected records. */
+void Keti_filter::run(const Conjunct &conjunct,
+                      const std::vector<const uchar *> &records,
+                      const std::vector<uint32> &selected) {
+  for (const Keti_instruction &instruction : conjunct.code) {
+    uint8 *dst = &m_file[instruction.dst * m_batch];
+    const uint8 *a = &m_file[instruction.a * m_batch];
+    const uint8 *b = &m_file[instruction.b * m_batch];
+
+    switch (instruction.op) {
+      case KETI_OP_UNKNOWN:
+        for (uint32 i : selected) dst[i] = IS_UNKNOWN;
+        break;
+      case KETI_OP_IS_NULL: {
+        const Operand &operand = m_operands[instruction.operand];
+        for (uint32 i : selected)
+          dst[i] = (records[i][operand.null_offset] & operand.null_bit)
+                       ? IS_TRUE
+                       : IS_FALSE;
+        break;
+      }
+      case KETI_OP_INT_CMP: {
+        const Operand &operand = m_operands[instruction.operand];
+        if (operand.values.size() == 1 && !operand.null_item &&
+            !operand.null_bit) {
+          /* The common case, column against one constant */
+          const Keti_packed_column column = operand.column;
+          const bool is_unsigned = column.kind == KETI_KIND_UINT;
+          const longlong constant = operand.values[0];
+          const bool constant_unsigned = operand.unsigned_values[0];
+          for (uint32 i : selected) {
+            const int cmp = compare_int(
+                static_cast<longlong>(keti_column_value(column, records[i])),
+                is_unsigned, constant, constant_unsigned);
+            dst[i] = cmp >= operand.lowest && cmp <= operand.highest
+                         ? IS_TRUE
+                         : IS_FALSE;
+          }
+        } else {
+          for (uint32 i : selected) compare(operand, records[i], &dst[i]);
+        }
+        break;
+      }
+      case KETI_OP_KEY_CMP: {
+        const Operand &operand = m_operands[instruction.operand];
+        for (uint32 i : selected) compare(operand, records[i], &dst[i]);
+        break;
+      }
+      case KETI_OP_NOT:
+        for (uint32 i : selected) dst[i] = NOT_TABLE[a[i]];
+        break;
+      case KETI_OP_AND:
+        for (uint32 i : selected) dst[i] = AND_TABLE[a[i]][b[i]];
+        break;
+      case KETI_OP_OR:
+        for (uint32 i : selected) dst[i] = OR_TABLE[a[i]][b[i]];
+        break;
+    }
+  }
+}
+
+void Keti_filter::evaluate(const std::vector<const uchar *> &records,
+                           std::vector<bool> *match) {
+  if (m_conjuncts.empty() || records.empty()) return;
+
+  m_batch = records.size();
+  m_file.resize(m_registers * m_batch);
+  std::vector<uint32> selected(m_batch);
+  std::iota(selected.begin(), selected.end(), 0);
+
+  /* Every conjunct leaves its value in register 0 */
+  const uint8 *value = m_file.data();
+  ulonglong rejected = 0;
+  for (Conjunct &conjunct : m_conjuncts) {
+    if (selected.empty()) break;
+    run(conjunct, records, selected);
+
+    size_t kept = 0;
+    for (uint32 i : selected) {
+      if (value[i] == IS_FALSE)
+        (*match)[i] = false;
+      else
+        selected[kept++] = i;
+    }
+    conjunct.rows_in += selected.size();
+    conjunct.rows_out += kept;
+    rejected += selected.size() - kept;
+    selected.resize(kept);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_filter_stats.rows_rejected += rejected;
+  }
+  if (++m_batches % REORDER_INTERVAL == 0) reorder();
+}
+
+/** Put the conjuncts that reject rows cheapest first. */
+void Keti_filter::reorder() {
+  auto rank = [](const Conjunct &conjunct) {
+    const double rejected =
+        (conjunct.rows_in - conjunct.rows_out + 1.0) / (conjunct.rows_in + 1.0);
+    return conjunct.cost / rejected;
+  };
+  auto before = [&rank](const Conjunct &a, const Conjunct &b) {
+    return rank(a) < rank(b);
+  };
+
+  if (!std::is_sorted(m_conjuncts.begin(), m_conjuncts.end(), before)) {
+    std::stable_sort(m_conjuncts.begin(), m_conjuncts.end(), before);
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_filter_stats.reorders++;
+  }
+
+  /* Older batches count less and less */
+  for (Conjunct &conjunct : m_conjuncts) {
+    conjunct.rows_in /= 2;
+    conjunct.rows_out /= 2;
+  }
+}
+
+bool Keti_filter::exact() const {
+  if (!m_exact) return false;
+  for (const Conjunct &conjunct : m_conjuncts)
+    for (const Keti_instruction &instruction : conjunct.code)
+      if (instruction.op == KETI_OP_UNKNOWN ||
+          instruction.op == KETI_OP_KEY_CMP)
+        return false;
+  return true;
+}
+
+void Keti_filter::pack(std::vector<uchar> *out) const {
+  size_t pos = out->size();
+  out->resize(pos + 2);
+  int2store(&(*out)[pos], static_cast<uint16>(m_conjuncts.size()));
+  for (const Conjunct &conjunct : m_conjuncts) {
+    pos = out->size();
+    out->resize(pos + 2 + 8 * conjunct.code.size());
+    uchar *ptr = &(*out)[pos];
+    int2store(ptr, static_cast<uint16>(conjunct.code.size()));
+    ptr += 2;
+    for (const Keti_instruction &instruction : conjunct.code) {
+      ptr[0] = instruction.op;
+      ptr[1] = instruction.dst;
+      ptr[2] = instruction.a;
+      ptr[3] = instruction.b;
+      int4store(ptr + 4, instruction.operand);
+      ptr += 8;
+    }
+  }
+
+  pos = out->size();
+  out->resize(pos + 2);
+  int2store(&(*out)[pos], static_cast<uint16>(m_operands.size()));
+  for (const Operand &operand : m_operands) {
+    pos = out->size();
+    out->resize(pos + 12 + 9 * operand.values.size());
+    uchar *ptr = &(*out)[pos];
+    int2store(ptr, operand.column.offset);
+    ptr[2] = operand.column.length;
+    ptr[3] = operand.column.kind;
+    int2store(ptr + 4, static_cast<uint16>(operand.null_offset));
+    ptr[6] = operand.null_bit;
+    ptr[7] = static_cast<uchar>(static_cast<int8>(operand.lowest));
+    ptr[8] = static_cast<uchar>(static_cast<int8>(operand.highest));
+    ptr[9] = operand.null_item;
+    int2store(ptr + 10, static_cast<uint16>(operand.values.size()));
+    ptr += 12;
+    for (size_t i = 0; i < operand.values.size(); i++) {
+      int8store(ptr, static_cast<ulonglong>(operand.values[i]));
+      ptr[8] = operand.unsigned_values[i];
+      ptr += 9;
+    }
+  }
+}
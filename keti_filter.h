@@ -0,0 +1,195 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_filter.h
+
+    @brief
+  Pushed conditions compiled to bytecode and evaluated on the rows of a
+  block as stored, before they are unpacked.
+
+    @details
+  cond_push() compiles every conjunct of the pushed condition into a
+  program of a register machine. A register holds, for every row of a
+  batch, FALSE, TRUE or UNKNOWN, the values of SQL's logic. The leaves are
+
+  - comparisons of integer columns with integer constants: =, <, <=, >,
+    >= and IN, BETWEEN as two of them;
+  - comparisons of CHAR and VARCHAR columns with string constants in their
+    collation, on weight strings; under a PAD SPACE collation only = and
+    IN, as keti_pushdown.h explains;
+  - IS NULL;
+
+  and <>, NOT and negated forms are NOT of them, AND and OR combine two
+  registers. Any other pushable predicate is UNKNOWN, and a conjunct that
+  can never be FALSE is left out.
+
+  The rows of a block are a batch. Each instruction is a loop over the rows
+  still selected, and each conjunct runs on the rows the ones before it
+  left. A row is skipped unread when a conjunct is FALSE for it; the server
+  evaluates the whole condition on the others.
+
+  Conjuncts run in the order that rejects rows cheapest. Per conjunct the
+  machine counts the rows it examined and rejected, and every 16 batches
+  sorts the conjuncts by their estimated cost per row over the share of
+  rows they reject. The counts are then halved, so the order follows the
+  data as the scan moves on.
+
+  Constants are evaluated by bind() when a scan starts, so that parameters
+  and constant subqueries have the values of the execution.
+
+  An exact program, one without UNKNOWN leaves or string comparisons, can
+  also run on the node, see keti_export.h. pack() writes it as
+
+  @verbatim
+    program     := conjunct_count(2) conjunct* operand_count(2) operand*
+    conjunct    := instruction_count(2) instruction*
+    instruction := op(1) dst(1) a(1) b(1) operand(4)
+    operand     := offset(2) length(1) kind(1) null_offset(2) null_bit(1)
+                   lowest(1) highest(1) null_constant(1) value_count(2)
+                   value*
+    value       := value(8) unsigned(1)
+  @endverbatim
+
+  the fields of an operand being those of Keti_packed_column and Operand,
+  lowest and highest as signed bytes and value_count 0 for IS NULL.
+*/
+
+#ifndef KETI_FILTER_H
+#define KETI_FILTER_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "my_inttypes.h"
+#include "storage/keti/keti_encode.h"
+
+class Field;
+class Item;
+struct TABLE;
+
+struct keti_filter_stats_t {
+  ulonglong rows_rejected;  ///< Rows skipped before they were unpacked
+  ulonglong reorders;       ///< Times the conjuncts of a filter moved
+};
+
+extern keti_filter_stats_t keti_filter_stats;
+
+/** Instructions of the machine; r is the register file. */
+enum Keti_opcode {
+  KETI_OP_UNKNOWN,  ///< r[dst] = UNKNOWN
+  KETI_OP_IS_NULL,  ///< r[dst] = column of operand is NULL
+  KETI_OP_INT_CMP,  ///< r[dst] = integer column of operand in its range
+  KETI_OP_KEY_CMP,  ///< r[dst] = string column of operand in its range
+  KETI_OP_NOT,      ///< r[dst] = NOT r[a]
+  KETI_OP_AND,      ///< r[dst] = r[a] AND r[b]
+  KETI_OP_OR        ///< r[dst] = r[a] OR r[b]
+};
+
+struct Keti_instruction {
+  uint8 op;  ///< Keti_opcode
+  uint8 dst;
+  uint8 a;
+  uint8 b;
+  uint32 operand;  ///< Index in the operands of the filter
+};
+
+/** @brief
+  A pushed condition compiled for the rows of a table.
+*/
+class Keti_filter {
+ public:
+  Keti_filter()
+      : m_registers(0), m_batch(0), m_batches(0), m_exact(true) {}
+
+  /** Compile the conjuncts of cond, a pushed condition on table. */
+  void compile(const Item *cond, const TABLE *table);
+
+  void clear();
+
+  bool empty() const { return m_conjuncts.empty(); }
+
+  /** Evaluate the constants of the condition. */
+  void bind();
+
+  /**
+    Evaluate the condition on rows as stored in a block, records at least
+    reclength bytes long each.
+
+    @param match  per record, set to false if the condition is FALSE for
+                  it and left alone otherwise
+  */
+  void evaluate(const std::vector<const uchar *> &records,
+                std::vector<bool> *match);
+
+  /**
+    True if the program decides the whole condition with integer
+    comparisons and IS NULL alone, so that the node can run it in place of
+    the server.
+  */
+  bool exact() const;
+
+  /** Append the program, bound, to out as the node takes it. */
+  void pack(std::vector<uchar> *out) const;
+
+ private:
+  /** A column and the constants a leaf compares it with. */
+  struct Operand {
+    Field *field;  ///< Of a string column, NULL for an integer one
+    Keti_packed_column column;
+    size_t null_offset;
+    uchar null_bit;  ///< 0 for a NOT NULL column
+    std::vector<Item *> items;
+    /** The column compares to some constant as lowest to highest. */
+    int lowest;
+    int highest;
+
+    /* Bound by bind() */
+    std::vector<longlong> values;
+    std::vector<bool> unsigned_values;
+    std::vector<std::string> keys;
+    bool null_item;  ///< Some constant is NULL
+  };
+
+  struct Conjunct {
+    std::vector<Keti_instruction> code;
+    double cost;  ///< Per row
+    ulonglong rows_in;
+    ulonglong rows_out;
+  };
+
+  void compile_node(const Item *cond, const TABLE *table, uint reg,
+                    Conjunct *conjunct, bool *may_false, bool *may_true);
+  bool compile_leaf(const Item *cond, const TABLE *table, uint reg,
+                    Conjunct *conjunct);
+  void emit(Conjunct *conjunct, Keti_opcode op, uint reg, uint a, uint b,
+            uint32 operand);
+  void run(const Conjunct &conjunct, const std::vector<const uchar *> &records,
+           const std::vector<uint32> &selected);
+  void compare(const Operand &operand, const uchar *record, uint8 *out);
+  void reorder();
+
+  std::vector<Operand> m_operands;
+  std::vector<Conjunct> m_conjuncts;
+  uint m_registers;
+  /** Register file: register r of row i at r * batch size + i. */
+  std::vector<uint8> m_file;
+  size_t m_batch;
+  ulonglong m_batches;
+  std::string m_key;  ///< Weights of a string column
+  bool m_exact;       ///< No conjunct was left out
+};
+
+#endif /* KETI_FILTER_H */
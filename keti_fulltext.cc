@@ -0,0 +1,505 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_fulltext.cc
+
+    @brief
+  Word splitting, FULLTEXT index construction and BM25 search.
+*/
+
+#include "storage/keti/keti_fulltext.h"
+
+#include <math.h>
+#include <algorithm>
+#include <mutex>
+
+#include "m_ctype.h"
+#include "my_byteorder.h"
+#include "sql/field.h"
+#include "sql/handler.h"
+#include "sql/table.h"
+#include "sql_string.h"
+#include "storage/keti/keti_bitmap.h"
+#include "storage/keti/keti_buf.h"
+#include "storage/keti/keti_inverted.h"
+#include "storage/keti/keti_key.h"
+#include "storage/keti/keti_mvcc.h"
+#include "template_utils.h"
+
+keti_fulltext_stats_t keti_fulltext_stats = {0, 0};
+
+ulong srv_ft_min_token_size = 3;
+ulong srv_ft_max_token_size = 84;
+
+static std::mutex stats_mutex;
+
+/** Row count the node replies with for a segment without the index. */
+static const uint32 NO_INDEX = 0xFFFFFFFF;
+/** Occurrences of a word in a row beyond this count no more. */
+static const uint32 MAX_WORD_COUNT = 255;
+/** Bytes per row in a search reply: block, offset and score. */
+static const size_t RESULT_SIZE = 4 + 4 + 8;
+
+static const double BM25_K1 = 1.2;
+static const double BM25_B = 0.75;
+
+/**
+  Length of the character at ptr, and whether it belongs to a word: letters,
+  digits and '_', as the FULLTEXT parser of the server has them.
+*/
+static int char_at(const CHARSET_INFO *cs, const char *ptr, const char *end,
+                   bool *word) {
+  int ctype;
+  const int length =
+      cs->cset->ctype(cs, &ctype, pointer_cast<const uchar *>(ptr),
+                      pointer_cast<const uchar *>(end));
+  *word = length > 0 && ((ctype & (_MY_U | _MY_L | _MY_NMR)) || *ptr == '_');
+  return length > 0 ? length : (length < 0 ? -length : 1);
+}
+
+/**
+  Call word(start, length, op, phrase) for each word of text from ptr to
+  end of a length keti_ft_min_token_size and keti_ft_max_token_size allow.
+  op is the boolean operator '+' or '-' right before the word or its
+  phrase, or 0; phrase is true inside double quotes.
+*/
+template <class Word>
+static void split(const CHARSET_INFO *cs, const char *ptr, const char *end,
+                  Word word) {
+  char op = 0;
+  char phrase_op = 0;
+  bool phrase = false;
+  bool in_word;
+  while (ptr < end) {
+    int length = char_at(cs, ptr, end, &in_word);
+    if (!in_word) {
+      if (*ptr == '"') {
+        phrase = !phrase;
+        phrase_op = op;
+      }
+      op = *ptr == '+' || *ptr == '-' ? *ptr : 0;
+      ptr += length;
+      continue;
+    }
+
+    const char *start = ptr;
+    size_t chars = 0;
+    for (; ptr < end && in_word; chars++) {
+      ptr += length;
+      if (ptr < end) length = char_at(cs, ptr, end, &in_word);
+    }
+    if (chars >= srv_ft_min_token_size && chars <= srv_ft_max_token_size)
+      word(start, static_cast<size_t>(ptr - start), phrase ? phrase_op : op,
+           phrase);
+    op = 0;
+  }
+}
+
+void keti_fulltext_keys(const TABLE_SHARE *share, std::vector<uint16> *keys) {
+  keys->clear();
+  for (uint i = 0; i < share->keys; i++)
+    if (share->key_info[i].flags & HA_FULLTEXT)
+      keys->push_back(static_cast<uint16>(i));
+}
+
+void keti_ft_words(const TABLE *table, uint key, const uchar *record,
+                   std::vector<std::string> *words) {
+  words->clear();
+  const ptrdiff_t offset = record - table->record[0];
+  const KEY &key_info = table->key_info[key];
+  String value;
+  for (uint i = 0; i < key_info.user_defined_key_parts; i++) {
+    Field *field = table->field[key_info.key_part[i].fieldnr - 1];
+    if (field->is_null(offset)) continue;
+    field->move_field_offset(offset);
+    field->val_str(&value);
+    field->move_field_offset(-offset);
+
+    const CHARSET_INFO *cs = field->charset();
+    split(cs, value.ptr(), value.ptr() + value.length(),
+          [cs, words](const char *start, size_t length, char, bool) {
+            words->push_back(keti_weight_string(cs, start, length));
+          });
+  }
+}
+
+void Keti_fulltext_index::add(uint16 key,
+                              const std::vector<std::string> &words,
+                              uint32 block, uint32 index) {
+  if (block > KETI_BITMAP_MAX_BLOCK) {
+    m_overflow = true;
+    return;
+  }
+  Key_index &key_index = m_keys[key];
+  const uint32 row = block << 16 | index;
+  key_index.rows.push_back(row);
+  key_index.lengths.push_back(static_cast<uint32>(words.size()));
+
+  std::map<std::string, uint32> counts;
+  for (const std::string &word : words) counts[word]++;
+  for (const auto &count : counts)
+    key_index.words[count.first].emplace_back(row, count.second);
+}
+
+void Keti_fulltext_index::take(std::vector<uchar> *out) {
+  out->clear();
+  std::vector<uint32> rows;
+  for (const auto &key : m_keys) {
+    if (m_overflow) break;
+    const Key_index &index = key.second;
+    size_t offset = out->size();
+    out->resize(offset + 2);
+    int2store(&(*out)[offset], key.first);
+    keti_pack_postings(index.rows, out);
+    offset = out->size();
+    out->resize(offset + 4 * index.lengths.size() + 4);
+    for (uint32 length : index.lengths) {
+      int4store(&(*out)[offset], length);
+      offset += 4;
+    }
+    int4store(&(*out)[offset], static_cast<uint32>(index.words.size()));
+
+    for (const auto &word : index.words) {
+      offset = out->size();
+      out->resize(offset + 4);
+      int4store(&(*out)[offset], static_cast<uint32>(word.first.size()));
+      out->insert(out->end(), word.first.begin(), word.first.end());
+      rows.clear();
+      for (const auto &count : word.second) rows.push_back(count.first);
+      keti_pack_postings(rows, out);
+      for (const auto &count : word.second)
+        out->push_back(
+            static_cast<uchar>(std::min(count.second, MAX_WORD_COUNT)));
+    }
+  }
+  m_keys.clear();
+  m_overflow = false;
+}
+
+/* The server drives a search through these */
+
+static int ft_read_next(FT_INFO *, char *) { return HA_ERR_WRONG_COMMAND; }
+
+static float ft_find_relevance(FT_INFO *info, uchar *, uint) {
+  return static_cast<Keti_ft_search *>(info)->relevance();
+}
+
+static void ft_close_search(FT_INFO *info) {
+  delete static_cast<Keti_ft_search *>(info);
+}
+
+static float ft_get_relevance(FT_INFO *info) {
+  return static_cast<Keti_ft_search *>(info)->last_relevance();
+}
+
+static void ft_reinit_search(FT_INFO *info) {
+  static_cast<Keti_ft_search *>(info)->rewind();
+}
+
+static _ft_vft keti_ft_vft = {ft_read_next, ft_find_relevance,
+                              ft_close_search, ft_get_relevance,
+                              ft_reinit_search};
+
+Keti_ft_search::Keti_ft_search(TABLE *table, uint key,
+                               const std::string &csd_name,
+                               const Keti_table_versions *versions,
+                               const Keti_row_pos *current)
+    : m_table(table),
+      m_key(key),
+      m_csd_name(csd_name),
+      m_versions(versions),
+      m_current(current),
+      m_limit(HA_POS_ERROR),
+      m_executed(false),
+      m_bounded(false),
+      m_next(0),
+      m_skipped(0),
+      m_last(0) {
+  please = &keti_ft_vft;
+}
+
+void Keti_ft_search::parse(const String &query, uint flags, ha_rows limit) {
+  m_limit = limit;
+  m_terms.clear();
+  const KEY &key_info = m_table->key_info[m_key];
+  const CHARSET_INFO *cs =
+      m_table->field[key_info.key_part[0].fieldnr - 1]->charset();
+  const bool boolean = flags & FT_BOOL;
+
+  split(cs, query.ptr(), query.ptr() + query.length(),
+        [this, cs, boolean](const char *start, size_t length, char op,
+                            bool phrase) {
+          Mode mode = OPTIONAL;
+          if (boolean && op == '+') mode = REQUIRED;
+          /* Rows holding some words of a phrase may still lack the phrase */
+          if (boolean && op == '-') {
+            if (phrase) return;
+            mode = EXCLUDED;
+          }
+          std::string word = keti_weight_string(cs, start, length);
+          for (Term &term : m_terms) {
+            if (term.word != word) continue;
+            term.mode = std::max(term.mode, mode);
+            return;
+          }
+          m_terms.push_back({std::move(word), mode, 0});
+        });
+}
+
+bool Keti_ft_search::score(const std::vector<uint32> &counts, uint32 length,
+                           double avg, double *score) const {
+  bool matched = false;
+  *score = 0;
+  for (size_t i = 0; i < m_terms.size(); i++) {
+    const double count = std::min(counts[i], MAX_WORD_COUNT);
+    if (m_terms[i].mode == EXCLUDED && count > 0) return false;
+    if (m_terms[i].mode == REQUIRED && count == 0) return false;
+    if (count == 0 || m_terms[i].mode == EXCLUDED) continue;
+    *score += m_terms[i].idf * count * (BM25_K1 + 1) /
+              (count + BM25_K1 * (1 - BM25_B + BM25_B * length / avg));
+    matched = true;
+  }
+  return matched;
+}
+
+int Keti_ft_search::scan_segment(const Keti_segment &segment,
+                                 ulonglong *rows, ulonglong *words,
+                                 std::vector<ulonglong> *df,
+                                 std::vector<Document> *documents) {
+  std::vector<uchar> record(m_table->s->reclength);
+  std::vector<uchar> blob_buffer;
+  std::vector<std::string> row_words;
+  ulonglong scanned = 0;
+
+  for (uint32 block = 0; block < segment.blocks; block++) {
+    const Keti_page_id id = {m_csd_name, segment.id, block};
+    Keti_page page;
+    int rc = keti_buffer_pool->read(id, &page);
+    if (rc) return rc;
+
+    size_t offset = KETI_BLOCK_HEADER_SIZE;
+    for (uint32 left = keti_block_rows(*page); left > 0; left--) {
+      if (offset + KETI_ROW_HEADER_SIZE > page->size()) return HA_ERR_CRASHED;
+      const Keti_row_pos pos = {segment.id, block,
+                                static_cast<uint32>(offset)};
+      rc = keti_unpack_row(m_table, page->data() + offset,
+                           page->data() + page->size(), record.data(),
+                           &blob_buffer);
+      if (rc) return rc;
+      offset += KETI_ROW_HEADER_SIZE + uint4korr(page->data() + offset);
+
+      keti_ft_words(m_table, m_key, record.data(), &row_words);
+      scanned++;
+      *words += row_words.size();
+      Document document = {pos, static_cast<uint32>(row_words.size()),
+                           std::vector<uint32>(m_terms.size(), 0)};
+      bool found = false;
+      for (const std::string &word : row_words)
+        for (size_t i = 0; i < m_terms.size(); i++)
+          if (m_terms[i].word == word) document.counts[i]++;
+      for (size_t i = 0; i < m_terms.size(); i++) {
+        if (document.counts[i] == 0) continue;
+        (*df)[i]++;
+        found = true;
+      }
+      if (found) documents->push_back(std::move(document));
+    }
+  }
+
+  *rows += scanned;
+  std::lock_guard<std::mutex> guard(stats_mutex);
+  keti_fulltext_stats.rows_host_scored += scanned;
+  return 0;
+}
+
+static int bad_reply(const std::string &table) {
+  keti_log(ERROR_LEVEL, "bad reply to fulltext search for %s", table.c_str());
+  return HA_ERR_INTERNAL_ERROR;
+}
+
+int Keti_ft_search::execute() {
+  {
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_fulltext_stats.searches++;
+  }
+  m_next = 0;
+  m_skipped = 0;
+  m_bounded = m_limit != HA_POS_ERROR;
+  return search(m_limit);
+}
+
+int Keti_ft_search::search(ha_rows limit) {
+  m_executed = true;
+  m_results.clear();
+  m_scores.clear();
+  if (m_terms.empty()) return 0;
+
+  std::vector<Keti_segment> segments;
+  int rc = csd_read_manifest(m_csd_name, &segments);
+  if (rc == HA_ERR_NO_SUCH_TABLE) return 0;
+  if (rc) return rc;
+  if (segments.empty()) return 0;
+  std::vector<uint32> ids;
+  for (const Keti_segment &segment : segments) ids.push_back(segment.id);
+
+  /* The key, then the words, each preceded by its length */
+  std::vector<uchar> body(2 + 4);
+  int2store(&body[0], static_cast<uint16>(m_key));
+  int4store(&body[2], static_cast<uint32>(m_terms.size()));
+  for (const Term &term : m_terms) {
+    const size_t offset = body.size();
+    body.resize(offset + 4);
+    int4store(&body[offset], static_cast<uint32>(term.word.size()));
+    body.insert(body.end(), term.word.begin(), term.word.end());
+  }
+  std::vector<uchar> reply;
+  if ((rc = csd_fulltext_stats(m_csd_name, ids, &body, &reply))) return rc;
+
+  /* Statistics of the whole table, unindexed segments counted here */
+  ulonglong rows = 0;
+  ulonglong words = 0;
+  std::vector<ulonglong> df(m_terms.size(), 0);
+  std::vector<uint32> indexed;
+  std::vector<Document> documents;
+  const uchar *ptr = reply.data();
+  const uchar *end = ptr + reply.size();
+  for (const Keti_segment &segment : segments) {
+    if (end - ptr < 4) return bad_reply(m_csd_name);
+    const uint32 count = uint4korr(ptr);
+    ptr += 4;
+    if (count == NO_INDEX) {
+      if ((rc = scan_segment(segment, &rows, &words, &df, &documents)))
+        return rc;
+      continue;
+    }
+    if (end - ptr < static_cast<ptrdiff_t>(8 + 4 * m_terms.size()))
+      return bad_reply(m_csd_name);
+    rows += count;
+    words += uint8korr(ptr);
+    ptr += 8;
+    for (size_t i = 0; i < m_terms.size(); i++, ptr += 4)
+      df[i] += uint4korr(ptr);
+    indexed.push_back(segment.id);
+  }
+  if (ptr != end) return bad_reply(m_csd_name);
+  if (rows == 0) return 0;
+
+  const double avg = words == 0 ? 1.0 : static_cast<double>(words) / rows;
+  for (size_t i = 0; i < m_terms.size(); i++)
+    m_terms[i].idf = log(1 + (rows - df[i] + 0.5) / (df[i] + 0.5));
+
+  if (!indexed.empty()) {
+    /* The limit, the average row length, then per word its mode and IDF */
+    body.resize(2 + 8 + 8 + 4);
+    int2store(&body[0], static_cast<uint16>(m_key));
+    int8store(&body[2], static_cast<ulonglong>(limit));
+    float8store(&body[10], avg);
+    int4store(&body[18], static_cast<uint32>(m_terms.size()));
+    for (const Term &term : m_terms) {
+      const size_t offset = body.size();
+      body.resize(offset + 1 + 8 + 4);
+      body[offset] = static_cast<uchar>(term.mode);
+      float8store(&body[offset + 1], term.idf);
+      int4store(&body[offset + 9], static_cast<uint32>(term.word.size()));
+      body.insert(body.end(), term.word.begin(), term.word.end());
+    }
+    if ((rc = csd_fulltext_search(m_csd_name, indexed, &body, &reply)))
+      return rc;
+
+    ptr = reply.data();
+    end = ptr + reply.size();
+    for (uint32 segment : indexed) {
+      if (end - ptr < 4) return bad_reply(m_csd_name);
+      const uint32 count = uint4korr(ptr);
+      ptr += 4;
+      if (static_cast<size_t>(end - ptr) / RESULT_SIZE < count)
+        return bad_reply(m_csd_name);
+      for (uint32 i = 0; i < count; i++, ptr += RESULT_SIZE) {
+        Result result = {{segment, uint4korr(ptr), uint4korr(ptr + 4)},
+                         float8get(ptr + 8)};
+        m_results.push_back(result);
+      }
+    }
+    if (ptr != end) return bad_reply(m_csd_name);
+  }
+
+  double document_score;
+  for (const Document &document : documents)
+    if (score(document.counts, document.length, avg, &document_score))
+      m_results.push_back({document.pos, document_score});
+
+  /* Best first; ties in position order, as the node breaks them */
+  auto better = [](const Result &a, const Result &b) {
+    if (a.score != b.score) return a.score > b.score;
+    if (a.pos.segment != b.pos.segment) return a.pos.segment < b.pos.segment;
+    if (a.pos.block != b.pos.block) return a.pos.block < b.pos.block;
+    return a.pos.offset < b.pos.offset;
+  };
+  if (limit < m_results.size()) {
+    std::partial_sort(m_results.begin(), m_results.begin() + limit,
+                      m_results.end(), better);
+    m_results.resize(limit);
+  } else {
+    std::sort(m_results.begin(), m_results.end(), better);
+  }
+
+  for (const Result &result : m_results) {
+    const Keti_row_pos pos = m_versions->forward(result.pos);
+    m_scores[std::make_pair(pos.segment,
+                            (ulonglong)pos.block << 32 | pos.offset)] =
+        static_cast<float>(result.score);
+  }
+  return 0;
+}
+
+int Keti_ft_search::next(Keti_row_pos *pos) {
+  int rc;
+  if (!m_executed && (rc = execute())) return rc;
+
+  if (m_next >= m_results.size()) {
+    /* Rows the reader cannot see took places among the best; look on */
+    if (!m_bounded || m_skipped == 0 || m_results.size() < m_limit)
+      return HA_ERR_END_OF_FILE;
+    m_bounded = false;
+    if ((rc = search(HA_POS_ERROR))) return rc;
+    if (m_next >= m_results.size()) return HA_ERR_END_OF_FILE;
+  }
+
+  const Result &result = m_results[m_next++];
+  *pos = result.pos;
+  m_last = static_cast<float>(result.score);
+  return 0;
+}
+
+float Keti_ft_search::relevance() {
+  const auto key = std::make_pair(
+      m_current->segment,
+      (ulonglong)m_current->block << 32 | m_current->offset);
+  if (m_executed) {
+    auto it = m_scores.find(key);
+    if (it != m_scores.end()) return it->second;
+    if (!m_bounded) return 0;
+  }
+
+  /* MATCH outside of the access method scores every row read */
+  m_bounded = false;
+  if (search(HA_POS_ERROR)) {
+    keti_log(ERROR_LEVEL, "cannot score rows of %s", m_csd_name.c_str());
+    m_results.clear();
+    m_scores.clear();
+  }
+  auto it = m_scores.find(key);
+  return it == m_scores.end() ? 0 : it->second;
+}
@@ -0,0 +1,208 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_fulltext.h
+
+    @brief
+  FULLTEXT keys: per segment inverted indexes with term frequencies, scored
+  with BM25 by the storage node.
+
+    @details
+  The words of a row are the runs of letters, digits and '_' in the columns
+  of the key, of keti_ft_min_token_size to keti_ft_max_token_size
+  characters, each kept as its weight string in the column's collation.
+  Every segment gets, per FULLTEXT key, the rows and their word counts and,
+  for each word, the rows that hold it and how often. Rows are numbered as
+  for bitmap indexes, block << 16 | index of the row in its block.
+
+  MATCH ... AGAINST runs in two requests. The node first counts, over all
+  segments, the rows and words of the key and the rows holding each query
+  word, so every segment scores with the IDF of the whole table. It then
+  scores the rows of each segment,
+
+  @verbatim
+    score = sum over query words w in the row of
+            idf(w) * tf * (k1 + 1) / (tf + k1 * (1 - b + b * length / avg))
+    idf(w) = ln(1 + (rows - df(w) + 0.5) / (df(w) + 0.5))
+  @endverbatim
+
+  with k1 = 1.2 and b = 0.75, and replies with its best rows by segment. The
+  host merges them into the best rows of the table. With an ORDER BY MATCH
+  ... LIMIT the server passes the limit down and each segment returns at
+  most that many rows. A segment the node has no index for, one too large
+  to number its rows, is read and scored on the host.
+
+  In BOOLEAN MODE a word after + must be in the row and one after - must
+  not; other words are optional, but a row with no required word needs one
+  of them. Operators that weigh words and truncation are ignored. The words
+  of a phrase take the operator of the phrase, without checking that they
+  are adjacent, and an excluded phrase is ignored. WITH QUERY EXPANSION
+  searches the query words only.
+*/
+
+#ifndef KETI_FULLTEXT_H
+#define KETI_FULLTEXT_H
+
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "my_base.h" /* ha_rows */
+#include "my_inttypes.h"
+#include "sql/item.h" /* FT_INFO */
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_row.h"
+
+class Keti_table_versions;
+class String;
+struct TABLE;
+struct TABLE_SHARE;
+
+struct keti_fulltext_stats_t {
+  ulonglong searches;          ///< MATCH ... AGAINST evaluated
+  ulonglong rows_host_scored;  ///< Rows of unindexed segments scored here
+};
+
+extern keti_fulltext_stats_t keti_fulltext_stats;
+
+extern ulong srv_ft_min_token_size;
+extern ulong srv_ft_max_token_size;
+
+/** @brief
+  The FULLTEXT indexes of one segment under construction.
+*/
+class Keti_fulltext_index {
+ public:
+  Keti_fulltext_index() : m_overflow(false) {}
+
+  /** Record the words of key in the row at block and index. */
+  void add(uint16 key, const std::vector<std::string> &words, uint32 block,
+           uint32 index);
+
+  bool empty() const { return m_keys.empty() || m_overflow; }
+
+  /**
+    Hand over the indexes in the format csd_write_fulltext() takes. Per key:
+    the key number in 2 bytes, its rows as packed by keti_pack_postings()
+    with their word counts in 4 bytes each, and the number of distinct
+    words in 4 bytes. Per word: the word preceded by its length in 4 bytes,
+    the rows holding it as packed by keti_pack_postings() and how often
+    each does in 1 byte, at most 255. The builder is empty afterwards.
+  */
+  void take(std::vector<uchar> *out);
+
+ private:
+  struct Key_index {
+    std::vector<uint32> rows;
+    std::vector<uint32> lengths;
+    std::map<std::string, std::vector<std::pair<uint32, uint32>>> words;
+  };
+  std::map<uint16, Key_index> m_keys;
+  bool m_overflow;
+};
+
+/** @brief
+  One MATCH ... AGAINST on a FULLTEXT key, handed to the server as its
+  FT_INFO.
+*/
+class Keti_ft_search : public FT_INFO {
+ public:
+  /**
+    @param current  the row the handler returned last, which
+                    find_relevance() scores
+  */
+  Keti_ft_search(TABLE *table, uint key, const std::string &csd_name,
+                 const Keti_table_versions *versions,
+                 const Keti_row_pos *current);
+
+  /** Split the query; limit is the number of rows wanted, or HA_POS_ERROR. */
+  void parse(const String &query, uint flags, ha_rows limit);
+
+  /** Find the matching rows of the table in the order of their scores. */
+  int execute();
+
+  /**
+    The next row by score.
+
+    @return 0, HA_ERR_END_OF_FILE or an error
+  */
+  int next(Keti_row_pos *pos);
+
+  /** The row next() returned last is not visible to the reader. */
+  void skipped() { m_skipped++; }
+
+  /** Score of the row last returned by the handler, 0 if it does not match. */
+  float relevance();
+
+  /** Score of the row next() returned last. */
+  float last_relevance() const { return m_last; }
+
+  /** Start over from the best row. */
+  void rewind() { m_next = 0; }
+
+ private:
+  enum Mode { OPTIONAL = 0, REQUIRED = 1, EXCLUDED = 2 };
+  struct Term {
+    std::string word;
+    Mode mode;
+    double idf;
+  };
+  struct Result {
+    Keti_row_pos pos;
+    double score;
+  };
+  /** A row of an unindexed segment, until the table's statistics are known. */
+  struct Document {
+    Keti_row_pos pos;
+    uint32 length;
+    std::vector<uint32> counts;  ///< Occurrences of each term
+  };
+
+  int search(ha_rows limit);
+  int scan_segment(const Keti_segment &segment, ulonglong *rows,
+                   ulonglong *words, std::vector<ulonglong> *df,
+                   std::vector<Document> *documents);
+  bool score(const std::vector<uint32> &counts, uint32 length, double avg,
+             double *score) const;
+
+  TABLE *m_table;
+  uint m_key;
+  std::string m_csd_name;
+  const Keti_table_versions *m_versions;
+  const Keti_row_pos *m_current;
+  std::vector<Term> m_terms;
+  ha_rows m_limit;
+
+  bool m_executed;
+  /** m_results holds the best m_limit rows only. */
+  bool m_bounded;
+  std::vector<Result> m_results;
+  /** Scores by forwarded position, as segment and block << 32 | offset. */
+  std::map<std::pair<uint32, ulonglong>, float> m_scores;
+  size_t m_next;
+  size_t m_skipped;
+  float m_last;
+};
+
+/** FULLTEXT keys of a table. */
+void keti_fulltext_keys(const TABLE_SHARE *share, std::vector<uint16> *keys);
+
+/** Words of the columns of FULLTEXT key of table in record, repeats kept. */
+void keti_ft_words(const TABLE *table, uint key, const uchar *record,
+                   std::vector<std::string> *words);
+
+#endif /* KETI_FULLTEXT_H */
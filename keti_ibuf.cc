@@ -0,0 +1,593 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_ibuf.cc
+
+    @brief
+  KETI change buffer, its log and its merge thread.
+
+    @details
+  Log records hold whole keys; the entries of a merge request, sorted by
+  key, only the part of their key that differs from the key before. A drop
+  record, field 0xFFFF, tells a replay to forget the entries of the table
+  before it:
+
+  @verbatim
+    log record := table_length(2) table field(2) entry
+    drop record:= table_length(2) table 0xFFFF(2)
+    entry      := op(1) segment(4) block(4) offset(4) key_length(4) key
+    change     := op(1) segment(4) block(4) offset(4) prefix_length(4)
+                  suffix_length(4) suffix
+  @endverbatim
+*/
+
+#include "storage/keti/keti_ibuf.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "my_byteorder.h"
+#include "my_io.h"
+#include "my_sys.h"
+#include "sql/field.h"
+#include "sql/mysqld.h"
+#include "sql/table.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_key.h"
+#include "template_utils.h"
+
+keti_ibuf_stats_t keti_ibuf_stats = {0, 0};
+
+ulonglong srv_change_buffer_max_size = 64 * 1024 * 1024;
+ulong srv_change_buffer_merge_interval = 5;
+
+static const char *LOG_FILE_NAME = "keti_ibuf.log";
+static const char *INDEX_COMMENT = "keti_index";
+static const size_t ENTRY_HEADER_SIZE = 1 + KETI_REF_LENGTH + 4;
+static const uint16 DROP_FIELD = 0xFFFF;
+
+typedef std::pair<std::string, uint16> index_id_t;
+
+static std::mutex ibuf_mutex;
+static std::map<index_id_t, std::vector<Keti_ibuf_entry>> buffers;
+static size_t buffered_bytes = 0;
+/** Sequence number of the next entry buffered */
+static ulonglong next_seq = 0;
+/** Merges between taking entries out of buffers and their reply */
+static size_t merges_running = 0;
+/** Adders syncing the log outside of ibuf_mutex */
+static size_t syncs_running = 0;
+static FILE *log_file = NULL;
+/** Size of the log, and of its records not merged yet */
+static size_t log_bytes = 0;
+static size_t live_bytes = 0;
+/**
+  next_seq when a table was dropped while merges were running, so that
+  those failing do not put its entries back
+*/
+static std::map<std::string, ulonglong> dropped;
+
+/** @brief
+  Entries in the log that wait for the commit they belong to.
+*/
+struct Pending_entries {
+  std::string table;
+  std::vector<Keti_ibuf_entry> entries;
+};
+
+static std::map<ulonglong, Pending_entries> pending;
+static ulonglong next_ticket = 1;
+
+void keti_indexed_fields(const TABLE_SHARE *share,
+                         std::vector<uint16> *fields) {
+  fields->clear();
+  for (uint i = 0; i < share->fields; i++) {
+    const LEX_CSTRING &comment = share->field[i]->comment;
+    if (comment.length > 0 &&
+        std::search(comment.str, comment.str + comment.length, INDEX_COMMENT,
+                    INDEX_COMMENT + strlen(INDEX_COMMENT)) !=
+            comment.str + comment.length)
+      fields->push_back(static_cast<uint16>(i));
+  }
+}
+
+void keti_index_key(Field *field, const uchar *record, std::string *key) {
+  keti_normalized_key(field, record, key);
+}
+
+static size_t entry_size(const Keti_ibuf_entry &entry) {
+  return ENTRY_HEADER_SIZE + entry.key.size();
+}
+
+static void store_entry(const Keti_ibuf_entry &entry, std::string *out) {
+  uchar header[ENTRY_HEADER_SIZE];
+  header[0] = entry.op;
+  keti_store_pos(header + 1, entry.pos);
+  int4store(header + 1 + KETI_REF_LENGTH,
+            static_cast<uint32>(entry.key.size()));
+  out->append(pointer_cast<const char *>(header), sizeof(header));
+  out->append(entry.key);
+}
+
+static size_t record_size(const std::string &table,
+                          const Keti_ibuf_entry &entry) {
+  return 4 + table.size() + entry_size(entry);
+}
+
+/** Append a log record, of entry or, if entry is NULL, of a drop. */
+static void store_record(const std::string &table,
+                         const Keti_ibuf_entry *entry, std::string *out) {
+  uchar header[4];
+  int2store(header, static_cast<uint16>(table.size()));
+  int2store(header + 2, entry != NULL ? entry->field : DROP_FIELD);
+  out->append(pointer_cast<const char *>(header), 2);
+  out->append(table);
+  out->append(pointer_cast<const char *>(header + 2), 2);
+  if (entry != NULL) store_entry(*entry, out);
+}
+
+/** Append entry to a merge request, its key front coded against previous. */
+static void store_change(const Keti_ibuf_entry &entry,
+                         const std::string &previous, std::string *out) {
+  const size_t limit = std::min(previous.size(), entry.key.size());
+  size_t prefix = 0;
+  while (prefix < limit && previous[prefix] == entry.key[prefix]) prefix++;
+
+  uchar header[ENTRY_HEADER_SIZE + 4];
+  header[0] = entry.op;
+  keti_store_pos(header + 1, entry.pos);
+  int4store(header + 1 + KETI_REF_LENGTH, static_cast<uint32>(prefix));
+  int4store(header + 1 + KETI_REF_LENGTH + 4,
+            static_cast<uint32>(entry.key.size() - prefix));
+  out->append(pointer_cast<const char *>(header), sizeof(header));
+  out->append(entry.key, prefix, std::string::npos);
+}
+
+static bool read_entry(const uchar **ptr, const uchar *end,
+                       Keti_ibuf_entry *entry) {
+  if (end - *ptr < static_cast<ptrdiff_t>(ENTRY_HEADER_SIZE)) return false;
+  entry->op = (*ptr)[0];
+  entry->pos = keti_read_pos(*ptr + 1);
+  const uint32 key_length = uint4korr(*ptr + 1 + KETI_REF_LENGTH);
+  *ptr += ENTRY_HEADER_SIZE;
+  if (end - *ptr < static_cast<ptrdiff_t>(key_length)) return false;
+  entry->key.assign(pointer_cast<const char *>(*ptr), key_length);
+  *ptr += key_length;
+  return true;
+}
+
+/** Add entries to the buffers; caller holds ibuf_mutex. */
+static void buffer_entry(const std::string &table, Keti_ibuf_entry &&entry) {
+  buffered_bytes += entry_size(entry);
+  keti_ibuf_stats.entries++;
+  entry.seq = next_seq++;
+  buffers[index_id_t(table, entry.field)].push_back(std::move(entry));
+}
+
+static void log_file_path(char *path) {
+  fn_format(path, LOG_FILE_NAME, mysql_real_data_home, "",
+            MY_UNPACK_FILENAME | MY_SAFE_PATH);
+}
+
+/**
+  Rewrite the log to the records not merged yet once they are less than
+  half of it, so that it neither grows without bound nor replays what the
+  node has; caller holds ibuf_mutex.
+*/
+static void checkpoint_log() {
+  if (log_file == NULL || merges_running > 0 || syncs_running > 0 ||
+      log_bytes <= 2 * live_bytes)
+    return;
+  if (buffers.empty() && pending.empty()) {
+    fflush(log_file);
+    if (ftruncate(fileno(log_file), 0) != 0)
+      keti_log(WARNING_LEVEL, "cannot truncate %s", LOG_FILE_NAME);
+    rewind(log_file);
+    log_bytes = 0;
+    return;
+  }
+
+  /* Entries of an index are in the order they were made, commits after */
+  std::string log;
+  for (const auto &buffer : buffers)
+    for (const Keti_ibuf_entry &entry : buffer.second)
+      store_record(buffer.first.first, &entry, &log);
+  for (const auto &waiting : pending)
+    for (const Keti_ibuf_entry &entry : waiting.second.entries)
+      store_record(waiting.second.table, &entry, &log);
+
+  char path[FN_REFLEN];
+  log_file_path(path);
+  const std::string tmp_path = std::string(path) + ".incomplete";
+  FILE *file = fopen(tmp_path.c_str(), "wb");
+  if (file == NULL) {
+    keti_log(WARNING_LEVEL, "cannot open %s for writing", tmp_path.c_str());
+    return;
+  }
+  const bool written =
+      fwrite(log.data(), 1, log.size(), file) == log.size() &&
+      fflush(file) == 0 && my_sync(fileno(file), MYF(0)) == 0;
+  if (fclose(file) != 0 || !written ||
+      rename(tmp_path.c_str(), path) != 0) {
+    keti_log(WARNING_LEVEL, "cannot checkpoint %s", LOG_FILE_NAME);
+    remove(tmp_path.c_str());
+    return;
+  }
+  my_sync_dir_by_file(path, MYF(0));
+
+  fclose(log_file);
+  log_file = fopen(path, "a+b");
+  if (log_file == NULL)
+    keti_log(ERROR_LEVEL,
+             "cannot open %s; index changes are not crash safe", path);
+  log_bytes = log.size();
+}
+
+/** Forget the buffered entries of table; caller holds ibuf_mutex. */
+static void forget_table(const std::string &table) {
+  for (auto it = buffers.begin(); it != buffers.end();) {
+    if (it->first.first != table) {
+      ++it;
+      continue;
+    }
+    for (const Keti_ibuf_entry &entry : it->second) {
+      buffered_bytes -= entry_size(entry);
+      live_bytes -= record_size(table, entry);
+    }
+    keti_ibuf_stats.entries -= it->second.size();
+    it = buffers.erase(it);
+  }
+}
+
+static std::condition_variable merge_cond;
+
+/** Forget entries waiting for a commit; caller holds ibuf_mutex. */
+static void discard(ulonglong ticket) {
+  auto it = pending.find(ticket);
+  if (it == pending.end()) return;
+  for (const Keti_ibuf_entry &entry : it->second.entries)
+    live_bytes -= record_size(it->second.table, entry);
+  pending.erase(it);
+  checkpoint_log();
+}
+
+/**
+  Append entries of table to the log and sync it. They are buffered, or
+  wait for the commit they belong to if ticket is not NULL.
+*/
+static int log_entries(const std::string &table,
+                       std::vector<Keti_ibuf_entry> *entries,
+                       ulonglong *ticket) {
+  std::string record;
+  for (const Keti_ibuf_entry &entry : *entries)
+    store_record(table, &entry, &record);
+
+  int fd = -1;
+  {
+    std::lock_guard<std::mutex> guard(ibuf_mutex);
+    if (log_file != NULL) {
+      if (fwrite(record.data(), 1, record.size(), log_file) != record.size() ||
+          fflush(log_file) != 0) {
+        keti_log(ERROR_LEVEL, "cannot append to %s", LOG_FILE_NAME);
+        return HA_ERR_INTERNAL_ERROR;
+      }
+      fd = fileno(log_file);
+      log_bytes += record.size();
+      syncs_running++;
+    }
+    live_bytes += record.size();
+    if (ticket != NULL) {
+      *ticket = next_ticket++;
+      Pending_entries &waiting = pending[*ticket];
+      waiting.table = table;
+      waiting.entries.swap(*entries);
+    } else {
+      for (Keti_ibuf_entry &entry : *entries)
+        buffer_entry(table, std::move(entry));
+      if (buffered_bytes > srv_change_buffer_max_size)
+        merge_cond.notify_all();
+    }
+  }
+  entries->clear();
+
+  /* Several adders may share one sync; no checkpoint closes the log under */
+  if (fd >= 0) {
+    const bool synced = my_sync(fd, MYF(0)) == 0;
+    std::lock_guard<std::mutex> guard(ibuf_mutex);
+    syncs_running--;
+    if (!synced) {
+      keti_log(ERROR_LEVEL, "cannot sync %s", LOG_FILE_NAME);
+      if (ticket != NULL) discard(*ticket);
+      return HA_ERR_INTERNAL_ERROR;
+    }
+  }
+  return 0;
+}
+
+int keti_ibuf_add(const std::string &table,
+                  std::vector<Keti_ibuf_entry> *entries) {
+  if (entries->empty()) return 0;
+  return log_entries(table, entries, NULL);
+}
+
+int keti_ibuf_log(const std::string &table,
+                  std::vector<Keti_ibuf_entry> *entries, ulonglong *ticket) {
+  *ticket = 0;
+  if (entries->empty()) return 0;
+  return log_entries(table, entries, ticket);
+}
+
+void keti_ibuf_publish(ulonglong ticket) {
+  std::lock_guard<std::mutex> guard(ibuf_mutex);
+  auto it = pending.find(ticket);
+  if (it == pending.end()) return;
+  for (Keti_ibuf_entry &entry : it->second.entries)
+    buffer_entry(it->second.table, std::move(entry));
+  pending.erase(it);
+  if (buffered_bytes > srv_change_buffer_max_size) merge_cond.notify_all();
+}
+
+void keti_ibuf_discard(ulonglong ticket) {
+  std::lock_guard<std::mutex> guard(ibuf_mutex);
+  discard(ticket);
+}
+
+/** Send the buffered entries of one index to the node. */
+static int merge_index(const index_id_t &id) {
+  std::vector<Keti_ibuf_entry> entries;
+  {
+    std::lock_guard<std::mutex> guard(ibuf_mutex);
+    auto it = buffers.find(id);
+    if (it == buffers.end()) return 0;
+    entries.swap(it->second);
+    buffers.erase(it);
+    merges_running++;
+  }
+
+  /* A delete after an insert of the same key and row must stay after it */
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const Keti_ibuf_entry &a, const Keti_ibuf_entry &b) {
+                     if (a.key != b.key) return a.key < b.key;
+                     if (a.pos.segment != b.pos.segment)
+                       return a.pos.segment < b.pos.segment;
+                     if (a.pos.block != b.pos.block)
+                       return a.pos.block < b.pos.block;
+                     if (a.pos.offset != b.pos.offset)
+                       return a.pos.offset < b.pos.offset;
+                     return a.seq < b.seq;
+                   });
+
+  std::string body;
+  const std::string none;
+  const std::string *previous = &none;
+  for (const Keti_ibuf_entry &entry : entries) {
+    store_change(entry, *previous, &body);
+    previous = &entry.key;
+  }
+  std::vector<unsigned char> request(body.begin(), body.end());
+  int rc = csd_write_index_changes(id.first, id.second, &request);
+
+  std::lock_guard<std::mutex> guard(ibuf_mutex);
+  merges_running--;
+  /* Entries of a table dropped since are not put back */
+  auto drop = dropped.find(id.first);
+  const ulonglong drop_seq = drop != dropped.end() ? drop->second : 0;
+  if (merges_running == 0) dropped.clear();
+  if (rc == HA_ERR_NO_SUCH_TABLE) {
+    keti_log(WARNING_LEVEL, "discarding changes of index %u of missing %s",
+             static_cast<uint>(id.second), id.first.c_str());
+    rc = 0;
+  } else if (rc) {
+    /*
+      Keep them for the next merge, they are still in the log, ahead of
+      the changes buffered since and in the order they were made
+    */
+    keti_log(WARNING_LEVEL, "merge of index %u of %s failed",
+             static_cast<uint>(id.second), id.first.c_str());
+    std::sort(entries.begin(), entries.end(),
+              [](const Keti_ibuf_entry &a, const Keti_ibuf_entry &b) {
+                return a.seq < b.seq;
+              });
+    auto kept = std::find_if(
+        entries.begin(), entries.end(),
+        [drop_seq](const Keti_ibuf_entry &entry) {
+          return entry.seq >= drop_seq;
+        });
+    if (kept != entries.end()) {
+      std::vector<Keti_ibuf_entry> &buffer = buffers[id];
+      buffer.insert(buffer.begin(), std::make_move_iterator(kept),
+                    std::make_move_iterator(entries.end()));
+    }
+    entries.erase(kept, entries.end());
+  } else {
+    keti_ibuf_stats.merges++;
+  }
+
+  for (const Keti_ibuf_entry &entry : entries) {
+    buffered_bytes -= entry_size(entry);
+    live_bytes -= record_size(id.first, entry);
+  }
+  keti_ibuf_stats.entries -= entries.size();
+  checkpoint_log();
+  return rc;
+}
+
+/** Merge the indexes whose ids satisfy pred; return the first error. */
+template <typename Pred>
+static int merge_indexes(Pred pred) {
+  std::vector<index_id_t> ids;
+  {
+    std::lock_guard<std::mutex> guard(ibuf_mutex);
+    for (const auto &buffer : buffers)
+      if (pred(buffer.first)) ids.push_back(buffer.first);
+  }
+
+  int rc = 0;
+  for (const index_id_t &id : ids) {
+    int merge_rc = merge_index(id);
+    if (rc == 0) rc = merge_rc;
+  }
+  return rc;
+}
+
+int keti_ibuf_merge(const std::string &table) {
+  return merge_indexes(
+      [&table](const index_id_t &id) { return id.first == table; });
+}
+
+void keti_ibuf_drop(const std::string &table) {
+  std::string record;
+  store_record(table, NULL, &record);
+
+  int fd = -1;
+  {
+    std::lock_guard<std::mutex> guard(ibuf_mutex);
+    forget_table(table);
+    if (merges_running > 0) dropped[table] = next_seq;
+    /* A replay must not buffer them again, for a table of the same name */
+    if (log_file != NULL && log_bytes > 0) {
+      if (fwrite(record.data(), 1, record.size(), log_file) ==
+              record.size() &&
+          fflush(log_file) == 0) {
+        log_bytes += record.size();
+        fd = fileno(log_file);
+        syncs_running++;
+      } else {
+        keti_log(ERROR_LEVEL, "cannot append to %s", LOG_FILE_NAME);
+      }
+    }
+    checkpoint_log();
+  }
+
+  if (fd >= 0) {
+    const bool synced = my_sync(fd, MYF(0)) == 0;
+    std::lock_guard<std::mutex> guard(ibuf_mutex);
+    syncs_running--;
+    if (!synced) keti_log(ERROR_LEVEL, "cannot sync %s", LOG_FILE_NAME);
+    checkpoint_log();
+  }
+}
+
+/** Buffer the entries of the log left by the previous run. */
+static void replay_log() {
+  std::vector<uchar> log;
+  uchar chunk[64 * 1024];
+  size_t length;
+  rewind(log_file);
+  while ((length = fread(chunk, 1, sizeof(chunk), log_file)) > 0)
+    log.insert(log.end(), chunk, chunk + length);
+
+  const uchar *ptr = log.data();
+  const uchar *end = ptr + log.size();
+  const uchar *complete = ptr;
+  size_t replayed = 0;
+  while (ptr < end) {
+    if (end - ptr < 2) break;
+    const uint16 table_length = uint2korr(ptr);
+    if (end - ptr < 4 + table_length) break;
+    const std::string table(pointer_cast<const char *>(ptr + 2),
+                            table_length);
+    Keti_ibuf_entry entry;
+    entry.field = uint2korr(ptr + 2 + table_length);
+    ptr += 4 + table_length;
+    if (entry.field == DROP_FIELD) {
+      forget_table(table);
+      complete = ptr;
+      continue;
+    }
+    /* A torn last record was never acknowledged */
+    if (!read_entry(&ptr, end, &entry)) break;
+    live_bytes += record_size(table, entry);
+    buffer_entry(table, std::move(entry));
+    replayed++;
+    complete = ptr;
+  }
+  /* Records appended behind a torn one would be lost at the next start */
+  if (complete < end) {
+    keti_log(WARNING_LEVEL, "dropping a torn record at the end of %s",
+             LOG_FILE_NAME);
+    fflush(log_file);
+    if (ftruncate(fileno(log_file), complete - log.data()) != 0)
+      keti_log(WARNING_LEVEL, "cannot truncate %s", LOG_FILE_NAME);
+  }
+  fseek(log_file, 0, SEEK_END);
+  log_bytes = complete - log.data();
+  checkpoint_log();
+
+  if (replayed > 0)
+    keti_log(INFORMATION_LEVEL, "replayed %zu change buffer entries",
+             replayed);
+}
+
+static std::thread merge_thread;
+static bool merge_thread_stop = false;
+
+static void change_buffer_merge_thread() {
+  std::unique_lock<std::mutex> lock(ibuf_mutex);
+  while (!merge_thread_stop) {
+    merge_cond.wait_for(lock,
+                        std::chrono::seconds(srv_change_buffer_merge_interval));
+    if (merge_thread_stop || buffers.empty()) continue;
+
+    lock.unlock();
+    merge_indexes([](const index_id_t &) { return true; });
+    lock.lock();
+  }
+}
+
+void keti_ibuf_init() {
+  char path[FN_REFLEN];
+  log_file_path(path);
+  log_file = fopen(path, "a+b");
+  if (log_file == NULL)
+    keti_log(ERROR_LEVEL,
+             "cannot open %s; index changes are not crash safe", path);
+  else
+    replay_log();
+
+  merge_thread_stop = false;
+  merge_thread = std::thread(change_buffer_merge_thread);
+}
+
+void keti_ibuf_deinit() {
+  {
+    std::lock_guard<std::mutex> guard(ibuf_mutex);
+    merge_thread_stop = true;
+    merge_cond.notify_all();
+  }
+  if (merge_thread.joinable()) merge_thread.join();
+
+  /* Whatever does not make it stays in the log for the next start */
+  merge_indexes([](const index_id_t &) { return true; });
+
+  std::lock_guard<std::mutex> guard(ibuf_mutex);
+  if (log_file != NULL) fclose(log_file);
+  log_file = NULL;
+  buffers.clear();
+  pending.clear();
+  dropped.clear();
+  buffered_bytes = 0;
+  log_bytes = 0;
+  live_bytes = 0;
+  keti_ibuf_stats.entries = 0;
+}
@@ -0,0 +1,136 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_ibuf.h
+
+    @brief
+  Change buffer for the secondary indexes the storage node keeps.
+
+    @details
+  A column whose COMMENT contains "keti_index" is indexed by the storage
+  node. Inserting a row does not update those indexes on the node. The
+  entry, the normalized key of the column (see keti_key.h) and the position
+  of the row, is appended to a write-ahead log in the data directory and
+  kept in memory, per index, until it is merged:
+
+  - before a scan that pushes a condition to the node, for the indexes of
+    that table, so that the node sees complete indexes;
+  - by a background thread every keti_change_buffer_merge_interval
+    seconds, or as soon as the buffer exceeds keti_change_buffer_max_size.
+
+  A merge sends the sorted entries of one index in one request, each key
+  stored as the part that differs from the key before, so the node touches
+  each of its index pages once per merge instead of once per row. Changes
+  of the same key and row keep the order they were made in. Once less
+  than half of the log is left to merge, it is rewritten to that part, or
+  emptied if nothing is left; a startup replays what it holds. Dropping a
+  table appends a record that makes the replay forget its earlier entries.
+
+  The index changes of the rows a transaction deletes are logged before
+  the node takes its commit, and buffered once it did, so that a crash in
+  between loses none of them. A replay may then send the deletion of an
+  entry whose row was never deleted; the node ignores those, as it ignores
+  the changes of rows of segments it discarded.
+*/
+
+#ifndef KETI_IBUF_H
+#define KETI_IBUF_H
+
+#include <string>
+#include <vector>
+
+#include "my_inttypes.h"
+#include "storage/keti/keti_row.h"
+
+class Field;
+struct TABLE;
+struct TABLE_SHARE;
+
+enum Keti_ibuf_op { KETI_IBUF_INSERT = 0, KETI_IBUF_DELETE = 1 };
+
+/** @brief
+  A buffered change of one index.
+*/
+struct Keti_ibuf_entry {
+  uint16 field;      ///< Indexed column
+  uint8 op;          ///< Keti_ibuf_op
+  Keti_row_pos pos;  ///< Row the key belongs to
+  std::string key;   ///< Normalized key, see keti_index_key()
+  ulonglong seq;     ///< Order it was buffered in; set by the buffer
+};
+
+/** Indexes of the columns of a table that carry a KETI index. */
+void keti_indexed_fields(const TABLE_SHARE *share, std::vector<uint16> *fields);
+
+/**
+  Key of a non-NULL column of the row in record, normalized so that the
+  node orders and searches its indexes with memcmp().
+*/
+void keti_index_key(Field *field, const uchar *record, std::string *key);
+
+/**
+  Make changes of the indexes of table durable in the log and buffer them.
+
+  @param entries  consumed
+*/
+int keti_ibuf_add(const std::string &table,
+                  std::vector<Keti_ibuf_entry> *entries);
+
+/**
+  Make changes of the indexes of table durable in the log, without
+  buffering them yet, as they belong to a commit the node has not taken.
+  keti_ibuf_publish() buffers them once it did, keti_ibuf_discard() forgets
+  them otherwise.
+
+  @param entries  consumed
+  @param ticket   receives what to publish or discard them by
+
+  @return 0, or an error, in which case nothing waits for publishing
+*/
+int keti_ibuf_log(const std::string &table,
+                  std::vector<Keti_ibuf_entry> *entries, ulonglong *ticket);
+
+/** Buffer the changes keti_ibuf_log() made durable; cannot fail. */
+void keti_ibuf_publish(ulonglong ticket);
+
+/** Forget the changes keti_ibuf_log() made durable. */
+void keti_ibuf_discard(ulonglong ticket);
+
+/** Merge the buffered changes of all indexes of table into the node. */
+int keti_ibuf_merge(const std::string &table);
+
+/**
+  Forget the buffered changes of a dropped table, including those of merges
+  running now that fail, and those in the log.
+*/
+void keti_ibuf_drop(const std::string &table);
+
+struct keti_ibuf_stats_t {
+  ulonglong entries;  ///< Entries buffered now
+  ulonglong merges;   ///< Index merges sent to the node
+};
+
+extern keti_ibuf_stats_t keti_ibuf_stats;
+
+extern ulonglong srv_change_buffer_max_size;
+extern ulong srv_change_buffer_merge_interval;
+
+/** Replay the log and start the merge thread. */
+void keti_ibuf_init();
+
+/** Stop the merge thread and merge what is left. */
+void keti_ibuf_deinit();
+
+#endif /* KETI_IBUF_H */
@@ -0,0 +1,391 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_import.cc
+
+    @brief
+  Writing and attaching segment files.
+*/
+
+#include "storage/keti/keti_import.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <mutex>
+
+#include "m_ctype.h"
+#include "my_byteorder.h"
+#include "my_dir.h"
+#include "sql/field.h"
+#include "sql/table.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_lock.h"
+#include "template_utils.h"
+
+keti_import_stats_t keti_import_stats = {0, 0, 0};
+
+static std::mutex stats_mutex;
+
+static const char FILE_MAGIC[8] = {'K', 'E', 'T', 'I', 'S', 'E', 'G', '1'};
+static const char FILE_EXTENSION[] = ".kseg";
+static const size_t FILE_HEADER_SIZE = 8 + 4 + 8;
+static const size_t ENTRY_HEADER_SIZE = 2 + 1 + 4 + 4 + 4;
+
+/** Sections of a file, in order. */
+enum Section {
+  SECTION_BLOCKS,
+  SECTION_BITMAPS,
+  SECTION_POSTINGS,
+  SECTION_FULLTEXT,
+  SECTION_VECTORS,
+  SECTION_ENTRIES,
+  SECTION_STATS,
+  SECTION_COUNT
+};
+
+static void hash_bytes(const void *data, size_t length, uint32 *hash) {
+  const uchar *bytes = static_cast<const uchar *>(data);
+  for (size_t i = 0; i < length; i++) {
+    *hash ^= bytes[i];
+    *hash *= 16777619;
+  }
+}
+
+static void hash_number(ulonglong number, uint32 *hash) {
+  uchar bytes[8];
+  int8store(bytes, number);
+  hash_bytes(bytes, sizeof(bytes), hash);
+}
+
+/**
+  FNV-1a hash of what the blocks and indexes of a segment of table depend
+  on: the record format, the collations of the columns, their COMMENTs,
+  which name their indexes, and the FULLTEXT keys.
+*/
+static uint32 table_layout(const TABLE *table) {
+  const TABLE_SHARE *share = table->s;
+  uint32 hash = 2166136261U;
+  hash_number(share->reclength, &hash);
+  hash_number(share->null_bytes, &hash);
+  hash_number(share->fields, &hash);
+  for (uint i = 0; i < share->fields; i++) {
+    const Field *field = table->field[i];
+    hash_number(field->real_type(), &hash);
+    hash_number(field->pack_length(), &hash);
+    hash_number(field->offset(table->record[0]), &hash);
+    hash_number(field->null_bit, &hash);
+    hash_number(field->charset()->number, &hash);
+    hash_number(field->comment.length, &hash);
+    hash_bytes(field->comment.str, field->comment.length, &hash);
+  }
+  for (uint i = 0; i < share->keys; i++) {
+    const KEY &key = table->key_info[i];
+    if (!(key.flags & HA_FULLTEXT)) continue;
+    hash_number(i, &hash);
+    for (uint j = 0; j < key.user_defined_key_parts; j++)
+      hash_number(key.key_part[j].fieldnr, &hash);
+  }
+  return hash;
+}
+
+static void append_section(const uchar *data, size_t length,
+                           std::vector<uchar> *out) {
+  const size_t pos = out->size();
+  out->resize(pos + 4);
+  int4store(out->data() + pos, static_cast<uint32>(length));
+  out->insert(out->end(), data, data + length);
+}
+
+static void append_section(const std::vector<uchar> &data,
+                           std::vector<uchar> *out) {
+  append_section(data.data(), data.size(), out);
+}
+
+int keti_write_segment_file(const char *dir, const TABLE *table,
+                            std::vector<uchar> *blocks, ha_rows rows,
+                            std::vector<Keti_ibuf_entry> *entries,
+                            Keti_segment_indexes *indexes,
+                            const Keti_row_stats &stats) {
+  std::vector<uchar> header(FILE_HEADER_SIZE);
+  memcpy(header.data(), FILE_MAGIC, sizeof(FILE_MAGIC));
+  int4store(header.data() + 8, table_layout(table));
+  int8store(header.data() + 12, rows);
+
+  std::vector<uchar> entry_data;
+  for (const Keti_ibuf_entry &entry : *entries) {
+    const size_t pos = entry_data.size();
+    entry_data.resize(pos + ENTRY_HEADER_SIZE);
+    uchar *ptr = entry_data.data() + pos;
+    int2store(ptr, entry.field);
+    ptr[2] = entry.op;
+    int4store(ptr + 3, entry.pos.block);
+    int4store(ptr + 7, entry.pos.offset);
+    int4store(ptr + 11, static_cast<uint32>(entry.key.size()));
+    entry_data.insert(entry_data.end(), entry.key.begin(), entry.key.end());
+  }
+  entries->clear();
+  std::vector<uchar> stats_data;
+  stats.pack(&stats_data);
+
+  std::vector<uchar> sections;
+  append_section(*blocks, &sections);
+  append_section(indexes->bitmaps, &sections);
+  append_section(indexes->postings, &sections);
+  append_section(indexes->fulltext, &sections);
+  append_section(indexes->vectors, &sections);
+  append_section(entry_data, &sections);
+  append_section(stats_data, &sections);
+  blocks->clear();
+  indexes->bitmaps.clear();
+  indexes->postings.clear();
+  indexes->fulltext.clear();
+  indexes->vectors.clear();
+
+  /* Unique across restarts; readers skip the file until it is renamed */
+  const std::string path = std::string(dir) + "/" +
+                           std::to_string(time(NULL)) + "-" +
+                           std::to_string(keti_next_version()) +
+                           FILE_EXTENSION;
+  const std::string tmp_path = path + ".incomplete";
+  FILE *file = fopen(tmp_path.c_str(), "wb");
+  if (file == NULL) {
+    keti_log(ERROR_LEVEL, "cannot open %s for writing", tmp_path.c_str());
+    return HA_ERR_INTERNAL_ERROR;
+  }
+  const bool written =
+      fwrite(header.data(), 1, header.size(), file) == header.size() &&
+      fwrite(sections.data(), 1, sections.size(), file) == sections.size();
+  if (fclose(file) != 0 || !written ||
+      rename(tmp_path.c_str(), path.c_str()) != 0) {
+    keti_log(ERROR_LEVEL, "cannot write segment file %s", path.c_str());
+    remove(tmp_path.c_str());
+    return HA_ERR_INTERNAL_ERROR;
+  }
+
+  std::lock_guard<std::mutex> guard(stats_mutex);
+  keti_import_stats.files_written++;
+  return 0;
+}
+
+static bool read_file(const std::string &path, std::vector<uchar> *data) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == NULL) return false;
+  bool read = fseek(file, 0, SEEK_END) == 0;
+  const long length = read ? ftell(file) : -1;
+  read = length >= 0 && fseek(file, 0, SEEK_SET) == 0;
+  if (read) {
+    data->resize(length);
+    read = fread(data->data(), 1, data->size(), file) == data->size();
+  }
+  fclose(file);
+  return read;
+}
+
+/** A segment file, its sections pointing into data. */
+struct Segment_file {
+  std::vector<uchar> data;
+  ha_rows rows;
+  const uchar *sections[SECTION_COUNT];
+  size_t lengths[SECTION_COUNT];
+};
+
+static int parse_file(const std::string &path, uint32 layout,
+                      Segment_file *file) {
+  if (!read_file(path, &file->data)) {
+    keti_log(ERROR_LEVEL, "cannot read segment file %s", path.c_str());
+    return HA_ERR_INTERNAL_ERROR;
+  }
+
+  const uchar *ptr = file->data.data();
+  const uchar *end = ptr + file->data.size();
+  if (file->data.size() < FILE_HEADER_SIZE ||
+      memcmp(ptr, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+    keti_log(ERROR_LEVEL, "%s is not a segment file", path.c_str());
+    return HA_ERR_CRASHED;
+  }
+  if (uint4korr(ptr + 8) != layout) {
+    keti_log(ERROR_LEVEL, "segment file %s was built for another definition",
+             path.c_str());
+    return HA_ERR_TABLE_DEF_CHANGED;
+  }
+  file->rows = uint8korr(ptr + 12);
+  ptr += FILE_HEADER_SIZE;
+
+  for (int i = 0; i < SECTION_COUNT; i++) {
+    if (end - ptr < 4 || static_cast<size_t>(end - ptr - 4) < uint4korr(ptr))
+      break;
+    file->lengths[i] = uint4korr(ptr);
+    file->sections[i] = ptr + 4;
+    ptr += 4 + file->lengths[i];
+    if (i == SECTION_COUNT - 1 && ptr == end) return 0;
+  }
+  keti_log(ERROR_LEVEL, "segment file %s is truncated", path.c_str());
+  return HA_ERR_CRASHED;
+}
+
+/** Read the KETI index entries of a file staged as segment. */
+static bool parse_entries(const Segment_file &file, uint32 segment,
+                          std::vector<Keti_ibuf_entry> *entries) {
+  const uchar *ptr = file.sections[SECTION_ENTRIES];
+  const uchar *end = ptr + file.lengths[SECTION_ENTRIES];
+  while (ptr < end) {
+    if (static_cast<size_t>(end - ptr) < ENTRY_HEADER_SIZE) return false;
+    Keti_ibuf_entry entry;
+    entry.field = uint2korr(ptr);
+    entry.op = ptr[2];
+    entry.pos.segment = segment;
+    entry.pos.block = uint4korr(ptr + 3);
+    entry.pos.offset = uint4korr(ptr + 7);
+    const uint32 key_length = uint4korr(ptr + 11);
+    ptr += ENTRY_HEADER_SIZE;
+    if (static_cast<size_t>(end - ptr) < key_length) return false;
+    entry.key.assign(pointer_cast<const char *>(ptr), key_length);
+    ptr += key_length;
+    entries->push_back(std::move(entry));
+  }
+  return true;
+}
+
+/** Send a section of a file, unless empty, with write. */
+template <typename Write>
+static int write_section(const Segment_file &file, Section section,
+                         Write write) {
+  if (file.lengths[section] == 0) return 0;
+  std::vector<uchar> body(file.sections[section],
+                          file.sections[section] + file.lengths[section]);
+  return write(&body);
+}
+
+/** Stage the segment of a file on the node with its indexes. */
+static int stage_file(const std::string &table, const Segment_file &file,
+                      uint32 *segment) {
+  if (file.lengths[SECTION_BLOCKS] == 0) return HA_ERR_CRASHED;
+  int rc = write_section(file, SECTION_BLOCKS,
+                         [&](std::vector<uchar> *body) {
+                           return csd_stage_segment(table, body, segment);
+                         });
+  if (rc) return rc;
+
+  /* Unlike a write, an import does not leave a segment without indexes */
+  if ((rc = write_section(file, SECTION_BITMAPS,
+                          [&](std::vector<uchar> *body) {
+                            return csd_write_bitmaps(table, *segment, body);
+                          })) ||
+      (rc = write_section(file, SECTION_POSTINGS,
+                          [&](std::vector<uchar> *body) {
+                            return csd_write_postings(table, *segment, body);
+                          })) ||
+      (rc = write_section(file, SECTION_FULLTEXT,
+                          [&](std::vector<uchar> *body) {
+                            return csd_write_fulltext(table, *segment, body);
+                          })) ||
+      (rc = write_section(file, SECTION_VECTORS,
+                          [&](std::vector<uchar> *body) {
+                            return csd_write_vectors(table, *segment, body);
+                          })) ||
+      (rc = write_section(file, SECTION_STATS,
+                          [&](std::vector<uchar> *body) {
+                            return csd_write_stats(table, *segment, body);
+                          })))
+    return rc;
+  return 0;
+}
+
+int keti_import_segments(const char *dir, const TABLE *table,
+                         const std::string &csd_name,
+                         Keti_table_versions *versions,
+                         Keti_table_stats *table_stats) {
+  MY_DIR *listing = my_dir(dir, MYF(0));
+  if (listing == NULL) {
+    keti_log(ERROR_LEVEL, "cannot read segment directory %s", dir);
+    return HA_ERR_WRONG_COMMAND;
+  }
+  std::vector<std::string> paths;
+  const size_t extension = sizeof(FILE_EXTENSION) - 1;
+  for (uint i = 0; i < listing->number_off_files; i++) {
+    const char *name = listing->dir_entry[i].name;
+    const size_t length = strlen(name);
+    if (length > extension &&
+        strcmp(name + length - extension, FILE_EXTENSION) == 0)
+      paths.push_back(std::string(dir) + "/" + name);
+  }
+  my_dirend(listing);
+
+  /* Stage everything first, and attach all files or none */
+  const uint32 layout = table_layout(table);
+  std::vector<uint32> segments;
+  std::vector<Keti_ibuf_entry> entries;
+  Keti_row_stats stats;
+  ha_rows rows = 0;
+  for (const std::string &path : paths) {
+    Segment_file file;
+    int rc = parse_file(path, layout, &file);
+    Keti_row_stats file_stats;
+    if (rc == 0 && !file_stats.unpack(file.sections[SECTION_STATS],
+                                      file.lengths[SECTION_STATS])) {
+      keti_log(ERROR_LEVEL, "bad statistics in segment file %s", path.c_str());
+      rc = HA_ERR_CRASHED;
+    }
+    uint32 segment;
+    if (rc == 0 && (rc = stage_file(csd_name, file, &segment)) == 0) {
+      segments.push_back(segment);
+      if (!parse_entries(file, segment, &entries)) {
+        keti_log(ERROR_LEVEL, "bad index entries in segment file %s",
+                 path.c_str());
+        rc = HA_ERR_CRASHED;
+      }
+    }
+    if (rc) {
+      if (!segments.empty()) csd_discard_segments(csd_name, segments);
+      return rc;
+    }
+    stats.merge(file_stats);
+    rows += file.rows;
+  }
+  if (segments.empty()) return 0;
+
+  /* Stamped as a transaction of its own, once the node attached them */
+  const ulonglong trx = keti_new_trx_id();
+  keti_trx_started(trx);
+  for (uint32 segment : segments)
+    versions->add_segment(segment, KETI_UNCOMMITTED, trx);
+  int rc = csd_attach_segments(csd_name, segments);
+  if (rc == 0)
+    versions->commit(trx, keti_trx_committing(trx), segments,
+                     std::vector<Keti_row_pos>(), std::vector<uchar>());
+  else
+    versions->rollback(trx, segments, std::vector<Keti_row_pos>(),
+                       std::vector<uchar>());
+  keti_trx_finished(trx);
+  if (rc) {
+    csd_discard_segments(csd_name, segments);
+    return rc;
+  }
+
+  table_stats->merge(stats);
+  for (const std::string &path : paths)
+    if (remove(path.c_str()) != 0)
+      keti_log(WARNING_LEVEL, "cannot remove attached segment file %s",
+               path.c_str());
+  keti_log(INFORMATION_LEVEL, "attached %zu segment files to %s",
+           segments.size(), csd_name.c_str());
+  {
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_import_stats.segments_imported += segments.size();
+    keti_import_stats.rows_imported += rows;
+  }
+  return keti_ibuf_add(csd_name, &entries);
+}
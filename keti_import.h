@@ -0,0 +1,108 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_import.h
+
+    @brief
+  Segment files: segments built ahead of time, away from the table they
+  are meant for, and attached to it whole.
+
+    @details
+  A session whose keti_segment_dir is set builds segment files instead of
+  writing segments. The segments its inserts into a KETI table fill are
+  written, with their bitmap, inverted, FULLTEXT and vector indexes, the
+  changes of their KETI indexes and the statistics of their rows, to files
+  in that directory rather than sent to the storage node. Loading a staging
+  table of the same definition that way, say with LOAD DATA of a file
+  sorted on the columns scans filter on, does the packing, encoding and
+  indexing of the rows off the critical path of the table they are for.
+  As the server writes and reads the files, setting keti_segment_dir takes
+  the FILE privilege and a directory secure_file_priv admits.
+
+  ALTER TABLE t IMPORT TABLESPACE, run by a session whose keti_segment_dir
+  names such a directory, attaches every segment file in it to t. Each
+  segment is staged on the node with its indexes, and then all of them
+  join the manifest in one update, so a scan sees either none or all of
+  the rows. They are stamped with one version, so read views opened before
+  do not see them. The files are removed once attached.
+
+  A file is
+
+  @verbatim
+    file     := magic(8) layout(4) rows(8) blocks bitmaps postings fulltext
+                vectors entries stats
+    section  := length(4) bytes
+    entry    := field(2) op(1) block(4) offset(4) key_length(4) key
+  @endverbatim
+
+  every name after rows being a section: the blocks of the segment as
+  csd_stage_segment() takes them, its indexes as the node takes them, the
+  KETI index entries of its rows and their statistics as
+  Keti_row_stats::pack() stores them. layout identifies the record format
+  and the indexes of the table that built the file; a table only attaches
+  files of its own layout, since the node takes the blocks and indexes as
+  they are.
+*/
+
+#ifndef KETI_IMPORT_H
+#define KETI_IMPORT_H
+
+#include <string>
+#include <vector>
+
+#include "my_base.h" /* ha_rows */
+#include "my_inttypes.h"
+#include "storage/keti/keti_ibuf.h"
+#include "storage/keti/keti_mvcc.h"
+#include "storage/keti/keti_stats.h"
+#include "storage/keti/keti_write.h"
+
+struct TABLE;
+
+struct keti_import_stats_t {
+  ulonglong files_written;      ///< Segment files built
+  ulonglong segments_imported;  ///< Segment files attached to tables
+  ulonglong rows_imported;      ///< Rows of those
+};
+
+extern keti_import_stats_t keti_import_stats;
+
+/**
+  Write a segment of table to a new file in dir.
+
+  @param blocks   as built by Keti_segment_builder; consumed
+  @param entries  KETI index changes of the rows; consumed
+  @param indexes  indexes of the segment; consumed
+  @param stats    statistics of the rows
+*/
+int keti_write_segment_file(const char *dir, const TABLE *table,
+                            std::vector<uchar> *blocks, ha_rows rows,
+                            std::vector<Keti_ibuf_entry> *entries,
+                            Keti_segment_indexes *indexes,
+                            const Keti_row_stats &stats);
+
+/**
+  Attach the segment files in dir to table, named csd_name on the node.
+
+  @return 0, HA_ERR_WRONG_COMMAND if dir cannot be read,
+          HA_ERR_TABLE_DEF_CHANGED if a file was built for another layout,
+          HA_ERR_CRASHED if one is not well formed, or an error of the node
+*/
+int keti_import_segments(const char *dir, const TABLE *table,
+                         const std::string &csd_name,
+                         Keti_table_versions *versions,
+                         Keti_table_stats *table_stats);
+
+#endif /* KETI_IMPORT_H */
@@ -0,0 +1,404 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_inverted.cc
+
+    @brief
+  Tag extraction, posting list encoding and containment search.
+*/
+
+#include "storage/keti/keti_inverted.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include <cpprest/json.h>
+
+#include "m_ctype.h"
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "sql/field.h"
+#include "sql/item.h"
+#include "sql/item_cmpfunc.h"
+#include "sql/table.h"
+#include "sql_string.h"
+#include "storage/keti/keti_bitmap.h"
+#include "storage/keti/keti_key.h"
+#include "template_utils.h"
+
+using namespace web;
+
+static const char *TAGS_COMMENT = "keti_tags";
+
+/** Rows per bit width in a posting list. */
+static const size_t RUN_LENGTH = 128;
+/** Row count the node replies with for a segment without the index. */
+static const uint32 NO_INDEX = 0xFFFFFFFF;
+
+void keti_pack_postings(const std::vector<uint32> &rows,
+                        std::vector<uchar> *out) {
+  size_t offset = out->size();
+  out->resize(offset + 4);
+  int4store(&(*out)[offset], static_cast<uint32>(rows.size()));
+
+  uint32 previous = 0;
+  uint32 deltas[RUN_LENGTH];
+  for (size_t start = 0; start < rows.size(); start += RUN_LENGTH) {
+    const size_t count = std::min(RUN_LENGTH, rows.size() - start);
+    uint32 bits_used = 0;
+    for (size_t i = 0; i < count; i++) {
+      deltas[i] = rows[start + i] - previous;
+      previous = rows[start + i];
+      bits_used |= deltas[i];
+    }
+    const uint width = bits_used == 0 ? 0 : 32 - __builtin_clz(bits_used);
+    out->push_back(static_cast<uchar>(width));
+
+    offset = out->size();
+    out->resize(offset + (count * width + 7) / 8);
+    uchar *ptr = out->data() + offset;
+    uint64 buffer = 0;
+    uint buffered = 0;
+    for (size_t i = 0; i < count; i++) {
+      buffer |= (uint64)deltas[i] << buffered;
+      for (buffered += width; buffered >= 8; buffered -= 8) {
+        *ptr++ = static_cast<uchar>(buffer);
+        buffer >>= 8;
+      }
+    }
+    if (buffered > 0) *ptr = static_cast<uchar>(buffer);
+  }
+}
+
+bool keti_unpack_postings(const uchar **ptr, const uchar *end,
+                          std::vector<uint32> *rows) {
+  rows->clear();
+  if (end - *ptr < 4) return false;
+  const uint32 count = uint4korr(*ptr);
+  *ptr += 4;
+
+  uint32 previous = 0;
+  while (rows->size() < count) {
+    const size_t run = std::min<size_t>(RUN_LENGTH, count - rows->size());
+    if (*ptr >= end) return false;
+    const uint width = *(*ptr)++;
+    const size_t length = (run * width + 7) / 8;
+    if (width > 32 || end - *ptr < static_cast<ptrdiff_t>(length))
+      return false;
+
+    const uint64 mask = ((uint64)1 << width) - 1;
+    const uchar *byte = *ptr;
+    uint64 buffer = 0;
+    uint buffered = 0;
+    for (size_t i = 0; i < run; i++) {
+      for (; buffered < width; buffered += 8)
+        buffer |= (uint64)*byte++ << buffered;
+      previous += static_cast<uint32>(buffer & mask);
+      buffer >>= width;
+      buffered -= width;
+      rows->push_back(previous);
+    }
+    *ptr += length;
+  }
+  return true;
+}
+
+void Keti_posting_index::add(uint16 field,
+                             const std::vector<std::string> &tags,
+                             uint32 block, uint32 index) {
+  if (block > KETI_BITMAP_MAX_BLOCK) {
+    m_overflow = true;
+    return;
+  }
+  for (const std::string &tag : tags)
+    m_postings[std::make_pair(field, tag)].push_back(block << 16 | index);
+}
+
+void Keti_posting_index::take(std::vector<uchar> *out) {
+  out->clear();
+  if (!m_overflow) {
+    for (const auto &posting : m_postings) {
+      const std::string &tag = posting.first.second;
+      const size_t offset = out->size();
+      out->resize(offset + 2 + 4);
+      int2store(&(*out)[offset], posting.first.first);
+      int4store(&(*out)[offset + 2], static_cast<uint32>(tag.size()));
+      out->insert(out->end(), tag.begin(), tag.end());
+      keti_pack_postings(posting.second, out);
+    }
+  }
+  m_postings.clear();
+  m_overflow = false;
+}
+
+static bool is_json(const Field *field) {
+  return field->type() == MYSQL_TYPE_JSON;
+}
+
+void keti_tag_fields(const TABLE_SHARE *share, std::vector<uint16> *fields) {
+  fields->clear();
+  for (uint i = 0; i < share->fields; i++) {
+    const Field *field = share->field[i];
+    const LEX_CSTRING &comment = field->comment;
+    if (comment.length == 0 ||
+        std::search(comment.str, comment.str + comment.length, TAGS_COMMENT,
+                    TAGS_COMMENT + strlen(TAGS_COMMENT)) ==
+            comment.str + comment.length)
+      continue;
+    if (is_json(field) || field->result_type() == STRING_RESULT)
+      fields->push_back(static_cast<uint16>(i));
+  }
+}
+
+/** Tags of the elements of a comma separated list, as FIND_IN_SET() splits. */
+static void list_tags(const CHARSET_INFO *cs, const String &list,
+                      std::vector<std::string> *tags) {
+  /* An empty string is an empty list, not a list of one empty element */
+  if (list.length() == 0) return;
+  const char *start = list.ptr();
+  const char *end = start + list.length();
+  for (;;) {
+    const char *comma = std::find(start, end, ',');
+    tags->push_back(keti_weight_string(cs, start, comma - start));
+    if (comma == end) break;
+    start = comma + 1;
+  }
+}
+
+/**
+  Tags of a JSON value: the value itself if it is a scalar, the tags of the
+  elements of an array.
+
+  @param document  true for a stored value, where objects hold no tags;
+                   false for a needle, where they make the tags unknown
+
+  @return false if the tags are unknown
+*/
+static bool json_tags(const json::value &value, bool document,
+                      std::vector<std::string> *tags) {
+  char number[32];
+  if (value.is_array()) {
+    for (const json::value &element : value.as_array())
+      if (!json_tags(element, document, tags)) return false;
+  } else if (value.is_string()) {
+    tags->push_back("s" + utility::conversions::to_utf8string(
+                              value.as_string()));
+  } else if (value.is_number()) {
+    /* 1 and 1.0 are equal to JSON_CONTAINS() */
+    snprintf(number, sizeof(number), "n%.17g", value.as_double());
+    tags->push_back(number);
+  } else if (value.is_boolean()) {
+    tags->push_back(value.as_bool() ? "t" : "f");
+  } else if (value.is_null()) {
+    tags->push_back("z");
+  } else {
+    /* JSON_CONTAINS() finds scalars in arrays only, never in objects */
+    return document;
+  }
+  return true;
+}
+
+/** @return false if text is not JSON or its tags are unknown */
+static bool parse_json_tags(const String &text, bool document,
+                            std::vector<std::string> *tags) {
+  try {
+    return json_tags(json::value::parse(utility::conversions::to_string_t(
+                         std::string(text.ptr(), text.length()))),
+                     document, tags);
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+
+void keti_tags(Field *field, const uchar *record,
+               std::vector<std::string> *tags) {
+  tags->clear();
+  const ptrdiff_t offset = record - field->table->record[0];
+  if (field->is_null(offset)) return;
+
+  String value;
+  field->move_field_offset(offset);
+  field->val_str(&value);
+  field->move_field_offset(-offset);
+
+  if (!is_json(field))
+    list_tags(field->charset(), value, tags);
+  else
+    parse_json_tags(value, true, tags);
+  std::sort(tags->begin(), tags->end());
+  tags->erase(std::unique(tags->begin(), tags->end()), tags->end());
+}
+
+bool keti_tag_predicate(const Item *cond, const TABLE *table,
+                        const Field **field, std::vector<std::string> *tags) {
+  if (cond->type() != Item::FUNC_ITEM) return false;
+  const Item_func *func = static_cast<const Item_func *>(cond);
+  Item **args = func->arguments();
+
+  Item *column;
+  Item *value;
+  const bool find_in_set = strcmp(func->func_name(), "find_in_set") == 0;
+  if (find_in_set && func->arg_count == 2) {
+    value = args[0];
+    column = args[1];
+  } else if (strcmp(func->func_name(), "json_contains") == 0 &&
+             (func->arg_count == 2 || func->arg_count == 3)) {
+    column = args[0];
+    value = args[1];
+    if (func->arg_count == 3) {
+      /* Only a search of the whole document */
+      String buffer;
+      const String *path =
+          args[2]->const_item() ? args[2]->val_str(&buffer) : NULL;
+      if (path == NULL || path->length() != 1 || path->ptr()[0] != '$')
+        return false;
+    }
+  } else {
+    return false;
+  }
+
+  const Item *real = column->real_item();
+  if (real->type() != Item::FIELD_ITEM || !value->const_item()) return false;
+  *field = static_cast<const Item_field *>(real)->field;
+  if ((*field)->table != table || is_json(*field) == find_in_set)
+    return false;
+  std::vector<uint16> fields;
+  keti_tag_fields(table->s, &fields);
+  if (std::find(fields.begin(), fields.end(), (*field)->field_index) ==
+      fields.end())
+    return false;
+
+  String buffer;
+  const String *text = value->val_str(&buffer);
+  if (text == NULL) return false;
+  tags->clear();
+  if (find_in_set) {
+    /* A needle with a comma matches nothing; leave that to the server */
+    if (std::find(text->ptr(), text->ptr() + text->length(), ',') !=
+        text->ptr() + text->length())
+      return false;
+    tags->push_back(keti_weight_string((*field)->charset(), text->ptr(),
+                                       text->length()));
+    return true;
+  }
+  return parse_json_tags(*text, false, tags);
+}
+
+bool Keti_tag_search::build(const Item *cond, const TABLE *table,
+                            const std::vector<uint16> &fields) {
+  m_clauses.clear();
+  if (cond == NULL || fields.empty()) return false;
+
+  std::vector<const Item *> conjuncts;
+  if (cond->type() == Item::COND_ITEM &&
+      static_cast<const Item_cond *>(cond)->functype() ==
+          Item_func::COND_AND_FUNC) {
+    List_iterator<Item> li(
+        *const_cast<Item_cond *>(static_cast<const Item_cond *>(cond))
+             ->argument_list());
+    Item *item;
+    while ((item = li++)) conjuncts.push_back(item);
+  } else {
+    conjuncts.push_back(cond);
+  }
+
+  const Field *field;
+  std::vector<std::string> tags;
+  for (const Item *conjunct : conjuncts) {
+    if (keti_tag_predicate(conjunct, table, &field, &tags)) {
+      /* Every tag of the needle must be there */
+      for (std::string &tag : tags) {
+        Term term = {static_cast<uint16>(field->field_index), std::move(tag)};
+        m_clauses.push_back(std::vector<Term>(1, std::move(term)));
+      }
+      continue;
+    }
+
+    /* An OR of single tag containments is one clause */
+    if (conjunct->type() != Item::COND_ITEM ||
+        static_cast<const Item_cond *>(conjunct)->functype() !=
+            Item_func::COND_OR_FUNC)
+      continue;
+    std::vector<Term> clause;
+    List_iterator<Item> li(
+        *const_cast<Item_cond *>(static_cast<const Item_cond *>(conjunct))
+             ->argument_list());
+    Item *item;
+    bool usable = true;
+    while (usable && (item = li++)) {
+      usable = keti_tag_predicate(item, table, &field, &tags) &&
+               tags.size() == 1;
+      if (usable)
+        clause.push_back(
+            {static_cast<uint16>(field->field_index), std::move(tags[0])});
+    }
+    if (usable && !clause.empty()) m_clauses.push_back(std::move(clause));
+  }
+  return !m_clauses.empty();
+}
+
+static int bad_reply(const std::string &table,
+                     std::vector<std::unique_ptr<Keti_bitmap>> *rows) {
+  keti_log(ERROR_LEVEL, "bad reply to tag search for %s", table.c_str());
+  for (std::unique_ptr<Keti_bitmap> &segment_rows : *rows) segment_rows.reset();
+  return HA_ERR_INTERNAL_ERROR;
+}
+
+int Keti_tag_search::search(
+    const std::string &table, const std::vector<Keti_segment> &segments,
+    std::vector<std::unique_ptr<Keti_bitmap>> *rows) const {
+  rows->clear();
+  rows->resize(segments.size());
+  if (m_clauses.empty() || segments.empty()) return 0;
+
+  std::vector<uint32> ids;
+  for (const Keti_segment &segment : segments) ids.push_back(segment.id);
+
+  /* Clauses, then per clause its terms, each list preceded by its length */
+  std::vector<uchar> body(4);
+  int4store(&body[0], static_cast<uint32>(m_clauses.size()));
+  for (const std::vector<Term> &clause : m_clauses) {
+    size_t offset = body.size();
+    body.resize(offset + 4);
+    int4store(&body[offset], static_cast<uint32>(clause.size()));
+    for (const Term &term : clause) {
+      offset = body.size();
+      body.resize(offset + 2 + 4);
+      int2store(&body[offset], term.field);
+      int4store(&body[offset + 2], static_cast<uint32>(term.tag.size()));
+      body.insert(body.end(), term.tag.begin(), term.tag.end());
+    }
+  }
+
+  std::vector<uchar> reply;
+  int rc = csd_search_postings(table, ids, &body, &reply);
+  if (rc) return rc;
+
+  const uchar *ptr = reply.data();
+  const uchar *end = ptr + reply.size();
+  std::vector<uint32> matches;
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (end - ptr >= 4 && uint4korr(ptr) == NO_INDEX) {
+      ptr += 4;
+      continue;
+    }
+    if (!keti_unpack_postings(&ptr, end, &matches))
+      return bad_reply(table, rows);
+    (*rows)[i].reset(new Keti_bitmap);
+    for (uint32 row : matches) (*rows)[i]->add(row);
+  }
+  return ptr == end ? 0 : bad_reply(table, rows);
+}
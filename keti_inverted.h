@@ -0,0 +1,150 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_inverted.h
+
+    @brief
+  Per segment inverted indexes of tag columns, searched by the storage node.
+
+    @details
+  A column whose COMMENT contains "keti_tags" holds a list of tags: either a
+  comma separated string, as FIND_IN_SET() reads it, or a JSON array. Every
+  segment gets an inverted index from each tag to the rows that carry it,
+  built on the host while the segment is filled. Rows are numbered as for
+  bitmap indexes, block << 16 | index of the row in its block; a posting
+  list is the ascending row numbers, delta encoded and bit packed in runs of
+  128 with one bit width per run.
+
+  A tag of a string column is the weight string of the element in the
+  column's collation, so it matches the way FIND_IN_SET() compares. A tag of
+  a JSON column is a type letter followed by the value: JSON_CONTAINS()
+  compares strings byte by byte and numbers by value. Elements of nested
+  arrays are tags too, since JSON_CONTAINS() looks into them; objects are
+  not indexed.
+
+  The pushed conjuncts FIND_IN_SET(constant, column) and
+  JSON_CONTAINS(column, constant) become a search in conjunctive normal form
+  that the node answers from its posting lists with the row numbers of the
+  matching rows of each segment; the scan reads only those.
+*/
+
+#ifndef KETI_INVERTED_H
+#define KETI_INVERTED_H
+
+#include <stddef.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "my_inttypes.h"
+#include "storage/keti/keti_csd.h"
+
+class Field;
+class Item;
+class Keti_bitmap;
+struct TABLE;
+struct TABLE_SHARE;
+
+/** @brief
+  The inverted indexes of one segment under construction.
+*/
+class Keti_posting_index {
+ public:
+  Keti_posting_index() : m_overflow(false) {}
+
+  /** Record that the row at block and index holds the tags in field. */
+  void add(uint16 field, const std::vector<std::string> &tags, uint32 block,
+           uint32 index);
+
+  bool empty() const { return m_postings.empty() || m_overflow; }
+
+  /**
+    Hand over the index in the format csd_write_postings() takes: for each
+    tag the column in 2 bytes, the tag preceded by its length in 4 bytes and
+    the posting list. The builder is empty afterwards.
+  */
+  void take(std::vector<uchar> *out);
+
+ private:
+  std::map<std::pair<uint16, std::string>, std::vector<uint32>> m_postings;
+  bool m_overflow;
+};
+
+/**
+  Append a posting list: the number of rows in 4 bytes, then per run of up
+  to 128 rows the bit width of its deltas in 1 byte and the deltas, packed
+  from the lowest bit of each byte up.
+*/
+void keti_pack_postings(const std::vector<uint32> &rows,
+                        std::vector<uchar> *out);
+
+/** Read what keti_pack_postings() wrote. @return false if malformed */
+bool keti_unpack_postings(const uchar **ptr, const uchar *end,
+                          std::vector<uint32> *rows);
+
+/** @brief
+  Containment search pushed to the inverted indexes.
+*/
+class Keti_tag_search {
+ public:
+  /**
+    Build the search for the containment conjuncts of cond on fields.
+
+    @return false if cond has none
+  */
+  bool build(const Item *cond, const TABLE *table,
+             const std::vector<uint16> &fields);
+
+  /**
+    Have the node find the rows of each segment that may match.
+
+    @param rows  receives, per segment, the rows that may match, or NULL if
+                 all of them may
+  */
+  int search(const std::string &table,
+             const std::vector<Keti_segment> &segments,
+             std::vector<std::unique_ptr<Keti_bitmap>> *rows) const;
+
+ private:
+  struct Term {
+    uint16 field;
+    std::string tag;
+  };
+  /** Every clause must match; a clause matches if one of its terms does. */
+  std::vector<std::vector<Term>> m_clauses;
+};
+
+/** Columns of a table with an inverted index. */
+void keti_tag_fields(const TABLE_SHARE *share, std::vector<uint16> *fields);
+
+/** Distinct tags of the value of field in record; none if it is NULL. */
+void keti_tags(Field *field, const uchar *record,
+               std::vector<std::string> *tags);
+
+/**
+  Recognize FIND_IN_SET(constant, column) and JSON_CONTAINS(column,
+  constant[, '$']) on a tag column of table.
+
+  @param field  receives the column
+  @param tags   receives the tags every matching row carries
+
+  @return false if cond is anything else or its tags cannot be known
+*/
+bool keti_tag_predicate(const Item *cond, const TABLE *table,
+                        const Field **field, std::vector<std::string> *tags);
+
+#endif /* KETI_INVERTED_H */
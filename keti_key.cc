@@ -0,0 +1,70 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_key.cc
+
+    @brief
+  Normalized keys.
+*/
+
+#include "storage/keti/keti_key.h"
+
+#include "m_ctype.h"
+#include "sql/field.h"
+#include "sql/table.h"
+#include "sql_string.h"
+#include "template_utils.h"
+
+std::string keti_weight_string(const CHARSET_INFO *cs, const char *str,
+                               size_t length) {
+  if (cs->pad_attribute == PAD_SPACE)
+    length = cs->cset->lengthsp(cs, str, length);
+  std::string weights(cs->coll->strnxfrmlen(cs, cs->mbmaxlen * length), '\0');
+  weights.resize(my_strnxfrm(cs, pointer_cast<uchar *>(&weights[0]),
+                             weights.size(),
+                             pointer_cast<const uchar *>(str), length));
+  return weights;
+}
+
+bool keti_string_field(const Field *field) {
+  switch (field->real_type()) {
+    case MYSQL_TYPE_VARCHAR:
+    case MYSQL_TYPE_VAR_STRING:
+    case MYSQL_TYPE_STRING:
+    case MYSQL_TYPE_TINY_BLOB:
+    case MYSQL_TYPE_MEDIUM_BLOB:
+    case MYSQL_TYPE_LONG_BLOB:
+    case MYSQL_TYPE_BLOB:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void keti_normalized_key(Field *field, const uchar *record, std::string *key) {
+  const ptrdiff_t offset = record - field->table->record[0];
+  field->move_field_offset(offset);
+  if (keti_string_field(field)) {
+    /* The whole value, not the prefix of max_sort_length filesort takes */
+    String value;
+    field->val_str(&value);
+    *key = keti_weight_string(field->charset(), value.ptr(), value.length());
+  } else {
+    key->resize(field->sort_length());
+    key->resize(field->make_sort_key(pointer_cast<uchar *>(&(*key)[0]),
+                                     key->size()));
+  }
+  field->move_field_offset(-offset);
+}
@@ -0,0 +1,59 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_key.h
+
+    @brief
+  Normalized keys: values as byte strings that compare with memcmp() as
+  the server compares the values.
+
+    @details
+  A string is normalized to its weight string in the column's collation,
+  so that under utf8mb4_0900_ai_ci 'a', 'A' and 'a' with an accent get the
+  same key and 'b' a greater one; in a binary collation the key is the
+  string itself. Trailing spaces are left out under PAD SPACE collations,
+  which ignore them, so 'a ' and 'a' get the same key there. Any other
+  value is normalized to the sort key filesort uses: integers big endian
+  with the sign bit flipped, floating point numbers with the sign bit
+  flipped and the other bits too if negative, decimals and temporal values
+  in their binary form, big endian.
+
+  A shorter key that is a prefix of a longer one sorts first, which is the
+  order of the strings the weights come from. Keys of one column carry no
+  terminator, so keys of several columns cannot simply be concatenated.
+*/
+
+#ifndef KETI_KEY_H
+#define KETI_KEY_H
+
+#include <stddef.h>
+#include <string>
+
+#include "my_inttypes.h"
+
+class Field;
+struct CHARSET_INFO;
+
+/** True if field holds a string: CHAR, VARCHAR, BINARY, BLOB or TEXT. */
+bool keti_string_field(const Field *field);
+
+/** Weight string of str in cs: equal for strings the collation finds equal. */
+std::string keti_weight_string(const CHARSET_INFO *cs, const char *str,
+                               size_t length);
+
+/** Normalized key of the value of a non-NULL field in record. */
+void keti_normalized_key(Field *field, const uchar *record, std::string *key);
+
+#endif /* KETI_KEY_H */
@@ -0,0 +1,304 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_lock.cc
+
+    @brief
+  KETI row lock manager and deadlock detector.
+*/
+
+#include "storage/keti/keti_lock.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <set>
+#include <thread>
+
+#include "my_base.h"
+
+Keti_lock_manager *keti_lock_manager = NULL;
+keti_lock_stats_t keti_lock_stats = {0, 0, 0};
+
+ulong srv_lock_shards = 256;
+ulong srv_lock_wait_timeout = 50;
+ulong srv_deadlock_detect_interval = 100;
+
+static std::atomic<ulonglong> next_trx_id(1);
+static std::mutex stats_mutex;
+
+ulonglong keti_new_trx_id() { return next_trx_id.fetch_add(1); }
+
+Keti_trx::Keti_trx()
+    : id(keti_new_trx_id()),
+      read_view(0),
+      view_low(0),
+      m_wait_shard(-1),
+      m_victim(false),
+      m_wait_key(0) {}
+
+Keti_lock_manager::Keti_lock_manager(size_t shards) : m_waiting(0) {
+  for (size_t i = 0; i < std::max<size_t>(shards, 1); i++)
+    m_shards.emplace_back(new Shard);
+}
+
+bool Keti_lock_manager::grantable(const queue_t &queue,
+                                  queue_t::const_iterator request) {
+  for (queue_t::const_iterator it = queue.begin(); it != request; ++it) {
+    if (it->trx == request->trx) continue;
+    if (conflicts(it->mode, request->mode)) return false;
+  }
+  return true;
+}
+
+void Keti_lock_manager::grant_waiters(queue_t *queue) {
+  for (queue_t::iterator it = queue->begin(); it != queue->end(); ++it) {
+    if (it->granted || !grantable(*queue, it)) continue;
+    it->granted = true;
+    it->trx->m_wait_cond.notify_one();
+  }
+}
+
+int Keti_lock_manager::lock(Keti_trx *trx, ulonglong key, Keti_lock_mode mode,
+                            ulong timeout) {
+  const size_t shard_no = key % m_shards.size();
+  Shard &shard = *m_shards[shard_no];
+  std::unique_lock<std::mutex> latch(shard.mutex);
+  queue_t &queue = shard.locks[key];
+
+  bool known = false;
+  for (const Request &request : queue) {
+    if (request.trx != trx) continue;
+    if (request.granted &&
+        (request.mode == KETI_LOCK_X || request.mode == mode))
+      return 0;
+    known = true;
+  }
+  if (!known) trx->m_keys.push_back(key);
+
+  Request request = {trx, mode, false};
+  queue_t::iterator mine = queue.insert(queue.end(), request);
+  if (grantable(queue, mine)) {
+    mine->granted = true;
+    return 0;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_lock_stats.waits++;
+  }
+  trx->m_wait_shard = static_cast<int>(shard_no);
+  trx->m_victim = false;
+  {
+    /* Those ahead only ever leave, so these are all it may wait for */
+    std::lock_guard<std::mutex> guard(m_waiters_mutex);
+    trx->m_wait_key = key;
+    trx->m_waits_for.clear();
+    for (queue_t::iterator it = queue.begin(); it != mine; ++it)
+      if (it->trx != trx && conflicts(it->mode, mode) &&
+          std::find(trx->m_waits_for.begin(), trx->m_waits_for.end(),
+                    it->trx) == trx->m_waits_for.end())
+        trx->m_waits_for.push_back(it->trx);
+    m_waiters.insert(trx);
+  }
+  m_waiting++;
+  trx->m_wait_cond.wait_for(latch, std::chrono::seconds(timeout), [&] {
+    return mine->granted || trx->m_victim;
+  });
+  m_waiting--;
+  trx->m_wait_shard = -1;
+  {
+    std::lock_guard<std::mutex> guard(m_waiters_mutex);
+    m_waiters.erase(trx);
+    trx->m_waits_for.clear();
+  }
+
+  if (mine->granted) {
+    trx->m_victim = false;
+    return 0;
+  }
+
+  const bool deadlock = trx->m_victim;
+  trx->m_victim = false;
+  queue.erase(mine);
+  grant_waiters(&queue);
+
+  std::lock_guard<std::mutex> guard(stats_mutex);
+  if (deadlock) return HA_ERR_LOCK_DEADLOCK;
+  keti_lock_stats.timeouts++;
+  return HA_ERR_LOCK_WAIT_TIMEOUT;
+}
+
+void Keti_lock_manager::release_all(Keti_trx *trx) {
+  for (ulonglong key : trx->m_keys) {
+    Shard &shard = shard_of(key);
+    std::lock_guard<std::mutex> latch(shard.mutex);
+
+    auto it = shard.locks.find(key);
+    if (it == shard.locks.end()) continue;
+    queue_t &queue = it->second;
+    queue.remove_if([trx](const Request &r) { return r.trx == trx; });
+    if (queue.empty())
+      shard.locks.erase(it);
+    else
+      grant_waiters(&queue);
+  }
+  trx->m_keys.clear();
+}
+
+typedef std::map<Keti_trx *, std::vector<Keti_trx *>> waits_for_t;
+
+/**
+  Depth first search of the waits-for graph for a cycle through from that
+  avoids the transactions in done.
+
+  @return true if it found one, then the transactions from where path
+          meets it again to its end
+*/
+static bool find_cycle(const waits_for_t &graph, Keti_trx *from,
+                       std::vector<Keti_trx *> *path,
+                       std::set<Keti_trx *> *done) {
+  auto on_path = std::find(path->begin(), path->end(), from);
+  if (on_path != path->end()) {
+    path->erase(path->begin(), on_path);
+    return true;
+  }
+  if (done->count(from)) return false;
+
+  auto edges = graph.find(from);
+  if (edges != graph.end()) {
+    path->push_back(from);
+    for (Keti_trx *to : edges->second)
+      if (find_cycle(graph, to, path, done)) return true;
+    path->pop_back();
+  }
+  done->insert(from);
+  return false;
+}
+
+Keti_trx *Keti_lock_manager::cycle_victim(
+    const std::vector<Keti_trx *> &cycle, const std::set<size_t> &latched) {
+  /* Waiters are alive while registered */
+  std::lock_guard<std::mutex> guard(m_waiters_mutex);
+  Keti_trx *victim = NULL;
+  for (size_t i = 0; i < cycle.size(); i++) {
+    Keti_trx *waiter = cycle[i];
+    Keti_trx *holder = cycle[(i + 1) % cycle.size()];
+    if (!m_waiters.count(waiter) ||
+        !latched.count(waiter->m_wait_key % m_shards.size()) ||
+        waiter->m_victim)
+      return NULL;
+
+    const Shard &shard = shard_of(waiter->m_wait_key);
+    auto lock = shard.locks.find(waiter->m_wait_key);
+    if (lock == shard.locks.end()) return NULL;
+    const queue_t &queue = lock->second;
+    auto mine = std::find_if(queue.begin(), queue.end(),
+                             [waiter](const Request &request) {
+                               return request.trx == waiter &&
+                                      !request.granted;
+                             });
+    if (mine == queue.end() ||
+        std::none_of(queue.begin(), mine,
+                     [holder, mine](const Request &request) {
+                       return request.trx == holder &&
+                              conflicts(request.mode, mine->mode);
+                     }))
+      return NULL;
+    if (victim == NULL || waiter->id > victim->id) victim = waiter;
+  }
+  return victim;
+}
+
+size_t Keti_lock_manager::detect_deadlocks() {
+  /* The edges waiters recorded, which may have gone stale since */
+  waits_for_t graph;
+  {
+    std::lock_guard<std::mutex> guard(m_waiters_mutex);
+    for (Keti_trx *waiter : m_waiters) graph[waiter] = waiter->m_waits_for;
+  }
+
+  size_t victims = 0;
+  std::set<Keti_trx *> done;
+  for (auto &node : graph) {
+    for (;;) {
+      std::vector<Keti_trx *> cycle;
+      if (!find_cycle(graph, node.first, &cycle, &done)) break;
+
+      /* Freeze the keys of the cycle, always in shard order */
+      std::set<size_t> shards;
+      {
+        std::lock_guard<std::mutex> guard(m_waiters_mutex);
+        for (Keti_trx *waiter : cycle)
+          if (m_waiters.count(waiter))
+            shards.insert(waiter->m_wait_key % m_shards.size());
+      }
+      std::vector<std::unique_lock<std::mutex>> latches;
+      for (size_t shard : shards) latches.emplace_back(m_shards[shard]->mutex);
+
+      /* A cycle that broke up meanwhile is looked for again next time */
+      Keti_trx *victim = cycle_victim(cycle, shards);
+      if (victim != NULL) {
+        victim->m_victim = true;
+        victim->m_wait_cond.notify_one();
+        victims++;
+      }
+      done.insert(victim != NULL ? victim : cycle.front());
+    }
+  }
+
+  if (victims > 0) {
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_lock_stats.deadlocks += victims;
+  }
+  return victims;
+}
+
+static std::thread detector_thread;
+static std::mutex detector_mutex;
+static std::condition_variable detector_cond;
+static bool detector_stop = false;
+
+static void deadlock_detector_thread() {
+  std::unique_lock<std::mutex> lock(detector_mutex);
+  while (!detector_stop) {
+    detector_cond.wait_for(
+        lock, std::chrono::milliseconds(srv_deadlock_detect_interval));
+    if (detector_stop) break;
+    if (!keti_lock_manager->has_waiters()) continue;
+
+    lock.unlock();
+    keti_lock_manager->detect_deadlocks();
+    lock.lock();
+  }
+}
+
+void keti_lock_init() {
+  keti_lock_manager = new Keti_lock_manager(srv_lock_shards);
+  detector_stop = false;
+  detector_thread = std::thread(deadlock_detector_thread);
+}
+
+void keti_lock_deinit() {
+  {
+    std::lock_guard<std::mutex> guard(detector_mutex);
+    detector_stop = true;
+  }
+  detector_cond.notify_all();
+  if (detector_thread.joinable()) detector_thread.join();
+
+  delete keti_lock_manager;
+  keti_lock_manager = NULL;
+}
@@ -0,0 +1,191 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_lock.h
+
+    @brief
+  Row lock manager of the KETI engine.
+
+    @details
+  Locks are identified by a 64-bit hash of the table and the row position
+  and are spread over keti_lock_shards independently latched hash tables,
+  so transactions locking different rows hardly ever touch the same latch.
+  An uncontended acquisition is one hash table insert under the latch of
+  its shard. Waiters sleep on a condition variable of their own, in the
+  order they arrived.
+
+  Shared locks are taken by locking reads and exclusive ones by changes
+  that make new versions of rows. Updates by deltas, see keti_delta.h,
+  take delta locks, which are compatible with each other, as additions
+  commute, but with neither of the other two.
+
+  Waiting never looks for deadlocks. A transaction that blocks records
+  the transactions it waits for, those ahead of it in the queue whose
+  requests conflict with its own. A background thread wakes every
+  keti_deadlock_detect_interval milliseconds while somebody waits and
+  walks these edges, without latching any shard; for each cycle it finds
+  it latches the shards of the keys waited for in the cycle only, checks
+  that the cycle is still there and rolls back its youngest transaction.
+  Waits that last longer than keti_lock_wait_timeout seconds give up on
+  their own.
+*/
+
+#ifndef KETI_LOCK_H
+#define KETI_LOCK_H
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "my_inttypes.h"
+
+enum Keti_lock_mode { KETI_LOCK_S, KETI_LOCK_X, KETI_LOCK_D };
+
+/** @brief
+  Lock state and read view of one transaction. Owned by the THD it runs in,
+  and reused for its next transaction with a new id.
+*/
+class Keti_trx {
+ public:
+  Keti_trx();
+
+  ulonglong id;  ///< Larger is younger
+  /** Changes stamped below this are visible; 0 if no view is open. */
+  ulonglong read_view;
+  /** Transactions with changes not stamped when the view opened, sorted. */
+  std::vector<ulonglong> view_active;
+  /** Changes stamped below this are seen by the view; bounds purge. */
+  ulonglong view_low;
+
+ private:
+  friend class Keti_lock_manager;
+
+  /** Keys this transaction has requests on. */
+  std::vector<ulonglong> m_keys;
+  /** Woken when the request waited for is granted or given up. */
+  std::condition_variable m_wait_cond;
+  /** Shard of the request waited for, or -1. Guarded by that shard. */
+  int m_wait_shard;
+  /** Set by the deadlock detector under the latch of m_wait_shard. */
+  bool m_victim;
+  /** Key waited for, while waiting. Guarded by the waiters mutex. */
+  ulonglong m_wait_key;
+  /** Transactions ahead of the request waited for that block it. */
+  std::vector<Keti_trx *> m_waits_for;
+};
+
+/** @brief
+  Hash partitioned table of row locks.
+*/
+class Keti_lock_manager {
+ public:
+  explicit Keti_lock_manager(size_t shards);
+
+  /**
+    Acquire a lock for trx, waiting at most timeout seconds. Locks are held
+    until release_all(); asking again for a lock already held is cheap.
+
+    @retval 0                         granted
+    @retval HA_ERR_LOCK_WAIT_TIMEOUT  timeout passed
+    @retval HA_ERR_LOCK_DEADLOCK      chosen as the victim of a deadlock
+  */
+  int lock(Keti_trx *trx, ulonglong key, Keti_lock_mode mode, ulong timeout);
+
+  /** Release all locks of trx and grant what its release unblocks. */
+  void release_all(Keti_trx *trx);
+
+  /**
+    Resolve the deadlocks among the current waiters.
+
+    @return transactions chosen as victims
+  */
+  size_t detect_deadlocks();
+
+  /** True while some request is waiting. */
+  bool has_waiters() const { return m_waiting.load() > 0; }
+
+ private:
+  struct Request {
+    Keti_trx *trx;
+    Keti_lock_mode mode;
+    bool granted;
+  };
+
+  /** Requests on one key, in arrival order. */
+  typedef std::list<Request> queue_t;
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<ulonglong, queue_t> locks;
+  };
+
+  Shard &shard_of(ulonglong key) { return *m_shards[key % m_shards.size()]; }
+
+  /** True if a lock in mode a and one in mode b of another trx conflict. */
+  static bool conflicts(Keti_lock_mode a, Keti_lock_mode b) {
+    return a == KETI_LOCK_X || b == KETI_LOCK_X || a != b;
+  }
+
+  /** True if nothing ahead of request in queue conflicts with it. */
+  static bool grantable(const queue_t &queue, queue_t::const_iterator request);
+
+  /** Grant the waiters of queue that can now proceed; caller holds latch. */
+  static void grant_waiters(queue_t *queue);
+
+  /**
+    The youngest transaction of cycle if every one of them still waits for
+    the next, the last for the first, on a key of the shards latched,
+    which the caller holds; NULL otherwise.
+  */
+  Keti_trx *cycle_victim(const std::vector<Keti_trx *> &cycle,
+                         const std::set<size_t> &latched);
+
+  std::vector<std::unique_ptr<Shard>> m_shards;
+  std::atomic<size_t> m_waiting;
+  /** Latched after any shard */
+  std::mutex m_waiters_mutex;
+  /** Transactions waiting, with their edges recorded */
+  std::set<Keti_trx *> m_waiters;
+};
+
+struct keti_lock_stats_t {
+  ulonglong waits;
+  ulonglong timeouts;
+  ulonglong deadlocks;
+};
+
+/** Id for a new transaction, larger than all before. */
+ulonglong keti_new_trx_id();
+
+extern Keti_lock_manager *keti_lock_manager;
+extern keti_lock_stats_t keti_lock_stats;
+
+extern ulong srv_lock_shards;
+extern ulong srv_lock_wait_timeout;
+extern ulong srv_deadlock_detect_interval;
+
+/** Create the lock manager and start the deadlock detector. */
+void keti_lock_init();
+
+/** Stop the deadlock detector and free the lock manager. */
+void keti_lock_deinit();
+
+#endif /* KETI_LOCK_H */
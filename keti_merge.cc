@@ -0,0 +1,264 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_merge.cc
+
+    @brief
+  Segment merger thread.
+*/
+
+#include "storage/keti/keti_merge.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_encode.h"
+#include "storage/keti/keti_ibuf.h"
+#include "storage/keti/keti_lock.h"
+#include "storage/keti/keti_mvcc.h"
+#include "storage/keti/keti_row.h"
+#include "storage/keti/keti_write.h"
+
+keti_merge_stats_t keti_merge_stats = {0, 0};
+
+ulong srv_merge_interval = 60;
+ulonglong srv_merge_min_segment_size = 4 * 1024 * 1024;
+ulonglong srv_merge_max_segment_size = 64 * 1024 * 1024;
+ulong srv_merge_sparse_pct = 30;
+
+static std::mutex stats_mutex;
+
+/** Segments to merge, with the purged rows of each when they were picked. */
+struct Merge_run {
+  std::vector<Keti_segment> segments;
+  std::vector<std::vector<ulonglong>> dead;
+};
+
+/**
+  Pick the small and sparse segments of a table to merge, in manifest
+  order, up to keti_merge_max_segment_size. Merging a single segment only
+  pays when it has purged rows.
+*/
+static void pick_run(Keti_table_versions *versions,
+                     const std::vector<Keti_segment> &segments,
+                     Merge_run *run) {
+  const size_t min_blocks = srv_merge_min_segment_size / KETI_BLOCK_SIZE;
+  const size_t max_blocks =
+      std::max<size_t>(srv_merge_max_segment_size / KETI_BLOCK_SIZE, 1);
+  size_t blocks = 0;
+  size_t dead_rows = 0;
+  std::vector<ulonglong> dead;
+
+  for (const Keti_segment &segment : segments) {
+    if (!versions->compactable(segment.id)) continue;
+    versions->dead_rows(segment.id, &dead);
+    const bool small = segment.blocks < min_blocks;
+    const bool sparse =
+        !dead.empty() &&
+        dead.size() * 100 >= segment.rows * srv_merge_sparse_pct;
+    if (!small && !sparse) continue;
+    if (!run->segments.empty() && blocks + segment.blocks > max_blocks) break;
+
+    run->segments.push_back(segment);
+    run->dead.push_back(dead);
+    blocks += segment.blocks;
+    dead_rows += dead.size();
+  }
+  if (run->segments.size() < 2 && dead_rows == 0) {
+    run->segments.clear();
+    run->dead.clear();
+  }
+}
+
+/** Old and new position of each row moved. */
+typedef std::vector<std::pair<Keti_row_pos, Keti_row_pos>> moves_t;
+
+/**
+  Copy the live rows of one block of segment into builder, locking each.
+
+  @retval HA_ERR_LOCK_WAIT_TIMEOUT  a row is locked by a transaction
+*/
+static int copy_block(ulonglong lock_id, uint32 segment, uint32 block_no,
+                      const std::vector<uchar> &block,
+                      const std::vector<ulonglong> &dead, Keti_trx *trx,
+                      Keti_segment_builder *builder, moves_t *moves) {
+  size_t offset = KETI_BLOCK_HEADER_SIZE;
+  for (uint32 rows = keti_block_rows(block); rows > 0; rows--) {
+    if (offset + KETI_ROW_HEADER_SIZE > block.size()) return HA_ERR_CRASHED;
+    const size_t length = KETI_ROW_HEADER_SIZE + uint4korr(&block[offset]);
+    if (offset + length > block.size()) return HA_ERR_CRASHED;
+
+    const Keti_row_pos from = {segment, block_no, static_cast<uint32>(offset)};
+    const ulonglong key = (ulonglong)block_no << 32 | offset;
+    offset += length;
+    if (std::binary_search(dead.begin(), dead.end(), key)) continue;
+
+    /* Never wait: the merge is retried later, the foreground is not */
+    int rc = keti_lock_manager->lock(trx, keti_row_lock_key(lock_id, from),
+                                     KETI_LOCK_X, 0);
+    if (rc) return rc;
+    moves->emplace_back(from, builder->add_packed_row(&block[from.offset],
+                                                      length));
+  }
+  return 0;
+}
+
+/** Rewrite the live rows of run into one segment and swap it in. */
+static int merge_run(const std::string &table, const Merge_run &run) {
+  /* The node remaps the index entries of moved rows, so it must have them */
+  int rc = keti_ibuf_merge(table);
+  if (rc) return rc;
+
+  /* As get_share() derives it */
+  const ulonglong lock_id = std::hash<std::string>()(table);
+  Keti_trx trx;
+  Keti_segment_builder builder;
+  moves_t moves;
+  std::vector<uint32> sources;
+  std::vector<uchar> block;
+  std::vector<Keti_packed_column> columns;
+
+  for (size_t i = 0; i < run.segments.size() && rc == 0; i++) {
+    const Keti_segment &segment = run.segments[i];
+    sources.push_back(segment.id);
+    for (uint32 n = 0; n < segment.blocks && rc == 0; n++) {
+      /* Around the buffer pool: these blocks are read once */
+      rc = csd_read_block(table, segment.id, n, &block);
+      /* The new segment encodes the columns its sources did */
+      if (rc == 0) rc = keti_decode_block(&block, &columns);
+      if (rc == 0 && !columns.empty()) builder.set_packed_columns(columns);
+      if (rc == 0)
+        rc = copy_block(lock_id, segment.id, n, block, run.dead[i], &trx,
+                        &builder, &moves);
+    }
+  }
+
+  if (rc == 0) {
+    auto check = [&](Keti_table_versions *versions) {
+      /* A row deleted before it was locked changed what views may need */
+      std::vector<ulonglong> dead;
+      for (size_t i = 0; i < run.segments.size(); i++) {
+        versions->dead_rows(run.segments[i].id, &dead);
+        if (!versions->compactable(run.segments[i].id) ||
+            dead.size() != run.dead[i].size()) {
+          rc = HA_ERR_LOCK_WAIT_TIMEOUT;
+          return;
+        }
+      }
+    };
+    if (!keti_with_table(table, check)) rc = HA_ERR_NO_SUCH_TABLE;
+  }
+
+  /*
+    The row locks keep the check true while the node replaces the segments,
+    so the upload need not hold up the registry.
+  */
+  if (rc == 0) {
+    std::vector<uchar> packed(moves.size() * 2 * KETI_REF_LENGTH);
+    for (size_t i = 0; i < moves.size(); i++) {
+      keti_store_pos(&packed[2 * i * KETI_REF_LENGTH], moves[i].first);
+      keti_store_pos(&packed[(2 * i + 1) * KETI_REF_LENGTH], moves[i].second);
+    }
+    std::vector<uchar> blocks;
+    builder.take(&blocks);
+    uint32 id;
+    rc = csd_replace_segments(table, sources, &packed, &blocks, &id);
+    if (rc == 0) {
+      for (auto &move : moves) move.second.segment = id;
+      /* A table closed meanwhile finds the rows where the node put them */
+      keti_with_table(table, [&](Keti_table_versions *versions) {
+        versions->move_rows(sources, moves);
+      });
+    }
+  }
+  keti_lock_manager->release_all(&trx);
+  if (rc) return rc;
+
+  std::lock_guard<std::mutex> guard(stats_mutex);
+  keti_merge_stats.segments_merged += sources.size();
+  keti_merge_stats.rows_moved += moves.size();
+  return 0;
+}
+
+static std::thread merge_thread;
+static std::mutex merge_mutex;
+static std::condition_variable merge_cond;
+static bool merge_thread_stop = false;
+
+/** One merge round: at most one run per table. */
+static void merge_round() {
+  std::vector<std::string> tables;
+  keti_for_each_table([&tables](Keti_table_versions *versions) {
+    tables.push_back(versions->table());
+  });
+
+  for (const std::string &table : tables) {
+    /* Writes of the foreground go first */
+    if (keti_write_stats.pending >= srv_io_threads) return;
+
+    std::vector<Keti_segment> segments;
+    if (csd_read_manifest(table, &segments)) continue;
+
+    Merge_run run;
+    keti_with_table(table, [&](Keti_table_versions *versions) {
+      pick_run(versions, segments, &run);
+    });
+    if (run.segments.empty()) continue;
+
+    int rc = merge_run(table, run);
+    if (rc && rc != HA_ERR_LOCK_WAIT_TIMEOUT && rc != HA_ERR_NO_SUCH_TABLE)
+      keti_log(WARNING_LEVEL, "cannot merge %zu segments of %s: error %d",
+               run.segments.size(), table.c_str(), rc);
+  }
+}
+
+static void merge_coordinator_thread() {
+  std::unique_lock<std::mutex> lock(merge_mutex);
+  while (!merge_thread_stop) {
+    /* keti_merge_interval = 0 pauses merging; look again every second */
+    merge_cond.wait_for(
+        lock, std::chrono::seconds(std::max(srv_merge_interval, 1UL)));
+    if (merge_thread_stop) break;
+    if (srv_merge_interval == 0) continue;
+
+    lock.unlock();
+    merge_round();
+    lock.lock();
+  }
+}
+
+void keti_merge_init() {
+  merge_thread_stop = false;
+  merge_thread = std::thread(merge_coordinator_thread);
+}
+
+void keti_merge_deinit() {
+  {
+    std::lock_guard<std::mutex> guard(merge_mutex);
+    merge_thread_stop = true;
+  }
+  merge_cond.notify_all();
+  if (merge_thread.joinable()) merge_thread.join();
+}
@@ -0,0 +1,63 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_merge.h
+
+    @brief
+  Background compaction of small and sparse segments.
+
+    @details
+  Trickle inserts leave many small segments behind and purged deletes leave
+  holes in the others, so a scan issues more and shorter reads as a table
+  ages. Every keti_merge_interval seconds the merger looks at the manifest
+  of each open table for a run of segments that are either smaller than
+  keti_merge_min_segment_size or have at least keti_merge_sparse_pct percent
+  of purged rows, and rewrites their live rows into one segment of at most
+  keti_merge_max_segment_size.
+
+  Only segments no open read view needs an older state of are merged: no
+  segment still invisible to some view and no row with an unpurged
+  tombstone. The merger holds the row locks on every row it moves, so the
+  rows cannot change while they are copied, and the node replaces the old
+  segments by the new one in a single manifest update. Scans that listed the
+  manifest before keep reading the old segments; the positions of their rows
+  are forwarded to the new segment, see Keti_table_versions::forward(), until
+  the purge thread retires the old segments.
+*/
+
+#ifndef KETI_MERGE_H
+#define KETI_MERGE_H
+
+#include "my_inttypes.h"
+
+struct keti_merge_stats_t {
+  ulonglong segments_merged;  ///< Segments replaced since startup
+  ulonglong rows_moved;       ///< Rows copied into new segments
+};
+
+extern keti_merge_stats_t keti_merge_stats;
+
+extern ulong srv_merge_interval;
+extern ulonglong srv_merge_min_segment_size;
+extern ulonglong srv_merge_max_segment_size;
+extern ulong srv_merge_sparse_pct;
+
+/** Start the merge thread. */
+void keti_merge_init();
+
+/** Stop the merge thread; a merge in progress is finished first. */
+void keti_merge_deinit();
+
+#endif /* KETI_MERGE_H */
@@ -0,0 +1,512 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_mvcc.cc
+
+    @brief
+  Read views, row visibility and the purge thread.
+*/
+
+#include "storage/keti/keti_mvcc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <set>
+#include <thread>
+
+#include "my_base.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_delta.h"
+#include "storage/keti/keti_lock.h"
+#include "storage/keti/keti_write.h"
+
+keti_purge_stats_t keti_purge_stats = {0, 0};
+
+ulong srv_purge_batch_size = 300;
+ulong srv_purge_interval = 1000;
+
+static std::atomic<ulonglong> current_version(0);
+static std::mutex stats_mutex;
+
+static std::mutex view_mutex;
+/** view_low of the open views */
+static std::multiset<ulonglong> open_views;
+/** Transactions with changes, and their commit version once they have one */
+static std::map<ulonglong, ulonglong> active_trx;
+
+ulonglong keti_next_version() { return ++current_version; }
+
+void keti_trx_started(ulonglong trx) {
+  std::lock_guard<std::mutex> guard(view_mutex);
+  active_trx.emplace(trx, KETI_UNCOMMITTED);
+}
+
+ulonglong keti_trx_committing(ulonglong trx) {
+  std::lock_guard<std::mutex> guard(view_mutex);
+  const ulonglong version = ++current_version;
+  active_trx[trx] = version;
+  return version;
+}
+
+void keti_trx_finished(ulonglong trx) {
+  std::lock_guard<std::mutex> guard(view_mutex);
+  active_trx.erase(trx);
+}
+
+void keti_open_read_view(Keti_trx *trx) {
+  if (trx->read_view != 0) return;
+  std::lock_guard<std::mutex> guard(view_mutex);
+  /* A view sees what was stamped before it was opened; versions start at 1 */
+  trx->read_view = current_version.load() + 1;
+  /* but not what a transaction still stamping its commit stamped before */
+  trx->view_low = trx->read_view;
+  trx->view_active.clear();
+  for (const auto &active : active_trx) {
+    trx->view_active.push_back(active.first);
+    trx->view_low = std::min(trx->view_low, active.second);
+  }
+  open_views.insert(trx->view_low);
+}
+
+void keti_close_read_view(Keti_trx *trx) {
+  if (trx->read_view == 0) return;
+  std::lock_guard<std::mutex> guard(view_mutex);
+  open_views.erase(open_views.find(trx->view_low));
+  trx->read_view = 0;
+  trx->view_active.clear();
+}
+
+ulonglong keti_low_watermark() {
+  std::lock_guard<std::mutex> guard(view_mutex);
+  ulonglong watermark = open_views.empty() ? current_version.load() + 1
+                                           : *open_views.begin();
+  /* Views opened while a commit is stamped will leave it out */
+  for (const auto &active : active_trx)
+    watermark = std::min(watermark, active.second);
+  return watermark;
+}
+
+bool keti_sees(ulonglong version, ulonglong stamp_trx, const Keti_trx *trx) {
+  if (trx != NULL && stamp_trx == trx->id) return true;
+  if (version == KETI_UNCOMMITTED) return false;
+  if (trx == NULL || trx->read_view == 0) return true;
+  return version < trx->read_view &&
+         !std::binary_search(trx->view_active.begin(), trx->view_active.end(),
+                             stamp_trx);
+}
+
+static std::mutex registry_mutex;
+static std::vector<Keti_table_versions *> registry;
+
+bool Keti_table_versions::Pos_less::operator()(const Keti_row_pos &a,
+                                               const Keti_row_pos &b) const {
+  if (a.segment != b.segment) return a.segment < b.segment;
+  if (a.block != b.block) return a.block < b.block;
+  return a.offset < b.offset;
+}
+
+Keti_table_versions::Keti_table_versions()
+    : m_deltas(NULL), m_stats(NULL), m_entries(0) {}
+
+Keti_table_versions::~Keti_table_versions() {
+  std::lock_guard<std::mutex> guard(registry_mutex);
+  registry.erase(std::remove(registry.begin(), registry.end(), this),
+                 registry.end());
+  std::lock_guard<std::mutex> latch(m_mutex);
+  std::lock_guard<std::mutex> stats_guard(stats_mutex);
+  keti_purge_stats.lag -= m_tombstones.size();
+}
+
+void Keti_table_versions::init(const std::string &table,
+                               Keti_delta_store *deltas,
+                               Keti_table_stats *stats) {
+  m_table = table;
+  m_deltas = deltas;
+  m_stats = stats;
+  std::lock_guard<std::mutex> guard(registry_mutex);
+  registry.push_back(this);
+}
+
+bool Keti_table_versions::sees(const Stamp &stamp, const Keti_trx *trx) {
+  return keti_sees(stamp.version, stamp.trx, trx);
+}
+
+void Keti_table_versions::add_segment(uint32 segment, ulonglong version,
+                                      ulonglong trx) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  Stamp stamp = {version, trx};
+  if (m_segments.emplace(segment, stamp).second) m_entries++;
+}
+
+bool Keti_table_versions::add_tombstone(const Keti_row_pos &pos,
+                                        ulonglong version, ulonglong trx) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  Stamp stamp = {version, trx};
+  auto added = m_tombstones.emplace(pos, stamp);
+  if (!added.second) return added.first->second.trx == trx;
+
+  m_entries++;
+  std::lock_guard<std::mutex> stats_guard(stats_mutex);
+  keti_purge_stats.lag++;
+  return true;
+}
+
+void Keti_table_versions::add_deltas(ulonglong trx,
+                                     const std::vector<uchar> &deltas) {
+  if (m_deltas == NULL) return;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (size_t i = 0; i + KETI_DELTA_SIZE <= deltas.size();
+       i += KETI_DELTA_SIZE) {
+    Keti_row_pos pos;
+    Keti_delta delta;
+    keti_delta_unpack(deltas.data() + i, &pos, &delta);
+    m_deltas->add(forward_locked(pos), delta, trx);
+  }
+}
+
+void Keti_table_versions::commit(ulonglong trx, ulonglong version,
+                                 const std::vector<uint32> &segments,
+                                 const std::vector<Keti_row_pos> &tombstones,
+                                 const std::vector<uchar> &deltas) {
+  const ulonglong low_watermark = keti_low_watermark();
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (uint32 segment : segments) {
+    auto it = m_segments.find(segment);
+    if (it != m_segments.end() && it->second.trx == trx)
+      it->second.version = version;
+  }
+  for (const Keti_row_pos &pos : tombstones) {
+    /* Compaction may have moved the row since */
+    auto it = m_tombstones.find(forward_locked(pos));
+    if (it != m_tombstones.end() && it->second.trx == trx)
+      it->second.version = version;
+  }
+  if (m_deltas == NULL) return;
+  for (size_t i = 0; i + KETI_DELTA_SIZE <= deltas.size();
+       i += KETI_DELTA_SIZE)
+    m_deltas->stamp(forward_locked(keti_read_pos(deltas.data() + i)), trx,
+                    version, low_watermark);
+}
+
+void Keti_table_versions::rollback(
+    ulonglong trx, const std::vector<uint32> &segments,
+    const std::vector<Keti_row_pos> &tombstones,
+    const std::vector<uchar> &deltas) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_deltas != NULL)
+    for (size_t i = 0; i + KETI_DELTA_SIZE <= deltas.size();
+         i += KETI_DELTA_SIZE)
+      m_deltas->remove(forward_locked(keti_read_pos(deltas.data() + i)), trx);
+  for (uint32 segment : segments) {
+    auto it = m_segments.find(segment);
+    if (it != m_segments.end() && it->second.trx == trx &&
+        it->second.version == KETI_UNCOMMITTED) {
+      m_segments.erase(it);
+      m_entries--;
+    }
+  }
+  size_t removed = 0;
+  for (const Keti_row_pos &pos : tombstones) {
+    auto it = m_tombstones.find(forward_locked(pos));
+    if (it != m_tombstones.end() && it->second.trx == trx &&
+        it->second.version == KETI_UNCOMMITTED) {
+      m_tombstones.erase(it);
+      m_entries--;
+      removed++;
+    }
+  }
+  std::lock_guard<std::mutex> stats_guard(stats_mutex);
+  keti_purge_stats.lag -= removed;
+}
+
+int Keti_table_versions::load() {
+  std::vector<unsigned char> log;
+  int rc = csd_read_tombstones(m_table, &log);
+  if (rc == HA_ERR_NO_SUCH_TABLE) return 0;
+  if (rc) return rc;
+
+  /* Nothing open predates them; purge hands them to the node again */
+  for (size_t i = 0; i + KETI_REF_LENGTH <= log.size(); i += KETI_REF_LENGTH)
+    add_tombstone(keti_read_pos(log.data() + i), 0, 0);
+  return 0;
+}
+
+bool Keti_table_versions::segment_visible(uint32 segment,
+                                          const Keti_trx *trx) const {
+  if (m_entries.load() == 0) return true;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto it = m_segments.find(segment);
+  return it == m_segments.end() || sees(it->second, trx);
+}
+
+bool Keti_table_versions::row_visible(const Keti_row_pos &pos,
+                                      const Keti_trx *trx) const {
+  if (m_entries.load() == 0) return true;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  const Keti_row_pos row = forward_locked(pos);
+
+  auto dead = m_dead.find(row.segment);
+  if (dead != m_dead.end() &&
+      std::binary_search(dead->second.begin(), dead->second.end(),
+                         (ulonglong)row.block << 32 | row.offset))
+    return false;
+
+  auto tombstone = m_tombstones.find(row);
+  return tombstone == m_tombstones.end() || !sees(tombstone->second, trx);
+}
+
+bool Keti_table_versions::row_deleted(const Keti_row_pos &pos,
+                                      const Keti_trx *trx) const {
+  if (m_entries.load() == 0) return false;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  const Keti_row_pos row = forward_locked(pos);
+
+  auto dead = m_dead.find(row.segment);
+  if (dead != m_dead.end() &&
+      std::binary_search(dead->second.begin(), dead->second.end(),
+                         (ulonglong)row.block << 32 | row.offset))
+    return true;
+
+  auto tombstone = m_tombstones.find(row);
+  return tombstone != m_tombstones.end() &&
+         (trx == NULL || tombstone->second.trx != trx->id);
+}
+
+bool Keti_table_versions::compactable(uint32 segment) const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_segments.count(segment) > 0 || m_replaced.count(segment) > 0)
+    return false;
+
+  const Keti_row_pos first = {segment, 0, 0};
+  auto tombstone = m_tombstones.lower_bound(first);
+  return tombstone == m_tombstones.end() ||
+         tombstone->first.segment != segment;
+}
+
+void Keti_table_versions::dead_rows(uint32 segment,
+                                    std::vector<ulonglong> *rows) const {
+  rows->clear();
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto dead = m_dead.find(segment);
+  if (dead != m_dead.end()) *rows = dead->second;
+}
+
+void Keti_table_versions::hidden_rows(uint32 segment, const Keti_trx *trx,
+                                      std::vector<Keti_row_pos> *rows) const {
+  rows->clear();
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto dead = m_dead.find(segment);
+  if (dead != m_dead.end())
+    for (ulonglong row : dead->second)
+      rows->push_back({segment, static_cast<uint32>(row >> 32),
+                       static_cast<uint32>(row)});
+
+  const Keti_row_pos first = {segment, 0, 0};
+  for (auto tombstone = m_tombstones.lower_bound(first);
+       tombstone != m_tombstones.end() && tombstone->first.segment == segment;
+       ++tombstone)
+    if (sees(tombstone->second, trx)) rows->push_back(tombstone->first);
+}
+
+void Keti_table_versions::move_rows(
+    const std::vector<uint32> &sources,
+    const std::vector<std::pair<Keti_row_pos, Keti_row_pos>> &moves) {
+  const ulonglong version = keti_next_version();
+  std::lock_guard<std::mutex> guard(m_mutex);
+
+  for (const auto &move : moves) {
+    auto tombstone = m_tombstones.find(move.first);
+    if (tombstone != m_tombstones.end()) {
+      m_tombstones.emplace(move.second, tombstone->second);
+      m_tombstones.erase(tombstone);
+    }
+    if (m_deltas != NULL) m_deltas->move(move.first, move.second);
+    m_forward.emplace(move.first, move.second);
+  }
+  for (uint32 segment : sources) m_replaced.emplace(segment, version);
+  m_entries += moves.size() + sources.size();
+}
+
+Keti_row_pos Keti_table_versions::forward_locked(
+    const Keti_row_pos &pos) const {
+  /* A merged segment may have been merged again */
+  Keti_row_pos row = pos;
+  for (auto it = m_forward.find(row); it != m_forward.end();
+       it = m_forward.find(row))
+    row = it->second;
+  return row;
+}
+
+Keti_row_pos Keti_table_versions::forward(const Keti_row_pos &pos) const {
+  if (m_entries.load() == 0) return pos;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return forward_locked(pos);
+}
+
+void Keti_table_versions::retire(ulonglong low_watermark,
+                                 std::vector<uint32> *segments) {
+  segments->clear();
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (auto it = m_replaced.begin(); it != m_replaced.end();) {
+    if (it->second >= low_watermark) {
+      ++it;
+      continue;
+    }
+    const uint32 segment = it->first;
+    const Keti_row_pos first = {segment, 0, 0};
+    auto forward = m_forward.lower_bound(first);
+    while (forward != m_forward.end() && forward->first.segment == segment) {
+      forward = m_forward.erase(forward);
+      m_entries--;
+    }
+    auto dead = m_dead.find(segment);
+    if (dead != m_dead.end()) {
+      m_entries -= dead->second.size();
+      m_dead.erase(dead);
+    }
+    it = m_replaced.erase(it);
+    m_entries--;
+    segments->push_back(segment);
+  }
+}
+
+void Keti_table_versions::purgeable(ulonglong low_watermark, size_t limit,
+                                    std::vector<Keti_row_pos> *rows) {
+  rows->clear();
+  if (m_deltas != NULL) m_deltas->fold(low_watermark);
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (auto it = m_segments.begin(); it != m_segments.end();) {
+    if (it->second.version < low_watermark) {
+      it = m_segments.erase(it);
+      m_entries--;
+    } else {
+      ++it;
+    }
+  }
+  /* KETI_UNCOMMITTED is above every watermark */
+  for (const auto &tombstone : m_tombstones) {
+    if (rows->size() >= limit) break;
+    if (tombstone.second.version < low_watermark)
+      rows->push_back(tombstone.first);
+  }
+}
+
+void Keti_table_versions::purged(const std::vector<Keti_row_pos> &rows) {
+  size_t purged = 0;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (const Keti_row_pos &pos : rows) {
+    /* The table may have been reopened meanwhile */
+    if (m_tombstones.erase(pos) == 0) continue;
+    std::vector<ulonglong> &dead = m_dead[pos.segment];
+    const ulonglong key = (ulonglong)pos.block << 32 | pos.offset;
+    dead.insert(std::lower_bound(dead.begin(), dead.end(), key), key);
+    if (m_deltas != NULL) m_deltas->erase(pos);
+    purged++;
+  }
+  std::lock_guard<std::mutex> stats_guard(stats_mutex);
+  keti_purge_stats.lag -= purged;
+  keti_purge_stats.rows_purged += purged;
+}
+
+size_t Keti_table_versions::lag() const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_tombstones.size();
+}
+
+static std::thread purge_thread;
+static std::mutex purge_mutex;
+static std::condition_variable purge_cond;
+static bool purge_thread_stop = false;
+
+void keti_for_each_table(
+    const std::function<void(Keti_table_versions *)> &fn) {
+  std::lock_guard<std::mutex> guard(registry_mutex);
+  for (Keti_table_versions *versions : registry) fn(versions);
+}
+
+bool keti_with_table(const std::string &table,
+                     const std::function<void(Keti_table_versions *)> &fn) {
+  std::lock_guard<std::mutex> guard(registry_mutex);
+  for (Keti_table_versions *versions : registry) {
+    if (versions->table() != table) continue;
+    fn(versions);
+    return true;
+  }
+  return false;
+}
+
+/**
+  One purge round over all tables. The node is told outside the registry,
+  so that opening and closing tables does not wait for it.
+*/
+static void purge_round() {
+  const ulonglong watermark = keti_low_watermark();
+  std::vector<std::string> tables;
+  keti_for_each_table([&tables](Keti_table_versions *versions) {
+    tables.push_back(versions->table());
+  });
+
+  for (const std::string &table : tables) {
+    /* Writes of the foreground go first */
+    if (keti_write_stats.pending >= srv_io_threads) return;
+
+    std::vector<Keti_row_pos> rows;
+    std::vector<uint32> retired;
+    keti_with_table(table, [&](Keti_table_versions *versions) {
+      versions->purgeable(watermark, srv_purge_batch_size, &rows);
+      versions->retire(watermark, &retired);
+    });
+
+    if (!rows.empty()) {
+      std::vector<unsigned char> body(rows.size() * KETI_REF_LENGTH);
+      for (size_t i = 0; i < rows.size(); i++)
+        keti_store_pos(body.data() + i * KETI_REF_LENGTH, rows[i]);
+      if (csd_purge(table, &body) == 0)
+        keti_with_table(table, [&rows](Keti_table_versions *versions) {
+          versions->purged(rows);
+        });
+    }
+    if (!retired.empty() && csd_retire_segments(table, retired))
+      keti_log(WARNING_LEVEL, "cannot drop %zu replaced segments of %s",
+               retired.size(), table.c_str());
+  }
+}
+
+static void purge_coordinator_thread() {
+  std::unique_lock<std::mutex> lock(purge_mutex);
+  while (!purge_thread_stop) {
+    purge_cond.wait_for(lock, std::chrono::milliseconds(srv_purge_interval));
+    if (purge_thread_stop) break;
+
+    lock.unlock();
+    purge_round();
+    lock.lock();
+  }
+}
+
+void keti_purge_init() {
+  purge_thread_stop = false;
+  purge_thread = std::thread(purge_coordinator_thread);
+}
+
+void keti_purge_deinit() {
+  {
+    std::lock_guard<std::mutex> guard(purge_mutex);
+    purge_thread_stop = true;
+  }
+  purge_cond.notify_all();
+  if (purge_thread.joinable()) purge_thread.join();
+}
@@ -0,0 +1,283 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_mvcc.h
+
+    @brief
+  Row versions of KETI tables and their background purge.
+
+    @details
+  A change is stamped KETI_UNCOMMITTED and the id of its transaction when it
+  is made, and with a version from one global counter when the transaction
+  commits, see keti_trx.h. A transaction reads as of the version current
+  when its read view was opened, plus its own changes:
+
+  - a segment committed at a later version by another transaction is
+    skipped as a whole;
+  - a row deleted, or replaced by an update, is hidden by a tombstone once
+    the reader's view is past the tombstone's version.
+
+  Stamping the changes of a commit is not atomic, so a view also leaves out
+  every transaction that was active when it opened, even if it commits
+  with a version below the view's.
+
+  The oldest open read view is the low watermark. A tombstone below it is
+  seen by nobody, so the purge thread moves it out of the versioned map into
+  a compact per-segment list of dead rows, tells the node the row is gone
+  (it drops the index entries) and forgets the deltas of the row. The space
+  is reclaimed when the segment is compacted, see keti_merge.h. The purge
+  thread also lets the node drop segments replaced by compaction once no
+  view can be scanning them. Purge takes at most keti_purge_batch_size rows
+  per table every keti_purge_interval milliseconds, and yields while the
+  write pipeline is saturated.
+*/
+
+#ifndef KETI_MVCC_H
+#define KETI_MVCC_H
+
+#include <stddef.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "my_inttypes.h"
+#include "storage/keti/keti_row.h"
+
+class Keti_delta_store;
+class Keti_table_stats;
+class Keti_trx;
+
+/** Version of changes not committed yet; above every read view. */
+static const ulonglong KETI_UNCOMMITTED = ~0ULL;
+
+/** Stamp a change with a new version. */
+ulonglong keti_next_version();
+
+/** trx is about to make changes; views opened from now on leave them out. */
+void keti_trx_started(ulonglong trx);
+
+/**
+  Start the commit of trx.
+
+  @return the version to stamp its changes with; views opened before
+          keti_trx_finished() leave them out all the same
+*/
+ulonglong keti_trx_committing(ulonglong trx);
+
+/** trx stamped its changes with its commit version, or took them back. */
+void keti_trx_finished(ulonglong trx);
+
+/** Give trx a read view unless it already has one. */
+void keti_open_read_view(Keti_trx *trx);
+
+/** Close the read view of trx, if any. */
+void keti_close_read_view(Keti_trx *trx);
+
+/** Changes stamped below this are visible to every open and future view. */
+ulonglong keti_low_watermark();
+
+/**
+  True if trx sees a change stamped with version by the transaction
+  stamp_trx: its own, or committed in its view. NULL sees what is committed.
+*/
+bool keti_sees(ulonglong version, ulonglong stamp_trx, const Keti_trx *trx);
+
+/** @brief
+  Versions of the segments and rows of one table.
+*/
+class Keti_table_versions {
+ public:
+  Keti_table_versions();
+  ~Keti_table_versions();
+
+  /**
+    Register for purge. Called once the name is known.
+
+    @param deltas  deltas of the same table, dropped for purged rows
+    @param stats   statistics of the same table, which commits update
+  */
+  void init(const std::string &table, Keti_delta_store *deltas,
+            Keti_table_stats *stats);
+
+  /** A segment written by trx became visible at version. */
+  void add_segment(uint32 segment, ulonglong version, ulonglong trx);
+
+  /**
+    The row at pos was deleted by trx at version.
+
+    @return false if another transaction deleted it first; its tombstone
+            stays
+  */
+  bool add_tombstone(const Keti_row_pos &pos, ulonglong version,
+                     ulonglong trx);
+
+  /**
+    The deltas of trx, in the log format, join those of the table, stamped
+    KETI_UNCOMMITTED.
+  */
+  void add_deltas(ulonglong trx, const std::vector<uchar> &deltas);
+
+  /**
+    Stamp the segments, tombstones and deltas trx added as KETI_UNCOMMITTED
+    with its commit version. Those another transaction added first stay as
+    they are.
+  */
+  void commit(ulonglong trx, ulonglong version,
+              const std::vector<uint32> &segments,
+              const std::vector<Keti_row_pos> &tombstones,
+              const std::vector<uchar> &deltas);
+
+  /**
+    Take out the segments, tombstones and deltas trx added as
+    KETI_UNCOMMITTED, as if it had never made them.
+  */
+  void rollback(ulonglong trx, const std::vector<uint32> &segments,
+                const std::vector<Keti_row_pos> &tombstones,
+                const std::vector<uchar> &deltas);
+
+  /** Read the tombstones the node still knows. */
+  int load();
+
+  /** False if trx may not see anything of the segment. */
+  bool segment_visible(uint32 segment, const Keti_trx *trx) const;
+
+  /** False if trx may not see the row at pos. */
+  bool row_visible(const Keti_row_pos &pos, const Keti_trx *trx) const;
+
+  /**
+    True if a transaction other than trx deleted the row at pos, whether
+    trx sees that or not.
+  */
+  bool row_deleted(const Keti_row_pos &pos, const Keti_trx *trx) const;
+
+  /**
+    True if the segment has no history an open view may need: it is not
+    stamped, none of its rows wait for purge and it is not being retired.
+  */
+  bool compactable(uint32 segment) const;
+
+  /** Purged rows of a segment, as block << 32 | offset, sorted. */
+  void dead_rows(uint32 segment, std::vector<ulonglong> *rows) const;
+
+  /** Rows of a segment trx may not see: purged, or deleted in its view. */
+  void hidden_rows(uint32 segment, const Keti_trx *trx,
+                   std::vector<Keti_row_pos> *rows) const;
+
+  /**
+    Rows moved out of sources into a new segment, which replaced them on the
+    node. Their tombstones and deltas follow them, and positions in sources
+    are forwarded until no view can be scanning sources any more.
+  */
+  void move_rows(const std::vector<uint32> &sources,
+                 const std::vector<std::pair<Keti_row_pos, Keti_row_pos>>
+                     &moves);
+
+  /** Where the row at pos lives now. */
+  Keti_row_pos forward(const Keti_row_pos &pos) const;
+
+  /**
+    Take out the replaced segments that no view opened before low_watermark
+    can still be scanning.
+  */
+  void retire(ulonglong low_watermark, std::vector<uint32> *segments);
+
+  const std::string &table() const { return m_table; }
+
+  Keti_table_stats *stats() const { return m_stats; }
+
+  /**
+    Pick up to limit tombstones older than low_watermark for purge, forget
+    the stamps of segments older than it and sum up the deltas stamped
+    below it.
+  */
+  void purgeable(ulonglong low_watermark, size_t limit,
+                 std::vector<Keti_row_pos> *rows);
+
+  /** The node reclaimed rows picked by purgeable(). */
+  void purged(const std::vector<Keti_row_pos> &rows);
+
+  /** Tombstones waiting for purge. */
+  size_t lag() const;
+
+ private:
+  struct Stamp {
+    ulonglong version;
+    ulonglong trx;
+  };
+
+  struct Pos_less {
+    bool operator()(const Keti_row_pos &a, const Keti_row_pos &b) const;
+  };
+
+  /** True if a change stamped so is visible to trx; caller holds m_mutex. */
+  static bool sees(const Stamp &stamp, const Keti_trx *trx);
+
+  /** forward() for a caller holding m_mutex. */
+  Keti_row_pos forward_locked(const Keti_row_pos &pos) const;
+
+  std::string m_table;
+  Keti_delta_store *m_deltas;
+  Keti_table_stats *m_stats;
+
+  mutable std::mutex m_mutex;
+  /** Segments some open view may not see yet. */
+  std::unordered_map<uint32, Stamp> m_segments;
+  std::map<Keti_row_pos, Stamp, Pos_less> m_tombstones;
+  /** Purged rows per segment, as block << 32 | offset, sorted. */
+  std::unordered_map<uint32, std::vector<ulonglong>> m_dead;
+  /** New positions of the rows of replaced segments. */
+  std::map<Keti_row_pos, Keti_row_pos, Pos_less> m_forward;
+  /** Replaced segments and the version they were replaced at. */
+  std::unordered_map<uint32, ulonglong> m_replaced;
+  /** Lets readers of tables without versions skip m_mutex. */
+  std::atomic<size_t> m_entries;
+};
+
+struct keti_purge_stats_t {
+  ulonglong lag;          ///< Tombstones waiting for purge, all tables
+  ulonglong rows_purged;  ///< Rows purged since startup
+};
+
+extern keti_purge_stats_t keti_purge_stats;
+
+extern ulong srv_purge_batch_size;
+extern ulong srv_purge_interval;
+
+/**
+  Call fn for every open table. Tables are not destroyed while fn runs, so
+  fn should not take long, nor wait for the storage node.
+*/
+void keti_for_each_table(const std::function<void(Keti_table_versions *)> &fn);
+
+/**
+  Call fn for the open table with the given name on the storage node, with
+  the same guarantee as keti_for_each_table().
+
+  @return false if the table is not open
+*/
+bool keti_with_table(const std::string &table,
+                     const std::function<void(Keti_table_versions *)> &fn);
+
+/** Start the purge thread. */
+void keti_purge_init();
+
+/** Stop the purge thread. */
+void keti_purge_deinit();
+
+#endif /* KETI_MVCC_H */
@@ -0,0 +1,295 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_project.cc
+
+    @brief
+  Projected reads of blocks.
+*/
+
+#include "storage/keti/keti_project.h"
+
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+#include "m_ctype.h"
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "sql/field.h"
+#include "sql/item.h"
+#include "sql/item_cmpfunc.h"
+#include "sql/item_func.h"
+#include "sql/sql_lex.h"
+#include "sql/table.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_row.h"
+
+keti_project_stats_t keti_project_stats = {0, 0};
+
+bool srv_projection_pushdown = true;
+
+static std::mutex stats_mutex;
+
+/**
+  Recognize LEFT(column, n) and SUBSTRING(column, 1, n) on a BLOB column of
+  table.
+
+  @param chars  receives n
+*/
+static bool column_prefix(Item_func *func, const TABLE *table,
+                          const Field **field, longlong *chars) {
+  Item **args = func->arguments();
+  Item *length;
+  if (func->arg_count == 2 && strcmp(func->func_name(), "left") == 0) {
+    length = args[1];
+  } else if (func->arg_count == 3 &&
+             strcmp(func->func_name(), "substr") == 0 &&
+             args[1]->basic_const_item() && args[1]->val_int() == 1 &&
+             !args[1]->null_value) {
+    length = args[2];
+  } else {
+    return false;
+  }
+
+  const Item *column = args[0]->real_item();
+  if (column->type() != Item::FIELD_ITEM || !length->basic_const_item())
+    return false;
+  *field = static_cast<const Item_field *>(column)->field;
+  if ((*field)->table != table || !((*field)->flags & BLOB_FLAG)) return false;
+  *chars = length->val_int();
+  return !length->null_value && *chars >= 0;
+}
+
+/**
+  Raise limits, by field, to the bytes of the BLOB columns of table that
+  item reads.
+
+  @return false if item is of a kind not looked into
+*/
+static bool blob_prefixes(Item *item, const TABLE *table,
+                          std::vector<uint32> *limits) {
+  item = item->real_item();
+  switch (item->type()) {
+    case Item::FIELD_ITEM: {
+      const Field *field = static_cast<Item_field *>(item)->field;
+      if (field->table == table)
+        (*limits)[field->field_index] = KETI_BLOB_WHOLE;
+      return true;
+    }
+    case Item::COND_ITEM: {
+      List_iterator<Item> li(*static_cast<Item_cond *>(item)->argument_list());
+      Item *arg;
+      while ((arg = li++))
+        if (!blob_prefixes(arg, table, limits)) return false;
+      return true;
+    }
+    case Item::FUNC_ITEM:
+      break;
+    default:
+      return item->basic_const_item();
+  }
+
+  Item_func *func = static_cast<Item_func *>(item);
+  const Field *field;
+  longlong chars;
+  if (column_prefix(func, table, &field, &chars)) {
+    uint32 &limit = (*limits)[field->field_index];
+    const ulonglong bytes = std::min<ulonglong>(
+        static_cast<ulonglong>(chars) * field->charset()->mbmaxlen,
+        KETI_BLOB_WHOLE - 1);
+    if (limit != KETI_BLOB_WHOLE)
+      limit = std::max(limit, static_cast<uint32>(bytes));
+    return true;
+  }
+
+  Item **args = func->arguments();
+  for (uint i = 0; i < func->arg_count; i++)
+    if (!blob_prefixes(args[i], table, limits)) return false;
+  return true;
+}
+
+/**
+  Bytes of the BLOB columns of table its query block reads, by field.
+
+  @return false unless it is a single table query block whose expressions
+          are all understood
+*/
+static bool query_blob_prefixes(const TABLE *table,
+                                std::vector<uint32> *limits) {
+  if (table->pos_in_table_list == NULL) return false;
+  SELECT_LEX *select = table->pos_in_table_list->select_lex;
+  if (select == NULL || select->leaf_table_count != 1) return false;
+
+  List_iterator<Item> li(select->fields_list);
+  Item *item;
+  while ((item = li++))
+    if (!blob_prefixes(item, table, limits)) return false;
+  if (select->where_cond() != NULL &&
+      !blob_prefixes(select->where_cond(), table, limits))
+    return false;
+  if (select->having_cond() != NULL &&
+      !blob_prefixes(select->having_cond(), table, limits))
+    return false;
+  for (const ORDER *order = select->group_list.first; order != NULL;
+       order = order->next)
+    if (!blob_prefixes(*order->item, table, limits)) return false;
+  for (const ORDER *order = select->order_list.first; order != NULL;
+       order = order->next)
+    if (!blob_prefixes(*order->item, table, limits)) return false;
+  return true;
+}
+
+void Keti_projection::build(const TABLE *table) {
+  const TABLE_SHARE *share = table->s;
+  m_active = false;
+  m_ranges.clear();
+  m_blob_limits.clear();
+  m_reclength = share->reclength;
+  /* Ranges are sent in 2 bytes */
+  if (!srv_projection_pushdown || share->reclength > 0xFFFF) return;
+
+  std::vector<uint32> limits(share->fields, 0);
+  const bool prefixes = query_blob_prefixes(table, &limits);
+
+  /* The null bits and the columns read; of a BLOB the record has a pointer */
+  std::vector<Range> ranges;
+  if (share->null_bytes > 0)
+    ranges.push_back({0, static_cast<uint16>(share->null_bytes)});
+  size_t kept = share->null_bytes;
+  bool cut = false;
+  for (uint i = 0; i < share->fields; i++) {
+    const Field *field = table->field[i];
+    const bool read = bitmap_is_set(table->read_set, i);
+    if (field->flags & BLOB_FLAG) {
+      /* A column read some other way than the query block shows */
+      if (read && (!prefixes || limits[i] == 0)) limits[i] = KETI_BLOB_WHOLE;
+      m_blob_limits.push_back(read ? limits[i] : 0);
+      cut |= m_blob_limits.back() != KETI_BLOB_WHOLE;
+    } else if (read) {
+      ranges.push_back({static_cast<uint16>(field->offset(table->record[0])),
+                        static_cast<uint16>(field->pack_length())});
+      kept += field->pack_length();
+    }
+  }
+  if (!cut && kept * 2 > share->reclength) {
+    m_blob_limits.clear();
+    return;
+  }
+
+  std::sort(ranges.begin(), ranges.end(),
+            [](const Range &a, const Range &b) { return a.offset < b.offset; });
+  for (const Range &range : ranges) {
+    if (range.length == 0) continue;
+    if (!m_ranges.empty() &&
+        m_ranges.back().offset + m_ranges.back().length >= range.offset) {
+      Range &last = m_ranges.back();
+      last.length = static_cast<uint16>(
+          std::max(last.offset + last.length, range.offset + range.length) -
+          last.offset);
+    } else {
+      m_ranges.push_back(range);
+    }
+  }
+  m_active = true;
+}
+
+int Keti_projection::read(const Keti_page_id &id, Keti_page *page) const {
+  if (keti_buffer_pool->cached(id, page)) return 0;
+
+  std::vector<uchar> projection(2 + 4 * m_ranges.size() + 2 +
+                                4 * m_blob_limits.size());
+  uchar *pos = projection.data();
+  int2store(pos, static_cast<uint16>(m_ranges.size()));
+  for (const Range &range : m_ranges) {
+    int2store(pos += 2, range.offset);
+    int2store(pos += 2, range.length);
+  }
+  int2store(pos += 2, static_cast<uint16>(m_blob_limits.size()));
+  pos += 2;
+  for (uint32 limit : m_blob_limits) {
+    int4store(pos, limit);
+    pos += 4;
+  }
+
+  std::vector<uchar> reply;
+  int rc = csd_read_projected(id.table, id.segment, id.block, &projection,
+                              &reply);
+  if (rc) return rc;
+
+  std::shared_ptr<std::vector<uchar>> block =
+      std::make_shared<std::vector<uchar>>();
+  if ((rc = materialize(reply, block.get()))) {
+    keti_log(ERROR_LEVEL, "bad projected block %u of segment %u of %s",
+             id.block, id.segment, id.table.c_str());
+    return rc;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_project_stats.blocks++;
+    if (block->size() > reply.size())
+      keti_project_stats.bytes_saved += block->size() - reply.size();
+  }
+  *page = block;
+  return 0;
+}
+
+/** Lay the rows of a reply out in the plain layout, at their offsets. */
+int Keti_projection::materialize(const std::vector<uchar> &reply,
+                                 std::vector<uchar> *block) const {
+  size_t kept = 0;
+  for (const Range &range : m_ranges) kept += range.length;
+
+  const uchar *pos = reply.data();
+  const uchar *end = pos + reply.size();
+  if (end - pos < 4) return HA_ERR_CRASHED;
+  const uint32 rows = uint4korr(pos);
+  pos += 4;
+  block->assign(KETI_BLOCK_HEADER_SIZE, 0);
+  int4store(block->data(), rows);
+
+  for (uint32 i = 0; i < rows; i++) {
+    if (static_cast<size_t>(end - pos) < 8 + kept) return HA_ERR_CRASHED;
+    const uint32 offset = uint4korr(pos);
+    const uint32 length = uint4korr(pos + 4);
+    pos += 8;
+    if (offset < block->size() || length < m_reclength) return HA_ERR_CRASHED;
+
+    block->resize(offset + KETI_ROW_HEADER_SIZE + length, 0);
+    uchar *row = block->data() + offset;
+    int4store(row, length);
+    uchar *record = row + KETI_ROW_HEADER_SIZE;
+    for (const Range &range : m_ranges) {
+      memcpy(record + range.offset, pos, range.length);
+      pos += range.length;
+    }
+
+    uchar *blob = record + m_reclength;
+    const uchar *row_end = record + length;
+    for (size_t j = 0; j < m_blob_limits.size(); j++) {
+      if (end - pos < 4) return HA_ERR_CRASHED;
+      const size_t blob_length = 4 + uint4korr(pos);
+      if (static_cast<size_t>(end - pos) < blob_length ||
+          static_cast<size_t>(row_end - blob) < blob_length)
+        return HA_ERR_CRASHED;
+      memcpy(blob, pos, blob_length);
+      pos += blob_length;
+      blob += blob_length;
+    }
+  }
+  return pos == end ? 0 : HA_ERR_CRASHED;
+}
@@ -0,0 +1,120 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_project.h
+
+    @brief
+  Projections: scans that have the storage node send only the parts of the
+  rows the statement reads.
+
+    @details
+  A scan by a statement that changes no rows asks the node, for every block
+  the buffer pool does not hold, for the columns in the read set of the
+  table only: the null bits, the bytes of those columns in the record, and
+  their BLOB data. A BLOB or TEXT column that a single table query reads
+  only as LEFT(column, n) or SUBSTRING(column, 1, n), n constant, is cut
+  to n characters, at most n * mbmaxlen bytes, since the server takes no
+  more of it. A select list of
+
+  @verbatim
+    SELECT DATE(ts), amount * rate, SUBSTRING(url, 1, 20) FROM t
+  @endverbatim
+
+  thus moves ts, amount, rate and 20 characters of url over the wire. The
+  expressions themselves are computed by the server, the handler interface
+  having no way to hand it computed values; their inputs are what takes
+  the bytes.
+
+  The node replies with the rows of the block as
+
+  @verbatim
+    reply   := row_count(4) row*
+    row     := offset(4) length(4) range-bytes blob*
+    blob    := length(4) data
+  @endverbatim
+
+  offset and length being those of the row in the plain block, range-bytes
+  the bytes of the record ranges asked for one after the other, and the
+  blobs those of the BLOB columns in field order, cut as asked. The host
+  lays the rows out again at their offsets in a block of the plain layout
+  of keti_row.h, the columns left out zeroed, so a scan sees the same
+  positions as with whole blocks. Such blocks are not cached.
+
+  A projection is used only when it leaves out a BLOB, cuts one, or leaves
+  at least half of the record behind.
+*/
+
+#ifndef KETI_PROJECT_H
+#define KETI_PROJECT_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "my_inttypes.h"
+#include "storage/keti/keti_buf.h"
+
+struct TABLE;
+
+struct keti_project_stats_t {
+  ulonglong blocks;       ///< Blocks read projected
+  ulonglong bytes_saved;  ///< Bytes the projections did not transfer
+};
+
+extern keti_project_stats_t keti_project_stats;
+
+extern bool srv_projection_pushdown;
+
+/** BLOB limit of a column read whole. */
+static const uint32 KETI_BLOB_WHOLE = 0xFFFFFFFF;
+
+/** @brief
+  The parts of the rows a scan reads.
+*/
+class Keti_projection {
+ public:
+  Keti_projection() : m_active(false), m_reclength(0) {}
+
+  /**
+    Work out what the statement scanning table reads of its rows. The
+    projection stays empty if reading whole blocks is as good.
+  */
+  void build(const TABLE *table);
+
+  void clear() { m_active = false; }
+  bool empty() const { return !m_active; }
+
+  /**
+    Read a block as the projection has it, or whole if the buffer pool
+    holds it.
+  */
+  int read(const Keti_page_id &id, Keti_page *page) const;
+
+ private:
+  struct Range {
+    uint16 offset;
+    uint16 length;
+  };
+
+  int materialize(const std::vector<uchar> &reply,
+                  std::vector<uchar> *block) const;
+
+  bool m_active;
+  std::vector<Range> m_ranges;  ///< Of the record, by offset
+  /** Bytes to send of each BLOB column, in field order. */
+  std::vector<uint32> m_blob_limits;
+  size_t m_reclength;
+};
+
+#endif /* KETI_PROJECT_H */
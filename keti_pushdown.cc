@@ -0,0 +1,361 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_pushdown.cc
+
+    @brief
+  Classification and selectivity estimation of pushed conditions.
+*/
+
+#include "storage/keti/keti_pushdown.h"
+
+#include <algorithm>
+
+#include "m_ctype.h"
+#include "sql/field.h"
+#include "sql/histograms/histogram.h"
+#include "sql/item.h"
+#include "sql/item_cmpfunc.h"
+#include "sql/item_func.h"
+#include "sql/table.h"
+#include "storage/keti/keti_inverted.h"
+#include "storage/keti/keti_key.h"
+#include "storage/keti/keti_stats.h"
+
+/*
+  Selectivity guesses for predicates on columns with neither a histogram nor
+  a zone map; the same values the server uses for its filtering estimates.
+*/
+static const double EQUALITY_SELECTIVITY = 0.1;
+static const double INEQUALITY_SELECTIVITY = 0.3333;
+static const double BETWEEN_SELECTIVITY = 0.1111;
+static const double NULL_SELECTIVITY = 0.1;
+
+bool keti_field_pushable(const Field *field) {
+  switch (field->result_type()) {
+    case INT_RESULT:
+    case REAL_RESULT:
+    case DECIMAL_RESULT:
+      return true;
+    case STRING_RESULT:
+      return keti_string_field(field) && !(field->flags & BLOB_FLAG);
+    default:
+      return false;
+  }
+}
+
+/** The column of table that item refers to, or NULL. */
+static const Item_field *table_field(const Item *item, const TABLE *table) {
+  const Item *real = item->real_item();
+  if (real->type() != Item::FIELD_ITEM) return NULL;
+
+  const Item_field *field = static_cast<const Item_field *>(real);
+  if (field->field->table != table || !keti_field_pushable(field->field))
+    return NULL;
+  return field;
+}
+
+/** Operator of "b op a" given the operator of "a op b". */
+static Item_func::Functype swap_operands(Item_func::Functype op) {
+  switch (op) {
+    case Item_func::LT_FUNC:
+      return Item_func::GT_FUNC;
+    case Item_func::LE_FUNC:
+      return Item_func::GE_FUNC;
+    case Item_func::GT_FUNC:
+      return Item_func::LT_FUNC;
+    case Item_func::GE_FUNC:
+      return Item_func::LE_FUNC;
+    default:
+      return op;
+  }
+}
+
+bool keti_normalize_predicate(const Item_func *func, const TABLE *table,
+                              Keti_predicate *pred) {
+  Item **args = func->arguments();
+  pred->op = func->functype();
+  pred->negated = false;
+  pred->args = args;
+  pred->arg_count = func->arg_count;
+
+  switch (pred->op) {
+    case Item_func::EQ_FUNC:
+    case Item_func::NE_FUNC:
+    case Item_func::LT_FUNC:
+    case Item_func::LE_FUNC:
+    case Item_func::GT_FUNC:
+    case Item_func::GE_FUNC:
+      if ((pred->field = table_field(args[0], table)) != NULL &&
+          args[1]->const_item()) {
+        pred->items[0] = args[0];
+        pred->items[1] = args[1];
+      } else if ((pred->field = table_field(args[1], table)) != NULL &&
+                 args[0]->const_item()) {
+        pred->op = swap_operands(pred->op);
+        pred->items[0] = args[1];
+        pred->items[1] = args[0];
+      } else {
+        return false;
+      }
+      pred->args = pred->items;
+      return true;
+    case Item_func::BETWEEN:
+    case Item_func::IN_FUNC:
+      if ((pred->field = table_field(args[0], table)) == NULL) return false;
+      for (uint i = 1; i < func->arg_count; i++)
+        if (!args[i]->const_item()) return false;
+      pred->negated =
+          pred->op == Item_func::BETWEEN
+              ? static_cast<const Item_func_between *>(func)->negated
+              : static_cast<const Item_func_in *>(func)->negated;
+      return true;
+    case Item_func::ISNULL_FUNC:
+    case Item_func::ISNOTNULL_FUNC:
+      return (pred->field = table_field(args[0], table)) != NULL;
+    default:
+      return false;
+  }
+}
+
+/**
+  Check whether the storage node can evaluate cond.
+
+  @param exact  if false, it is enough that the node can evaluate a weaker
+                condition that every matching row satisfies, since the server
+                checks the whole condition again; under NOT the pushed part
+                must be exact
+*/
+static bool pushable(const Item *cond, const TABLE *table, bool exact) {
+  if (cond->type() == Item::COND_ITEM) {
+    const Item_cond *item_cond = static_cast<const Item_cond *>(cond);
+    const bool is_and = item_cond->functype() == Item_func::COND_AND_FUNC;
+    if (!is_and && item_cond->functype() != Item_func::COND_OR_FUNC)
+      return false;
+
+    /* A relaxed AND needs one pushable conjunct, anything else needs all. */
+    const bool any = is_and && !exact;
+    List_iterator<Item> li(*const_cast<Item_cond *>(item_cond)->argument_list());
+    Item *item;
+    while ((item = li++)) {
+      const bool arg = pushable(item, table, exact);
+      if (any && arg) return true;
+      if (!any && !arg) return false;
+    }
+    return !any;
+  }
+
+  if (cond->type() != Item::FUNC_ITEM) return false;
+
+  const Item_func *func = static_cast<const Item_func *>(cond);
+  if (func->functype() == Item_func::NOT_FUNC)
+    return pushable(func->arguments()[0], table, true);
+
+  Keti_predicate pred;
+  if (keti_normalize_predicate(func, table, &pred)) return true;
+
+  /* Inverted indexes find the rows that contain a tag, not the others */
+  const Field *field;
+  std::vector<std::string> tags;
+  return !exact && keti_tag_predicate(cond, table, &field, &tags);
+}
+
+bool keti_cond_pushable(const Item *cond, const TABLE *table) {
+  return cond != NULL && pushable(cond, table, false);
+}
+
+bool keti_equality_predicate(const Item *cond, const TABLE *table,
+                             const Field **field, std::vector<Item *> *values) {
+  if (cond->type() != Item::FUNC_ITEM) return false;
+
+  Keti_predicate pred;
+  if (!keti_normalize_predicate(static_cast<const Item_func *>(cond), table,
+                                &pred) ||
+      pred.negated ||
+      (pred.op != Item_func::EQ_FUNC && pred.op != Item_func::IN_FUNC))
+    return false;
+
+  *field = pred.field->field;
+  values->assign(pred.args + 1, pred.args + pred.arg_count);
+  return true;
+}
+
+bool keti_string_constant(const Field *field, const Item *value) {
+  if (value->result_type() != STRING_RESULT) return false;
+  /* Bytes are bytes, whatever the character set of the constant */
+  return field->charset() == &my_charset_bin ||
+         value->collation.collation == field->charset();
+}
+
+/** Histogram operator for a normalized predicate. */
+static histograms::Histogram::enum_operator histogram_operator(
+    const Keti_predicate &pred) {
+  typedef histograms::Histogram::enum_operator op_t;
+  switch (pred.op) {
+    case Item_func::EQ_FUNC:
+      return op_t::EQUALS_TO;
+    case Item_func::NE_FUNC:
+      return op_t::NOT_EQUALS_TO;
+    case Item_func::LT_FUNC:
+      return op_t::LESS_THAN;
+    case Item_func::LE_FUNC:
+      return op_t::LESS_THAN_OR_EQUAL;
+    case Item_func::GT_FUNC:
+      return op_t::GREATER_THAN;
+    case Item_func::GE_FUNC:
+      return op_t::GREATER_THAN_OR_EQUAL;
+    case Item_func::BETWEEN:
+      return pred.negated ? op_t::NOT_BETWEEN : op_t::BETWEEN;
+    case Item_func::IN_FUNC:
+      return pred.negated ? op_t::NOT_IN_LIST : op_t::IN_LIST;
+    case Item_func::ISNULL_FUNC:
+      return op_t::IS_NULL;
+    default:
+      return op_t::IS_NOT_NULL;
+  }
+}
+
+/** Fraction of the zone [min, max] that lies below value. */
+static double zone_fraction(const Keti_zone &zone, double value) {
+  if (value <= zone.min) return 0.0;
+  if (value >= zone.max) return 1.0;
+  return (value - zone.min) / (zone.max - zone.min);
+}
+
+static double equality_selectivity(const Keti_zone &zone, double value) {
+  if (value < zone.min || value > zone.max) return 0.0;
+  if (zone.min == zone.max) return 1.0;
+  return EQUALITY_SELECTIVITY;
+}
+
+/** Selectivity of a normalized predicate among non-NULL rows, from a zone. */
+static double zone_selectivity(const Keti_predicate &pred,
+                               const Keti_zone &zone) {
+  if (zone.empty) return 0.0;
+
+  double selectivity;
+  switch (pred.op) {
+    case Item_func::EQ_FUNC:
+      return equality_selectivity(zone, pred.args[1]->val_real());
+    case Item_func::NE_FUNC:
+      return 1.0 - equality_selectivity(zone, pred.args[1]->val_real());
+    case Item_func::LT_FUNC:
+    case Item_func::LE_FUNC:
+      return zone_fraction(zone, pred.args[1]->val_real());
+    case Item_func::GT_FUNC:
+    case Item_func::GE_FUNC:
+      return 1.0 - zone_fraction(zone, pred.args[1]->val_real());
+    case Item_func::BETWEEN:
+      selectivity = std::max(zone_fraction(zone, pred.args[2]->val_real()) -
+                                 zone_fraction(zone, pred.args[1]->val_real()),
+                             0.0);
+      /* A single point range still matches when it falls inside the zone. */
+      if (selectivity == 0.0)
+        selectivity = equality_selectivity(zone, pred.args[1]->val_real());
+      break;
+    default: /* IN_FUNC */
+      selectivity = 0.0;
+      for (uint i = 1; i < pred.arg_count; i++)
+        selectivity += equality_selectivity(zone, pred.args[i]->val_real());
+      selectivity = std::min(selectivity, 1.0);
+      break;
+  }
+  return pred.negated ? 1.0 - selectivity : selectivity;
+}
+
+/** Selectivity of a normalized predicate with no statistics at all. */
+static double default_selectivity(const Keti_predicate &pred) {
+  double selectivity;
+  switch (pred.op) {
+    case Item_func::EQ_FUNC:
+      return EQUALITY_SELECTIVITY;
+    case Item_func::NE_FUNC:
+      return 1.0 - EQUALITY_SELECTIVITY;
+    case Item_func::ISNULL_FUNC:
+      return NULL_SELECTIVITY;
+    case Item_func::ISNOTNULL_FUNC:
+      return 1.0 - NULL_SELECTIVITY;
+    case Item_func::BETWEEN:
+      selectivity = BETWEEN_SELECTIVITY;
+      break;
+    case Item_func::IN_FUNC:
+      selectivity =
+          std::min((pred.arg_count - 1) * EQUALITY_SELECTIVITY, 0.5);
+      break;
+    default:
+      return INEQUALITY_SELECTIVITY;
+  }
+  return pred.negated ? 1.0 - selectivity : selectivity;
+}
+
+static double predicate_selectivity(const Keti_predicate &pred, TABLE *table,
+                                    const Keti_table_stats &stats) {
+  const Field *field = pred.field->field;
+
+  const histograms::Histogram *histogram =
+      table->s->find_histogram(field->field_index);
+  double selectivity;
+  if (histogram != NULL &&
+      !histogram->get_selectivity(pred.args, pred.arg_count,
+                                  histogram_operator(pred), &selectivity))
+    return selectivity;
+
+  Keti_zone zone;
+  const ha_rows records = stats.records();
+  if (records == 0 || !stats.zone(field, &zone))
+    return default_selectivity(pred);
+
+  const double null_fraction = static_cast<double>(zone.nulls) / records;
+  switch (pred.op) {
+    case Item_func::ISNULL_FUNC:
+      return null_fraction;
+    case Item_func::ISNOTNULL_FUNC:
+      return 1.0 - null_fraction;
+    default:
+      /* Comparisons never match NULL, negated or not. */
+      return zone_selectivity(pred, zone) * (1.0 - null_fraction);
+  }
+}
+
+double keti_cond_selectivity(const Item *cond, TABLE *table,
+                             const Keti_table_stats &stats) {
+  if (!keti_cond_pushable(cond, table)) return 1.0;
+
+  if (cond->type() == Item::COND_ITEM) {
+    const Item_cond *item_cond = static_cast<const Item_cond *>(cond);
+    const bool is_and = item_cond->functype() == Item_func::COND_AND_FUNC;
+
+    /* Conjuncts are taken as independent; so are disjuncts. */
+    double selectivity = 1.0;
+    List_iterator<Item> li(*const_cast<Item_cond *>(item_cond)->argument_list());
+    Item *item;
+    while ((item = li++)) {
+      const double arg = keti_cond_selectivity(item, table, stats);
+      selectivity *= is_and ? arg : 1.0 - arg;
+    }
+    return is_and ? selectivity : 1.0 - selectivity;
+  }
+
+  const Item_func *func = static_cast<const Item_func *>(cond);
+  if (func->functype() == Item_func::NOT_FUNC)
+    return 1.0 - keti_cond_selectivity(func->arguments()[0], table, stats);
+
+  /* Not a comparison, so a tag containment */
+  Keti_predicate pred;
+  if (!keti_normalize_predicate(func, table, &pred))
+    return EQUALITY_SELECTIVITY;
+  return std::min(std::max(predicate_selectivity(pred, table, stats), 0.0),
+                  1.0);
+}
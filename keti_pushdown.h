@@ -0,0 +1,109 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_pushdown.h
+
+    @brief
+  Conditions that KETI can hand to the storage node, and how selective they
+  are.
+
+    @details
+  A condition is pushable if it is built from AND, OR and NOT over
+  comparisons of a column of the table with constants (=, <>, <, <=, >, >=,
+  BETWEEN, IN, IS [NOT] NULL). Columns must be numeric, or strings other
+  than BLOB and TEXT. The storage node knows no collations: the host hands
+  it strings as their weight strings in the column's collation (see
+  keti_key.h), which it compares as bytes. An AND is pushable if any of its
+  conjuncts is: the server evaluates the complete condition on the rows the
+  node returns, so the node may apply a weaker one. The argument of a NOT
+  must be pushable as a whole.
+
+  FIND_IN_SET() and JSON_CONTAINS() on a column with an inverted index are
+  pushable outside of a NOT; see keti_inverted.h.
+
+  Scans also check pushed conditions on the rows of their blocks as stored,
+  see keti_filter.h.
+*/
+
+#ifndef KETI_PUSHDOWN_H
+#define KETI_PUSHDOWN_H
+
+#include <vector>
+
+#include "my_inttypes.h"
+#include "sql/item_func.h"
+
+class Field;
+class Item;
+class Item_field;
+class Keti_table_stats;
+struct TABLE;
+
+/** @brief
+  A comparison in the normal form "column op constant [, constant ...]".
+*/
+struct Keti_predicate {
+  Item_func::Functype op;
+  const Item_field *field;
+  /** field followed by the constants, as the histogram interface wants. */
+  Item *items[2];
+  Item **args;
+  uint arg_count;
+  bool negated;
+};
+
+/** True if the storage node can evaluate comparisons on this column. */
+bool keti_field_pushable(const Field *field);
+
+/**
+  True if value is a string constant that the server compares with field
+  in the collation of field, so that their weight strings compare alike.
+*/
+bool keti_string_constant(const Field *field, const Item *value);
+
+/** True if at least part of cond can be evaluated by the storage node. */
+bool keti_cond_pushable(const Item *cond, const TABLE *table);
+
+/**
+  Bring a comparison of a pushable column of table with constants into
+  normal form; IS [NOT] NULL has no constant.
+
+  @return false if func is no such comparison
+*/
+bool keti_normalize_predicate(const Item_func *func, const TABLE *table,
+                              Keti_predicate *pred);
+
+/**
+  Recognize "column = constant" and "column IN (constant, ...)" on a
+  pushable column of table.
+
+  @param field   receives the column
+  @param values  receives the constants
+
+  @return false if cond is anything else
+*/
+bool keti_equality_predicate(const Item *cond, const TABLE *table,
+                             const Field **field, std::vector<Item *> *values);
+
+/**
+  Estimate the fraction of rows of table that satisfy the pushable part of
+  cond. Column histograms are used when present, zone maps otherwise.
+
+  @return selectivity in [0, 1]; 1 if cond is NULL or not pushable
+*/
+double keti_cond_selectivity(const Item *cond, TABLE *table,
+                             const Keti_table_stats &stats);
+
+#endif /* KETI_PUSHDOWN_H */
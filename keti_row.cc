@@ -0,0 +1,126 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_row.cc
+
+    @brief
+  Packing and unpacking of KETI rows.
+*/
+
+#include "storage/keti/keti_row.h"
+
+#include <string.h>
+
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "sql/field.h"
+#include "sql/table.h"
+#include "template_utils.h"
+
+void keti_store_pos(uchar *ref, const Keti_row_pos &pos) {
+  int4store(ref, pos.segment);
+  int4store(ref + 4, pos.block);
+  int4store(ref + 8, pos.offset);
+}
+
+Keti_row_pos keti_read_pos(const uchar *ref) {
+  Keti_row_pos pos;
+  pos.segment = uint4korr(ref);
+  pos.block = uint4korr(ref + 4);
+  pos.offset = uint4korr(ref + 8);
+  return pos;
+}
+
+ulonglong keti_row_lock_key(ulonglong table, const Keti_row_pos &pos) {
+  return table ^ ((ulonglong)pos.segment << 40) ^ ((ulonglong)pos.block << 20) ^
+         pos.offset;
+}
+
+size_t keti_packed_length(TABLE *table, const uchar *record) {
+  const ptrdiff_t offset = record - table->record[0];
+  size_t length = KETI_ROW_HEADER_SIZE + table->s->reclength;
+
+  for (Field **field = table->field; *field; field++) {
+    if (!((*field)->flags & BLOB_FLAG)) continue;
+    length += 4 + down_cast<Field_blob *>(*field)->get_length(offset);
+  }
+  return length;
+}
+
+void keti_pack_row(TABLE *table, const uchar *record,
+                   std::vector<uchar> *out) {
+  const ptrdiff_t offset = record - table->record[0];
+  const size_t start = out->size();
+  const size_t length = keti_packed_length(table, record);
+
+  out->resize(start + length);
+  uchar *pos = out->data() + start;
+  int4store(pos, static_cast<uint32>(length - KETI_ROW_HEADER_SIZE));
+  pos += KETI_ROW_HEADER_SIZE;
+  memcpy(pos, record, table->s->reclength);
+  pos += table->s->reclength;
+
+  for (Field **field = table->field; *field; field++) {
+    if (!((*field)->flags & BLOB_FLAG)) continue;
+    Field_blob *blob = down_cast<Field_blob *>(*field);
+    const uint32 blob_length = blob->get_length(offset);
+    int4store(pos, blob_length);
+    if (blob_length > 0)
+      memcpy(pos + 4, blob->get_blob_data(offset), blob_length);
+    pos += 4 + blob_length;
+  }
+}
+
+int keti_unpack_row(TABLE *table, const uchar *row, const uchar *end,
+                    uchar *record, std::vector<uchar> *blob_buffer) {
+  const ptrdiff_t offset = record - table->record[0];
+  const size_t reclength = table->s->reclength;
+
+  if (end - row < static_cast<ptrdiff_t>(KETI_ROW_HEADER_SIZE))
+    return HA_ERR_CRASHED;
+  const uint32 length = uint4korr(row);
+  row += KETI_ROW_HEADER_SIZE;
+  if (length < reclength || end - row < static_cast<ptrdiff_t>(length))
+    return HA_ERR_CRASHED;
+  end = row + length;
+
+  memcpy(record, row, reclength);
+  row += reclength;
+  if (table->s->blob_fields == 0) return 0;
+
+  /*
+    The blob data is copied out of the block, which may be evicted from the
+    buffer pool while the server still looks at the row.
+  */
+  blob_buffer->assign(row, end);
+  const uchar *data = blob_buffer->data();
+  const uchar *data_end = data + blob_buffer->size();
+  for (Field **field = table->field; *field; field++) {
+    if (!((*field)->flags & BLOB_FLAG)) continue;
+    if (data_end - data < 4) return HA_ERR_CRASHED;
+    const uint32 blob_length = uint4korr(data);
+    data += 4;
+    if (data_end - data < static_cast<ptrdiff_t>(blob_length))
+      return HA_ERR_CRASHED;
+    down_cast<Field_blob *>(*field)->set_ptr_offset(offset, blob_length, data);
+    data += blob_length;
+  }
+  return 0;
+}
+
+uint32 keti_block_rows(const std::vector<uchar> &block) {
+  if (block.size() < KETI_BLOCK_HEADER_SIZE) return 0;
+  return uint4korr(block.data());
+}
@@ -0,0 +1,93 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_row.h
+
+    @brief
+  On-CSD layout of KETI rows and blocks.
+
+    @details
+  A table is a list of segments, and a segment a sequence of blocks of at
+  most KETI_BLOCK_SIZE bytes:
+
+  @verbatim
+    block   := row_count(4) row*
+    row     := length(4) record blob*
+    blob    := length(4) data
+  @endverbatim
+
+  record is the table->s->reclength bytes of the server's record format;
+  each BLOB column is appended in field order since the record only holds a
+  pointer to its data. Integers are little endian. A row longer than a block
+  gets a block of its own. A row is addressed by its segment, block and byte
+  offset inside the block.
+
+  The node may hold a block with some of its columns encoded, see
+  keti_encode.h; it is decoded into this layout as it is read.
+*/
+
+#ifndef KETI_ROW_H
+#define KETI_ROW_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "my_inttypes.h"
+
+struct TABLE;
+
+static const size_t KETI_BLOCK_HEADER_SIZE = 4;
+static const size_t KETI_ROW_HEADER_SIZE = 4;
+
+/** Length of handler::ref: segment id, block number and offset. */
+static const uint KETI_REF_LENGTH = 12;
+
+/** @brief
+  Address of a row on the storage node.
+*/
+struct Keti_row_pos {
+  uint32 segment;
+  uint32 block;
+  uint32 offset;
+};
+
+void keti_store_pos(uchar *ref, const Keti_row_pos &pos);
+Keti_row_pos keti_read_pos(const uchar *ref);
+
+/** Key of the row lock on the row at pos of the table with lock id table. */
+ulonglong keti_row_lock_key(ulonglong table, const Keti_row_pos &pos);
+
+/** Bytes the row in record takes in a block, row header included. */
+size_t keti_packed_length(TABLE *table, const uchar *record);
+
+/** Append the row in record, row header included, to out. */
+void keti_pack_row(TABLE *table, const uchar *record, std::vector<uchar> *out);
+
+/**
+  Copy a packed row into record.
+
+  @param row          start of the row header
+  @param end          end of the block the row lives in
+  @param blob_buffer  receives the BLOB data record will point to
+
+  @return 0 or HA_ERR_CRASHED if the row does not fit in the block
+*/
+int keti_unpack_row(TABLE *table, const uchar *row, const uchar *end,
+                    uchar *record, std::vector<uchar> *blob_buffer);
+
+/** Number of rows stored in a block. */
+uint32 keti_block_rows(const std::vector<uchar> &block);
+
+#endif /* KETI_ROW_H */
@@ -0,0 +1,188 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_stats.cc
+
+    @brief
+  Row count and zone map maintenance.
+*/
+
+#include "storage/keti/keti_stats.h"
+
+#include <algorithm>
+
+#include "my_byteorder.h"
+
+#include "sql/field.h"
+#include "sql/table.h"
+#include "storage/keti/keti_csd.h"
+
+bool keti_zone_tracked(const Field *field) {
+  switch (field->result_type()) {
+    case INT_RESULT:
+    case REAL_RESULT:
+    case DECIMAL_RESULT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void Keti_row_stats::add_row(TABLE *table) {
+  if (m_zones.size() != table->s->fields) {
+    Keti_zone empty = {0.0, 0.0, 0, true};
+    m_zones.assign(table->s->fields, empty);
+  }
+
+  m_records++;
+  for (Field **field = table->field; *field; field++) {
+    if (!keti_zone_tracked(*field)) continue;
+
+    Keti_zone &zone = m_zones[(*field)->field_index];
+    if ((*field)->is_null()) {
+      zone.nulls++;
+      continue;
+    }
+
+    const double value = (*field)->val_real();
+    if (zone.empty) {
+      zone.min = zone.max = value;
+      zone.empty = false;
+    } else {
+      zone.min = std::min(zone.min, value);
+      zone.max = std::max(zone.max, value);
+    }
+  }
+}
+
+void Keti_row_stats::merge(const Keti_row_stats &other) {
+  if (m_zones.size() != other.m_zones.size()) {
+    Keti_zone empty = {0.0, 0.0, 0, true};
+    m_zones.resize(std::max(m_zones.size(), other.m_zones.size()), empty);
+  }
+
+  m_records += other.m_records;
+  for (size_t i = 0; i < other.m_zones.size(); i++) {
+    const Keti_zone &from = other.m_zones[i];
+    Keti_zone &zone = m_zones[i];
+    zone.nulls += from.nulls;
+    if (from.empty) continue;
+    if (zone.empty) {
+      zone.min = from.min;
+      zone.max = from.max;
+      zone.empty = false;
+    } else {
+      zone.min = std::min(zone.min, from.min);
+      zone.max = std::max(zone.max, from.max);
+    }
+  }
+}
+
+void Keti_row_stats::clear() {
+  m_records = 0;
+  m_zones.clear();
+}
+
+/* records(8) zone_count(4) (min(8) max(8) nulls(8) empty(1))* */
+static const size_t ZONE_SIZE = 8 + 8 + 8 + 1;
+
+void Keti_row_stats::pack(std::vector<uchar> *out) const {
+  size_t pos = out->size();
+  out->resize(pos + 8 + 4 + ZONE_SIZE * m_zones.size());
+  uchar *ptr = out->data() + pos;
+  int8store(ptr, m_records);
+  int4store(ptr + 8, static_cast<uint32>(m_zones.size()));
+  ptr += 12;
+  for (const Keti_zone &zone : m_zones) {
+    float8store(ptr, zone.min);
+    float8store(ptr + 8, zone.max);
+    int8store(ptr + 16, zone.nulls);
+    ptr[24] = zone.empty;
+    ptr += ZONE_SIZE;
+  }
+}
+
+bool Keti_row_stats::unpack(const uchar *data, size_t length) {
+  if (length < 12) return false;
+  const uint32 zones = uint4korr(data + 8);
+  if (length != 12 + ZONE_SIZE * zones) return false;
+
+  m_records = uint8korr(data);
+  m_zones.resize(zones);
+  const uchar *ptr = data + 12;
+  for (Keti_zone &zone : m_zones) {
+    zone.min = float8get(ptr);
+    zone.max = float8get(ptr + 8);
+    zone.nulls = uint8korr(ptr + 16);
+    zone.empty = ptr[24] != 0;
+    ptr += ZONE_SIZE;
+  }
+  return true;
+}
+
+bool Keti_row_stats::zone(const Field *field, Keti_zone *zone) const {
+  if (!keti_zone_tracked(field)) return false;
+  if (field->field_index >= m_zones.size()) return false;
+  *zone = m_zones[field->field_index];
+  return true;
+}
+
+void Keti_table_stats::merge(const Keti_row_stats &delta) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_stats.merge(delta);
+}
+
+void Keti_table_stats::remove_rows(ha_rows rows) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_stats.remove_rows(rows);
+}
+
+int Keti_table_stats::load(const std::string &table, ha_rows deleted) {
+  std::vector<uchar> reply;
+  int rc = csd_read_stats(table, &reply);
+  if (rc == HA_ERR_NO_SUCH_TABLE) return 0;
+  if (rc) return rc;
+  if (reply.size() < 4) return HA_ERR_CRASHED;
+
+  Keti_row_stats stats;
+  Keti_row_stats segment;
+  const uchar *ptr = reply.data() + 4;
+  const uchar *end = reply.data() + reply.size();
+  for (uint32 count = uint4korr(reply.data()); count > 0; count--) {
+    if (end - ptr < 8) return HA_ERR_CRASHED;
+    const uint32 length = uint4korr(ptr + 4);
+    ptr += 8;
+    if (static_cast<size_t>(end - ptr) < length ||
+        !segment.unpack(ptr, length))
+      return HA_ERR_CRASHED;
+    stats.merge(segment);
+    ptr += length;
+  }
+  stats.remove_rows(deleted);
+
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_stats.merge(stats);
+  return 0;
+}
+
+ha_rows Keti_table_stats::records() const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_stats.records();
+}
+
+bool Keti_table_stats::zone(const Field *field, Keti_zone *zone) const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_stats.zone(field, zone);
+}
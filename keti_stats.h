@@ -0,0 +1,136 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_stats.h
+
+    @brief
+  Table statistics kept by the KETI engine for the optimizer.
+
+    @details
+  Besides the row count, a zone map (minimum, maximum and NULL count) is
+  maintained for every numeric column. The optimizer uses it to estimate how
+  many rows survive a condition pushed to the storage node when no histogram
+  is available for the column. The statistics of the rows of a segment are
+  stored with it on the storage node and summed up when a table is opened.
+*/
+
+#ifndef KETI_STATS_H
+#define KETI_STATS_H
+
+#include <stddef.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "my_base.h" /* ha_rows */
+#include "my_inttypes.h"
+
+class Field;
+struct TABLE;
+
+/** @brief
+  Zone map of one column.
+*/
+struct Keti_zone {
+  double min;
+  double max;
+  ha_rows nulls;
+  /** True until a non-NULL value has been seen. */
+  bool empty;
+};
+
+/** True if a zone map is maintained for this column. */
+bool keti_zone_tracked(const Field *field);
+
+/** @brief
+  Row count and zone maps of a set of rows. Not synchronized; a handler
+  collects the statistics of the rows it inserts in one of these.
+*/
+class Keti_row_stats {
+ public:
+  Keti_row_stats() : m_records(0) {}
+
+  /** Account for the row in table->record[0]. */
+  void add_row(TABLE *table);
+
+  /** Account for deleted rows. Zone maps stay as wide as they were. */
+  void remove_rows(ha_rows rows) { m_records -= std::min(rows, m_records); }
+
+  /** Account for all rows of other. */
+  void merge(const Keti_row_stats &other);
+
+  void clear();
+
+  /** Append the statistics to out, for unpack(). */
+  void pack(std::vector<uchar> *out) const;
+
+  /**
+    Replace the statistics by those pack() stored in the length bytes at
+    data.
+
+    @return false if they are not well formed
+  */
+  bool unpack(const uchar *data, size_t length);
+
+  ha_rows records() const { return m_records; }
+
+  /** As Keti_table_stats::zone(). */
+  bool zone(const Field *field, Keti_zone *zone) const;
+
+ private:
+  ha_rows m_records;
+  std::vector<Keti_zone> m_zones;
+};
+
+/** @brief
+  Row count and zone maps of one table, shared by all its handlers.
+
+    @details
+  Transactions merge the statistics of their inserts and deletes in when
+  they commit, see keti_trx.h, so that rollbacks have nothing to take
+  back and concurrent inserters do not take turns on m_mutex per row.
+*/
+class Keti_table_stats {
+ public:
+  /** Account for the rows in delta. */
+  void merge(const Keti_row_stats &delta);
+
+  /** Account for deleted rows. */
+  void remove_rows(ha_rows rows);
+
+  /**
+    Read the statistics the node keeps with the segments of a table.
+
+    @param deleted  rows deleted but not yet purged, which the node still
+                    counts
+  */
+  int load(const std::string &table, ha_rows deleted);
+
+  ha_rows records() const;
+
+  /**
+    Copy the zone map of a column.
+
+    @return false if the column has no zone map
+  */
+  bool zone(const Field *field, Keti_zone *zone) const;
+
+ private:
+  mutable std::mutex m_mutex;
+  Keti_row_stats m_stats;
+};
+
+#endif /* KETI_STATS_H */
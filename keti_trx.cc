@@ -0,0 +1,292 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_trx.cc
+
+    @brief
+  Uncommitted changes of transactions and their commit, see keti_trx.h.
+*/
+
+#include "storage/keti/keti_trx.h"
+
+#include <string.h>
+
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "storage/keti/keti_lock.h"
+#include "storage/keti/keti_mvcc.h"
+
+keti_trx_stats_t keti_trx_stats = {0};
+
+static std::mutex stats_mutex;
+
+Keti_table_changes *Keti_trx_changes::of(const std::string &table) {
+  for (const std::unique_ptr<Keti_table_changes> &changes : m_tables)
+    if (changes->table == table) return changes.get();
+
+  /* Views opened from now on leave the transaction out */
+  if (m_tables.empty()) keti_trx_started(m_trx->id);
+  m_tables.emplace_back(new Keti_table_changes);
+  m_tables.back()->table = table;
+  return m_tables.back().get();
+}
+
+void Keti_trx_changes::add_segment(const std::string &table,
+                                   const Keti_segment &segment) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  of(table)->segments.push_back(segment);
+}
+
+void Keti_trx_changes::add_tombstone(const std::string &table,
+                                     const Keti_row_pos &pos,
+                                     std::vector<Keti_ibuf_entry> *entries) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  Keti_table_changes *changes = of(table);
+  changes->tombstones.push_back(pos);
+  for (Keti_ibuf_entry &entry : *entries)
+    changes->index.push_back(std::move(entry));
+  entries->clear();
+}
+
+void Keti_trx_changes::add_stats(const std::string &table,
+                                 const Keti_row_stats &stats) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  of(table)->statement_stats.merge(stats);
+}
+
+void Keti_trx_changes::add_deltas(const std::string &table,
+                                  const Keti_row_pos &pos,
+                                  const std::vector<Keti_delta> &deltas) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  Keti_table_changes *changes = of(table);
+  if (!changes->delta_store) changes->delta_store.reset(new Keti_delta_store);
+  for (const Keti_delta &delta : deltas) {
+    changes->delta_store->add(pos, delta);
+    keti_delta_pack(pos, delta, &changes->deltas);
+  }
+  m_deltas += deltas.size();
+}
+
+void Keti_trx_changes::apply_deltas(const std::string &table, TABLE *form,
+                                    const Keti_row_pos &pos,
+                                    uchar *record) const {
+  if (m_deltas.load() == 0) return;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (const std::unique_ptr<Keti_table_changes> &changes : m_tables)
+    if (changes->table == table && changes->delta_store)
+      changes->delta_store->apply(form, pos, m_trx, record);
+}
+
+void Keti_trx_changes::table_deltas(const std::string &table,
+                                    std::vector<uchar> *deltas) const {
+  if (m_deltas.load() == 0) return;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (const std::unique_ptr<Keti_table_changes> &changes : m_tables)
+    if (changes->table == table)
+      deltas->insert(deltas->end(), changes->deltas.begin(),
+                     changes->deltas.end());
+}
+
+void Keti_trx_changes::staged_segments(
+    const std::string &table, std::vector<Keti_segment> *segments) const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (const std::unique_ptr<Keti_table_changes> &changes : m_tables)
+    if (changes->table == table)
+      segments->insert(segments->end(), changes->segments.begin(),
+                       changes->segments.end());
+}
+
+bool Keti_trx_changes::empty() const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_tables.empty();
+}
+
+void Keti_trx_changes::statement_done() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (const std::unique_ptr<Keti_table_changes> &changes : m_tables) {
+    changes->statement_segments = changes->segments.size();
+    changes->statement_tombstones = changes->tombstones.size();
+    changes->statement_index = changes->index.size();
+    changes->statement_deltas = changes->deltas.size();
+    changes->stats.merge(changes->statement_stats);
+    changes->statement_stats.clear();
+  }
+}
+
+/** Ids of the segments of changes. */
+static std::vector<uint32> segment_ids(const Keti_table_changes &changes) {
+  std::vector<uint32> ids;
+  for (const Keti_segment &segment : changes.segments)
+    ids.push_back(segment.id);
+  return ids;
+}
+
+/** Append the changes to one table to a commit request. */
+static void pack_table(const Keti_table_changes &changes,
+                       std::vector<uchar> *request) {
+  const std::vector<uint32> ids = segment_ids(changes);
+  size_t pos = request->size();
+  request->resize(pos + 2 + changes.table.size() + 4 + 4 * ids.size() + 4 +
+                  KETI_REF_LENGTH * changes.tombstones.size() + 4 +
+                  changes.deltas.size());
+  uchar *ptr = request->data() + pos;
+  int2store(ptr, static_cast<uint16>(changes.table.size()));
+  memcpy(ptr + 2, changes.table.data(), changes.table.size());
+  ptr += 2 + changes.table.size();
+  int4store(ptr, static_cast<uint32>(ids.size()));
+  ptr += 4;
+  for (uint32 id : ids) {
+    int4store(ptr, id);
+    ptr += 4;
+  }
+  int4store(ptr, static_cast<uint32>(changes.tombstones.size()));
+  ptr += 4;
+  for (const Keti_row_pos &row : changes.tombstones) {
+    keti_store_pos(ptr, row);
+    ptr += KETI_REF_LENGTH;
+  }
+  int4store(ptr, static_cast<uint32>(changes.deltas.size() / KETI_DELTA_SIZE));
+  ptr += 4;
+  if (!changes.deltas.empty())
+    memcpy(ptr, changes.deltas.data(), changes.deltas.size());
+}
+
+int Keti_trx_changes::commit() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_tables.empty()) return 0;
+  const ulonglong trx = m_trx->id;
+
+  int rc = 0;
+  std::vector<uchar> request(4);
+  int4store(request.data(), static_cast<uint32>(m_tables.size()));
+  for (const std::unique_ptr<Keti_table_changes> &changes : m_tables) {
+    /* Readers must not take what the node publishes for committed yet */
+    keti_with_table(changes->table, [&](Keti_table_versions *versions) {
+      for (const Keti_segment &segment : changes->segments)
+        versions->add_segment(segment.id, KETI_UNCOMMITTED, trx);
+      /* A table reopened since may know of another deletion of a row */
+      for (Keti_row_pos &pos : changes->tombstones) {
+        pos = versions->forward(pos);
+        if (!versions->add_tombstone(pos, KETI_UNCOMMITTED, trx))
+          rc = HA_ERR_RECORD_CHANGED;
+      }
+      /* Compaction may have moved the rows the deltas apply to */
+      for (size_t i = 0; i < changes->deltas.size(); i += KETI_DELTA_SIZE) {
+        uchar *ptr = changes->deltas.data() + i;
+        keti_store_pos(ptr, versions->forward(keti_read_pos(ptr)));
+      }
+      versions->add_deltas(trx, changes->deltas);
+    });
+    pack_table(*changes, &request);
+  }
+
+  /* Logged first, so that a crash once the node took the commit keeps them */
+  std::vector<ulonglong> tickets;
+  for (const std::unique_ptr<Keti_table_changes> &changes : m_tables) {
+    ulonglong ticket;
+    if (rc == 0 && (rc = keti_ibuf_log(changes->table, &changes->index,
+                                       &ticket)) == 0)
+      tickets.push_back(ticket);
+  }
+
+  if (rc == 0) rc = csd_commit(&request);
+  if (rc) {
+    keti_log(ERROR_LEVEL, "commit of transaction %llu failed, rolling back",
+             trx);
+    for (ulonglong ticket : tickets) keti_ibuf_discard(ticket);
+    rollback_locked(false);
+    return rc;
+  }
+
+  const ulonglong version = keti_trx_committing(trx);
+  for (const std::unique_ptr<Keti_table_changes> &changes : m_tables) {
+    const std::vector<uint32> ids = segment_ids(*changes);
+    keti_with_table(changes->table, [&](Keti_table_versions *versions) {
+      versions->commit(trx, version, ids, changes->tombstones,
+                       changes->deltas);
+      /* A table not open reads its statistics from the node when it is */
+      Keti_table_stats *stats = versions->stats();
+      if (stats == NULL) return;
+      stats->merge(changes->stats);
+      stats->merge(changes->statement_stats);
+      stats->remove_rows(changes->tombstones.size());
+    });
+  }
+  keti_trx_finished(trx);
+  {
+    std::lock_guard<std::mutex> stats_guard(stats_mutex);
+    keti_trx_stats.deltas_written += m_deltas.load();
+  }
+
+  for (ulonglong ticket : tickets) keti_ibuf_publish(ticket);
+  m_tables.clear();
+  m_deltas = 0;
+  return 0;
+}
+
+void Keti_trx_changes::rollback(bool statement) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  rollback_locked(statement);
+}
+
+void Keti_trx_changes::rollback_locked(bool statement) {
+  const ulonglong trx = m_trx->id;
+  for (const std::unique_ptr<Keti_table_changes> &changes : m_tables) {
+    const size_t first_segment = statement ? changes->statement_segments : 0;
+    const size_t first_tombstone =
+        statement ? changes->statement_tombstones : 0;
+    std::vector<uint32> ids;
+    for (size_t i = first_segment; i < changes->segments.size(); i++)
+      ids.push_back(changes->segments[i].id);
+    const std::vector<Keti_row_pos> tombstones(
+        changes->tombstones.begin() + first_tombstone,
+        changes->tombstones.end());
+    /* The deltas the transaction keeps are those of earlier statements */
+    const size_t deltas = statement ? changes->statement_deltas : 0;
+    const std::vector<uchar> undone(changes->deltas.begin() + deltas,
+                                    changes->deltas.end());
+
+    /* Index changes sent for the segments are ignored from now on */
+    if (!ids.empty() && csd_discard_segments(changes->table, ids))
+      keti_log(WARNING_LEVEL,
+               "cannot discard %zu staged segments of %s; the node drops "
+               "them when it restarts",
+               ids.size(), changes->table.c_str());
+    keti_with_table(changes->table, [&](Keti_table_versions *versions) {
+      versions->rollback(trx, ids, tombstones, undone);
+    });
+
+    changes->segments.resize(first_segment);
+    changes->tombstones.resize(first_tombstone);
+    changes->index.resize(statement ? changes->statement_index : 0);
+    changes->statement_stats.clear();
+
+    if (deltas == changes->deltas.size()) continue;
+    m_deltas -= (changes->deltas.size() - deltas) / KETI_DELTA_SIZE;
+    changes->deltas.resize(deltas);
+    changes->delta_store.reset(deltas > 0 ? new Keti_delta_store : NULL);
+    for (size_t i = 0; i < deltas; i += KETI_DELTA_SIZE) {
+      Keti_row_pos pos;
+      Keti_delta delta;
+      keti_delta_unpack(changes->deltas.data() + i, &pos, &delta);
+      changes->delta_store->add(pos, delta);
+    }
+  }
+  if (statement || m_tables.empty()) return;
+
+  m_tables.clear();
+  m_deltas = 0;
+  keti_trx_finished(trx);
+}
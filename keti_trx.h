@@ -0,0 +1,180 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_trx.h
+
+    @brief
+  Changes of a transaction that are part of no table before it commits.
+
+    @details
+  The segments of the rows a transaction inserts are staged on the storage
+  node, see keti_write.h, and the positions of the rows it deletes and the
+  deltas of the rows it updates, see keti_delta.h, are kept in memory. Its
+  own scans read the segments it staged besides those of the manifest and
+  add its deltas to the rows; its tombstones hide rows from it alone, as
+  they are stamped KETI_UNCOMMITTED until it commits, see keti_mvcc.h.
+
+  A commit registers the segments, tombstones and deltas with the versions
+  of their tables, in case a table was reopened meanwhile, so that readers
+  do not see them before they are stamped. Then it sends them to the node
+  in one request, which the node applies to all tables or to none:
+
+  @verbatim
+    request  := table_count(4) table*
+    table    := name_length(2) name segment_count(4) segment(4)*
+                tombstone_count(4) row(12)* delta_count(4) delta(22)*
+  @endverbatim
+
+  each row as keti_store_pos() writes it and each delta as keti_delta_pack()
+  does. The node attaches the segments and appends the rows to the
+  tombstone log and the deltas to the delta log. Only then are the changes
+  stamped with the commit version, and the rows inserted and deleted
+  counted in the statistics of their tables, see keti_stats.h. The index
+  changes of the deleted rows are written to the change buffer log before
+  the request is sent, and buffered for merging once the node took it, see
+  keti_ibuf.h.
+
+  A rollback, or a commit the node refused, discards the staged segments on
+  the node and takes the changes out of the versions of their tables. A
+  statement that fails inside a transaction takes back only what it did:
+  each statement the transaction completes marks how far its changes went.
+*/
+
+#ifndef KETI_TRX_H
+#define KETI_TRX_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "my_inttypes.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_delta.h"
+#include "storage/keti/keti_ibuf.h"
+#include "storage/keti/keti_row.h"
+#include "storage/keti/keti_stats.h"
+
+class Keti_trx;
+struct TABLE;
+
+struct keti_trx_stats_t {
+  ulonglong deltas_written;  ///< Deltas committed since startup
+};
+
+extern keti_trx_stats_t keti_trx_stats;
+
+/** @brief
+  Changes of one transaction to one table.
+*/
+struct Keti_table_changes {
+  Keti_table_changes()
+      : statement_segments(0),
+        statement_tombstones(0),
+        statement_index(0),
+        statement_deltas(0) {}
+
+  std::string table;                     ///< Name on the storage node
+  std::vector<Keti_segment> segments;    ///< Staged, attached on commit
+  std::vector<Keti_row_pos> tombstones;  ///< Rows deleted
+  std::vector<Keti_ibuf_entry> index;    ///< Index changes of those rows
+  std::vector<uchar> deltas;             ///< Deltas, in the log format
+  Keti_row_stats stats;                  ///< Rows earlier statements inserted
+  Keti_row_stats statement_stats;        ///< Rows the current one inserted
+  /** The deltas, for the reads of the transaction; NULL if none */
+  std::unique_ptr<Keti_delta_store> delta_store;
+  /** Sizes of the above when the current statement started */
+  size_t statement_segments;
+  size_t statement_tombstones;
+  size_t statement_index;
+  size_t statement_deltas;
+};
+
+/** @brief
+  Changes of the transaction trx runs that are not committed yet.
+*/
+class Keti_trx_changes {
+ public:
+  explicit Keti_trx_changes(Keti_trx *trx) : m_trx(trx), m_deltas(0) {}
+
+  /** A segment of table was staged. Called by the I/O threads. */
+  void add_segment(const std::string &table, const Keti_segment &segment);
+
+  /**
+    The row at pos of table was deleted.
+
+    @param entries  index changes of the row; consumed
+  */
+  void add_tombstone(const std::string &table, const Keti_row_pos &pos,
+                     std::vector<Keti_ibuf_entry> *entries);
+
+  /** Rows of table with statistics stats were inserted. */
+  void add_stats(const std::string &table, const Keti_row_stats &stats);
+
+  /** The row at pos of table was updated by adding deltas to it. */
+  void add_deltas(const std::string &table, const Keti_row_pos &pos,
+                  const std::vector<Keti_delta> &deltas);
+
+  /** Add the deltas of the transaction to the row at pos of table. */
+  void apply_deltas(const std::string &table, TABLE *form,
+                    const Keti_row_pos &pos, uchar *record) const;
+
+  /** Append the deltas of the transaction to table, in the log format. */
+  void table_deltas(const std::string &table, std::vector<uchar> *deltas) const;
+
+  /** Append the segments staged for table to segments. */
+  void staged_segments(const std::string &table,
+                       std::vector<Keti_segment> *segments) const;
+
+  bool empty() const;
+
+  /** True if the transaction updated rows by deltas. */
+  bool has_deltas() const { return m_deltas.load() > 0; }
+
+  /** A statement completed; a later rollback of a statement keeps it. */
+  void statement_done();
+
+  /**
+    Publish the changes on the node and stamp them with a commit version.
+    Segments still being staged must have been waited for.
+
+    @return 0, HA_ERR_RECORD_CHANGED if another transaction deleted a row
+            this one deleted, or the error of the node or of the change
+            buffer log; in all cases the changes are rolled back
+  */
+  int commit();
+
+  /**
+    Take back the changes of the transaction, or those of its current
+    statement only. Segments still being staged must have been waited for.
+  */
+  void rollback(bool statement);
+
+ private:
+  /** The changes to table, created on first use; caller holds m_mutex. */
+  Keti_table_changes *of(const std::string &table);
+
+  /** rollback() for a caller holding m_mutex. */
+  void rollback_locked(bool statement);
+
+  Keti_trx *m_trx;
+  mutable std::mutex m_mutex;
+  std::vector<std::unique_ptr<Keti_table_changes>> m_tables;
+  /** Deltas in m_tables, so that reads skip m_mutex while there are none */
+  std::atomic<size_t> m_deltas;
+};
+
+#endif /* KETI_TRX_H */
@@ -0,0 +1,385 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_vector.cc
+
+    @brief
+  Vector columns, keti_vector_distance() and nearest neighbour search.
+*/
+
+#include "storage/keti/keti_vector.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <tuple>
+
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "mysql/components/services/udf_registration.h"
+#include "mysql/service_plugin_registry.h"
+#include "sql/field.h"
+#include "sql/handler.h"
+#include "sql/item.h"
+#include "sql/item_func.h"
+#include "sql/sql_lex.h"
+#include "sql/table.h"
+#include "sql_string.h"
+#include "storage/keti/keti_bitmap.h"
+#include "storage/keti/keti_mvcc.h"
+#include "template_utils.h"
+
+keti_vector_stats_t keti_vector_stats = {0};
+
+ulong srv_vector_nprobe = 8;
+
+static std::mutex stats_mutex;
+
+static const char *VECTOR_COMMENT = "keti_vector";
+static const char *DISTANCE_FUNCTION = "keti_vector_distance";
+
+/** Row count the node replies with for a segment without the index. */
+static const uint32 NO_INDEX = 0xFFFFFFFF;
+/** Bytes per row in a search reply: row number and distance. */
+static const size_t RESULT_SIZE = 4 + 8;
+
+bool keti_parse_vector(const char *str, size_t length,
+                       std::vector<float> *vector) {
+  vector->clear();
+
+  /* Text: a bracketed list of numbers */
+  const char *begin = str;
+  const char *end = str + length;
+  while (begin < end && isspace(static_cast<uchar>(*begin))) begin++;
+  while (end > begin && isspace(static_cast<uchar>(end[-1]))) end--;
+  if (end - begin >= 2 && *begin == '[' && end[-1] == ']') {
+    const std::string text(begin + 1, end - 1);
+    const char *ptr = text.c_str();
+    for (;;) {
+      char *next;
+      const float value = strtof(ptr, &next);
+      if (next == ptr) break;
+      vector->push_back(value);
+      for (ptr = next; isspace(static_cast<uchar>(*ptr)); ptr++) {
+      }
+      if (*ptr != ',') break;
+      ptr++;
+    }
+    for (; isspace(static_cast<uchar>(*ptr)); ptr++) {
+    }
+    if (*ptr == '\0' && !vector->empty()) return true;
+    vector->clear();
+  }
+
+  /* Binary: little endian floats */
+  if (length == 0 || length % 4 != 0) return false;
+  vector->resize(length / 4);
+  for (size_t i = 0; i < vector->size(); i++)
+    (*vector)[i] = float4get(pointer_cast<const uchar *>(str) + 4 * i);
+  return true;
+}
+
+bool keti_vector(Field *field, const uchar *record,
+                 std::vector<float> *vector) {
+  const ptrdiff_t offset = record - field->table->record[0];
+  if (field->is_null(offset)) return false;
+
+  String value;
+  field->move_field_offset(offset);
+  field->val_str(&value);
+  field->move_field_offset(-offset);
+  return keti_parse_vector(value.ptr(), value.length(), vector);
+}
+
+void keti_vector_fields(const TABLE_SHARE *share,
+                        std::vector<uint16> *fields) {
+  fields->clear();
+  for (uint i = 0; i < share->fields; i++) {
+    const Field *field = share->field[i];
+    const LEX_CSTRING &comment = field->comment;
+    if (comment.length == 0 ||
+        std::search(comment.str, comment.str + comment.length, VECTOR_COMMENT,
+                    VECTOR_COMMENT + strlen(VECTOR_COMMENT)) ==
+            comment.str + comment.length)
+      continue;
+    if (field->result_type() == STRING_RESULT && field->binary())
+      fields->push_back(static_cast<uint16>(i));
+  }
+}
+
+void Keti_vector_index::add(uint16 field, const std::vector<float> &vector,
+                            uint32 block, uint32 index) {
+  if (block > KETI_BITMAP_MAX_BLOCK) {
+    m_overflow = true;
+    return;
+  }
+  Field_vectors &vectors = m_fields[field];
+  if (vectors.dimension == 0)
+    vectors.dimension = static_cast<uint32>(vector.size());
+  if (vector.size() != vectors.dimension) {
+    vectors.unindexed.push_back(block << 16 | index);
+    return;
+  }
+  vectors.rows.push_back(block << 16 | index);
+  vectors.values.insert(vectors.values.end(), vector.begin(), vector.end());
+}
+
+void Keti_vector_index::add_unindexed(uint16 field, uint32 block,
+                                      uint32 index) {
+  if (block > KETI_BITMAP_MAX_BLOCK) {
+    m_overflow = true;
+    return;
+  }
+  m_fields[field].unindexed.push_back(block << 16 | index);
+}
+
+void Keti_vector_index::take(std::vector<uchar> *out) {
+  out->clear();
+  for (const auto &field : m_fields) {
+    if (m_overflow) break;
+    const Field_vectors &vectors = field.second;
+    size_t offset = out->size();
+    out->resize(offset + 2 + 4 + 4 +
+                vectors.rows.size() * (4 + 4 * vectors.dimension) + 4 +
+                4 * vectors.unindexed.size());
+    uchar *ptr = &(*out)[offset];
+    int2store(ptr, field.first);
+    int4store(ptr + 2, vectors.dimension);
+    int4store(ptr + 6, static_cast<uint32>(vectors.rows.size()));
+    ptr += 10;
+    const float *value = vectors.values.data();
+    for (uint32 row : vectors.rows) {
+      int4store(ptr, row);
+      ptr += 4;
+      for (uint32 i = 0; i < vectors.dimension; i++, ptr += 4)
+        float4store(ptr, *value++);
+    }
+    int4store(ptr, static_cast<uint32>(vectors.unindexed.size()));
+    ptr += 4;
+    for (uint32 row : vectors.unindexed) {
+      int4store(ptr, row);
+      ptr += 4;
+    }
+  }
+  m_fields.clear();
+  m_overflow = false;
+}
+
+bool Keti_vector_search::build(const TABLE *table,
+                               const std::vector<uint16> &fields) {
+  if (fields.empty() || table->pos_in_table_list == NULL ||
+      thd_sql_command(table->in_use) != SQLCOM_SELECT)
+    return false;
+  const SELECT_LEX *select = table->pos_in_table_list->select_lex;
+  if (select == NULL || select->leaf_table_count != 1 ||
+      select->where_cond() != NULL || select->having_cond() != NULL ||
+      select->is_grouped() || select->is_distinct() ||
+      select->select_limit == NULL || select->order_list.elements == 0)
+    return false;
+
+  /* The first ORDER BY expression is the distance to a constant */
+  const ORDER *order = select->order_list.first;
+  const Item *item = *order->item;
+  if (order->direction == ORDER_DESC || item->type() != Item::FUNC_ITEM)
+    return false;
+  const Item_func *func = static_cast<const Item_func *>(item);
+  if (func->functype() != Item_func::UDF_FUNC ||
+      strcmp(func->func_name(), DISTANCE_FUNCTION) != 0 ||
+      func->arg_count != 2)
+    return false;
+
+  Item **args = func->arguments();
+  for (int i = 0; i < 2; i++) {
+    const Item *column = args[i]->real_item();
+    Item *value = args[1 - i];
+    if (column->type() != Item::FIELD_ITEM || !value->const_item()) continue;
+    const Field *field = static_cast<const Item_field *>(column)->field;
+    if (field->table != table ||
+        std::find(fields.begin(), fields.end(), field->field_index) ==
+            fields.end())
+      continue;
+
+    String buffer;
+    const String *text = value->val_str(&buffer);
+    if (text == NULL ||
+        !keti_parse_vector(text->ptr(), text->length(), &m_query))
+      return false;
+    m_field = field->field_index;
+
+    const longlong limit = select->select_limit->val_int();
+    const longlong offset =
+        select->offset_limit != NULL ? select->offset_limit->val_int() : 0;
+    if (limit <= 0 || offset < 0) return false;
+    m_count = static_cast<ulonglong>(limit) + static_cast<ulonglong>(offset);
+    return true;
+  }
+  return false;
+}
+
+static int bad_reply(const std::string &table,
+                     std::vector<std::unique_ptr<Keti_bitmap>> *rows) {
+  keti_log(ERROR_LEVEL, "bad reply to vector search for %s", table.c_str());
+  for (std::unique_ptr<Keti_bitmap> &segment_rows : *rows) segment_rows.reset();
+  return HA_ERR_INTERNAL_ERROR;
+}
+
+int Keti_vector_search::search(
+    const std::string &table, const std::vector<Keti_segment> &segments,
+    const Keti_table_versions &versions, const Keti_trx *trx,
+    std::vector<std::unique_ptr<Keti_bitmap>> *rows) const {
+  rows->clear();
+  rows->resize(segments.size());
+
+  /* Segments the reader cannot see must not take places among the best */
+  std::vector<uint32> ids;
+  std::vector<size_t> searched;
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (!versions.segment_visible(segments[i].id, trx)) continue;
+    ids.push_back(segments[i].id);
+    searched.push_back(i);
+  }
+  if (ids.empty()) return 0;
+
+  /* and deleted rows may, so look for as many more */
+  const ulonglong wanted = m_count + versions.lag();
+
+  /* The column, the count, the lists to probe, then the query vector */
+  std::vector<uchar> body(2 + 8 + 4 + 4 + 4 * m_query.size());
+  int2store(&body[0], m_field);
+  int8store(&body[2], wanted);
+  int4store(&body[10], static_cast<uint32>(srv_vector_nprobe));
+  int4store(&body[14], static_cast<uint32>(m_query.size()));
+  for (size_t i = 0; i < m_query.size(); i++)
+    float4store(&body[18 + 4 * i], m_query[i]);
+
+  std::vector<uchar> reply;
+  int rc = csd_search_vectors(table, ids, &body, &reply);
+  if (rc) return rc;
+  {
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_vector_stats.searches++;
+  }
+
+  /* The best rows of each segment, merged into the best of the table */
+  std::vector<std::tuple<double, size_t, uint32>> nearest;
+  const uchar *ptr = reply.data();
+  const uchar *end = ptr + reply.size();
+  for (size_t i : searched) {
+    if (end - ptr < 4) return bad_reply(table, rows);
+    const uint32 count = uint4korr(ptr);
+    ptr += 4;
+    if (count == NO_INDEX) continue;
+    if (static_cast<size_t>(end - ptr) / RESULT_SIZE < count)
+      return bad_reply(table, rows);
+    (*rows)[i].reset(new Keti_bitmap);
+    for (uint32 j = 0; j < count; j++, ptr += RESULT_SIZE)
+      nearest.emplace_back(float8get(ptr + 4), i, uint4korr(ptr));
+
+    /* Rows without a distance sort first, so they are always read */
+    if (end - ptr < 4) return bad_reply(table, rows);
+    const uint32 unindexed = uint4korr(ptr);
+    ptr += 4;
+    if (static_cast<size_t>(end - ptr) / 4 < unindexed)
+      return bad_reply(table, rows);
+    for (uint32 j = 0; j < unindexed; j++, ptr += 4)
+      (*rows)[i]->add(uint4korr(ptr));
+  }
+  if (ptr != end) return bad_reply(table, rows);
+
+  if (nearest.size() > wanted) {
+    std::nth_element(nearest.begin(), nearest.begin() + wanted, nearest.end());
+    nearest.resize(wanted);
+  }
+  for (const auto &row : nearest)
+    (*rows)[std::get<1>(row)]->add(std::get<2>(row));
+  return 0;
+}
+
+/* keti_vector_distance() */
+
+static bool vector_distance_init(UDF_INIT *initid, UDF_ARGS *args,
+                                 char *message) {
+  if (args->arg_count != 2) {
+    strcpy(message, "keti_vector_distance() takes two vectors");
+    return true;
+  }
+  args->arg_type[0] = STRING_RESULT;
+  args->arg_type[1] = STRING_RESULT;
+  initid->maybe_null = true;
+  initid->ptr = reinterpret_cast<char *>(new std::vector<float>[2]);
+  return false;
+}
+
+static void vector_distance_deinit(UDF_INIT *initid) {
+  delete[] reinterpret_cast<std::vector<float> *>(initid->ptr);
+}
+
+static double vector_distance(UDF_INIT *initid, UDF_ARGS *args,
+                              unsigned char *is_null, unsigned char *) {
+  std::vector<float> *vectors =
+      reinterpret_cast<std::vector<float> *>(initid->ptr);
+  if (args->args[0] == NULL || args->args[1] == NULL ||
+      !keti_parse_vector(args->args[0], args->lengths[0], &vectors[0]) ||
+      !keti_parse_vector(args->args[1], args->lengths[1], &vectors[1]) ||
+      vectors[0].size() != vectors[1].size()) {
+    *is_null = 1;
+    return 0;
+  }
+
+  double sum = 0;
+  for (size_t i = 0; i < vectors[0].size(); i++) {
+    const double difference = vectors[0][i] - vectors[1][i];
+    sum += difference * difference;
+  }
+  return sqrt(sum);
+}
+
+/** Run fn on the UDF registration service. @return false if unavailable */
+template <class Fn>
+static bool with_udf_registration(Fn fn) {
+  SERVICE_TYPE(registry) *registry = mysql_plugin_registry_acquire();
+  if (registry == NULL) return false;
+  my_h_service service;
+  const bool acquired = !registry->acquire("udf_registration", &service);
+  if (acquired) {
+    fn(reinterpret_cast<SERVICE_TYPE(udf_registration) *>(service));
+    registry->release(service);
+  }
+  mysql_plugin_registry_release(registry);
+  return acquired;
+}
+
+void keti_vector_init() {
+  bool registered = false;
+  with_udf_registration([&registered](SERVICE_TYPE(udf_registration) * udf) {
+    registered = !udf->udf_register(
+        DISTANCE_FUNCTION, REAL_RESULT,
+        reinterpret_cast<Udf_func_any>(vector_distance), vector_distance_init,
+        vector_distance_deinit);
+  });
+  if (!registered)
+    keti_log(WARNING_LEVEL, "cannot register %s(); vector search is off",
+             DISTANCE_FUNCTION);
+}
+
+void keti_vector_deinit() {
+  with_udf_registration([](SERVICE_TYPE(udf_registration) * udf) {
+    int was_present;
+    udf->udf_unregister(DISTANCE_FUNCTION, &was_present);
+  });
+}
@@ -0,0 +1,166 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_vector.h
+
+    @brief
+  Approximate nearest neighbour search over vector columns, answered by
+  per segment indexes on the storage node.
+
+    @details
+  A BLOB or VARBINARY column whose COMMENT contains "keti_vector" holds
+  embeddings as arrays of little endian 32 bit floats. The host hands the
+  vectors of every segment, with their row numbers as for bitmap indexes,
+  to the node, which trains an IVF-PQ index on them: about sqrt(rows) lists
+  around k-means centroids, and the residuals product quantized.
+
+  The plugin registers the function keti_vector_distance(a, b), the
+  Euclidean distance of two vectors given as such BLOBs or as text like
+  '[0.5, 1, -2]', NULL if either is NULL or their dimensions differ. A query
+  block on a single KETI table of the form
+
+  @verbatim
+    SELECT ... FROM t ORDER BY keti_vector_distance(column, constant)
+      LIMIT [offset,] count
+  @endverbatim
+
+  without WHERE, GROUP BY, HAVING or DISTINCT has the node probe the
+  keti_vector_nprobe lists nearest to the constant in each segment, rank
+  the candidates by their exact distance and return the best offset +
+  count rows. The scan then reads only the best rows over all segments,
+  and the server sorts them. Segments without an index, or whose vectors
+  have another dimension than the constant, are scanned in full. Results
+  are approximate: a neighbour in a list that was not probed is missed.
+
+  Rows whose column is NULL, is no vector or has another dimension than
+  the first vector of their segment are not in its index. Their distance
+  is NULL, which sorts first, so the node returns them with every search
+  of their segment.
+*/
+
+#ifndef KETI_VECTOR_H
+#define KETI_VECTOR_H
+
+#include <stddef.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "my_inttypes.h"
+#include "storage/keti/keti_csd.h"
+
+class Field;
+class Keti_bitmap;
+class Keti_table_versions;
+class Keti_trx;
+struct TABLE;
+struct TABLE_SHARE;
+
+struct keti_vector_stats_t {
+  ulonglong searches;  ///< Scans narrowed by a nearest neighbour search
+};
+
+extern keti_vector_stats_t keti_vector_stats;
+
+extern ulong srv_vector_nprobe;
+
+/** @brief
+  The vectors of one segment under construction, for the node to index.
+*/
+class Keti_vector_index {
+ public:
+  Keti_vector_index() : m_overflow(false) {}
+
+  /**
+    Record the vector of field in the row at block and index. Vectors of
+    another dimension than the first one of the segment are recorded as
+    unindexed.
+  */
+  void add(uint16 field, const std::vector<float> &vector, uint32 block,
+           uint32 index);
+
+  /** The row at block and index has no vector in field. */
+  void add_unindexed(uint16 field, uint32 block, uint32 index);
+
+  bool empty() const { return m_fields.empty() || m_overflow; }
+
+  /**
+    Hand over the vectors in the format csd_write_vectors() takes: per
+    column its number in 2 bytes, the dimension and the number of rows in 4
+    bytes each, then per row its number in 4 bytes and its vector, then
+    the number of unindexed rows in 4 bytes and their numbers in 4 bytes
+    each. The builder is empty afterwards.
+  */
+  void take(std::vector<uchar> *out);
+
+ private:
+  struct Field_vectors {
+    uint32 dimension;  ///< 0 until the first vector
+    std::vector<uint32> rows;
+    std::vector<float> values;
+    std::vector<uint32> unindexed;
+  };
+  std::map<uint16, Field_vectors> m_fields;
+  bool m_overflow;
+};
+
+/** @brief
+  Nearest neighbour search pushed to the node for the ORDER BY of a scan.
+*/
+class Keti_vector_search {
+ public:
+  /**
+    Recognize the query block table is scanned for. Only SELECT is
+    narrowed; a statement changing rows must see all of them.
+
+    @return false if it is not of the form in keti_vector.h
+  */
+  bool build(const TABLE *table, const std::vector<uint16> &fields);
+
+  /**
+    Have the node find the nearest rows of the segments trx sees.
+
+    @param rows  receives, per segment, the rows among the nearest, or
+                 NULL if all of them must be read
+  */
+  int search(const std::string &table,
+             const std::vector<Keti_segment> &segments,
+             const Keti_table_versions &versions, const Keti_trx *trx,
+             std::vector<std::unique_ptr<Keti_bitmap>> *rows) const;
+
+ private:
+  uint16 m_field;
+  std::vector<float> m_query;
+  ulonglong m_count;
+};
+
+/** Vector columns of a table. */
+void keti_vector_fields(const TABLE_SHARE *share, std::vector<uint16> *fields);
+
+/** Parse a vector, binary or text. @return false if it is neither */
+bool keti_parse_vector(const char *str, size_t length,
+                       std::vector<float> *vector);
+
+/** The vector of field in record. @return false if NULL or malformed */
+bool keti_vector(Field *field, const uchar *record, std::vector<float> *vector);
+
+/** Register keti_vector_distance(); failures are logged. */
+void keti_vector_init();
+
+/** Unregister keti_vector_distance(). */
+void keti_vector_deinit();
+
+#endif /* KETI_VECTOR_H */
@@ -0,0 +1,363 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_write.cc
+
+    @brief
+  KETI segment builder and write pipeline.
+*/
+
+#include "storage/keti/keti_write.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "my_byteorder.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_row.h"
+
+keti_write_stats_t keti_write_stats = {0, 0, 0};
+
+ulong srv_io_threads = 4;
+ulong srv_load_threads = 0;
+ulonglong srv_write_batch_size = 1024 * 1024;
+ulong srv_shutdown_timeout = 60;
+
+static Keti_io_pool *io_pool = NULL;
+static Keti_io_pool *load_pool = NULL;
+static std::mutex stats_mutex;
+
+Keti_row_pos Keti_segment_builder::add_row(TABLE *table,
+                                           const uchar *record) {
+  /* Pack straight into the open block; move the row out if it overflows */
+  const size_t row_start = m_block.size();
+  keti_pack_row(table, record, &m_block);
+  return place_row(row_start);
+}
+
+Keti_row_pos Keti_segment_builder::add_packed_row(const uchar *row,
+                                                  size_t length) {
+  const size_t row_start = m_block.size();
+  m_block.insert(m_block.end(), row, row + length);
+  return place_row(row_start);
+}
+
+Keti_row_pos Keti_segment_builder::place_row(size_t row_start) {
+  if (m_block_rows > 0 &&
+      m_block.size() > KETI_BLOCK_SIZE - KETI_BLOCK_HEADER_SIZE) {
+    m_row.assign(m_block.begin() + row_start, m_block.end());
+    m_block.resize(row_start);
+    close_block();
+    m_block.swap(m_row);
+  }
+  m_block_rows++;
+  m_rows++;
+
+  Keti_row_pos pos;
+  pos.segment = 0;
+  pos.block = m_block_count;
+  pos.offset = static_cast<uint32>(KETI_BLOCK_HEADER_SIZE +
+                                   (m_block_rows == 1 ? 0 : row_start));
+  return pos;
+}
+
+void Keti_segment_builder::close_block() {
+  if (m_block_rows == 0) return;
+
+  const size_t start = m_blocks.size();
+  if (!m_defer_encoding && srv_block_encoding &&
+      keti_encode_block(m_columns, m_block_rows, m_block, &m_encoded)) {
+    m_blocks.resize(start + 4);
+    int4store(&m_blocks[start], static_cast<uint32>(m_encoded.size()));
+    m_blocks.insert(m_blocks.end(), m_encoded.begin(), m_encoded.end());
+  } else {
+    m_blocks.resize(start + 4 + KETI_BLOCK_HEADER_SIZE);
+    int4store(&m_blocks[start],
+              static_cast<uint32>(KETI_BLOCK_HEADER_SIZE + m_block.size()));
+    int4store(&m_blocks[start + 4], m_block_rows);
+    m_blocks.insert(m_blocks.end(), m_block.begin(), m_block.end());
+  }
+
+  m_block.clear();
+  m_block_rows = 0;
+  m_block_count++;
+}
+
+size_t Keti_segment_builder::size() const {
+  return m_blocks.size() +
+         (m_block_rows > 0 ? 4 + KETI_BLOCK_HEADER_SIZE + m_block.size() : 0);
+}
+
+void Keti_segment_builder::take(std::vector<uchar> *blocks) {
+  close_block();
+  blocks->swap(m_blocks);
+  m_blocks.clear();
+  m_rows = 0;
+  m_block_count = 0;
+}
+
+Keti_io_pool::Keti_io_pool(size_t threads)
+    : m_running(0), m_admit(true), m_stop(false) {
+  for (size_t i = 0; i < threads; i++)
+    m_threads.emplace_back(&Keti_io_pool::worker, this);
+}
+
+int Keti_io_pool::submit(job_t job, std::future<int> *done) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (!m_admit) return HA_ERR_INTERNAL_ERROR;
+
+  m_queue.emplace_back();
+  m_queue.back().job = std::move(job);
+  *done = m_queue.back().done.get_future();
+  m_work.notify_one();
+  return 0;
+}
+
+void Keti_io_pool::stop_admission() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_admit = false;
+}
+
+size_t Keti_io_pool::drain(ulong timeout) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait_for(lock, std::chrono::seconds(timeout),
+                  [this] { return m_queue.empty() && m_running == 0; });
+  return m_queue.size() + m_running;
+}
+
+void Keti_io_pool::stop() {
+  std::deque<Entry> abandoned;
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_admit = false;
+    m_stop = true;
+    abandoned.swap(m_queue);
+    m_work.notify_all();
+  }
+  for (Entry &entry : abandoned) entry.done.set_value(HA_ERR_INTERNAL_ERROR);
+  for (std::thread &thread : m_threads) thread.join();
+  m_threads.clear();
+}
+
+void Keti_io_pool::worker() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_work.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+    if (m_queue.empty()) return;
+
+    Entry entry = std::move(m_queue.front());
+    m_queue.pop_front();
+    m_running++;
+
+    lock.unlock();
+    entry.done.set_value(entry.job());
+    lock.lock();
+
+    m_running--;
+    if (m_queue.empty() && m_running == 0) m_idle.notify_all();
+  }
+}
+
+/** Queue a write, keeping keti_segment_writes_pending up to date. */
+static int submit(Keti_io_pool *pool, const std::string &table,
+                  Keti_io_pool::job_t write, std::future<int> *done) {
+  if (pool == NULL) return HA_ERR_INTERNAL_ERROR;
+
+  {
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_write_stats.pending++;
+  }
+  int rc = pool->submit(
+      [write]() {
+        int rc = write();
+        std::lock_guard<std::mutex> guard(stats_mutex);
+        keti_write_stats.pending--;
+        return rc;
+      },
+      done);
+  if (rc) {
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_write_stats.pending--;
+    keti_log(ERROR_LEVEL, "write to %s refused: shutting down", table.c_str());
+  }
+  return rc;
+}
+
+/** Number of blocks in a segment as Keti_segment_builder built it. */
+static uint32 count_blocks(const std::vector<uchar> &body) {
+  uint32 blocks = 0;
+  size_t pos = 0;
+  while (pos + 4 <= body.size()) {
+    pos += 4 + uint4korr(&body[pos]);
+    blocks++;
+  }
+  return blocks;
+}
+
+/** Stage a segment and hand its index changes to the change buffer. */
+static int write_segment(const std::string &table, std::vector<uchar> *body,
+                         ha_rows rows, std::vector<Keti_ibuf_entry> *changes,
+                         Keti_segment_indexes *index,
+                         const std::function<void(const Keti_segment &)>
+                             &staged) {
+  Keti_segment segment = {0, count_blocks(*body), rows};
+  int rc = csd_stage_segment(table, body, &segment.id);
+  if (rc) return rc;
+  /* Searches of the indexes find its rows from now on */
+  staged(segment);
+  /* Segments without their indexes are read in full; go on */
+  if ((!index->bitmaps.empty() &&
+       csd_write_bitmaps(table, segment.id, &index->bitmaps)) ||
+      (!index->postings.empty() &&
+       csd_write_postings(table, segment.id, &index->postings)) ||
+      (!index->fulltext.empty() &&
+       csd_write_fulltext(table, segment.id, &index->fulltext)) ||
+      (!index->vectors.empty() &&
+       csd_write_vectors(table, segment.id, &index->vectors)) ||
+      (!index->stats.empty() &&
+       csd_write_stats(table, segment.id, &index->stats)))
+    keti_log(WARNING_LEVEL, "cannot write the indexes of segment %u of %s",
+             segment.id, table.c_str());
+  {
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    keti_write_stats.segments_written++;
+    keti_write_stats.rows_written += rows;
+  }
+
+  for (Keti_ibuf_entry &entry : *changes) entry.pos.segment = segment.id;
+  return keti_ibuf_add(table, changes);
+}
+
+/** The arguments of write_segment(), moved where a job can copy them. */
+struct Segment_write {
+  std::shared_ptr<std::vector<uchar>> body;
+  std::shared_ptr<std::vector<Keti_ibuf_entry>> changes;
+  std::shared_ptr<Keti_segment_indexes> index;
+
+  Segment_write(std::vector<uchar> *blocks,
+                std::vector<Keti_ibuf_entry> *entries,
+                Keti_segment_indexes *indexes)
+      : body(std::make_shared<std::vector<uchar>>()),
+        changes(std::make_shared<std::vector<Keti_ibuf_entry>>()),
+        index(std::make_shared<Keti_segment_indexes>()) {
+    body->swap(*blocks);
+    changes->swap(*entries);
+    index->bitmaps.swap(indexes->bitmaps);
+    index->postings.swap(indexes->postings);
+    index->fulltext.swap(indexes->fulltext);
+    index->vectors.swap(indexes->vectors);
+    index->stats.swap(indexes->stats);
+  }
+};
+
+int keti_write_segment(const std::string &table, std::vector<uchar> *blocks,
+                       ha_rows rows, std::vector<Keti_ibuf_entry> *entries,
+                       Keti_segment_indexes *indexes,
+                       std::function<void(const Keti_segment &)> staged,
+                       std::future<int> *done) {
+  /* std::function needs a copyable target, so the data goes in shared_ptrs */
+  const Segment_write write(blocks, entries, indexes);
+  return submit(
+      io_pool, table,
+      [table, write, rows, staged]() {
+        return write_segment(table, write.body.get(), rows,
+                             write.changes.get(), write.index.get(), staged);
+      },
+      done);
+}
+
+void keti_encode_segment(const std::vector<Keti_packed_column> &columns,
+                         std::vector<uchar> *blocks) {
+  if (!srv_block_encoding || columns.empty()) return;
+
+  std::vector<uchar> out;
+  std::vector<uchar> rows;
+  std::vector<uchar> encoded;
+  out.reserve(blocks->size());
+  const uchar *pos = blocks->data();
+  const uchar *end = pos + blocks->size();
+  while (end - pos >= 4 + static_cast<ptrdiff_t>(KETI_BLOCK_HEADER_SIZE)) {
+    const uint32 length = uint4korr(pos);
+    const uchar *block = pos + 4;
+    const uint32 row_count = uint4korr(block);
+    pos = block + length;
+    if (!(row_count & KETI_BLOCK_ENCODED)) {
+      rows.assign(block + KETI_BLOCK_HEADER_SIZE, block + length);
+      if (keti_encode_block(columns, row_count, rows, &encoded)) {
+        const size_t start = out.size();
+        out.resize(start + 4);
+        int4store(&out[start], static_cast<uint32>(encoded.size()));
+        out.insert(out.end(), encoded.begin(), encoded.end());
+        continue;
+      }
+    }
+    out.insert(out.end(), block - 4, block + length);
+  }
+  blocks->swap(out);
+}
+
+int keti_load_segment(const std::string &table,
+                      const std::vector<Keti_packed_column> &columns,
+                      std::vector<uchar> *blocks, ha_rows rows,
+                      std::vector<Keti_ibuf_entry> *entries,
+                      Keti_segment_indexes *indexes,
+                      std::function<void(const Keti_segment &)> staged,
+                      std::shared_future<int> after, std::future<int> *done) {
+  const Segment_write write(blocks, entries, indexes);
+  return submit(
+      load_pool, table,
+      [table, columns, write, rows, staged, after]() {
+        keti_encode_segment(columns, write.body.get());
+        /* Jobs start in order, so the one before is running or done */
+        if (after.valid()) after.wait();
+        return write_segment(table, write.body.get(), rows,
+                             write.changes.get(), write.index.get(), staged);
+      },
+      done);
+}
+
+void keti_write_init() {
+  io_pool = new Keti_io_pool(std::max<ulong>(srv_io_threads, 1));
+  load_pool = new Keti_io_pool(
+      srv_load_threads > 0
+          ? srv_load_threads
+          : std::max<ulong>(std::thread::hardware_concurrency(), 1));
+}
+
+void keti_write_deinit() {
+  if (io_pool == NULL) return;
+
+  /* Loads write their segments themselves; drain them first */
+  load_pool->stop_admission();
+  const size_t loads_left = load_pool->drain(srv_shutdown_timeout);
+  if (loads_left > 0)
+    keti_log(WARNING_LEVEL,
+             "%zu segments of bulk loads did not finish within %lu seconds "
+             "and are lost",
+             loads_left, srv_shutdown_timeout);
+  delete load_pool;
+  load_pool = NULL;
+
+  io_pool->stop_admission();
+  const size_t left = io_pool->drain(srv_shutdown_timeout);
+  if (left > 0)
+    keti_log(WARNING_LEVEL,
+             "%zu segment writes did not finish within %lu seconds and are "
+             "lost",
+             left, srv_shutdown_timeout);
+
+  delete io_pool;
+  io_pool = NULL;
+}
@@ -0,0 +1,260 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_write.h
+
+    @brief
+  Batching of inserted rows into segments and the I/O threads that send
+  them to the storage node.
+
+    @details
+  Every handler packs the rows it is given into a Keti_segment_builder of
+  its own, so inserters never contend on a shared tail block. Once the
+  batch reaches keti_write_batch_size bytes it is handed to the I/O pool,
+  which writes it as a new segment while the statement goes on inserting.
+  The segments are staged, and join the table when the transaction commits,
+  see keti_trx.h. The handler waits for its outstanding segments when the
+  statement ends, so a statement that returned success has all of its rows
+  on the node.
+
+  A bulk load, LOAD DATA or a multi-row INSERT, leaves encoding its blocks
+  to a second pool of keti_load_threads threads, one per core by default.
+  The inserting thread only packs rows and builds their indexes; the
+  segments of the load are encoded side by side and written one after the
+  other, in the order of the input.
+
+  At shutdown new writes are refused and the pool is given
+  keti_shutdown_timeout seconds to drain, before the node is asked to
+  checkpoint so that it has nothing to replay when it comes back.
+*/
+
+#ifndef KETI_WRITE_H
+#define KETI_WRITE_H
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "my_base.h" /* ha_rows */
+#include "my_inttypes.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_encode.h"
+#include "storage/keti/keti_ibuf.h"
+#include "storage/keti/keti_row.h"
+
+struct TABLE;
+
+/** @brief
+  Packs rows into the blocks of one segment.
+
+    @details
+  The result is what csd_stage_segment() sends: each block preceded by its
+  length in 4 bytes. A block is closed when the next row would not fit into
+  KETI_BLOCK_SIZE; a row larger than that gets a block of its own. Closed
+  blocks are encoded as keti_encode.h describes if columns to encode were
+  given and keti_block_encoding is on.
+*/
+class Keti_segment_builder {
+ public:
+  Keti_segment_builder()
+      : m_defer_encoding(false), m_block_rows(0), m_block_count(0),
+        m_rows(0) {}
+
+  /**
+    Append a row in the record format of table.
+
+    @return where the row will be; the segment is only known once written
+  */
+  Keti_row_pos add_row(TABLE *table, const uchar *record);
+
+  /** Append a row as packed in a block, row header included. */
+  Keti_row_pos add_packed_row(const uchar *row, size_t length);
+
+  /** Encode these columns of the blocks closed from now on. */
+  void set_packed_columns(const std::vector<Keti_packed_column> &columns) {
+    m_columns = columns;
+  }
+
+  /**
+    Leave the blocks closed from now on plain, for keti_load_segment() to
+    encode off the inserting thread.
+  */
+  void set_defer_encoding(bool defer) { m_defer_encoding = defer; }
+
+  /** Index in its block of the row added last. */
+  uint32 last_row_index() const { return m_block_rows - 1; }
+
+  /** Bytes the segment would take if it was taken now. */
+  size_t size() const;
+  ha_rows rows() const { return m_rows; }
+  bool empty() const { return m_rows == 0; }
+
+  /** Hand over the segment. The builder is empty afterwards. */
+  void take(std::vector<uchar> *blocks);
+
+ private:
+  /** Account for the row appended to m_block at row_start. */
+  Keti_row_pos place_row(size_t row_start);
+  void close_block();
+
+  std::vector<uchar> m_blocks;  ///< Closed blocks with their lengths
+  std::vector<uchar> m_block;   ///< Rows of the open block
+  std::vector<uchar> m_row;     ///< Row moved out of a full block
+  std::vector<uchar> m_encoded;  ///< m_block encoded
+  std::vector<Keti_packed_column> m_columns;  ///< Columns to encode
+  bool m_defer_encoding;
+  uint32 m_block_rows;          ///< Rows in m_block
+  uint32 m_block_count;         ///< Blocks in m_blocks
+  ha_rows m_rows;               ///< Rows in the segment
+};
+
+/** @brief
+  Fixed set of threads sending writes to the storage node.
+*/
+class Keti_io_pool {
+ public:
+  typedef std::function<int()> job_t;
+
+  explicit Keti_io_pool(size_t threads);
+  ~Keti_io_pool() { stop(); }
+
+  /**
+    Queue a job. Its result is delivered through done.
+
+    @retval 0                        queued
+    @retval HA_ERR_INTERNAL_ERROR    the pool no longer admits work
+  */
+  int submit(job_t job, std::future<int> *done);
+
+  /** Refuse all further submit() calls. */
+  void stop_admission();
+
+  /**
+    Wait until no job is queued or running, at most timeout seconds.
+
+    @return jobs still queued or running
+  */
+  size_t drain(ulong timeout);
+
+  /**
+    Let the running jobs finish and fail the queued ones with
+    HA_ERR_INTERNAL_ERROR, then join the threads.
+  */
+  void stop();
+
+ private:
+  void worker();
+
+  struct Entry {
+    job_t job;
+    std::promise<int> done;
+  };
+
+  std::mutex m_mutex;
+  std::condition_variable m_work;  ///< Signalled on submit() and stop()
+  std::condition_variable m_idle;  ///< Signalled when a job finishes
+  std::deque<Entry> m_queue;
+  size_t m_running;
+  bool m_admit;
+  bool m_stop;
+  std::vector<std::thread> m_threads;
+};
+
+/** @brief
+  Per segment indexes, written with the segment.
+*/
+struct Keti_segment_indexes {
+  std::vector<uchar> bitmaps;   ///< From Keti_bitmap_index::take()
+  std::vector<uchar> postings;  ///< From Keti_posting_index::take()
+  std::vector<uchar> fulltext;  ///< From Keti_fulltext_index::take()
+  std::vector<uchar> vectors;   ///< From Keti_vector_index::take()
+  std::vector<uchar> stats;     ///< From Keti_row_stats::pack()
+};
+
+struct keti_write_stats_t {
+  ulonglong segments_written;
+  ulonglong rows_written;
+  /** Segments queued or being written. */
+  ulonglong pending;
+};
+
+extern keti_write_stats_t keti_write_stats;
+
+extern ulong srv_io_threads;
+extern ulong srv_load_threads;
+extern ulonglong srv_write_batch_size;
+extern ulong srv_shutdown_timeout;
+
+/**
+  Write a segment of table in the background.
+
+  @param blocks   as built by Keti_segment_builder; consumed
+  @param rows     rows in the segment, for the statistics
+  @param entries  index changes of the rows, handed to the change buffer
+                  with the segment id filled in once it is written; consumed
+  @param indexes  indexes of the segment the node keeps with it; consumed
+  @param staged   called with the segment once it is staged, before its
+                  indexes are written
+  @param done     receives 0 or the HA_ERR_* code of the write
+*/
+int keti_write_segment(const std::string &table, std::vector<uchar> *blocks,
+                       ha_rows rows, std::vector<Keti_ibuf_entry> *entries,
+                       Keti_segment_indexes *indexes,
+                       std::function<void(const Keti_segment &)> staged,
+                       std::future<int> *done);
+
+/**
+  Encode the plain blocks of a segment built with deferred encoding, as
+  Keti_segment_builder would have.
+
+  @param blocks  as built by Keti_segment_builder
+*/
+void keti_encode_segment(const std::vector<Keti_packed_column> &columns,
+                         std::vector<uchar> *blocks);
+
+/**
+  Write a segment of a bulk load in the background. Its blocks, built with
+  deferred encoding, are encoded by one of keti_load_threads threads, so
+  the segments of a load are encoded in parallel, and it is staged once
+  the segment before it is, so they join the manifest in the order they
+  were built.
+
+  @param after  the done of the segment before, if any
+  @param done   as for keti_write_segment(), as all other parameters
+*/
+int keti_load_segment(const std::string &table,
+                      const std::vector<Keti_packed_column> &columns,
+                      std::vector<uchar> *blocks, ha_rows rows,
+                      std::vector<Keti_ibuf_entry> *entries,
+                      Keti_segment_indexes *indexes,
+                      std::function<void(const Keti_segment &)> staged,
+                      std::shared_future<int> after, std::future<int> *done);
+
+/** Start the I/O and load threads. */
+void keti_write_init();
+
+/**
+  Refuse new writes, wait up to keti_shutdown_timeout seconds for the
+  queued ones and stop the I/O threads.
+*/
+void keti_write_deinit();
+
+#endif /* KETI_WRITE_H */
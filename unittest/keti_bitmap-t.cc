@@ -0,0 +1,223 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_bitmap-t.cc
+
+    @brief
+  Keti_bitmap against std::set: adds, AND, OR, pack and unpack, over
+  containers that are arrays, bitsets and that turn from one into the other.
+*/
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "my_byteorder.h"
+#include "my_inttypes.h"
+#include "storage/keti/keti_bitmap.h"
+
+namespace keti_bitmap_unittest {
+
+/** Values the bitmaps of these tests hold are below this. */
+static const uint32 UNIVERSE = 4 << 16;
+
+/** Expect bitmap to hold exactly values. */
+static void expect_same(const Keti_bitmap &bitmap,
+                        const std::set<uint32> &values) {
+  EXPECT_EQ(values.size(), bitmap.cardinality());
+  EXPECT_EQ(values.empty(), bitmap.empty());
+  for (uint32 value = 0; value < UNIVERSE; value++) {
+    if (bitmap.contains(value) != (values.count(value) > 0)) {
+      ADD_FAILURE() << "value " << value;
+      return;
+    }
+  }
+  for (uint32 high = 0; high < UNIVERSE >> 16; high++) {
+    const auto first = values.lower_bound(high << 16);
+    EXPECT_EQ(first != values.end() && *first >> 16 == high,
+              bitmap.contains_high(static_cast<uint16>(high)))
+        << "high " << high;
+  }
+}
+
+/** Add count random values of [from, to) of container high to values. */
+static void add_random(std::mt19937 *random, uint16 high, uint32 from,
+                       uint32 to, size_t count, std::set<uint32> *values) {
+  std::uniform_int_distribution<uint32> low(from, to - 1);
+  for (size_t i = 0; i < count; i++)
+    values->insert(static_cast<uint32>(high) << 16 | low(*random));
+}
+
+/** A bitmap of values, added in random order. */
+static Keti_bitmap make_bitmap(const std::set<uint32> &values,
+                               std::mt19937 *random) {
+  std::vector<uint32> order(values.begin(), values.end());
+  std::shuffle(order.begin(), order.end(), *random);
+  Keti_bitmap bitmap;
+  for (uint32 value : order) bitmap.add(value);
+  return bitmap;
+}
+
+/*
+  Per container: 0 array and bitset, 1 two bitsets whose AND is an array,
+  2 two arrays whose OR is a bitset, 3 in b only.
+*/
+class KetiBitmapTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    std::mt19937 random(115);
+    add_random(&random, 0, 0, 65536, 1000, &a_values);
+    add_random(&random, 0, 0, 65536, 30000, &b_values);
+    for (uint32 low = 0; low < 20000; low++) a_values.insert(1 << 16 | low);
+    for (uint32 low = 16000; low < 40000; low++)
+      b_values.insert(1 << 16 | low);
+    add_random(&random, 2, 0, 30000, 3000, &a_values);
+    add_random(&random, 2, 30000, 65536, 3000, &b_values);
+    add_random(&random, 3, 0, 65536, 100, &b_values);
+    a = make_bitmap(a_values, &random);
+    b = make_bitmap(b_values, &random);
+  }
+
+  std::set<uint32> a_values;
+  std::set<uint32> b_values;
+  Keti_bitmap a;
+  Keti_bitmap b;
+};
+
+TEST_F(KetiBitmapTest, Add) {
+  expect_same(a, a_values);
+  expect_same(b, b_values);
+
+  /* Adding a value again changes nothing */
+  for (uint32 value : a_values) a.add(value);
+  expect_same(a, a_values);
+}
+
+TEST_F(KetiBitmapTest, Empty) {
+  Keti_bitmap empty;
+  expect_same(empty, std::set<uint32>());
+
+  Keti_bitmap copy = a;
+  copy.intersect(empty);
+  expect_same(copy, std::set<uint32>());
+
+  copy = a;
+  copy.unite(empty);
+  expect_same(copy, a_values);
+
+  empty.unite(a);
+  expect_same(empty, a_values);
+}
+
+TEST_F(KetiBitmapTest, Intersect) {
+  std::set<uint32> both;
+  std::set_intersection(a_values.begin(), a_values.end(), b_values.begin(),
+                        b_values.end(), std::inserter(both, both.end()));
+  const auto in_1 = [](uint32 value) { return value >> 16 == 1; };
+  ASSERT_EQ(4000, std::count_if(both.begin(), both.end(), in_1));
+
+  Keti_bitmap ab = a;
+  ab.intersect(b);
+  expect_same(ab, both);
+
+  Keti_bitmap ba = b;
+  ba.intersect(a);
+  expect_same(ba, both);
+
+  /* Disjoint containers leave none behind */
+  Keti_bitmap none;
+  none.add(2 << 16 | 65535);
+  none.intersect(a);
+  expect_same(none, std::set<uint32>());
+}
+
+TEST_F(KetiBitmapTest, Unite) {
+  std::set<uint32> either = a_values;
+  either.insert(b_values.begin(), b_values.end());
+
+  Keti_bitmap ab = a;
+  ab.unite(b);
+  expect_same(ab, either);
+
+  Keti_bitmap ba = b;
+  ba.unite(a);
+  expect_same(ba, either);
+
+  /* What a union turned into a bitset intersects back into an array */
+  std::set<uint32> a_only;
+  for (uint32 value : a_values)
+    if (value >> 16 == 2) a_only.insert(value);
+  std::mt19937 random(115);
+  ab.intersect(make_bitmap(a_only, &random));
+  expect_same(ab, a_only);
+}
+
+TEST_F(KetiBitmapTest, PackUnpack) {
+  for (const Keti_bitmap *bitmap : {&a, &b}) {
+    /* pack() appends */
+    std::vector<uchar> packed(3, 0xAA);
+    bitmap->pack(&packed);
+    ASSERT_GT(packed.size(), 3U + 4U);
+
+    Keti_bitmap unpacked;
+    ASSERT_TRUE(unpacked.unpack(packed.data() + 3, packed.size() - 3));
+    expect_same(unpacked, bitmap == &a ? a_values : b_values);
+
+    std::vector<uchar> again(3, 0xAA);
+    unpacked.pack(&again);
+    EXPECT_TRUE(again == packed);
+  }
+
+  Keti_bitmap empty;
+  std::vector<uchar> packed;
+  empty.pack(&packed);
+  ASSERT_EQ(4U, packed.size());
+  Keti_bitmap unpacked = a;
+  ASSERT_TRUE(unpacked.unpack(packed.data(), packed.size()));
+  expect_same(unpacked, std::set<uint32>());
+}
+
+TEST_F(KetiBitmapTest, UnpackMalformed) {
+  std::vector<uchar> packed;
+  a.pack(&packed);
+  Keti_bitmap bitmap;
+
+  /* Cut anywhere */
+  for (size_t length = 0; length < packed.size(); length += 1 + length / 2)
+    EXPECT_FALSE(bitmap.unpack(packed.data(), length)) << "length " << length;
+
+  /* A container claiming more than it holds or none at all */
+  std::vector<uchar> bad = packed;
+  int4store(&bad[4 + 2], 65537);
+  EXPECT_FALSE(bitmap.unpack(bad.data(), bad.size()));
+  bad = packed;
+  int4store(&bad[4 + 2], 0);
+  EXPECT_FALSE(bitmap.unpack(bad.data(), bad.size()));
+
+  /* Containers out of order */
+  Keti_bitmap one;
+  one.add(5 << 16);
+  std::vector<uchar> twice;
+  one.pack(&twice);
+  const std::vector<uchar> container(twice.begin() + 4, twice.end());
+  twice.insert(twice.end(), container.begin(), container.end());
+  int4store(&twice[0], 2);
+  EXPECT_FALSE(bitmap.unpack(twice.data(), twice.size()));
+}
+
+}  // namespace keti_bitmap_unittest
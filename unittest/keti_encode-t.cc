@@ -0,0 +1,480 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_encode-t.cc
+
+    @brief
+  Round trips of blocks through the column encodings of keti_encode.h.
+
+    @details
+  Blocks are encoded from values made to need a given number of bits with
+  a given codec, and must decode to the plain rows they came from. The
+  encoder only packs what saves space, so the widths no encoder choice
+  reaches, 64 bits and the widest deltas, are covered by blocks built here
+  in the documented format and decoded.
+*/
+
+#include <gtest/gtest.h>
+#include <limits.h>
+#include <string.h>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "my_inttypes.h"
+#include "storage/keti/keti_encode.h"
+#include "storage/keti/keti_row.h"
+
+namespace keti_encode_unittest {
+
+/** Codecs, as the column header of an encoded block numbers them. */
+enum Codec { CODEC_FOR = 1, CODEC_DELTA = 2, CODEC_DOD = 3, CODEC_XOR = 4 };
+
+static const size_t COLUMN_HEADER_SIZE = 2 + 1 + 1 + 1 + 8 + 8 + 1;
+static const uint32 ROW_COUNT = 512;
+
+static uint64 unzigzag(uint64 number) {
+  return number >> 1 ^ (0 - (number & 1));
+}
+
+/** Largest number of bits bits. */
+static uint64 max_number(uint bits) {
+  return bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+/**
+  Rows of records record_length bytes long holding values[c][i] in column c
+  of row i, with filler in between and a few bytes of blob after some.
+*/
+static std::vector<uchar> make_rows(
+    const std::vector<Keti_packed_column> &columns, size_t record_length,
+    const std::vector<std::vector<uint64>> &values) {
+  std::vector<uchar> rows;
+  const uint32 row_count = static_cast<uint32>(values[0].size());
+  for (uint32 i = 0; i < row_count; i++) {
+    const size_t length = record_length + i % 3;
+    const size_t start = rows.size();
+    rows.resize(start + KETI_ROW_HEADER_SIZE + length);
+    uchar *row = &rows[start];
+    int4store(row, static_cast<uint32>(length));
+    uchar *record = row + KETI_ROW_HEADER_SIZE;
+    for (size_t j = 0; j < length; j++)
+      record[j] = static_cast<uchar>(i * 7 + j);
+    for (size_t c = 0; c < columns.size(); c++) {
+      const Keti_packed_column &column = columns[c];
+      uint64 value = values[c][i];
+      for (uint j = 0; j < column.length; j++, value >>= 8) {
+        const uint at = column.kind == KETI_KIND_BIG_ENDIAN
+                            ? column.length - 1 - j
+                            : j;
+        record[column.offset + at] = static_cast<uchar>(value);
+      }
+    }
+  }
+  return rows;
+}
+
+/**
+  Encode rows, expect them to decode back to the plain block, and return
+  the encoded block, or an empty one if encoding did not pay.
+*/
+static std::vector<uchar> round_trip(
+    const std::vector<Keti_packed_column> &columns, uint32 row_count,
+    const std::vector<uchar> &rows) {
+  std::vector<uchar> block;
+  if (!keti_encode_block(columns, row_count, rows, &block)) return {};
+
+  std::vector<uchar> plain(KETI_BLOCK_HEADER_SIZE);
+  int4store(plain.data(), row_count);
+  plain.insert(plain.end(), rows.begin(), rows.end());
+
+  std::vector<uchar> decoded = block;
+  std::vector<Keti_packed_column> encoded;
+  EXPECT_EQ(0, keti_decode_block(&decoded, &encoded));
+  EXPECT_TRUE(decoded == plain);
+  EXPECT_FALSE(encoded.empty());
+  return block;
+}
+
+/** Codec of the first encoded column of block. */
+static uint codec_of(const std::vector<uchar> &block) {
+  return block[KETI_BLOCK_HEADER_SIZE + 1 + 4];
+}
+
+/** Bits of the numbers of the first encoded column of block. */
+static uint bits_of(const std::vector<uchar> &block) {
+  return block[KETI_BLOCK_HEADER_SIZE + 1 + 21];
+}
+
+/** One 8 byte column at offset 0 of records of 12 bytes. */
+static std::vector<Keti_packed_column> one_column(uint8 kind) {
+  Keti_packed_column column;
+  column.offset = 0;
+  column.length = 8;
+  column.kind = kind;
+  return {column};
+}
+
+static const uint8 INTEGER_KINDS[] = {KETI_KIND_INT, KETI_KIND_UINT};
+
+TEST(KetiEncodeTest, ForEveryWidth) {
+  std::mt19937_64 random(115);
+  for (uint8 kind : INTEGER_KINDS) {
+    for (uint bits = 0; bits <= 64; bits++) {
+      SCOPED_TRACE(testing::Message() << "kind " << static_cast<uint>(kind)
+                                      << " bits " << bits);
+      const uint64 range = max_number(bits);
+      uint64 base;
+      if (kind == KETI_KIND_INT)
+        base = static_cast<uint64>(bits >= 63 ? LLONG_MIN : -(1LL << 62));
+      else
+        base = bits == 64 ? 0 : 1000;
+
+      /* The first two rows take the ends of the range */
+      std::vector<uint64> values(ROW_COUNT);
+      for (uint32 i = 0; i < ROW_COUNT; i++)
+        values[i] = base + (i == 0 ? 0 : i == 1 ? range : random() & range);
+
+      const std::vector<Keti_packed_column> columns = one_column(kind);
+      const std::vector<uchar> block =
+          round_trip(columns, ROW_COUNT, make_rows(columns, 12, {values}));
+      /* 64 bit numbers are no smaller than the values */
+      if (bits == 64) {
+        EXPECT_TRUE(block.empty());
+        continue;
+      }
+      ASSERT_FALSE(block.empty());
+      EXPECT_EQ(static_cast<uint>(CODEC_FOR), codec_of(block));
+      EXPECT_EQ(bits, bits_of(block));
+    }
+  }
+}
+
+/*
+  Values step apart plus up to bits wide more. Beyond 52 bits the values of
+  512 rows span so few more bits than their deltas that FOR packs them as
+  tightly, see DecodeEveryWidth.
+*/
+TEST(KetiEncodeTest, DeltaEveryWidth) {
+  std::mt19937_64 random(115);
+  for (uint8 kind : INTEGER_KINDS) {
+    for (uint bits = 0; bits <= 52; bits++) {
+      SCOPED_TRACE(testing::Message() << "kind " << static_cast<uint>(kind)
+                                      << " bits " << bits);
+      const uint64 range = max_number(bits);
+      const uint64 step = 1ULL << (bits + 1);
+      std::vector<uint64> values(ROW_COUNT);
+      values[0] = kind == KETI_KIND_INT ? static_cast<uint64>(-(1LL << 62))
+                                        : 1000;
+      for (uint32 i = 1; i < ROW_COUNT; i++)
+        values[i] = values[i - 1] + step +
+                    (i == 1 ? 0 : i == 2 ? range : random() & range);
+
+      const std::vector<Keti_packed_column> columns = one_column(kind);
+      const std::vector<uchar> block =
+          round_trip(columns, ROW_COUNT, make_rows(columns, 12, {values}));
+      ASSERT_FALSE(block.empty());
+      EXPECT_EQ(static_cast<uint>(CODEC_DELTA), codec_of(block));
+      EXPECT_EQ(bits, bits_of(block));
+    }
+  }
+}
+
+/*
+  Values whose deltas keep shrinking by up to bits wide changes. With no
+  change at all DELTA needs no bits either and is taken.
+*/
+TEST(KetiEncodeTest, DeltaOfDeltaEveryWidth) {
+  std::mt19937_64 random(115);
+  for (uint8 kind : INTEGER_KINDS) {
+    for (uint bits = 1; bits <= 40; bits++) {
+      SCOPED_TRACE(testing::Message() << "kind " << static_cast<uint>(kind)
+                                      << " bits " << bits);
+      const uint64 range = max_number(bits);
+      std::vector<uint64> values(ROW_COUNT);
+      values[0] = kind == KETI_KIND_INT ? 0 : 1ULL << 60;
+      values[1] = values[0] + 1000;
+      uint64 delta = 1000;
+      for (uint32 i = 2; i < ROW_COUNT; i++) {
+        /* Odd numbers are negative changes */
+        delta += unzigzag(i == 2 ? range : (random() & range) | 1);
+        values[i] = values[i - 1] + delta;
+      }
+
+      const std::vector<Keti_packed_column> columns = one_column(kind);
+      const std::vector<uchar> block =
+          round_trip(columns, ROW_COUNT, make_rows(columns, 12, {values}));
+      ASSERT_FALSE(block.empty());
+      EXPECT_EQ(static_cast<uint>(CODEC_DOD), codec_of(block));
+      EXPECT_EQ(bits, bits_of(block));
+    }
+  }
+}
+
+TEST(KetiEncodeTest, NarrowColumns) {
+  std::mt19937_64 random(115);
+  for (uint8 kind : INTEGER_KINDS) {
+    for (uint8 length = 1; length <= 8; length++) {
+      SCOPED_TRACE(testing::Message() << "kind " << static_cast<uint>(kind)
+                                      << " length "
+                                      << static_cast<uint>(length));
+      /* Three bits short of the column, negative half the time if signed */
+      const uint bits = 8 * length - 3;
+      std::vector<uint64> values(ROW_COUNT);
+      for (uint64 &value : values) {
+        value = random() & max_number(bits);
+        if (kind == KETI_KIND_INT) value -= 1ULL << (bits - 1);
+      }
+
+      Keti_packed_column column;
+      column.offset = 3;
+      column.length = length;
+      column.kind = kind;
+      const std::vector<uchar> block = round_trip(
+          {column}, ROW_COUNT, make_rows({column}, 3 + length + 5, {values}));
+      ASSERT_FALSE(block.empty());
+      EXPECT_EQ(static_cast<uint>(CODEC_FOR), codec_of(block));
+      EXPECT_EQ(bits, bits_of(block));
+    }
+  }
+}
+
+TEST(KetiEncodeTest, XorDoubles) {
+  std::vector<uint64> values(ROW_COUNT);
+  for (uint32 i = 0; i < ROW_COUNT; i++) {
+    const double sample = 20.0 + (i % 17) * 0.25 - (i % 5) * 0.125;
+    memcpy(&values[i], &sample, sizeof(sample));
+  }
+
+  const std::vector<Keti_packed_column> columns = one_column(KETI_KIND_FLOAT);
+  const std::vector<uchar> block =
+      round_trip(columns, ROW_COUNT, make_rows(columns, 12, {values}));
+  ASSERT_FALSE(block.empty());
+  EXPECT_EQ(static_cast<uint>(CODEC_XOR), codec_of(block));
+}
+
+TEST(KetiEncodeTest, XorFloats) {
+  std::vector<uint64> values(ROW_COUNT);
+  for (uint32 i = 0; i < ROW_COUNT; i++) {
+    const float sample = 1.5f + (i / 8) * 0.5f;
+    uint32 bits;
+    memcpy(&bits, &sample, sizeof(sample));
+    values[i] = bits;
+  }
+
+  Keti_packed_column column;
+  column.offset = 0;
+  column.length = 4;
+  column.kind = KETI_KIND_FLOAT;
+  const std::vector<uchar> block =
+      round_trip({column}, ROW_COUNT, make_rows({column}, 6, {values}));
+  ASSERT_FALSE(block.empty());
+  EXPECT_EQ(static_cast<uint>(CODEC_XOR), codec_of(block));
+}
+
+/* Bit patterns with runs of leading and trailing zeros of every length */
+TEST(KetiEncodeTest, XorSpecialValues) {
+  const double specials[] = {0.0,
+                             -0.0,
+                             1.0,
+                             -1.0,
+                             std::numeric_limits<double>::infinity(),
+                             -std::numeric_limits<double>::infinity(),
+                             std::numeric_limits<double>::quiet_NaN(),
+                             std::numeric_limits<double>::denorm_min(),
+                             std::numeric_limits<double>::min(),
+                             std::numeric_limits<double>::max(),
+                             std::numeric_limits<double>::lowest()};
+  const size_t count = sizeof(specials) / sizeof(specials[0]);
+  std::vector<uint64> values(ROW_COUNT);
+  for (uint32 i = 0; i < ROW_COUNT; i++) {
+    /* Long runs of one value, so that the block is worth encoding */
+    memcpy(&values[i], &specials[i / 16 % count], sizeof(double));
+    if (i % 64 == 63) values[i] = 1ULL << (i / 64);
+  }
+
+  const std::vector<Keti_packed_column> columns = one_column(KETI_KIND_FLOAT);
+  const std::vector<uchar> block =
+      round_trip(columns, ROW_COUNT, make_rows(columns, 12, {values}));
+  ASSERT_FALSE(block.empty());
+  EXPECT_EQ(static_cast<uint>(CODEC_XOR), codec_of(block));
+}
+
+/* Several columns of every kind between bytes that stay in the records */
+TEST(KetiEncodeTest, ColumnsOfEveryKind) {
+  const uint8 kinds[] = {KETI_KIND_UINT, KETI_KIND_CODE, KETI_KIND_BIG_ENDIAN,
+                         KETI_KIND_INT, KETI_KIND_FLOAT};
+  const uint8 lengths[] = {4, 3, 5, 2, 8};
+  std::vector<Keti_packed_column> columns;
+  uint16 offset = 1;
+  for (size_t c = 0; c < sizeof(kinds); c++) {
+    Keti_packed_column column;
+    column.offset = offset;
+    column.length = lengths[c];
+    column.kind = kinds[c];
+    columns.push_back(column);
+    offset += column.length + 2;
+  }
+
+  const uint32 row_count = 300;
+  std::vector<std::vector<uint64>> values(columns.size(),
+                                          std::vector<uint64>(row_count));
+  for (uint32 i = 0; i < row_count; i++) {
+    values[0][i] = 100000 + i * 3;
+    values[1][i] = 2026 * 512 + 10 * 32 + i % 28;
+    values[2][i] = 0x8000000000ULL + 60 * i;
+    values[3][i] = static_cast<uint64>(-300 + static_cast<longlong>(i));
+    const double sample = 0.5 * (i % 4);
+    memcpy(&values[4][i], &sample, sizeof(sample));
+  }
+
+  const std::vector<uchar> block =
+      round_trip(columns, row_count, make_rows(columns, offset + 1, values));
+  ASSERT_FALSE(block.empty());
+
+  /* The decoder reports what it took out, in record order */
+  std::vector<uchar> decoded = block;
+  std::vector<Keti_packed_column> encoded;
+  ASSERT_EQ(0, keti_decode_block(&decoded, &encoded));
+  ASSERT_EQ(columns.size(), encoded.size());
+  for (size_t c = 0; c < columns.size(); c++) {
+    EXPECT_EQ(columns[c].offset, encoded[c].offset);
+    EXPECT_EQ(columns[c].length, encoded[c].length);
+    EXPECT_EQ(columns[c].kind, encoded[c].kind);
+  }
+}
+
+TEST(KetiEncodeTest, PlainBlockDecodesAsItIs) {
+  const std::vector<Keti_packed_column> columns = one_column(KETI_KIND_UINT);
+  std::vector<uchar> block(KETI_BLOCK_HEADER_SIZE);
+  int4store(block.data(), 3);
+  const std::vector<uchar> rows =
+      make_rows(columns, 12, {std::vector<uint64>{1, 2, 3}});
+  block.insert(block.end(), rows.begin(), rows.end());
+
+  std::vector<uchar> decoded = block;
+  std::vector<Keti_packed_column> encoded;
+  EXPECT_EQ(0, keti_decode_block(&decoded, &encoded));
+  EXPECT_TRUE(decoded == block);
+  EXPECT_TRUE(encoded.empty());
+}
+
+/** Append numbers in groups of 64, as the column format lays them out. */
+static void pack_numbers(const std::vector<uint64> &numbers, uint bits,
+                         std::vector<uchar> *out) {
+  for (size_t start = 0; bits > 0 && start < numbers.size(); start += 64) {
+    std::vector<uint64> words(bits, 0);
+    for (size_t j = 0; j < 64 && start + j < numbers.size(); j++)
+      for (uint b = 0; b < bits; b++)
+        if (numbers[start + j] >> b & 1) {
+          const size_t bit = j * bits + b;
+          words[bit / 64] |= 1ULL << (bit % 64);
+        }
+    for (uint64 word : words) {
+      const size_t at = out->size();
+      out->resize(at + 8);
+      int8store(&(*out)[at], word);
+    }
+  }
+}
+
+/*
+  Blocks of every codec and width, of a row count that leaves the last
+  group short, built here and decoded.
+*/
+TEST(KetiEncodeTest, DecodeEveryWidth) {
+  std::mt19937_64 random(115);
+  const uint32 row_count = 200;
+  const uint64 base = 0x0123456789ABCDEFULL;
+  const uint64 step = 0xFEDCBA9876543210ULL;
+  for (uint codec = CODEC_FOR; codec <= CODEC_DOD; codec++) {
+    for (uint bits = 0; bits <= 64; bits++) {
+      SCOPED_TRACE(testing::Message() << "codec " << codec << " bits " << bits);
+      std::vector<uint64> numbers(row_count);
+      for (uint32 i = 0; i < row_count; i++)
+        numbers[i] = random() & max_number(bits);
+      /* The first number of DELTA, and the first two of DOD, are 0 */
+      numbers[0] = 0;
+      if (codec == CODEC_DOD) numbers[1] = 0;
+
+      std::vector<uint64> values(row_count);
+      uint64 previous = base - step;
+      uint64 delta = step;
+      for (uint32 i = 0; i < row_count; i++) {
+        if (codec == CODEC_FOR) {
+          values[i] = base + numbers[i];
+        } else if (codec == CODEC_DELTA) {
+          values[i] = previous += step + numbers[i];
+        } else {
+          delta += unzigzag(numbers[i]);
+          values[i] = previous += delta;
+        }
+      }
+
+      std::vector<uchar> block(KETI_BLOCK_HEADER_SIZE + 1 +
+                               COLUMN_HEADER_SIZE);
+      int4store(&block[0], KETI_BLOCK_ENCODED | row_count);
+      block[KETI_BLOCK_HEADER_SIZE] = 1;
+      uchar *header = &block[KETI_BLOCK_HEADER_SIZE + 1];
+      int2store(header, 0);
+      header[2] = 8;
+      header[3] = KETI_KIND_UINT;
+      header[4] = static_cast<uchar>(codec);
+      int8store(header + 5, base);
+      int8store(header + 13, codec == CODEC_FOR ? 0 : step);
+      header[21] = static_cast<uchar>(bits);
+      pack_numbers(numbers, bits, &block);
+      /* Rows of 8 byte records left empty by the column */
+      for (uint32 i = 0; i < row_count; i++) {
+        const size_t at = block.size();
+        block.resize(at + KETI_ROW_HEADER_SIZE);
+        int4store(&block[at], 8);
+      }
+
+      ASSERT_EQ(0, keti_decode_block(&block, NULL));
+      ASSERT_EQ(KETI_BLOCK_HEADER_SIZE + row_count * (KETI_ROW_HEADER_SIZE + 8),
+                block.size());
+      EXPECT_EQ(row_count, uint4korr(&block[0]));
+      for (uint32 i = 0; i < row_count; i++) {
+        const uchar *row =
+            &block[KETI_BLOCK_HEADER_SIZE + i * (KETI_ROW_HEADER_SIZE + 8)];
+        EXPECT_EQ(8U, uint4korr(row));
+        EXPECT_EQ(values[i], uint8korr(row + KETI_ROW_HEADER_SIZE))
+            << "row " << i;
+      }
+    }
+  }
+}
+
+TEST(KetiEncodeTest, TruncatedBlockIsCrashed) {
+  std::mt19937_64 random(115);
+  std::vector<uint64> values(ROW_COUNT);
+  for (uint64 &value : values) value = random() & 0xFFFF;
+  const std::vector<Keti_packed_column> columns = one_column(KETI_KIND_UINT);
+  const std::vector<uchar> block =
+      round_trip(columns, ROW_COUNT, make_rows(columns, 12, {values}));
+  ASSERT_FALSE(block.empty());
+
+  for (size_t length = KETI_BLOCK_HEADER_SIZE; length < block.size();
+       length += 97) {
+    std::vector<uchar> truncated(block.begin(), block.begin() + length);
+    EXPECT_EQ(HA_ERR_CRASHED, keti_decode_block(&truncated, NULL))
+        << "length " << length;
+  }
+}
+
+}  // namespace keti_encode_unittest
@@ -0,0 +1,377 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_ibuf-t.cc
+
+    @brief
+  The change buffer of keti_ibuf.h across restarts: what the log replays
+  and what merges send.
+
+    @details
+  The storage node is faked by csd_write_index_changes() below, which
+  records the requests and fails them while node_down is set, so that a
+  restart finds the entries still in the log.
+*/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "my_base.h"
+#include "my_byteorder.h"
+#include "my_inttypes.h"
+#include "my_io.h"
+#include "sql/mysqld.h"
+#include "storage/keti/keti_csd.h"
+#include "storage/keti/keti_ibuf.h"
+#include "storage/keti/keti_row.h"
+
+/** A merge request the fake node received. */
+struct Node_request {
+  std::string table;
+  uint field;
+  std::vector<unsigned char> changes;
+};
+
+static std::mutex node_mutex;
+static std::vector<Node_request> node_requests;
+static bool node_down = false;
+
+int csd_write_index_changes(const std::string &table, uint field,
+                            std::vector<unsigned char> *changes) {
+  std::lock_guard<std::mutex> guard(node_mutex);
+  if (node_down) return HA_ERR_NO_CONNECTION;
+  node_requests.push_back(Node_request{table, field, *changes});
+  return 0;
+}
+
+void keti_log(enum loglevel, const char *, ...) {}
+
+namespace keti_ibuf_unittest {
+
+static const size_t CHANGE_HEADER_SIZE = 1 + KETI_REF_LENGTH + 4 + 4;
+
+static Keti_ibuf_entry make_entry(uint16 field, Keti_ibuf_op op,
+                                  uint32 segment, uint32 offset,
+                                  const std::string &key) {
+  Keti_ibuf_entry entry;
+  entry.field = field;
+  entry.op = static_cast<uint8>(op);
+  entry.pos.segment = segment;
+  entry.pos.block = 0;
+  entry.pos.offset = offset;
+  entry.key = key;
+  entry.seq = 0;
+  return entry;
+}
+
+/** The entries of a merge request, their keys made whole again. */
+static std::vector<Keti_ibuf_entry> read_changes(const Node_request &request) {
+  std::vector<Keti_ibuf_entry> entries;
+  const unsigned char *ptr = request.changes.data();
+  const unsigned char *end = ptr + request.changes.size();
+  std::string key;
+  while (ptr < end) {
+    EXPECT_LE(CHANGE_HEADER_SIZE, static_cast<size_t>(end - ptr));
+    if (static_cast<size_t>(end - ptr) < CHANGE_HEADER_SIZE) break;
+    Keti_ibuf_entry entry;
+    entry.field = static_cast<uint16>(request.field);
+    entry.op = ptr[0];
+    entry.pos = keti_read_pos(ptr + 1);
+    const size_t prefix = uint4korr(ptr + 1 + KETI_REF_LENGTH);
+    const size_t suffix = uint4korr(ptr + 1 + KETI_REF_LENGTH + 4);
+    ptr += CHANGE_HEADER_SIZE;
+    EXPECT_LE(prefix, key.size());
+    EXPECT_LE(suffix, static_cast<size_t>(end - ptr));
+    if (prefix > key.size() || suffix > static_cast<size_t>(end - ptr)) break;
+    key.resize(prefix);
+    key.append(reinterpret_cast<const char *>(ptr), suffix);
+    ptr += suffix;
+    entry.key = key;
+    entry.seq = 0;
+    entries.push_back(entry);
+  }
+  return entries;
+}
+
+static void expect_entry(const Keti_ibuf_entry &expected,
+                         const Keti_ibuf_entry &entry) {
+  EXPECT_EQ(expected.key, entry.key);
+  EXPECT_EQ(expected.op, entry.op);
+  EXPECT_EQ(expected.pos.segment, entry.pos.segment);
+  EXPECT_EQ(expected.pos.block, entry.pos.block);
+  EXPECT_EQ(expected.pos.offset, entry.pos.offset);
+}
+
+class KetiIbufTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    char dir[] = "/tmp/keti_ibuf-t-XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    data_dir = dir;
+    snprintf(mysql_real_data_home, FN_REFLEN, "%s/", dir);
+    log_path = data_dir + "/keti_ibuf.log";
+    srv_change_buffer_merge_interval = 3600;
+    srv_change_buffer_max_size = 64 * 1024 * 1024;
+    node_down = false;
+    node_requests.clear();
+  }
+
+  void TearDown() {
+    unlink(log_path.c_str());
+    rmdir(data_dir.c_str());
+  }
+
+  /** Buffer entries of table, expecting the log to take them. */
+  static void add(const std::string &table,
+                  std::vector<Keti_ibuf_entry> entries) {
+    ASSERT_EQ(0, keti_ibuf_add(table, &entries));
+    EXPECT_TRUE(entries.empty());
+  }
+
+  /** Shut the buffer down while the node is down, and start it again. */
+  static void restart() {
+    node_down = true;
+    keti_ibuf_deinit();
+    keti_ibuf_init();
+    node_down = false;
+  }
+
+  long log_size() const {
+    FILE *file = fopen(log_path.c_str(), "rb");
+    if (file == NULL) return -1;
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fclose(file);
+    return size;
+  }
+
+  std::string data_dir;
+  std::string log_path;
+};
+
+TEST_F(KetiIbufTest, MergeSendsSortedKeys) {
+  keti_ibuf_init();
+  add("db/t1", {make_entry(2, KETI_IBUF_INSERT, 1, 30, "banana"),
+                make_entry(2, KETI_IBUF_INSERT, 1, 10, "apple"),
+                make_entry(2, KETI_IBUF_INSERT, 1, 20, "applesauce")});
+  EXPECT_EQ(3U, keti_ibuf_stats.entries);
+  EXPECT_LT(0, log_size());
+
+  ASSERT_EQ(0, keti_ibuf_merge("db/t1"));
+  ASSERT_EQ(1U, node_requests.size());
+  EXPECT_EQ("db/t1", node_requests[0].table);
+  EXPECT_EQ(2U, node_requests[0].field);
+  const std::vector<Keti_ibuf_entry> sent = read_changes(node_requests[0]);
+  ASSERT_EQ(3U, sent.size());
+  expect_entry(make_entry(2, KETI_IBUF_INSERT, 1, 10, "apple"), sent[0]);
+  expect_entry(make_entry(2, KETI_IBUF_INSERT, 1, 20, "applesauce"), sent[1]);
+  expect_entry(make_entry(2, KETI_IBUF_INSERT, 1, 30, "banana"), sent[2]);
+  /* "applesauce" is sent as the part after "apple" */
+  EXPECT_EQ(5U, uint4korr(&node_requests[0].changes[CHANGE_HEADER_SIZE + 5 +
+                                                    1 + KETI_REF_LENGTH]));
+
+  /* Nothing is left to replay */
+  EXPECT_EQ(0U, keti_ibuf_stats.entries);
+  EXPECT_EQ(0, log_size());
+  keti_ibuf_deinit();
+}
+
+TEST_F(KetiIbufTest, ReplayAfterRestart) {
+  keti_ibuf_init();
+  add("db/t1", {make_entry(0, KETI_IBUF_INSERT, 1, 0, "b"),
+                make_entry(0, KETI_IBUF_DELETE, 1, 8, "a")});
+  add("db/t2", {make_entry(1, KETI_IBUF_INSERT, 4, 0, "x")});
+  add("db/t1", {make_entry(0, KETI_IBUF_INSERT, 2, 0, "c")});
+  restart();
+  EXPECT_EQ(4U, keti_ibuf_stats.entries);
+  EXPECT_TRUE(node_requests.empty());
+
+  ASSERT_EQ(0, keti_ibuf_merge("db/t1"));
+  ASSERT_EQ(1U, node_requests.size());
+  std::vector<Keti_ibuf_entry> sent = read_changes(node_requests[0]);
+  ASSERT_EQ(3U, sent.size());
+  expect_entry(make_entry(0, KETI_IBUF_DELETE, 1, 8, "a"), sent[0]);
+  expect_entry(make_entry(0, KETI_IBUF_INSERT, 1, 0, "b"), sent[1]);
+  expect_entry(make_entry(0, KETI_IBUF_INSERT, 2, 0, "c"), sent[2]);
+  EXPECT_EQ(1U, keti_ibuf_stats.entries);
+  /* The log is checkpointed to the record db/t2 still needs */
+  EXPECT_EQ(static_cast<long>(4 + strlen("db/t2") + 1 + KETI_REF_LENGTH + 4 +
+                              strlen("x")),
+            log_size());
+
+  ASSERT_EQ(0, keti_ibuf_merge("db/t2"));
+  ASSERT_EQ(2U, node_requests.size());
+  EXPECT_EQ("db/t2", node_requests[1].table);
+  EXPECT_EQ(1U, node_requests[1].field);
+  sent = read_changes(node_requests[1]);
+  ASSERT_EQ(1U, sent.size());
+  expect_entry(make_entry(1, KETI_IBUF_INSERT, 4, 0, "x"), sent[0]);
+  EXPECT_EQ(0, log_size());
+
+  /* A merged log replays nothing */
+  restart();
+  EXPECT_EQ(0U, keti_ibuf_stats.entries);
+  keti_ibuf_deinit();
+}
+
+/** Expect the one request sent to alternate inserts and deletes of "k". */
+static void expect_insert_delete(size_t count) {
+  ASSERT_EQ(1U, node_requests.size());
+  const std::vector<Keti_ibuf_entry> sent = read_changes(node_requests[0]);
+  ASSERT_EQ(count, sent.size());
+  for (size_t i = 0; i < sent.size(); i++)
+    expect_entry(make_entry(0, i % 2 ? KETI_IBUF_DELETE : KETI_IBUF_INSERT,
+                            1, 0, "k"),
+                 sent[i]);
+}
+
+TEST_F(KetiIbufTest, ReplayKeepsOrderOfSameEntry) {
+  keti_ibuf_init();
+  for (int round = 0; round < 3; round++) {
+    add("db/t1", {make_entry(0, KETI_IBUF_INSERT, 1, 0, "k")});
+    add("db/t1", {make_entry(0, KETI_IBUF_DELETE, 1, 0, "k")});
+  }
+  /* Failed merges put the entries back in the order they were made */
+  node_down = true;
+  EXPECT_NE(0, keti_ibuf_merge("db/t1"));
+  add("db/t1", {make_entry(0, KETI_IBUF_INSERT, 1, 0, "k")});
+  EXPECT_NE(0, keti_ibuf_merge("db/t1"));
+  node_down = false;
+  ASSERT_EQ(0, keti_ibuf_merge("db/t1"));
+  expect_insert_delete(7);
+
+  /* And so does the log */
+  node_requests.clear();
+  for (int round = 0; round < 3; round++) {
+    add("db/t1", {make_entry(0, KETI_IBUF_INSERT, 1, 0, "k")});
+    add("db/t1", {make_entry(0, KETI_IBUF_DELETE, 1, 0, "k")});
+  }
+  restart();
+  EXPECT_EQ(6U, keti_ibuf_stats.entries);
+  ASSERT_EQ(0, keti_ibuf_merge("db/t1"));
+  expect_insert_delete(6);
+  keti_ibuf_deinit();
+}
+
+TEST_F(KetiIbufTest, TornRecordIsDropped) {
+  keti_ibuf_init();
+  add("db/t1", {make_entry(0, KETI_IBUF_INSERT, 1, 0, "first"),
+                make_entry(0, KETI_IBUF_INSERT, 1, 8, "second")});
+  node_down = true;
+  keti_ibuf_deinit();
+  const long complete = log_size();
+
+  /* A crash in the middle of appending a record */
+  FILE *file = fopen(log_path.c_str(), "ab");
+  ASSERT_NE(nullptr, file);
+  const unsigned char torn[] = {5, 0, 'd', 'b', '/', 't'};
+  ASSERT_EQ(sizeof(torn), fwrite(torn, 1, sizeof(torn), file));
+  fclose(file);
+
+  keti_ibuf_init();
+  node_down = false;
+  EXPECT_EQ(2U, keti_ibuf_stats.entries);
+  EXPECT_EQ(complete, log_size());
+
+  /* What is appended next is replayed too */
+  add("db/t1", {make_entry(0, KETI_IBUF_INSERT, 1, 16, "third")});
+  restart();
+  EXPECT_EQ(3U, keti_ibuf_stats.entries);
+
+  ASSERT_EQ(0, keti_ibuf_merge("db/t1"));
+  ASSERT_EQ(1U, node_requests.size());
+  const std::vector<Keti_ibuf_entry> sent = read_changes(node_requests[0]);
+  ASSERT_EQ(3U, sent.size());
+  expect_entry(make_entry(0, KETI_IBUF_INSERT, 1, 0, "first"), sent[0]);
+  expect_entry(make_entry(0, KETI_IBUF_INSERT, 1, 8, "second"), sent[1]);
+  expect_entry(make_entry(0, KETI_IBUF_INSERT, 1, 16, "third"), sent[2]);
+  keti_ibuf_deinit();
+}
+
+TEST_F(KetiIbufTest, CommitPublishesLoggedEntries) {
+  keti_ibuf_init();
+  std::vector<Keti_ibuf_entry> committed = {
+      make_entry(0, KETI_IBUF_DELETE, 1, 0, "kept")};
+  std::vector<Keti_ibuf_entry> refused = {
+      make_entry(0, KETI_IBUF_DELETE, 1, 8, "dropped")};
+  ulonglong committed_ticket;
+  ulonglong refused_ticket;
+  ASSERT_EQ(0, keti_ibuf_log("db/t1", &committed, &committed_ticket));
+  ASSERT_EQ(0, keti_ibuf_log("db/t1", &refused, &refused_ticket));
+  EXPECT_TRUE(committed.empty());
+  EXPECT_NE(committed_ticket, refused_ticket);
+
+  /* In the log, but not merged before their commit */
+  EXPECT_EQ(0U, keti_ibuf_stats.entries);
+  EXPECT_LT(0, log_size());
+  ASSERT_EQ(0, keti_ibuf_merge("db/t1"));
+  EXPECT_TRUE(node_requests.empty());
+
+  keti_ibuf_publish(committed_ticket);
+  keti_ibuf_discard(refused_ticket);
+  EXPECT_EQ(1U, keti_ibuf_stats.entries);
+  ASSERT_EQ(0, keti_ibuf_merge("db/t1"));
+  ASSERT_EQ(1U, node_requests.size());
+  std::vector<Keti_ibuf_entry> sent = read_changes(node_requests[0]);
+  ASSERT_EQ(1U, sent.size());
+  expect_entry(make_entry(0, KETI_IBUF_DELETE, 1, 0, "kept"), sent[0]);
+  EXPECT_EQ(0, log_size());
+
+  /* A crash before the commit is published replays its entries */
+  committed = {make_entry(0, KETI_IBUF_DELETE, 1, 16, "crash")};
+  ASSERT_EQ(0, keti_ibuf_log("db/t1", &committed, &committed_ticket));
+  restart();
+  EXPECT_EQ(1U, keti_ibuf_stats.entries);
+  keti_ibuf_deinit();
+}
+
+TEST_F(KetiIbufTest, DropForgetsTable) {
+  keti_ibuf_init();
+  add("db/t1", {make_entry(0, KETI_IBUF_INSERT, 1, 0, "a")});
+  add("db/t2", {make_entry(0, KETI_IBUF_INSERT, 1, 0, "b"),
+                make_entry(0, KETI_IBUF_INSERT, 1, 8, "c"),
+                make_entry(0, KETI_IBUF_INSERT, 1, 16, "d")});
+  keti_ibuf_drop("db/t1");
+  EXPECT_EQ(3U, keti_ibuf_stats.entries);
+
+  /* The log still holds the entry of db/t1; a restart must not revive it */
+  restart();
+  EXPECT_EQ(3U, keti_ibuf_stats.entries);
+
+  /* Nor merge it into a table created again under the same name */
+  add("db/t1", {make_entry(0, KETI_IBUF_INSERT, 2, 0, "new")});
+  ASSERT_EQ(0, keti_ibuf_merge("db/t1"));
+  ASSERT_EQ(1U, node_requests.size());
+  EXPECT_EQ("db/t1", node_requests[0].table);
+  std::vector<Keti_ibuf_entry> sent = read_changes(node_requests[0]);
+  ASSERT_EQ(1U, sent.size());
+  expect_entry(make_entry(0, KETI_IBUF_INSERT, 2, 0, "new"), sent[0]);
+
+  ASSERT_EQ(0, keti_ibuf_merge("db/t2"));
+  ASSERT_EQ(2U, node_requests.size());
+  EXPECT_EQ("db/t2", node_requests[1].table);
+  EXPECT_EQ(3U, read_changes(node_requests[1]).size());
+  EXPECT_EQ(0, log_size());
+  keti_ibuf_deinit();
+}
+
+}  // namespace keti_ibuf_unittest
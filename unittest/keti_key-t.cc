@@ -0,0 +1,194 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_key-t.cc
+
+    @brief
+  The normalized keys of keti_key.h must compare with memcmp() as the
+  server compares the values they come from.
+
+    @details
+  Weight strings are checked against the collation's own strnncollsp() for
+  every pair of a set of strings, under a NO PAD, a PAD SPACE and the
+  binary collation. Keys of integer, floating point and string fields are
+  checked to ascend with values stored in ascending order.
+*/
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "m_ctype.h"
+#include "my_inttypes.h"
+#include "my_sys.h"
+#include "sql/field.h"
+#include "storage/keti/keti_key.h"
+#include "template_utils.h"
+#include "unittest/gunit/fake_table.h"
+#include "unittest/gunit/test_utils.h"
+
+namespace keti_key_unittest {
+
+/** Strings to compare, spaces, case, accents and expansions among them. */
+static const char *const STRINGS[] = {
+    "",  " ",  "a", "A", "a ", "a  ", " a", "\xC3\xA1", "ab",
+    "aB", "b", "B", "ss", "\xC3\x9F", "z", "~", "\xC3\xBF"};
+
+/** -1, 0 or 1 as cmp is negative, zero or positive. */
+static int sign(int cmp) { return (cmp > 0) - (cmp < 0); }
+
+/** Weight string of the NUL terminated str in cs. */
+static std::string weights(const CHARSET_INFO *cs, const char *str) {
+  return keti_weight_string(cs, str, strlen(str));
+}
+
+/** Expect keys, made from values in ascending order, to ascend too. */
+static void expect_ascending(const std::vector<std::string> &keys) {
+  for (size_t i = 1; i < keys.size(); i++)
+    EXPECT_LT(keys[i - 1], keys[i]) << "value " << i;
+}
+
+class KetiKeyTest : public ::testing::Test {
+ protected:
+  void SetUp() { initializer.SetUp(); }
+  void TearDown() { initializer.TearDown(); }
+
+  /** Give field a table of its own, with the field first in its record. */
+  void bind(Field *field) {
+    table.reset(new Fake_TABLE(field));
+    table->record[0] = record;
+    field->ptr = record;
+  }
+
+  /** Normalized key of the value last stored in the field bound. */
+  std::string key_of(Field *field) {
+    std::string key;
+    keti_normalized_key(field, table->record[0], &key);
+    return key;
+  }
+
+  my_testing::Server_initializer initializer;
+  std::unique_ptr<Fake_TABLE> table;
+  uchar record[8192];
+};
+
+TEST_F(KetiKeyTest, WeightStringOrder) {
+  const CHARSET_INFO *const collations[] = {
+      get_charset_by_name("utf8mb4_0900_ai_ci", MYF(0)), &my_charset_latin1,
+      &my_charset_bin};
+  for (const CHARSET_INFO *cs : collations) {
+    ASSERT_TRUE(cs != NULL);
+    for (const char *a : STRINGS) {
+      for (const char *b : STRINGS) {
+        const int expected = sign(cs->coll->strnncollsp(
+            cs, pointer_cast<const uchar *>(a), strlen(a),
+            pointer_cast<const uchar *>(b), strlen(b)));
+        EXPECT_EQ(expected, sign(weights(cs, a).compare(weights(cs, b))))
+            << cs->name << ": '" << a << "' and '" << b << "'";
+      }
+    }
+  }
+}
+
+TEST_F(KetiKeyTest, WeightStringEquality) {
+  /* Case and accents are ignored, and trailing spaces are not */
+  const CHARSET_INFO *ai_ci = get_charset_by_name("utf8mb4_0900_ai_ci", MYF(0));
+  ASSERT_TRUE(ai_ci != NULL);
+  EXPECT_EQ(weights(ai_ci, "a"), weights(ai_ci, "A"));
+  EXPECT_EQ(weights(ai_ci, "a"), weights(ai_ci, "\xC3\xA1"));
+  EXPECT_LT(weights(ai_ci, "a"), weights(ai_ci, "a "));
+  EXPECT_LT(weights(ai_ci, "\xC3\xA1"), weights(ai_ci, "b"));
+
+  /* PAD SPACE ignores trailing spaces only */
+  const CHARSET_INFO *latin1 = &my_charset_latin1;
+  EXPECT_EQ(weights(latin1, "a"), weights(latin1, "a  "));
+  EXPECT_EQ(weights(latin1, ""), weights(latin1, " "));
+  EXPECT_LT(weights(latin1, " a"), weights(latin1, "a"));
+
+  /* The binary collation keeps the bytes */
+  EXPECT_EQ(std::string("a "), weights(&my_charset_bin, "a "));
+  EXPECT_LT(weights(&my_charset_bin, "A"), weights(&my_charset_bin, "a"));
+}
+
+TEST_F(KetiKeyTest, SignedIntegers) {
+  Field_long field(11, false, "n", false);
+  bind(&field);
+  const longlong values[] = {std::numeric_limits<int32>::min(), -65536, -1,
+                             0, 1, 255, 256, std::numeric_limits<int32>::max()};
+  std::vector<std::string> keys;
+  for (longlong value : values) {
+    field.store(value, false);
+    keys.push_back(key_of(&field));
+  }
+  expect_ascending(keys);
+}
+
+TEST_F(KetiKeyTest, UnsignedIntegers) {
+  Field_long field(10, false, "n", true);
+  bind(&field);
+  const ulonglong values[] = {0, 1, 255, 256, 0x7FFFFFFFULL, 0x80000000ULL,
+                              0xFFFFFFFFULL};
+  std::vector<std::string> keys;
+  for (ulonglong value : values) {
+    field.store(static_cast<longlong>(value), true);
+    keys.push_back(key_of(&field));
+  }
+  expect_ascending(keys);
+}
+
+TEST_F(KetiKeyTest, Doubles) {
+  Field_double field(22, false, "d", DECIMAL_NOT_SPECIFIED);
+  bind(&field);
+  const double values[] = {-std::numeric_limits<double>::max(), -1e100, -2.5,
+                           -1, -std::numeric_limits<double>::min(), 0,
+                           std::numeric_limits<double>::denorm_min(), 1, 2.5,
+                           1e100, std::numeric_limits<double>::max()};
+  std::vector<std::string> keys;
+  for (double value : values) {
+    field.store(value);
+    keys.push_back(key_of(&field));
+  }
+  expect_ascending(keys);
+}
+
+TEST_F(KetiKeyTest, Strings) {
+  const CHARSET_INFO *ai_ci = get_charset_by_name("utf8mb4_0900_ai_ci", MYF(0));
+  ASSERT_TRUE(ai_ci != NULL);
+  Fake_TABLE_SHARE share(1);
+  Field_varstring field(4 * 2000, false, "s", &share, ai_ci);
+  bind(&field);
+
+  /* Past the max_sort_length prefix filesort would take */
+  const std::string long_a(1500, 'x');
+  const std::string long_b = long_a + "b";
+  const std::string values[] = {"", "a", "ab", "b", "x", long_a,
+                                long_a + "a", long_b, "y"};
+  std::vector<std::string> keys;
+  for (const std::string &value : values) {
+    field.store(value.data(), value.size(), ai_ci);
+    keys.push_back(key_of(&field));
+    EXPECT_EQ(weights(ai_ci, value.c_str()), keys.back());
+  }
+  expect_ascending(keys);
+
+  /* Values the collation finds equal get the same key */
+  field.store("A", 1, ai_ci);
+  EXPECT_EQ(keys[1], key_of(&field));
+}
+
+}  // namespace keti_key_unittest
@@ -0,0 +1,185 @@
+/* Copyright (c) 2026, KETI. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/** @file keti_lock-t.cc
+
+    @brief
+  The row lock manager of keti_lock.h: which modes are granted together,
+  waits that time out or are granted on release, and the victims the
+  deadlock detector picks.
+
+    @details
+  The tests call detect_deadlocks() themselves, as no detector thread
+  runs. A request that must not be granted at once is made with a timeout
+  of 0, which gives up without waiting.
+*/
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include "my_base.h"
+#include "my_inttypes.h"
+#include "storage/keti/keti_lock.h"
+
+namespace keti_lock_unittest {
+
+static const ulonglong KEY = 42;
+static const ulonglong OTHER_KEY = 43;
+
+/** Run a request of trx in a thread of its own, as it may wait. */
+static std::future<int> lock_async(Keti_lock_manager *locks, Keti_trx *trx,
+                                   ulonglong key, Keti_lock_mode mode) {
+  return std::async(std::launch::async, [=] {
+    return locks->lock(trx, key, mode, 10);
+  });
+}
+
+/** Wait until the detector sees waiters, as the threads block after us. */
+static void wait_for_waiters(const Keti_lock_manager &locks) {
+  for (int i = 0; i < 1000 && !locks.has_waiters(); i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  ASSERT_TRUE(locks.has_waiters());
+}
+
+TEST(KetiLockTest, Compatibility) {
+  Keti_lock_manager locks(4);
+  Keti_trx a;
+  Keti_trx b;
+
+  /* Shared locks go together, and so do delta locks */
+  EXPECT_EQ(0, locks.lock(&a, KEY, KETI_LOCK_S, 0));
+  EXPECT_EQ(0, locks.lock(&b, KEY, KETI_LOCK_S, 0));
+  EXPECT_EQ(0, locks.lock(&a, OTHER_KEY, KETI_LOCK_D, 0));
+  EXPECT_EQ(0, locks.lock(&b, OTHER_KEY, KETI_LOCK_D, 0));
+
+  /* but with nothing else */
+  Keti_trx c;
+  EXPECT_EQ(HA_ERR_LOCK_WAIT_TIMEOUT, locks.lock(&c, KEY, KETI_LOCK_X, 0));
+  EXPECT_EQ(HA_ERR_LOCK_WAIT_TIMEOUT, locks.lock(&c, KEY, KETI_LOCK_D, 0));
+  EXPECT_EQ(HA_ERR_LOCK_WAIT_TIMEOUT,
+            locks.lock(&c, OTHER_KEY, KETI_LOCK_S, 0));
+  locks.release_all(&a);
+  locks.release_all(&b);
+
+  /* An exclusive lock covers the others of its holder */
+  EXPECT_EQ(0, locks.lock(&a, KEY, KETI_LOCK_X, 0));
+  EXPECT_EQ(0, locks.lock(&a, KEY, KETI_LOCK_S, 0));
+  EXPECT_EQ(0, locks.lock(&a, KEY, KETI_LOCK_X, 0));
+  EXPECT_EQ(HA_ERR_LOCK_WAIT_TIMEOUT, locks.lock(&b, KEY, KETI_LOCK_S, 0));
+  locks.release_all(&a);
+  EXPECT_EQ(0, locks.lock(&b, KEY, KETI_LOCK_S, 0));
+  locks.release_all(&b);
+  locks.release_all(&c);
+  EXPECT_FALSE(locks.has_waiters());
+}
+
+TEST(KetiLockTest, ReleaseGrantsWaiter) {
+  Keti_lock_manager locks(4);
+  Keti_trx holder;
+  Keti_trx waiter;
+  ASSERT_EQ(0, locks.lock(&holder, KEY, KETI_LOCK_X, 0));
+
+  std::future<int> waited = lock_async(&locks, &waiter, KEY, KETI_LOCK_X);
+  wait_for_waiters(locks);
+  /* Waiting on one another is no deadlock */
+  EXPECT_EQ(0U, locks.detect_deadlocks());
+  EXPECT_EQ(std::future_status::timeout,
+            waited.wait_for(std::chrono::milliseconds(20)));
+
+  locks.release_all(&holder);
+  EXPECT_EQ(0, waited.get());
+  EXPECT_FALSE(locks.has_waiters());
+  locks.release_all(&waiter);
+}
+
+TEST(KetiLockTest, WaitTimesOut) {
+  Keti_lock_manager locks(4);
+  Keti_trx holder;
+  Keti_trx waiter;
+  ASSERT_EQ(0, locks.lock(&holder, KEY, KETI_LOCK_S, 0));
+
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(HA_ERR_LOCK_WAIT_TIMEOUT,
+            locks.lock(&waiter, KEY, KETI_LOCK_X, 1));
+  EXPECT_LE(std::chrono::seconds(1), std::chrono::steady_clock::now() - start);
+
+  /* The request given up leaves nothing behind */
+  EXPECT_FALSE(locks.has_waiters());
+  Keti_trx reader;
+  EXPECT_EQ(0, locks.lock(&reader, KEY, KETI_LOCK_S, 0));
+  locks.release_all(&holder);
+  locks.release_all(&reader);
+  EXPECT_EQ(0, locks.lock(&waiter, KEY, KETI_LOCK_X, 0));
+  locks.release_all(&waiter);
+}
+
+TEST(KetiLockTest, DeadlockVictimIsYoungest) {
+  Keti_lock_manager locks(4);
+  Keti_trx older;
+  Keti_trx younger;
+  ASSERT_LT(older.id, younger.id);
+  ASSERT_EQ(0, locks.lock(&older, KEY, KETI_LOCK_X, 0));
+  ASSERT_EQ(0, locks.lock(&younger, OTHER_KEY, KETI_LOCK_D, 0));
+
+  std::future<int> older_waits =
+      lock_async(&locks, &older, OTHER_KEY, KETI_LOCK_S);
+  wait_for_waiters(locks);
+  std::future<int> younger_waits =
+      lock_async(&locks, &younger, KEY, KETI_LOCK_D);
+
+  /* Until the second one blocks there is no cycle */
+  size_t victims = 0;
+  for (int i = 0; i < 1000 && victims == 0; i++) {
+    victims = locks.detect_deadlocks();
+    if (victims == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(1U, victims);
+  EXPECT_EQ(HA_ERR_LOCK_DEADLOCK, younger_waits.get());
+
+  /* The victim rolls back, and the other goes on */
+  locks.release_all(&younger);
+  EXPECT_EQ(0, older_waits.get());
+  EXPECT_EQ(0U, locks.detect_deadlocks());
+  locks.release_all(&older);
+  EXPECT_FALSE(locks.has_waiters());
+}
+
+TEST(KetiLockTest, CycleOfThree) {
+  Keti_lock_manager locks(2);
+  Keti_trx trx[3];
+  for (ulonglong i = 0; i < 3; i++)
+    ASSERT_EQ(0, locks.lock(&trx[i], KEY + i, KETI_LOCK_X, 0));
+
+  std::future<int> waits[3];
+  for (ulonglong i = 0; i < 3; i++)
+    waits[i] = lock_async(&locks, &trx[i], KEY + (i + 1) % 3, KETI_LOCK_X);
+
+  size_t victims = 0;
+  for (int i = 0; i < 1000 && victims == 0; i++) {
+    victims = locks.detect_deadlocks();
+    if (victims == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(1U, victims);
+  EXPECT_EQ(HA_ERR_LOCK_DEADLOCK, waits[2].get());
+  locks.release_all(&trx[2]);
+  EXPECT_EQ(0, waits[1].get());
+  locks.release_all(&trx[1]);
+  EXPECT_EQ(0, waits[0].get());
+  locks.release_all(&trx[0]);
+}
+
+}  // namespace keti_lock_unittest